@@ -0,0 +1,974 @@
+#include "Util.h"
+#include "CookDatabase.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "MeshProcessor.h"
+#include "TangentGenerator.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "VertexQuantizer.h"
+#include "TextureCompressor.h"
+#include "TextureCache.h"
+#include "MipGenerator.h"
+#include "ImageReader.h"
+#include "AtlasBuilder.h"
+#include "MeshTests.h"
+#include "TextureAtlas.h"
+#include "VirtualTexture.h"
+#include "VirtualTextureFile.h"
+#include "Parallel.h"
+
+#include <filesystem>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <iomanip>
+#include <cmath>
+
+// AssetCooker
+// Offline cooker for the renderer assets, usage:
+// AssetCooker <asset directory> [--force] [--dry-run] [--uncompressed]
+// Finds every .obj, .gltf and .glb below the directory and writes its MeshCache
+// file next to it, the same file ObjLoader / GltfLoader write on the first load,
+// so the runtime starts from cooked meshes. The dependency graph of every mesh
+// (source, .mtl libraries, textures, glTF buffers) is kept with content hashes
+// in <asset directory>/.cookdb and only meshes with a changed input are cooked
+// again. The runtime checks the size and write time of the sources instead of their
+// content, a mesh whose source was only touched is cooked again by its first load.
+// Meshes are cooked in parallel on all hardware threads.
+// Then the textures of the meshes' materials (.png and .tga) get their TextureCache
+// file: the mip chain filtered by MipGenerator, BC7 for color and BC5 for normal
+// maps (RGBA8 if the size is not a multiple of 4). The runtime maps these instead
+// of decoding the images. A texture is cooked again when the source hash in its
+// cache file no longer matches, or its cache is for another content. It is also
+// cooked again when only the size or write time of the source changed, since the
+// runtime checks those instead of hashing the source.
+// Last the small diffuse textures are packed into shared atlases in
+// <asset directory>/.atlas, see AtlasBuilder.
+//
+// AssetCooker --bc-benchmark [size]
+// Block compresses synthetic size x size test images (512 by default) to every
+// BCn format at every SIMD level the CPU has and prints the PSNR and the
+// throughput, needs no image files and no GPU.
+//
+// AssetCooker --vt-simulate [frames]
+// Drives a 64K x 64K VirtualTexture with the feedback of a camera flying over a
+// textured ground plane (200 frames by default, the last 50 standing still),
+// checks the page table every frame and prints the page requests, loads and
+// evictions. A 32 x 32 page cache holds the pages of the still camera, a second
+// pass with an 8 x 8 cache has to evict and fall back to the parent pages. Also
+// writes and reads back a VirtualTextureFile.
+//
+// AssetCooker --mesh-test <asset directory>
+// Runs the MeshTests on the meshes of the directory without touching their caches:
+// exact welded counts and load times of teapot.obj, ObjParser against tinyobj in
+// MB/s on a generated 20 MB .obj, meshlet culling counts from fixed camera poses,
+// MeshCodec round trips, ratio and MB/s, ACMR / ATVR before and after MeshOptimizer,
+// and the worst frame and upload bytes per frame of streaming static batches.
+// Returns 1 if a check fails.
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// bump when the cooker writes different output for the same input
+	const UINT COOKER_VERSION = 1;
+
+	const char* DATABASE_FILE_NAME = ".cookdb";
+	const char* ATLAS_DIRECTORY_NAME = ".atlas";
+
+	enum AssetType
+	{
+		ASSET_OBJ,
+		ASSET_GLTF
+	};
+
+	struct TextureAsset
+	{
+		std::string name;		// relative to the asset directory, '/' separators
+		std::string fileName;
+		TextureContent content;
+		bool stale;
+		bool cooked;
+		double cookMilliseconds;
+	};
+
+	struct Asset
+	{
+		std::string name;		// relative to the asset directory, '/' separators
+		std::string fileName;	// path handed to the loaders
+		std::string baseDir;	// directory of fileName with a trailing separator
+		AssetType type;
+		bool stale;
+		bool cooked;
+		double cookMilliseconds;
+		CookDatabase::Record record;
+	};
+
+	std::string GetAssetName(const fs::path& root, const fs::path& file)
+	{
+		return file.lexically_normal().lexically_relative(root).generic_string();
+	}
+
+	bool IsUpToDate(const fs::path& root, const Asset& asset, const CookDatabase& database)
+	{
+		const CookDatabase::Record* record = database.Find(asset.name);
+		if (record == NULL || record->dependencies.empty())
+			return false;
+
+		std::error_code error;
+		if (!fs::exists(MeshCache::GetCacheFileName(asset.fileName), error))
+			return false;
+
+		for (size_t i = 0; i < record->dependencies.size(); ++i)
+		{
+			const CookDatabase::Dependency& dependency = record->dependencies[i];
+			if (MeshCache::Instance()->HashFile((root / dependency.path).string()) != dependency.hash)
+				return false;
+		}
+		return true;
+	}
+
+	bool Cook(const fs::path& root, Asset& asset)
+	{
+		// the loaders only cook when there is no valid cache, drop the old one
+		std::string cacheFile = MeshCache::GetCacheFileName(asset.fileName);
+		remove(cacheFile.c_str());
+
+		MeshData meshData;
+		std::vector<std::string> dependencies;
+		if (asset.type == ASSET_OBJ)
+		{
+			if (!ObjLoader::Instance()->LoadToMesh(asset.fileName, asset.baseDir, meshData) ||
+				!ObjLoader::Instance()->GetDependencies(asset.fileName, asset.baseDir, dependencies))
+				return false;
+		}
+		else
+		{
+			if (!GltfLoader::Instance()->LoadToMesh(asset.fileName, asset.baseDir, meshData) ||
+				!GltfLoader::Instance()->GetDependencies(asset.fileName, dependencies))
+				return false;
+		}
+
+		std::error_code error;
+		if (!fs::exists(cacheFile, error))
+			return false;
+
+		for (auto it = meshData.materials.begin(); it != meshData.materials.end(); ++it)
+		{
+			if (!it->second.diffuseTexture.empty())
+				dependencies.push_back(it->second.diffuseTexture);
+			if (!it->second.normalTexture.empty())
+				dependencies.push_back(it->second.normalTexture);
+		}
+
+		asset.record.dependencies.clear();
+		CookDatabase::Dependency source = { asset.name, MeshCache::Instance()->HashFile(asset.fileName) };
+		asset.record.dependencies.push_back(source);
+
+		for (size_t i = 0; i < dependencies.size(); ++i)
+		{
+			CookDatabase::Dependency dependency = { GetAssetName(root, dependencies[i]), MeshCache::Instance()->HashFile(dependencies[i]) };
+
+			bool duplicate = false;
+			for (size_t d = 0; d < asset.record.dependencies.size(); ++d)
+				duplicate = duplicate || asset.record.dependencies[d].path == dependency.path;
+			if (!duplicate)
+				asset.record.dependencies.push_back(dependency);
+		}
+
+		return true;
+	}
+
+	// The textures the materials of every mesh use, from the mesh caches. A texture used
+	// both ways is cooked as the content of its first use.
+	std::vector<TextureAsset> CollectTextures(const fs::path& root, const std::vector<Asset>& assets)
+	{
+		std::vector<std::vector<std::pair<std::string, TextureContent> > > meshTextures(assets.size());
+		ParallelFor(assets.size(), [&](size_t i)
+		{
+			MeshData meshData;
+			if (!MeshCache::Instance()->Load(assets[i].fileName, 0, meshData))
+				return;
+			for (auto it = meshData.materials.begin(); it != meshData.materials.end(); ++it)
+			{
+				if (!it->second.diffuseTexture.empty())
+					meshTextures[i].push_back(std::make_pair(it->second.diffuseTexture, TEXTURE_COLOR));
+				if (!it->second.normalTexture.empty())
+					meshTextures[i].push_back(std::make_pair(it->second.normalTexture, TEXTURE_NORMAL_MAP));
+			}
+		});
+
+		std::map<std::string, TextureAsset> textures;
+		for (size_t i = 0; i < meshTextures.size(); ++i)
+		{
+			for (size_t t = 0; t < meshTextures[i].size(); ++t)
+			{
+				TextureAsset texture;
+				texture.name = GetAssetName(root, meshTextures[i][t].first);
+				texture.fileName = meshTextures[i][t].first;
+				texture.content = meshTextures[i][t].second;
+				texture.stale = true;
+				texture.cooked = false;
+				texture.cookMilliseconds = 0.0;
+				textures.insert(std::make_pair(texture.name, texture));
+			}
+		}
+
+		std::vector<TextureAsset> result;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+			result.push_back(it->second);
+		return result;
+	}
+
+	bool CookTexture(const TextureAsset& texture)
+	{
+		TextureData image;
+		MipOptions options;
+		options.content = texture.content;
+		if (!ImageReader::Read(texture.fileName, image) || !MipGenerator::Instance()->Generate(image, options))
+			return false;
+
+		// the top mip of a block compressed texture must be a whole number of blocks
+		TextureData compressed;
+		const TextureData* cooked = &image;
+		if (image.width % 4 == 0 && image.height % 4 == 0)
+		{
+			DXGI_FORMAT format = texture.content == TEXTURE_NORMAL_MAP ? DXGI_FORMAT_BC5_UNORM : DXGI_FORMAT_BC7_UNORM;
+			if (!TextureCompressor::Instance()->Compress(image, format, compressed))
+				return false;
+			cooked = &compressed;
+		}
+
+		return TextureCache::Instance()->Save(texture.fileName, MeshCache::Instance()->HashFile(texture.fileName), texture.content, *cooked);
+	}
+
+	// The files of the textures used as diffuse textures
+	std::vector<std::string> GetColorTextures(const std::vector<TextureAsset>& textures)
+	{
+		std::vector<std::string> colorTextures;
+		for (size_t i = 0; i < textures.size(); ++i)
+		{
+			if (textures[i].content == TEXTURE_COLOR)
+				colorTextures.push_back(textures[i].fileName);
+		}
+		return colorTextures;
+	}
+
+	enum TestImage
+	{
+		IMAGE_ALBEDO,	// bricks with noise, opaque
+		IMAGE_DECAL,	// the bricks with a soft and a cut out alpha
+		IMAGE_MASK,		// gray scale noise and hard edged spots
+		IMAGE_NORMAL	// tangent space normals of a noise height field
+	};
+
+	float Hash(int x, int y, int seed)
+	{
+		UINT h = (UINT)x * 374761393u + (UINT)y * 668265263u + (UINT)seed * 2246822519u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		return ((h ^ (h >> 16)) & 0xffffff) / 16777216.0f;
+	}
+
+	// Smoothly interpolated lattice noise summed over octaves, about 0 to 1
+	float Noise(float x, float y, int octaves, int seed)
+	{
+		float value = 0.0f, amplitude = 0.5f;
+		for (int octave = 0; octave < octaves; ++octave, x *= 2.0f, y *= 2.0f, amplitude *= 0.5f)
+		{
+			int x0 = (int)floorf(x), y0 = (int)floorf(y);
+			float fx = x - x0, fy = y - y0;
+			fx = fx * fx * (3.0f - 2.0f * fx);
+			fy = fy * fy * (3.0f - 2.0f * fy);
+			float top = Hash(x0, y0, seed + octave) + (Hash(x0 + 1, y0, seed + octave) - Hash(x0, y0, seed + octave)) * fx;
+			float bottom = Hash(x0, y0 + 1, seed + octave) + (Hash(x0 + 1, y0 + 1, seed + octave) - Hash(x0, y0 + 1, seed + octave)) * fx;
+			value += amplitude * (top + (bottom - top) * fy);
+		}
+		return value;
+	}
+
+	BYTE ToByte(float value)
+	{
+		return (BYTE)std::min(std::max(value * 255.0f + 0.5f, 0.0f), 255.0f);
+	}
+
+	void CreateTestImage(TestImage image, UINT size, TextureData& textureData)
+	{
+		TextureMip mip = { size, size, size * 4, 0 };
+		textureData.width = size;
+		textureData.height = size;
+		textureData.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureData.mips.assign(1, mip);
+		textureData.pixels.resize((size_t)mip.rowPitch * size);
+
+		float scale = 512.0f / size;
+		for (UINT y = 0; y < size; ++y)
+		{
+			for (UINT x = 0; x < size; ++x)
+			{
+				BYTE* texel = &textureData.pixels[(size_t)y * mip.rowPitch + x * 4];
+				float u = x * scale, v = y * scale;
+				if (image == IMAGE_ALBEDO || image == IMAGE_DECAL)
+				{
+					// 64x32 bricks in every other row shifted by half a brick, 3 texel mortar
+					int row = (int)(v / 32.0f);
+					float brickU = u + (row & 1) * 32.0f;
+					int column = (int)(brickU / 64.0f);
+					bool mortar = fmodf(v, 32.0f) < 3.0f || fmodf(brickU, 64.0f) < 3.0f;
+					float detail = Noise(u / 8.0f, v / 8.0f, 3, 1) - 0.5f;
+					float tint = Hash(column, row, 2);
+					float shade = 0.8f + 0.4f * Noise(u / 128.0f, v / 128.0f, 2, 3);
+					float rgb[3];
+					if (mortar)
+					{
+						rgb[0] = rgb[1] = rgb[2] = 0.7f + 0.2f * detail;
+					}
+					else
+					{
+						rgb[0] = (0.55f + 0.25f * tint + 0.15f * detail) * shade;
+						rgb[1] = (0.25f + 0.15f * tint + 0.1f * detail) * shade;
+						rgb[2] = (0.18f + 0.1f * tint + 0.08f * detail) * shade;
+					}
+					for (UINT c = 0; c < 3; ++c)
+						texel[c] = ToByte(rgb[c]);
+
+					texel[3] = 255;
+					if (image == IMAGE_DECAL)
+					{
+						// soft alpha on the left half, cut out holes on the right
+						float coverage = Noise(u / 32.0f, v / 32.0f, 3, 4);
+						texel[3] = u < 256.0f ? ToByte(coverage * 1.6f - 0.3f) : (coverage > 0.5f ? 255 : 0);
+					}
+				}
+				else if (image == IMAGE_MASK)
+				{
+					float value = Noise(u / 24.0f, v / 24.0f, 4, 5);
+					float spotU = fmodf(u, 48.0f) - 24.0f, spotV = fmodf(v, 48.0f) - 24.0f;
+					if (spotU * spotU + spotV * spotV < 100.0f)
+						value = Hash((int)(u / 48.0f), (int)(v / 48.0f), 6) > 0.5f ? 1.0f : 0.0f;
+					texel[0] = texel[1] = texel[2] = ToByte(value);
+					texel[3] = 255;
+				}
+				else
+				{
+					// central differences of the height field
+					const float step = 0.5f, strength = 24.0f;
+					float dx = Noise((u + step) / 32.0f, v / 32.0f, 4, 7) - Noise((u - step) / 32.0f, v / 32.0f, 4, 7);
+					float dy = Noise(u / 32.0f, (v + step) / 32.0f, 4, 7) - Noise(u / 32.0f, (v - step) / 32.0f, 4, 7);
+					float nx = -dx * strength, ny = -dy * strength;
+					float length = sqrtf(nx * nx + ny * ny + 1.0f);
+					texel[0] = ToByte(nx / length * 0.5f + 0.5f);
+					texel[1] = ToByte(ny / length * 0.5f + 0.5f);
+					texel[2] = ToByte(1.0f / length * 0.5f + 0.5f);
+					texel[3] = 255;
+				}
+			}
+		}
+	}
+
+	// Peak signal to noise ratio in dB over the channels of the mask, 99 for an exact copy
+	double GetPsnr(const TextureData& a, const TextureData& b, UINT channels)
+	{
+		double squaredError = 0.0;
+		size_t count = 0;
+		for (size_t i = 0; i < a.pixels.size(); ++i)
+		{
+			if (channels & (1 << (i & 3)))
+			{
+				double d = (double)a.pixels[i] - b.pixels[i];
+				squaredError += d * d;
+				count++;
+			}
+		}
+		if (squaredError == 0.0)
+			return 99.0;
+		return 10.0 * log10(255.0 * 255.0 * count / squaredError);
+	}
+
+	// Compresses the test images at every SIMD level, returns 1 if the levels disagree
+	int BenchmarkTextureCompression(UINT size)
+	{
+		struct BenchmarkCase
+		{
+			const char* name;
+			TestImage image;
+			DXGI_FORMAT format;
+			UINT bc7Quality;
+			UINT channels;	// compared for the PSNR
+		};
+		const BenchmarkCase cases[] =
+		{
+			{ "BC1 albedo", IMAGE_ALBEDO, DXGI_FORMAT_BC1_UNORM, 0, 0x7 },
+			{ "BC3 decal", IMAGE_DECAL, DXGI_FORMAT_BC3_UNORM, 0, 0xf },
+			{ "BC4 mask", IMAGE_MASK, DXGI_FORMAT_BC4_UNORM, 0, 0x1 },
+			{ "BC5 normal", IMAGE_NORMAL, DXGI_FORMAT_BC5_UNORM, 0, 0x3 },
+			{ "BC7 q0 albedo", IMAGE_ALBEDO, DXGI_FORMAT_BC7_UNORM, 0, 0x7 },
+			{ "BC7 q1 albedo", IMAGE_ALBEDO, DXGI_FORMAT_BC7_UNORM, 1, 0x7 },
+			{ "BC7 q2 albedo", IMAGE_ALBEDO, DXGI_FORMAT_BC7_UNORM, 2, 0x7 },
+			{ "BC7 q1 decal", IMAGE_DECAL, DXGI_FORMAT_BC7_UNORM, 1, 0xf },
+			{ "BC7 q1 normal", IMAGE_NORMAL, DXGI_FORMAT_BC7_UNORM, 1, 0x3 },
+		};
+
+		TextureCompressor* compressor = TextureCompressor::Instance();
+		SimdLevel maxLevel = compressor->GetMaxSimdLevel();
+
+		std::cout << size << "x" << size << " test images, " << GetWorkerThreadCount() << " threads, MPixel/s per SIMD level\n";
+		std::cout << std::left << std::setw(16) << "format" << std::right << std::setw(10) << "PSNR dB";
+		for (int level = SIMD_SCALAR; level <= maxLevel; ++level)
+			std::cout << std::setw(10) << GetSimdLevelName((SimdLevel)level);
+		std::cout << "\n";
+
+		int mismatches = 0;
+		for (size_t i = 0; i < ARRAYSIZE(cases); ++i)
+		{
+			const BenchmarkCase& test = cases[i];
+			TextureData source;
+			CreateTestImage(test.image, size, source);
+
+			TextureCompressOptions options;
+			options.bc7Quality = test.bc7Quality;
+
+			TextureData reference;
+			std::cout << std::left << std::setw(16) << test.name << std::right << std::fixed << std::setprecision(2);
+			std::ostringstream rates;
+			for (int level = SIMD_SCALAR; level <= maxLevel; ++level)
+			{
+				compressor->SetSimdLevel((SimdLevel)level);
+				TextureData compressed;
+				auto start = std::chrono::high_resolution_clock::now();
+				compressor->Compress(source, test.format, compressed, options);
+				double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				rates << std::setw(10) << std::fixed << std::setprecision(2) << (double)size * size / seconds / 1e6;
+
+				if (level == SIMD_SCALAR)
+					reference = compressed;
+				else if (compressed.pixels != reference.pixels)
+				{
+					rates << " (differs from scalar)";
+					mismatches++;
+				}
+			}
+
+			TextureData decompressed;
+			if (!compressor->Decompress(reference, decompressed))
+			{
+				std::cout << std::setw(10) << "decode failed\n";
+				mismatches++;
+				continue;
+			}
+			std::cout << std::setw(10) << GetPsnr(source, decompressed, test.channels) << rates.str() << "\n";
+		}
+		compressor->SetSimdLevel(maxLevel);
+
+		return mismatches == 0 ? 0 : 1;
+	}
+
+	// Writes a page file of a test image and compares every tile with the mips it was cut from
+	bool TestVirtualTextureFile()
+	{
+		const UINT size = 1024, pageSize = 128, border = 4;
+
+		TextureData texture;
+		CreateTestImage(IMAGE_ALBEDO, size, texture);
+		if (!MipGenerator::Instance()->Generate(texture))
+			return false;
+
+		std::error_code error;
+		std::string fileName = (fs::temp_directory_path(error) / "AssetCooker.vt").string();
+		bool passed = true;
+
+		const DXGI_FORMAT formats[] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_BC7_UNORM };
+		for (size_t f = 0; f < ARRAYSIZE(formats) && passed; ++f)
+		{
+			VirtualTextureFile file;
+			passed = VirtualTextureFile::Write(fileName, texture, pageSize, border, formats[f]) && file.Open(fileName) &&
+				file.GetMipCount() == 4 && file.GetTileSize() == pageSize + 2 * border && file.GetPage(MakePageId(8, 0, 0)) == NULL;
+
+			UINT pages = 0;
+			for (UINT m = 0; m < file.GetMipCount() && passed; ++m)
+			{
+				const TextureMip& mip = texture.mips[m];
+				UINT pagesPerSide = (size / pageSize) >> m;
+				for (UINT page = 0; page < pagesPerSide * pagesPerSide && passed; ++page, ++pages)
+				{
+					UINT px = page % pagesPerSide, py = page / pagesPerSide;
+					const BYTE* tile = file.GetPage(MakePageId(px, py, m));
+					if (tile == NULL)
+					{
+						passed = false;
+						break;
+					}
+
+					// the BC7 tiles are only looked up, the uncompressed ones compared texel by texel
+					if (formats[f] != DXGI_FORMAT_R8G8B8A8_UNORM)
+						continue;
+					for (UINT y = 0; y < file.GetTileSize() && passed; ++y)
+					{
+						for (UINT x = 0; x < file.GetTileSize(); ++x)
+						{
+							int sx = std::min(std::max((int)(px * pageSize + x) - (int)border, 0), (int)mip.width - 1);
+							int sy = std::min(std::max((int)(py * pageSize + y) - (int)border, 0), (int)mip.height - 1);
+							if (memcmp(tile + (size_t)y * file.GetPageRowPitch() + x * 4, &texture.pixels[mip.offset + (size_t)sy * mip.rowPitch + sx * 4], 4) != 0)
+							{
+								passed = false;
+								break;
+							}
+						}
+					}
+				}
+			}
+			std::cout << "page file " << (formats[f] == DXGI_FORMAT_BC7_UNORM ? "BC7  " : "RGBA8") << ": " << pages << " pages of "
+				<< file.GetPageBytes() << " bytes, " << (passed ? "ok" : "FAILED") << "\n";
+		}
+
+		fs::remove(fileName, error);
+		return passed;
+	}
+
+	// Page ids a width x height feedback target gets from a camera cameraHeight above a
+	// ground plane covered once by the virtual texture, for pixels resolutionScale
+	// times the size of the feedback pixels
+	void RenderGroundFeedback(const VirtualTexture& virtualTexture, float worldSize, float cameraX, float cameraZ, float cameraHeight,
+		float yaw, float pitch, UINT width, UINT height, UINT resolutionScale, std::vector<VirtualPageId>& feedback)
+	{
+		const float tanHalfFov = tanf(M_PI / 6.0f);
+		const float aspect = (float)width / height;
+
+		XMFLOAT3 forward(cosf(pitch) * sinf(yaw), -sinf(pitch), cosf(pitch) * cosf(yaw));
+		XMFLOAT3 right(cosf(yaw), 0.0f, -sinf(yaw));
+		XMFLOAT3 up(sinf(pitch) * sinf(yaw), cosf(pitch), sinf(pitch) * cosf(yaw));
+
+		// ground position seen through the screen point x, y in [-1, 1], false above the horizon
+		auto hit = [&](float x, float y, float& u, float& v)
+		{
+			float dx = forward.x + x * tanHalfFov * aspect * right.x + y * tanHalfFov * up.x;
+			float dy = forward.y + x * tanHalfFov * aspect * right.y + y * tanHalfFov * up.y;
+			float dz = forward.z + x * tanHalfFov * aspect * right.z + y * tanHalfFov * up.z;
+			if (dy > -1e-4f)
+				return false;
+			float t = -cameraHeight / dy;
+			u = (cameraX + t * dx) / worldSize;
+			v = (cameraZ + t * dz) / worldSize;
+			return true;
+		};
+
+		UINT pagesX = virtualTexture.GetPagesX(0), pagesY = virtualTexture.GetPagesY(0);
+		float texelsX = (float)virtualTexture.GetWidth(), texelsY = (float)virtualTexture.GetHeight();
+		float pixelX = 2.0f / (width * resolutionScale), pixelY = 2.0f / (height * resolutionScale);
+		UINT lastMip = virtualTexture.GetMipCount() - 1;
+
+		feedback.assign((size_t)width * height, InvalidPageId);
+		for (UINT py = 0; py < height; ++py)
+		{
+			for (UINT px = 0; px < width; ++px)
+			{
+				float x = (px + 0.5f) / width * 2.0f - 1.0f, y = 1.0f - (py + 0.5f) / height * 2.0f;
+				float u, v, ux, vx, uy, vy;
+				if (!hit(x, y, u, v) || !hit(x + pixelX, y, ux, vx) || !hit(x, y - pixelY, uy, vy))
+					continue;
+
+				// the mip VirtualTextureFeedback picks from the uv derivatives
+				float lengthX = ((ux - u) * texelsX) * ((ux - u) * texelsX) + ((vx - v) * texelsY) * ((vx - v) * texelsY);
+				float lengthY = ((uy - u) * texelsX) * ((uy - u) * texelsX) + ((vy - v) * texelsY) * ((vy - v) * texelsY);
+				float mip = floorf(0.5f * log2f(std::max(std::max(lengthX, lengthY), 1e-8f)));
+				UINT m = (UINT)std::min(std::max(mip, 0.0f), (float)lastMip);
+
+				u -= floorf(u);
+				v -= floorf(v);
+				UINT pageX = std::min((UINT)(u * pagesX), pagesX - 1) >> m;
+				UINT pageY = std::min((UINT)(v * pagesY), pagesY - 1) >> m;
+				feedback[(size_t)py * width + px] = MakePageId(pageX, pageY, m);
+			}
+		}
+	}
+
+	// Flies a camera over a virtual textured ground plane, returns 1 if the page table
+	// ever disagrees with the resident pages or the pages of the still camera do not
+	// all arrive
+	// One pass of --vt-simulate with a cachePages x cachePages page cache. A cache that
+	// holds the pages of the still camera has to have them all at the end, a smaller
+	// one has to evict.
+	bool SimulateVirtualTexturePass(UINT frames, UINT cachePages, bool holdsStillPages)
+	{
+		// 64K x 64K texels in 128 texel pages, 1280 x 720 drawn with a feedback target
+		// of an eighth of the size, read back two frames late
+		const UINT feedbackWidth = 160, feedbackHeight = 90, resolutionScale = 8, feedbackLatency = 2, maxLoads = 32;
+		const UINT stillFrames = std::min(frames / 4, 50u);
+		const float worldSize = 1024.0f;
+
+		VirtualTexture virtualTexture;
+		if (!virtualTexture.Init(65536, 65536, 128, cachePages, cachePages))
+			return false;
+
+		std::cout << "virtual texture " << virtualTexture.GetWidth() << "x" << virtualTexture.GetHeight() << ", "
+			<< virtualTexture.GetMipCount() << " mips, " << virtualTexture.GetCachePagesX() * virtualTexture.GetCachePagesY()
+			<< " cache pages, " << feedbackWidth << "x" << feedbackHeight << " feedback, " << maxLoads << " loads per frame\n";
+		std::cout << std::setw(6) << "frame" << std::setw(10) << "samples" << std::setw(10) << "pages" << std::setw(10) << "missing"
+			<< std::setw(10) << "queued" << std::setw(8) << "loads" << std::setw(8) << "evict" << std::setw(10) << "resident" << std::setw(10) << "ms" << "\n";
+
+		std::vector<std::vector<VirtualPageId> > pending;
+		std::vector<PageLoad> loads;
+		UINT64 totalLoads = 0, totalEvictions = 0;
+		double totalMilliseconds = 0.0, maxMilliseconds = 0.0;
+		bool valid = true;
+		VirtualTextureStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+
+		for (UINT frame = 0; frame < frames; ++frame)
+		{
+			// a circle of 200 m at 0.5 m a frame, 2 m above the ground looking ahead and down
+			float angle = std::min(frame, frames - stillFrames) * 0.5f / 200.0f;
+			float cameraX = 512.0f + 200.0f * cosf(angle), cameraZ = 512.0f + 200.0f * sinf(angle);
+			std::vector<VirtualPageId> feedback;
+			RenderGroundFeedback(virtualTexture, worldSize, cameraX, cameraZ, 2.0f, M_PI - angle, 0.3f,
+				feedbackWidth, feedbackHeight, resolutionScale, feedback);
+			pending.push_back(feedback);
+
+			if (pending.size() > feedbackLatency)
+			{
+				virtualTexture.AddFeedback(&pending[0][0], pending[0].size());
+				pending.erase(pending.begin());
+			}
+
+			loads.clear();
+			virtualTexture.Update(maxLoads, loads);
+			virtualTexture.ClearDirty();
+			stats = virtualTexture.GetStats();
+
+			if (!virtualTexture.Validate())
+			{
+				std::cout << "frame " << frame << ": the page table does not match the resident pages\n";
+				valid = false;
+				break;
+			}
+
+			totalLoads += stats.loads;
+			totalEvictions += stats.evictions;
+			totalMilliseconds += stats.milliseconds;
+			maxMilliseconds = std::max(maxMilliseconds, stats.milliseconds);
+
+			if (frame % 25 == 0 || frame + 1 == frames)
+			{
+				std::cout << std::setw(6) << frame << std::setw(10) << stats.feedbackSamples << std::setw(10) << stats.requestedPages
+					<< std::setw(10) << stats.missingPages << std::setw(10) << stats.queuedLoads << std::setw(8) << stats.loads
+					<< std::setw(8) << stats.evictions << std::setw(10) << stats.residentPages
+					<< std::setw(10) << std::fixed << std::setprecision(3) << stats.milliseconds << "\n";
+			}
+		}
+
+		std::cout << totalLoads << " loads, " << totalEvictions << " evictions, update " << std::fixed << std::setprecision(3)
+			<< totalMilliseconds / std::max(frames, 1u) << " ms average, " << maxMilliseconds << " ms max\n";
+
+		// the still camera's pages fit into the cache, they have all arrived at the end
+		if (valid && holdsStillPages && stillFrames >= 20 && stats.missingPages != 0)
+		{
+			std::cout << stats.missingPages << " pages still missing after " << stillFrames << " frames without movement\n";
+			valid = false;
+		}
+		if (valid && !holdsStillPages && totalEvictions == 0)
+		{
+			std::cout << "no page was evicted from the " << cachePages << " x " << cachePages << " cache\n";
+			valid = false;
+		}
+		return valid;
+	}
+
+	int SimulateVirtualTexture(UINT frames)
+	{
+		if (!TestVirtualTextureFile())
+			return 1;
+
+		bool passed = SimulateVirtualTexturePass(frames, 32, true);
+		passed = SimulateVirtualTexturePass(frames, 8, false) && passed;
+		return passed ? 0 : 1;
+	}
+
+	void PrintUsage()
+	{
+		std::cout << "usage: AssetCooker <asset directory> [--force] [--dry-run] [--uncompressed]\n"
+			"       AssetCooker --bc-benchmark [size]\n"
+			"       AssetCooker --vt-simulate [frames]\n"
+			"       AssetCooker --mesh-test <asset directory>\n"
+			"  --force         cook every mesh and texture, ignore the dependency database\n"
+			"  --dry-run       only list the meshes and textures that would be cooked\n"
+			"  --uncompressed  write mesh caches without MeshCodec compression (use with --force)\n"
+			"  --bc-benchmark  block compress size x size test images, print PSNR and throughput\n"
+			"  --vt-simulate   drive a virtual texture page table with the feedback of a moving camera\n"
+			"  --mesh-test     check and time the mesh pipeline on the meshes of the asset directory\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && std::string(argv[1]) == "--bc-benchmark")
+	{
+		int size = argc >= 3 ? atoi(argv[2]) : 512;
+		if (argc > 3 || size <= 0)
+		{
+			PrintUsage();
+			return 2;
+		}
+		return BenchmarkTextureCompression((UINT)size);
+	}
+
+	if (argc >= 2 && std::string(argv[1]) == "--vt-simulate")
+	{
+		int frames = argc >= 3 ? atoi(argv[2]) : 200;
+		if (argc > 3 || frames <= 0)
+		{
+			PrintUsage();
+			return 2;
+		}
+		return SimulateVirtualTexture((UINT)frames);
+	}
+
+	if (argc >= 2 && std::string(argv[1]) == "--mesh-test")
+	{
+		std::error_code error;
+		if (argc != 3 || !fs::is_directory(argv[2], error))
+		{
+			PrintUsage();
+			return 2;
+		}
+		MeshTests tests(argv[2]);
+		return tests.Run() ? 0 : 1;
+	}
+
+	std::string rootArgument;
+	bool force = false;
+	bool dryRun = false;
+	bool compress = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if (argument == "--force")
+			force = true;
+		else if (argument == "--dry-run")
+			dryRun = true;
+		else if (argument == "--uncompressed")
+			compress = false;
+		else if (rootArgument.empty() && argument.compare(0, 2, "--") != 0)
+			rootArgument = argument;
+		else
+		{
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	std::error_code error;
+	if (rootArgument.empty() || !fs::is_directory(rootArgument, error))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	auto cookStart = std::chrono::high_resolution_clock::now();
+
+	fs::path root = fs::path(rootArgument).lexically_normal();
+
+	std::vector<Asset> assets;
+	for (fs::recursive_directory_iterator it(root, error), end; it != end; it.increment(error))
+	{
+		if (!it->is_regular_file(error))
+			continue;
+
+		std::string extension = it->path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+		Asset asset;
+		if (extension == ".obj")
+			asset.type = ASSET_OBJ;
+		else if (extension == ".gltf" || extension == ".glb")
+			asset.type = ASSET_GLTF;
+		else
+			continue;
+
+		asset.name = GetAssetName(root, it->path());
+		asset.fileName = it->path().string();
+		asset.baseDir = it->path().parent_path().string();
+		if (!asset.baseDir.empty())
+			asset.baseDir += fs::path::preferred_separator;
+		asset.stale = true;
+		asset.cooked = false;
+		asset.cookMilliseconds = 0.0;
+		assets.push_back(asset);
+	}
+	std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) { return a.name < b.name; });
+
+	// The singletons are created lazily, create them before any worker thread does
+	ObjLoader::Instance();
+	GltfLoader::Instance();
+	MeshCache::Instance()->SetCompression(compress);
+	MeshCodec::Instance();
+	MeshProcessor::Instance();
+	TangentGenerator::Instance();
+	// the cooker has the time to keep the overdraw order only where it measures less overdraw
+	MeshOptimizer::Instance()->SetAnalyzeOverdraw(true);
+	MeshletBuilder::Instance();
+	MeshSimplifier::Instance();
+	VertexQuantizer::Instance();
+	TextureCache::Instance();
+	MipGenerator::Instance();
+	TextureCompressor::Instance();
+	TextureAtlas::Instance();
+
+	// the database version changes with the cooker and the cache format
+	CookDatabase database(COOKER_VERSION * 1000 + MeshCache::mVersion);
+	std::string databaseFile = (root / DATABASE_FILE_NAME).string();
+	if (!force)
+		database.Load(databaseFile);
+
+	ParallelFor(assets.size(), [&](size_t i)
+	{
+		assets[i].stale = force || !IsUpToDate(root, assets[i], database);
+	});
+
+	std::vector<size_t> staleAssets;
+	for (size_t i = 0; i < assets.size(); ++i)
+	{
+		if (assets[i].stale)
+			staleAssets.push_back(i);
+	}
+
+	if (dryRun)
+	{
+		for (size_t i = 0; i < staleAssets.size(); ++i)
+			std::cout << "stale " << assets[staleAssets[i]].name << "\n";
+		std::cout << staleAssets.size() << " of " << assets.size() << " meshes would be cooked\n";
+
+		// the textures of meshes without a cache are not known until they are cooked
+		std::vector<TextureAsset> textures = CollectTextures(root, assets);
+		size_t staleTextures = 0;
+		for (size_t i = 0; i < textures.size(); ++i)
+		{
+			if (ImageReader::IsSupported(textures[i].fileName) &&
+				(force || !TextureCache::Instance()->IsValid(textures[i].fileName, MeshCache::Instance()->HashFile(textures[i].fileName), textures[i].content)))
+			{
+				std::cout << "stale " << textures[i].name << "\n";
+				staleTextures++;
+			}
+		}
+		std::cout << staleTextures << " of " << textures.size() << " textures would be cooked\n";
+
+		// the atlases are picked from the cooked textures, stale ones may change them
+		AtlasBuilder atlasBuilder((root / ATLAS_DIRECTORY_NAME).string(), GetColorTextures(textures));
+		if (force || staleTextures > 0 || !atlasBuilder.IsUpToDate())
+			std::cout << "the texture atlases would be built\n";
+		return 0;
+	}
+
+	std::mutex outputMutex;
+	ParallelFor(staleAssets.size(), [&](size_t i)
+	{
+		Asset& asset = assets[staleAssets[i]];
+
+		auto start = std::chrono::high_resolution_clock::now();
+		asset.cooked = Cook(root, asset);
+		asset.cookMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		if (asset.cooked)
+			std::cout << "cooked " << asset.name << " (" << (int)asset.cookMilliseconds << " ms)\n";
+		else
+			std::cerr << "FAILED " << asset.name << "\n";
+	});
+
+	// Failed meshes are dropped so the next run tries again, meshes that no longer exist are forgotten
+	int failed = 0;
+	std::vector<std::string> removed;
+	for (auto it = database.GetRecords().begin(); it != database.GetRecords().end(); ++it)
+	{
+		bool found = false;
+		for (size_t i = 0; i < assets.size() && !found; ++i)
+			found = assets[i].name == it->first;
+		if (!found)
+			removed.push_back(it->first);
+	}
+	for (size_t i = 0; i < removed.size(); ++i)
+		database.Remove(removed[i]);
+
+	for (size_t i = 0; i < staleAssets.size(); ++i)
+	{
+		Asset& asset = assets[staleAssets[i]];
+		if (asset.cooked)
+		{
+			database.Set(asset.name, asset.record);
+		}
+		else
+		{
+			database.Remove(asset.name);
+			failed++;
+		}
+	}
+
+	if (!database.Save(databaseFile))
+	{
+		std::cerr << "AssetCooker: could not write " << databaseFile << std::endl;
+		return 1;
+	}
+
+	// Textures one at a time, the mip filtering and the block compression use every thread
+	std::vector<TextureAsset> textures = CollectTextures(root, assets);
+	int texturesCooked = 0, texturesFailed = 0, texturesSkipped = 0;
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		TextureAsset& texture = textures[i];
+		if (!ImageReader::IsSupported(texture.fileName))
+		{
+			texturesSkipped++;
+			continue;
+		}
+
+		UINT64 hash = MeshCache::Instance()->HashFile(texture.fileName);
+		texture.stale = force || !TextureCache::Instance()->IsValid(texture.fileName, hash, texture.content);
+		if (!texture.stale)
+			continue;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		texture.cooked = hash != 0 && CookTexture(texture);
+		texture.cookMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (texture.cooked)
+		{
+			std::cout << "cooked " << texture.name << " (" << (int)texture.cookMilliseconds << " ms)\n";
+			texturesCooked++;
+		}
+		else
+		{
+			std::cerr << "FAILED " << texture.name << "\n";
+			texturesFailed++;
+		}
+	}
+
+	// The atlases after the textures, the candidates are picked by their cooked size
+	bool atlasFailed = false;
+	AtlasBuilder atlasBuilder((root / ATLAS_DIRECTORY_NAME).string(), GetColorTextures(textures));
+	if (force || !atlasBuilder.IsUpToDate())
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		AtlasStats atlasStats;
+		atlasFailed = !atlasBuilder.Build(atlasStats);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (atlasFailed)
+		{
+			std::cerr << "FAILED texture atlases\n";
+		}
+		else if (atlasStats.atlases > 0)
+		{
+			std::cout << "packed " << atlasStats.textures << " textures into " << atlasStats.atlases << " atlases, "
+				<< std::fixed << std::setprecision(1) << 100.0 * atlasStats.usedTexels / atlasStats.texels << "% used ("
+				<< (int)milliseconds << " ms)\n" << std::defaultfloat;
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - cookStart).count();
+	std::cout << staleAssets.size() - failed << " cooked, " << assets.size() - staleAssets.size() << " up to date, "
+		<< failed << " failed in " << seconds << " s on " << GetWorkerThreadCount() << " threads\n";
+	std::cout << "textures: " << texturesCooked << " cooked, " << textures.size() - texturesCooked - texturesFailed - texturesSkipped << " up to date, "
+		<< texturesFailed << " failed, " << texturesSkipped << " left to the runtime decoder\n";
+
+	return failed == 0 && texturesFailed == 0 && !atlasFailed ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+#include "AtlasBuilder.h"
+#include "ImageReader.h"
+#include "MeshCache.h"
+#include "MipGenerator.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+
+#include <filesystem>
+#include <iostream>
+
+// imgui is not linked into the cooker, the packer is compiled here
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imgui/stb_rect_pack.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// bump when the atlases are built differently from the same textures
+	const UINT ATLAS_VERSION = 1;
+
+	// The atlas sides are a whole number of 4x4 blocks on every mip
+	const UINT ATLAS_ALIGNMENT = 4 << (AtlasBuilder::MipCount - 1);
+
+	void HashBytes(UINT64& hash, const void* data, size_t size)
+	{
+		const BYTE* bytes = (const BYTE*)data;
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+}
+
+AtlasBuilder::AtlasBuilder(const std::string& atlasDirectory, const std::vector<std::string>& colorTextures)
+	: mDirectory(atlasDirectory), mTextures(colorTextures), mHash(0)
+{
+	std::sort(mTextures.begin(), mTextures.end());
+	mTextures.erase(std::unique(mTextures.begin(), mTextures.end()), mTextures.end());
+
+	// the size comes from the cooked texture, no image is decoded to find the candidates
+	for (size_t i = 0; i < mTextures.size(); ++i)
+	{
+		Candidate candidate;
+		candidate.fileName = mTextures[i];
+		candidate.hash = MeshCache::Instance()->HashFile(candidate.fileName);
+
+		TextureData cooked;
+		if (candidate.hash == 0 || !ImageReader::IsSupported(candidate.fileName) ||
+			!TextureCache::Instance()->Load(candidate.fileName, candidate.hash, TEXTURE_COLOR, cooked))
+		{
+			continue;
+		}
+
+		candidate.width = cooked.width;
+		candidate.height = cooked.height;
+		if (candidate.width <= MaxTextureSize && candidate.height <= MaxTextureSize &&
+			candidate.width % Gutter == 0 && candidate.height % Gutter == 0)
+		{
+			mCandidates.push_back(candidate);
+		}
+	}
+
+	// a single texture gains nothing from an atlas
+	if (mCandidates.size() < 2)
+	{
+		mCandidates.clear();
+		return;
+	}
+
+	mHash = 0xcbf29ce484222325ULL;
+	UINT settings[] = { ATLAS_VERSION, MaxTextureSize, AtlasSize, Gutter, MipCount };
+	HashBytes(mHash, settings, sizeof(settings));
+	for (size_t i = 0; i < mCandidates.size(); ++i)
+	{
+		HashBytes(mHash, mCandidates[i].fileName.data(), mCandidates[i].fileName.size() + 1);
+		HashBytes(mHash, &mCandidates[i].hash, sizeof(mCandidates[i].hash));
+	}
+
+	// 0 is reserved for "no source"
+	mHash = mHash != 0 ? mHash : 1;
+}
+
+std::string AtlasBuilder::GetAtlasFileName(UINT index) const
+{
+	return (fs::path(mDirectory) / ("atlas" + std::to_string(index))).string();
+}
+
+bool AtlasBuilder::IsUpToDate() const
+{
+	if (mHash == 0)
+	{
+		std::error_code error;
+		return !fs::exists(TextureCache::GetCacheFileName(GetAtlasFileName(0)), error);
+	}
+	if (!TextureCache::Instance()->IsValid(GetAtlasFileName(0), mHash, TEXTURE_COLOR))
+		return false;
+
+	// the runtime checks the entries by the size and write time of the sources, a touched
+	// source needs its entry written again. Textures alone on their page have no entry.
+	std::error_code error;
+	for (size_t i = 0; i < mCandidates.size(); ++i)
+	{
+		if (fs::exists(TextureAtlas::GetEntryFileName(mCandidates[i].fileName), error) &&
+			!TextureAtlas::Instance()->IsValid(mCandidates[i].fileName, mCandidates[i].hash))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void AtlasBuilder::CopyWithGutter(const TextureData& texture, UINT mip, UINT x, UINT y, TextureData& atlas) const
+{
+	const TextureMip& source = texture.mips[mip];
+	const TextureMip& dest = atlas.mips[mip];
+	UINT gutter = Gutter >> mip;
+	UINT left = x >> mip;
+	UINT top = y >> mip;
+
+	// the texture sides are multiples of Gutter, so every mip has at least gutter texels to wrap
+	const BYTE* pixels = texture.GetPixels();
+	for (UINT row = 0; row < source.height + 2 * gutter; ++row)
+	{
+		UINT sourceRow = (row + source.height - gutter) % source.height;
+		const UINT* sourceTexels = (const UINT*)(pixels + source.offset + (size_t)sourceRow * source.rowPitch);
+		UINT* destTexels = (UINT*)(&atlas.pixels[dest.offset + (size_t)(top + row) * dest.rowPitch]) + left;
+
+		for (UINT column = 0; column < gutter; ++column)
+			destTexels[column] = sourceTexels[source.width - gutter + column];
+		memcpy(destTexels + gutter, sourceTexels, source.width * sizeof(UINT));
+		for (UINT column = 0; column < gutter; ++column)
+			destTexels[gutter + source.width + column] = sourceTexels[column];
+	}
+}
+
+bool AtlasBuilder::Build(AtlasStats& stats)
+{
+	ZeroMemory(&stats, sizeof(stats));
+
+	// The atlases and entries of the previous build, also when nothing is packed any more
+	for (UINT i = 0; ; ++i)
+	{
+		if (remove(TextureCache::GetCacheFileName(GetAtlasFileName(i)).c_str()) != 0)
+			break;
+	}
+	for (size_t i = 0; i < mTextures.size(); ++i)
+		remove(TextureAtlas::GetEntryFileName(mTextures[i]).c_str());
+
+	if (mCandidates.empty())
+		return true;
+
+	std::error_code error;
+	fs::create_directories(mDirectory, error);
+
+	// Rectangles in Gutter units, so their origins are Gutter aligned. Atlases are filled
+	// one after the other, what does not fit goes into the next one.
+	std::vector<stbrp_rect> remaining(mCandidates.size());
+	for (size_t i = 0; i < mCandidates.size(); ++i)
+	{
+		remaining[i].id = (int)i;
+		remaining[i].w = (stbrp_coord)(mCandidates[i].width / Gutter + 2);
+		remaining[i].h = (stbrp_coord)(mCandidates[i].height / Gutter + 2);
+	}
+
+	const int atlasUnits = AtlasSize / Gutter;
+	std::vector<stbrp_node> nodes(atlasUnits);
+	std::vector<std::vector<stbrp_rect> > pages;
+	while (!remaining.empty())
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, atlasUnits, atlasUnits, &nodes[0], atlasUnits);
+		stbrp_setup_heuristic(&context, STBRP_HEURISTIC_Skyline_BF_sortHeight);
+		stbrp_pack_rects(&context, &remaining[0], (int)remaining.size());
+
+		std::vector<stbrp_rect> page, next;
+		for (size_t i = 0; i < remaining.size(); ++i)
+			(remaining[i].was_packed ? page : next).push_back(remaining[i]);
+
+		// every texture fits into an empty atlas, this only guards the loop
+		if (page.empty())
+			return false;
+
+		pages.push_back(page);
+		remaining.swap(next);
+	}
+
+	UINT atlasIndex = 0;
+	for (size_t p = 0; p < pages.size(); ++p)
+	{
+		const std::vector<stbrp_rect>& page = pages[p];
+		if (page.size() < 2)
+			continue;
+
+		// The atlas is cut to the packed rectangles
+		UINT width = 0, height = 0;
+		for (size_t r = 0; r < page.size(); ++r)
+		{
+			width = std::max(width, (UINT)(page[r].x + page[r].w) * Gutter);
+			height = std::max(height, (UINT)(page[r].y + page[r].h) * Gutter);
+		}
+		width = (width + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+		height = (height + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+
+		TextureData atlas;
+		atlas.width = width;
+		atlas.height = height;
+		atlas.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		size_t atlasBytes = 0;
+		for (UINT m = 0; m < MipCount; ++m)
+		{
+			TextureMip mip = { std::max(width >> m, 1u), std::max(height >> m, 1u), std::max(width >> m, 1u) * 4, atlasBytes };
+			atlas.mips.push_back(mip);
+			atlasBytes += (size_t)mip.rowPitch * mip.height;
+		}
+		atlas.pixels.resize(atlasBytes, 0);
+
+		// The mips are filtered per texture, the border never blends into a neighbour
+		for (size_t r = 0; r < page.size(); ++r)
+		{
+			const Candidate& candidate = mCandidates[page[r].id];
+
+			TextureData texture;
+			MipOptions options;
+			options.content = TEXTURE_COLOR;
+			if (!ImageReader::Read(candidate.fileName, texture) || !MipGenerator::Instance()->Generate(texture, options) ||
+				texture.width != candidate.width || texture.height != candidate.height || texture.mips.size() < MipCount)
+			{
+				std::cerr << "AtlasBuilder: could not read " << candidate.fileName << std::endl;
+				return false;
+			}
+
+			for (UINT m = 0; m < MipCount; ++m)
+				CopyWithGutter(texture, m, page[r].x * Gutter, page[r].y * Gutter, atlas);
+		}
+
+		TextureData compressed;
+		std::string atlasFile = GetAtlasFileName(atlasIndex);
+		if (!TextureCompressor::Instance()->Compress(atlas, DXGI_FORMAT_BC7_UNORM, compressed) ||
+			!TextureCache::Instance()->Save(atlasFile, mHash, TEXTURE_COLOR, compressed))
+		{
+			std::cerr << "AtlasBuilder: could not write " << TextureCache::GetCacheFileName(atlasFile) << std::endl;
+			return false;
+		}
+
+		// The entries name the atlas relative to the texture, the assets can move as a whole
+		fs::path atlasPath = fs::absolute(atlasFile, error).lexically_normal();
+		for (size_t r = 0; r < page.size(); ++r)
+		{
+			const Candidate& candidate = mCandidates[page[r].id];
+
+			AtlasEntry entry;
+			entry.atlasFile = atlasPath.lexically_relative(fs::absolute(candidate.fileName, error).lexically_normal().parent_path()).generic_string();
+			entry.uvTransform = XMFLOAT4((float)candidate.width / width, (float)candidate.height / height,
+				(float)(page[r].x * Gutter + Gutter) / width, (float)(page[r].y * Gutter + Gutter) / height);
+			if (!TextureAtlas::Instance()->Save(candidate.fileName, candidate.hash, entry))
+			{
+				std::cerr << "AtlasBuilder: could not write " << TextureAtlas::GetEntryFileName(candidate.fileName) << std::endl;
+				return false;
+			}
+
+			stats.textures++;
+			stats.usedTexels += (UINT64)candidate.width * candidate.height;
+		}
+
+		stats.atlases++;
+		stats.texels += (UINT64)width * height;
+		atlasIndex++;
+	}
+
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+
+// Result of AtlasBuilder::Build
+struct AtlasStats
+{
+	UINT textures;		// textures packed into an atlas
+	UINT atlases;		// atlases written
+	UINT64 texels;		// texels of the atlases' top mips
+	UINT64 usedTexels;	// of these, texels of the packed textures without the gutters
+};
+
+// AtlasBuilder
+// Packs the small color textures of the materials into shared atlases with stb_rect_pack,
+// so the draws using them bind one shader resource view and the static batches can
+// merge their materials. usage:
+// AtlasBuilder builder(atlasDirectory, colorTextures);
+// if (force || !builder.IsUpToDate()) builder.Build(stats)
+//
+// Textures go into an atlas when they are cooked, at most MaxTextureSize and a multiple
+// of Gutter on both sides. Every texture gets a Gutter texels wide border of its own
+// wrapped texels and its rectangle is aligned to Gutter, so its first MipCount mips sit
+// at whole texels with a border of at least one texel: tiling UVs wrap with frac in the
+// shader and the bilinear and mip filters never read a neighbour. The atlases have
+// MipCount mips filtered per texture by MipGenerator, BC7 compressed, and are written
+// as TextureCache files <atlasDirectory>/atlas<n>.dds without a source image. Every
+// packed texture gets its TextureAtlas entry with the atlas and its UV scale and bias.
+// The atlases are built again when the set of packed textures or one of them changes.
+class AtlasBuilder
+{
+public:
+	// Largest texture side packed into an atlas
+	static const UINT MaxTextureSize = 256;
+	// Largest atlas side
+	static const UINT AtlasSize = 2048;
+	// Border of wrapped texels around every texture and the alignment of the rectangles
+	static const UINT Gutter = 8;
+	// Mips of the atlases, the border is Gutter >> (MipCount - 1) texels on the last one
+	static const UINT MipCount = 4;
+
+	// colorTextures: every texture the materials use as diffuse texture, the ones that fit
+	// are picked from their TextureCache files, so cook the textures first
+	AtlasBuilder(const std::string& atlasDirectory, const std::vector<std::string>& colorTextures);
+
+	// True if the atlases on disk were built from the same textures and the entries still
+	// match the size and write time of their sources
+	bool IsUpToDate() const;
+
+	// Writes the atlases and the atlas entries, removes the atlases and entries of an earlier build
+	bool Build(AtlasStats& stats);
+
+	// Number of textures that fit into an atlas
+	UINT GetCandidateCount() const { return (UINT)mCandidates.size(); }
+
+	// Source name of atlas index, TextureManager loads it by this name
+	std::string GetAtlasFileName(UINT index) const;
+
+private:
+	// A texture to pack, sizes in texels without the gutter
+	struct Candidate
+	{
+		std::string fileName;
+		UINT64 hash;
+		UINT width;
+		UINT height;
+	};
+
+	// Copies mip of the texture into the atlas mip with its wrapped border, x and y in top mip texels
+	void CopyWithGutter(const TextureData& texture, UINT mip, UINT x, UINT y, TextureData& atlas) const;
+
+	std::string mDirectory;
+	std::vector<std::string> mTextures;
+	std::vector<Candidate> mCandidates;
+	UINT64 mHash;	// of the candidates, stored as the source hash of the atlases
+};
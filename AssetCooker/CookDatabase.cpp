@@ -0,0 +1,103 @@
+#include "CookDatabase.h"
+
+#include <cstdlib>
+
+// Text file, one line per entry:
+// AssetCooker <version>
+// asset <path>
+// dep <hash as 16 hex digits> <path>
+// The dep lines belong to the asset line above them.
+
+CookDatabase::CookDatabase(UINT version) : mVersion(version)
+{
+}
+
+bool CookDatabase::Load(const std::string& fileName)
+{
+	mRecords.clear();
+
+	std::ifstream in(fileName);
+	if (!in)
+		return false;
+
+	std::string line;
+	if (!std::getline(in, line) || line != "AssetCooker " + std::to_string(mVersion))
+		return false;
+
+	Record* record = NULL;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if (line.compare(0, 6, "asset ") == 0)
+		{
+			record = &mRecords[line.substr(6)];
+			record->dependencies.clear();
+		}
+		else if (line.compare(0, 4, "dep ") == 0 && line.size() > 21 && line[20] == ' ' && record != NULL)
+		{
+			Dependency dependency;
+			dependency.hash = strtoull(line.substr(4, 16).c_str(), NULL, 16);
+			dependency.path = line.substr(21);
+			record->dependencies.push_back(dependency);
+		}
+		else if (!line.empty())
+		{
+			// unknown data, start from scratch rather than trust a partial graph
+			mRecords.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CookDatabase::Save(const std::string& fileName) const
+{
+	// written next to the old database and renamed, an interrupted cook keeps the old one
+	std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream out(tempFileName, std::ios::out | std::ios::trunc);
+		if (!out)
+			return false;
+
+		out << "AssetCooker " << mVersion << "\n";
+		for (auto it = mRecords.begin(); it != mRecords.end(); ++it)
+		{
+			out << "asset " << it->first << "\n";
+			for (size_t i = 0; i < it->second.dependencies.size(); ++i)
+			{
+				char hash[17];
+				snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)it->second.dependencies[i].hash);
+				out << "dep " << hash << " " << it->second.dependencies[i].path << "\n";
+			}
+		}
+
+		if (!out)
+		{
+			out.close();
+			remove(tempFileName.c_str());
+			return false;
+		}
+	}
+
+	remove(fileName.c_str());
+	return rename(tempFileName.c_str(), fileName.c_str()) == 0;
+}
+
+const CookDatabase::Record* CookDatabase::Find(const std::string& asset) const
+{
+	auto it = mRecords.find(asset);
+	return it != mRecords.end() ? &it->second : NULL;
+}
+
+void CookDatabase::Set(const std::string& asset, const Record& record)
+{
+	mRecords[asset] = record;
+}
+
+void CookDatabase::Remove(const std::string& asset)
+{
+	mRecords.erase(asset);
+}
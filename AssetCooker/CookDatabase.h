@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Util.h"
+
+// CookDatabase
+// Dependency graph of the last cook: for every cooked asset the content hash of
+// each file it was built from (the source itself, .mtl libraries, textures,
+// glTF buffers). An asset is rebuilt when any of these hashes changes.
+// Paths are relative to the asset directory and use '/' separators.
+// usage:
+// CookDatabase database(version);
+// database.Load("Assets/.cookdb");
+// const CookDatabase::Record* record = database.Find("cube/cube.obj");
+// if the recorded hashes differ from the files on disk: cook, database.Set("cube/cube.obj", newRecord)
+// database.Save("Assets/.cookdb");
+class CookDatabase
+{
+public:
+	struct Dependency
+	{
+		std::string path;
+		UINT64 hash;	// 0 if the file did not exist
+	};
+
+	// dependencies[0] is the source asset
+	struct Record
+	{
+		std::vector<Dependency> dependencies;
+	};
+
+	// version is stored in the file, a database of another version loads empty
+	// so everything is rebuilt
+	explicit CookDatabase(UINT version);
+
+	bool Load(const std::string& fileName);
+	bool Save(const std::string& fileName) const;
+
+	const Record* Find(const std::string& asset) const;
+	void Set(const std::string& asset, const Record& record);
+	void Remove(const std::string& asset);
+
+	const std::map<std::string, Record>& GetRecords() const { return mRecords; }
+
+private:
+	UINT mVersion;
+	std::map<std::string, Record> mRecords;
+};
@@ -0,0 +1,605 @@
+#include "ImageReader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+	// D3D11 limit for 2D textures
+	const UINT MaxTextureSize = 16384;
+
+	UINT ReadBigEndian(const BYTE* data)
+	{
+		return ((UINT)data[0] << 24) | ((UINT)data[1] << 16) | ((UINT)data[2] << 8) | data[3];
+	}
+
+	UINT ReadLittleEndian16(const BYTE* data)
+	{
+		return data[0] | ((UINT)data[1] << 8);
+	}
+
+	void InitTexture(UINT width, UINT height, TextureData& textureData)
+	{
+		TextureMip mip = { width, height, width * 4, 0 };
+		textureData.width = width;
+		textureData.height = height;
+		textureData.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureData.mips.assign(1, mip);
+		textureData.pixels.assign((size_t)mip.rowPitch * height, 0);
+	}
+
+	// Canonical Huffman code of a deflate block, decoded a bit at a time
+	struct Huffman
+	{
+		short count[16];	// codes of every length
+		short symbol[288];	// symbols ordered by code
+	};
+
+	// Reads the zlib stream of the PNG IDAT chunks, RFC 1950 and 1951
+	class Inflater
+	{
+	public:
+		Inflater(const BYTE* data, size_t size) : mData(data), mSize(size), mPosition(0), mBits(0), mBitCount(0), mError(false) {}
+
+		bool Inflate(std::vector<BYTE>& output)
+		{
+			if (mSize < 2 || (mData[0] & 0x0f) != 8 || ((mData[0] << 8) | mData[1]) % 31 != 0 || (mData[1] & 0x20) != 0)
+				return false;
+			mPosition = 2;
+
+			bool last = false;
+			while (!last && !mError)
+			{
+				last = GetBits(1) != 0;
+				UINT type = GetBits(2);
+				bool decoded;
+				if (type == 0)
+					decoded = Stored(output);
+				else if (type == 1)
+					decoded = Fixed(output);
+				else if (type == 2)
+					decoded = Dynamic(output);
+				else
+					decoded = false;
+				if (!decoded)
+					return false;
+			}
+			return !mError;
+		}
+
+	private:
+		UINT GetBits(UINT count)
+		{
+			while (mBitCount < count)
+			{
+				if (mPosition >= mSize)
+				{
+					mError = true;
+					return 0;
+				}
+				mBits |= (UINT)mData[mPosition++] << mBitCount;
+				mBitCount += 8;
+			}
+			UINT value = mBits & ((1u << count) - 1);
+			mBits >>= count;
+			mBitCount -= count;
+			return value;
+		}
+
+		// Fails for over subscribed codes, incomplete codes are allowed for a single distance code
+		static bool Build(Huffman& huffman, const BYTE* lengths, UINT count)
+		{
+			memset(huffman.count, 0, sizeof(huffman.count));
+			for (UINT i = 0; i < count; ++i)
+				huffman.count[lengths[i]]++;
+			if (huffman.count[0] == (short)count)
+				return true;
+
+			int left = 1;
+			for (UINT length = 1; length < 16; ++length)
+			{
+				left = left * 2 - huffman.count[length];
+				if (left < 0)
+					return false;
+			}
+
+			short offsets[16];
+			offsets[1] = 0;
+			for (UINT length = 1; length < 15; ++length)
+				offsets[length + 1] = offsets[length] + huffman.count[length];
+			for (UINT i = 0; i < count; ++i)
+			{
+				if (lengths[i] != 0)
+					huffman.symbol[offsets[lengths[i]]++] = (short)i;
+			}
+			return true;
+		}
+
+		int Decode(const Huffman& huffman)
+		{
+			int code = 0, first = 0, index = 0;
+			for (UINT length = 1; length < 16; ++length)
+			{
+				code |= (int)GetBits(1);
+				int count = huffman.count[length];
+				if (code - count < first)
+					return huffman.symbol[index + (code - first)];
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			return -1;
+		}
+
+		bool Stored(std::vector<BYTE>& output)
+		{
+			mBits = 0;
+			mBitCount = 0;
+			if (mPosition + 4 > mSize)
+				return false;
+			UINT length = ReadLittleEndian16(mData + mPosition);
+			UINT complement = ReadLittleEndian16(mData + mPosition + 2);
+			mPosition += 4;
+			if (length != (~complement & 0xffff) || mPosition + length > mSize)
+				return false;
+			output.insert(output.end(), mData + mPosition, mData + mPosition + length);
+			mPosition += length;
+			return true;
+		}
+
+		bool Codes(std::vector<BYTE>& output, const Huffman& lengthCode, const Huffman& distanceCode)
+		{
+			static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			for (;;)
+			{
+				int symbol = Decode(lengthCode);
+				if (symbol < 0 || mError)
+					return false;
+				if (symbol < 256)
+				{
+					output.push_back((BYTE)symbol);
+					continue;
+				}
+				if (symbol == 256)
+					return true;
+
+				symbol -= 257;
+				if (symbol >= 29)
+					return false;
+				UINT length = lengthBase[symbol] + GetBits(lengthExtra[symbol]);
+
+				int distanceSymbol = Decode(distanceCode);
+				if (distanceSymbol < 0 || distanceSymbol >= 30)
+					return false;
+				size_t distance = distanceBase[distanceSymbol] + GetBits(distanceExtra[distanceSymbol]);
+				if (distance > output.size() || mError)
+					return false;
+
+				// the copy may overlap what it writes
+				size_t from = output.size() - distance;
+				for (UINT i = 0; i < length; ++i)
+					output.push_back(output[from + i]);
+			}
+		}
+
+		bool Fixed(std::vector<BYTE>& output)
+		{
+			BYTE lengths[288 + 30];
+			for (UINT i = 0; i < 144; ++i)
+				lengths[i] = 8;
+			for (UINT i = 144; i < 256; ++i)
+				lengths[i] = 9;
+			for (UINT i = 256; i < 280; ++i)
+				lengths[i] = 7;
+			for (UINT i = 280; i < 288; ++i)
+				lengths[i] = 8;
+			for (UINT i = 0; i < 30; ++i)
+				lengths[288 + i] = 5;
+
+			Huffman lengthCode, distanceCode;
+			Build(lengthCode, lengths, 288);
+			Build(distanceCode, lengths + 288, 30);
+			return Codes(output, lengthCode, distanceCode);
+		}
+
+		bool Dynamic(std::vector<BYTE>& output)
+		{
+			static const BYTE order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			UINT lengthCount = GetBits(5) + 257;
+			UINT distanceCount = GetBits(5) + 1;
+			UINT codeCount = GetBits(4) + 4;
+			if (lengthCount > 286 || distanceCount > 30 || mError)
+				return false;
+
+			BYTE lengths[286 + 30];
+			memset(lengths, 0, sizeof(lengths));
+			for (UINT i = 0; i < codeCount; ++i)
+				lengths[order[i]] = (BYTE)GetBits(3);
+
+			Huffman code;
+			if (!Build(code, lengths, 19))
+				return false;
+
+			// the code lengths of both codes, run length coded
+			UINT index = 0;
+			while (index < lengthCount + distanceCount)
+			{
+				int symbol = Decode(code);
+				if (symbol < 0 || mError)
+					return false;
+				if (symbol < 16)
+				{
+					lengths[index++] = (BYTE)symbol;
+					continue;
+				}
+
+				BYTE length = 0;
+				UINT repeat;
+				if (symbol == 16)
+				{
+					if (index == 0)
+						return false;
+					length = lengths[index - 1];
+					repeat = 3 + GetBits(2);
+				}
+				else if (symbol == 17)
+				{
+					repeat = 3 + GetBits(3);
+				}
+				else
+				{
+					repeat = 11 + GetBits(7);
+				}
+				if (index + repeat > lengthCount + distanceCount)
+					return false;
+				while (repeat-- > 0)
+					lengths[index++] = length;
+			}
+
+			if (lengths[256] == 0)
+				return false;
+
+			Huffman lengthCode, distanceCode;
+			if (!Build(lengthCode, lengths, lengthCount) || !Build(distanceCode, lengths + lengthCount, distanceCount))
+				return false;
+			return Codes(output, lengthCode, distanceCode);
+		}
+
+		const BYTE* mData;
+		size_t mSize;
+		size_t mPosition;
+		UINT mBits;
+		UINT mBitCount;
+		bool mError;
+	};
+
+	BYTE Paeth(BYTE a, BYTE b, BYTE c)
+	{
+		int p = (int)a + b - c;
+		int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return a;
+		return pb <= pc ? b : c;
+	}
+
+	// Sample x of an unfiltered PNG row, bitDepth 1 to 16. 16 bit samples keep all their bits.
+	UINT GetPngSample(const BYTE* row, UINT x, UINT bitDepth)
+	{
+		if (bitDepth == 8)
+			return row[x];
+		if (bitDepth == 16)
+			return ((UINT)row[x * 2] << 8) | row[x * 2 + 1];
+		UINT bit = x * bitDepth;
+		return (row[bit / 8] >> (8 - bitDepth - bit % 8)) & ((1u << bitDepth) - 1);
+	}
+}
+
+bool ImageReader::IsSupported(const std::string& fileName)
+{
+	size_t dot = fileName.find_last_of('.');
+	if (dot == std::string::npos)
+		return false;
+	std::string extension = fileName.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".tga";
+}
+
+bool ImageReader::Read(const std::string& fileName, TextureData& textureData)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	static const BYTE pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	bool png = file.GetSize() >= 8 && memcmp(file.GetData(), pngSignature, 8) == 0;
+
+	bool read = png ? ReadPng(file.GetData(), file.GetSize(), textureData) : ReadTga(file.GetData(), file.GetSize(), textureData);
+	if (!read)
+	{
+		textureData = TextureData();
+		std::cerr << "ImageReader: can not decode " << fileName << std::endl;
+	}
+	return read;
+}
+
+bool ImageReader::ReadPng(const BYTE* data, size_t size, TextureData& textureData)
+{
+	UINT width = 0, height = 0, bitDepth = 0, colorType = 0;
+	BYTE palette[256][4];
+	UINT paletteSize = 0;
+	UINT transparent[3] = { UINT_MAX, UINT_MAX, UINT_MAX };	// gray or rgb key of tRNS
+	std::vector<BYTE> compressed;
+
+	for (size_t position = 8; position + 12 <= size; )
+	{
+		UINT length = ReadBigEndian(data + position);
+		const BYTE* type = data + position + 4;
+		const BYTE* chunk = data + position + 8;
+		if (length > size - position - 12)
+			return false;
+		position += 12 + (size_t)length;
+
+		if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+		{
+			width = ReadBigEndian(chunk);
+			height = ReadBigEndian(chunk + 4);
+			bitDepth = chunk[8];
+			colorType = chunk[9];
+			if (chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0)
+				return false;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			paletteSize = std::min(length / 3, 256u);
+			for (UINT i = 0; i < paletteSize; ++i)
+			{
+				palette[i][0] = chunk[i * 3];
+				palette[i][1] = chunk[i * 3 + 1];
+				palette[i][2] = chunk[i * 3 + 2];
+				palette[i][3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (colorType == 3)
+			{
+				for (UINT i = 0; i < std::min(length, paletteSize); ++i)
+					palette[i][3] = chunk[i];
+			}
+			else if (colorType == 0 && length >= 2)
+			{
+				transparent[0] = (chunk[0] << 8) | chunk[1];
+			}
+			else if (colorType == 2 && length >= 6)
+			{
+				for (UINT c = 0; c < 3; ++c)
+					transparent[c] = (chunk[c * 2] << 8) | chunk[c * 2 + 1];
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+	}
+
+	UINT channels;
+	switch (colorType)
+	{
+	case 0: channels = 1; break;	// gray
+	case 2: channels = 3; break;	// rgb
+	case 3: channels = 1; break;	// palette index
+	case 4: channels = 2; break;	// gray, alpha
+	case 6: channels = 4; break;	// rgba
+	default: return false;
+	}
+	bool validDepth = colorType == 3 ? bitDepth <= 8 && (bitDepth & (bitDepth - 1)) == 0 :
+		colorType == 0 ? bitDepth <= 16 && (bitDepth & (bitDepth - 1)) == 0 : bitDepth == 8 || bitDepth == 16;
+	if (width == 0 || height == 0 || width > MaxTextureSize || height > MaxTextureSize || !validDepth || (colorType == 3 && paletteSize == 0))
+		return false;
+
+	size_t stride = ((size_t)width * channels * bitDepth + 7) / 8;
+	size_t texelBytes = std::max<size_t>(channels * bitDepth / 8, 1);
+
+	std::vector<BYTE> filtered;
+	filtered.reserve((stride + 1) * height);
+	if (!Inflater(compressed.empty() ? NULL : &compressed[0], compressed.size()).Inflate(filtered) || filtered.size() < (stride + 1) * height)
+		return false;
+
+	InitTexture(width, height, textureData);
+
+	// the filters predict from the unfiltered row above, which is kept in previous
+	std::vector<BYTE> previous(stride, 0), current(stride);
+	UINT maxSample = (1u << bitDepth) - 1;
+	for (UINT y = 0; y < height; ++y)
+	{
+		const BYTE* source = &filtered[y * (stride + 1)];
+		BYTE filter = source[0];
+		source++;
+		for (size_t i = 0; i < stride; ++i)
+		{
+			BYTE left = i >= texelBytes ? current[i - texelBytes] : 0;
+			BYTE upperLeft = i >= texelBytes ? previous[i - texelBytes] : 0;
+			switch (filter)
+			{
+			case 0: current[i] = source[i]; break;
+			case 1: current[i] = source[i] + left; break;
+			case 2: current[i] = source[i] + previous[i]; break;
+			case 3: current[i] = source[i] + (BYTE)((left + previous[i]) / 2); break;
+			case 4: current[i] = source[i] + Paeth(left, previous[i], upperLeft); break;
+			default: return false;
+			}
+		}
+
+		BYTE* dest = &textureData.pixels[(size_t)y * width * 4];
+		for (UINT x = 0; x < width; ++x, dest += 4)
+		{
+			UINT samples[4];
+			for (UINT c = 0; c < channels; ++c)
+				samples[c] = GetPngSample(&current[0], x * channels + c, bitDepth);
+
+			if (colorType == 3)
+			{
+				if (samples[0] >= paletteSize)
+					return false;
+				memcpy(dest, palette[samples[0]], 4);
+				continue;
+			}
+
+			// to 8 bits: 16 bit samples keep the high byte, low depth gray is scaled up
+			BYTE values[4];
+			for (UINT c = 0; c < channels; ++c)
+				values[c] = bitDepth == 16 ? (BYTE)(samples[c] >> 8) : (BYTE)(samples[c] * 255 / maxSample);
+
+			if (channels <= 2)
+			{
+				dest[0] = dest[1] = dest[2] = values[0];
+				dest[3] = channels == 2 ? values[1] : samples[0] == transparent[0] ? 0 : 255;
+			}
+			else
+			{
+				dest[0] = values[0];
+				dest[1] = values[1];
+				dest[2] = values[2];
+				dest[3] = channels == 4 ? values[3] :
+					samples[0] == transparent[0] && samples[1] == transparent[1] && samples[2] == transparent[2] ? 0 : 255;
+			}
+		}
+		previous.swap(current);
+	}
+	return true;
+}
+
+bool ImageReader::ReadTga(const BYTE* data, size_t size, TextureData& textureData)
+{
+	const size_t HeaderSize = 18;
+	if (size < HeaderSize)
+		return false;
+
+	UINT idLength = data[0];
+	UINT colorMapType = data[1];
+	UINT imageType = data[2];
+	UINT colorMapFirst = ReadLittleEndian16(data + 3);
+	UINT colorMapLength = ReadLittleEndian16(data + 5);
+	UINT colorMapDepth = data[7];
+	UINT width = ReadLittleEndian16(data + 12);
+	UINT height = ReadLittleEndian16(data + 14);
+	UINT depth = data[16];
+	UINT descriptor = data[17];
+
+	bool rle = imageType >= 9;
+	UINT baseType = rle ? imageType - 8 : imageType;
+	bool validDepth = baseType == 1 ? depth == 8 && colorMapType == 1 && (colorMapDepth == 15 || colorMapDepth == 16 || colorMapDepth == 24 || colorMapDepth == 32) :
+		baseType == 2 ? depth == 15 || depth == 16 || depth == 24 || depth == 32 :
+		baseType == 3 ? depth == 8 : false;
+	if (!validDepth || width == 0 || height == 0 || width > MaxTextureSize || height > MaxTextureSize)
+		return false;
+
+	size_t position = HeaderSize + idLength;
+
+	// BGR(A) texels of 15, 16, 24 or 32 bits to RGBA, alpha only from 32 bit texels with alpha bits
+	bool hasAlpha = (descriptor & 0x0f) != 0;
+	auto toRgba = [hasAlpha](const BYTE* texel, UINT texelDepth, BYTE* rgba)
+	{
+		if (texelDepth <= 16)
+		{
+			UINT value = ReadLittleEndian16(texel);
+			rgba[0] = (BYTE)(((value >> 10) & 0x1f) * 255 / 31);
+			rgba[1] = (BYTE)(((value >> 5) & 0x1f) * 255 / 31);
+			rgba[2] = (BYTE)((value & 0x1f) * 255 / 31);
+			rgba[3] = 255;
+		}
+		else
+		{
+			rgba[0] = texel[2];
+			rgba[1] = texel[1];
+			rgba[2] = texel[0];
+			rgba[3] = texelDepth == 32 && hasAlpha ? texel[3] : 255;
+		}
+	};
+
+	std::vector<BYTE> colorMap;
+	if (colorMapType == 1)
+	{
+		UINT entryBytes = (colorMapDepth + 7) / 8;
+		if (position + (size_t)colorMapLength * entryBytes > size)
+			return false;
+		colorMap.resize((size_t)colorMapLength * 4);
+		for (UINT i = 0; i < colorMapLength; ++i)
+			toRgba(data + position + i * entryBytes, colorMapDepth, &colorMap[i * 4]);
+		position += (size_t)colorMapLength * entryBytes;
+	}
+
+	InitTexture(width, height, textureData);
+
+	UINT texelBytes = (depth + 7) / 8;
+	size_t texelCount = (size_t)width * height;
+	std::vector<BYTE> rgba(texelCount * 4);
+	for (size_t t = 0; t < texelCount; )
+	{
+		// raw images are one raw packet
+		size_t count = texelCount - t;
+		bool repeat = false;
+		if (rle)
+		{
+			if (position >= size)
+				return false;
+			BYTE packet = data[position++];
+			repeat = (packet & 0x80) != 0;
+			count = std::min<size_t>((packet & 0x7f) + 1, texelCount - t);
+		}
+
+		// a repeat packet has one texel for all of its count
+		const BYTE* texel = NULL;
+		for (size_t i = 0; i < count; ++i, ++t)
+		{
+			if (!repeat || i == 0)
+			{
+				if (position + texelBytes > size)
+					return false;
+				texel = data + position;
+				position += texelBytes;
+			}
+
+			BYTE* dest = &rgba[t * 4];
+			if (baseType == 1)
+			{
+				if (texel[0] < colorMapFirst || texel[0] - colorMapFirst >= colorMapLength)
+					return false;
+				memcpy(dest, &colorMap[(texel[0] - colorMapFirst) * 4], 4);
+			}
+			else if (baseType == 3)
+			{
+				dest[0] = dest[1] = dest[2] = texel[0];
+				dest[3] = 255;
+			}
+			else
+			{
+				toRgba(texel, depth, dest);
+			}
+		}
+	}
+
+	// rows are stored bottom up unless bit 5 is set, right to left if bit 4 is
+	bool topDown = (descriptor & 0x20) != 0;
+	bool rightToLeft = (descriptor & 0x10) != 0;
+	for (UINT y = 0; y < height; ++y)
+	{
+		const BYTE* source = &rgba[(size_t)(topDown ? y : height - 1 - y) * width * 4];
+		BYTE* dest = &textureData.pixels[(size_t)y * width * 4];
+		for (UINT x = 0; x < width; ++x)
+			memcpy(dest + x * 4, source + (rightToLeft ? width - 1 - x : x) * 4, 4);
+	}
+	return true;
+}
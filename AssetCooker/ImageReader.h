@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+
+// ImageReader
+// Decodes PNG and TGA files into RGBA8 TextureData (mips[0] only) without a platform
+// image library, so the cooker reads textures the same way on Windows and Linux.
+// The runtime decodes the other formats (jpg, bmp, ...) through WIC as before.
+// PNG: every color type and bit depth, tRNS transparency, no Adam7 interlacing.
+// TGA: true color (16, 24, 32 bit), gray and 8 bit color mapped, raw and RLE.
+// usage:
+// if (ImageReader::IsSupported(fileName)) ImageReader::Read(fileName, textureData)
+class ImageReader
+{
+public:
+	// By the extension of fileName
+	static bool IsSupported(const std::string& fileName);
+
+	// Returns false and leaves textureData empty if fileName can not be decoded
+	static bool Read(const std::string& fileName, TextureData& textureData);
+
+private:
+	static bool ReadPng(const BYTE* data, size_t size, TextureData& textureData);
+	static bool ReadTga(const BYTE* data, size_t size, TextureData& textureData);
+};
@@ -0,0 +1,843 @@
+#include "MeshTests.h"
+#include "ObjLoader.h"
+#include "ObjParser.h"
+#include "MeshletCuller.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "MeshStreamer.h"
+#include "StaticBatcher.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Welded counts of Assets/teapot.obj: 1202 positions each with its own normal, 2256 triangles
+	const UINT TEAPOT_VERTICES = 1202;
+	const UINT TEAPOT_INDICES = 2256 * 3;
+
+	// Loads of every mesh the load benchmarks average over
+	const UINT LOAD_ITERATIONS = 10;
+	// Parses of every file the parse benchmark takes the fastest of
+	const UINT PARSE_ITERATIONS = 3;
+	// Vertices per side of the generated parse benchmark grid, about 20 MB of .obj
+	const UINT PARSE_GRID_SIZE = 400;
+
+	// Meshlets per side of the culling test grid, 10 apart on the xz plane
+	const UINT CULL_GRID_SIZE = 10;
+
+	// Shortest time a codec throughput is measured over
+	const double CODEC_BENCHMARK_MILLISECONDS = 50.0;
+
+	// Seed of the triangle order the optimizer test shuffles teapot.obj into
+	const UINT OPTIMIZER_SHUFFLE_SEED = 1;
+
+	// Static teapots per side of the streaming test grid, 10 apart on the xz plane
+	const UINT STREAM_GRID_SIZE = 8;
+	// Upload budget and batch cell size of the streaming test, the budget holds a cell of
+	// 2 x 2 teapots but not two, so every frame has to keep to it
+	const UINT64 STREAM_UPLOAD_BUDGET = 512 * 1024;
+	const float STREAM_CELL_SIZE = 20.0f;
+	// Frame the streaming test paces its render loop at, the longest frame it accepts
+	// and the frames it waits for everything to stream in
+	const double STREAM_FRAME_MILLISECONDS = 1000.0 / 60.0;
+	const double STREAM_WORST_FRAME_MILLISECONDS = 2.0 * STREAM_FRAME_MILLISECONDS;
+	const UINT STREAM_MAX_FRAMES = 60 * 60;
+
+	enum ObjParserType
+	{
+		PARSER_TINYOBJ,
+		PARSER_OBJPARSER
+	};
+
+	const char* GetParserName(ObjParserType parser)
+	{
+		return parser == PARSER_TINYOBJ ? "tinyobj" : "ObjParser";
+	}
+
+	// Loads fileName through ObjLoader without the mesh cache, parsed by parser
+	bool LoadObj(const std::string& fileName, ObjParserType parser, MeshData& meshData)
+	{
+		ObjLoader* loader = ObjLoader::Instance();
+		loader->SetUseMeshCache(false);
+		loader->SetParallelParseThreshold(parser == PARSER_TINYOBJ ? 0 : 1);
+
+		std::string baseDir = fs::path(fileName).parent_path().string();
+		if (!baseDir.empty())
+			baseDir += (char)fs::path::preferred_separator;
+		return loader->LoadToMesh(fileName, baseDir, meshData);
+	}
+
+	double GetMilliseconds(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Triangles of LOD 0 as their corner positions, every triangle starts at its smallest
+	// corner so the comparison does not depend on the order the optimizer picked
+	std::vector<std::array<float, 9> > GetTrianglePositions(const MeshData& meshData)
+	{
+		std::vector<std::array<float, 9> > triangles;
+		if (meshData.Lods.empty())
+			return triangles;
+
+		const MeshLod& lod = meshData.Lods[0];
+		for (UINT i = lod.indexStart; i + 2 < lod.indexStart + lod.indexCount; i += 3)
+		{
+			std::array<std::array<float, 3>, 3> corners;
+			for (UINT c = 0; c < 3; ++c)
+			{
+				const XMFLOAT3& p = meshData.Vertices[meshData.Indices[i + c]].Position;
+				corners[c] = { p.x, p.y, p.z };
+			}
+			size_t first = std::min_element(corners.begin(), corners.end()) - corners.begin();
+
+			std::array<float, 9> triangle;
+			for (UINT c = 0; c < 3; ++c)
+				std::copy(corners[(first + c) % 3].begin(), corners[(first + c) % 3].end(), triangle.begin() + 3 * c);
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// Writes an .obj grid of size x size vertices with texcoords and normals and a quad
+	// between every four, the faces of every second row use relative indices. The
+	// vertices of a row are written right before the faces using them, so relative
+	// indices also reach back over the chunk boundaries of ObjParser.
+	bool WriteGridObj(const std::string& fileName, UINT size)
+	{
+		FILE* file = fopen(fileName.c_str(), "wb");
+		if (file == NULL)
+			return false;
+
+		for (UINT y = 0; y < size; ++y)
+		{
+			for (UINT x = 0; x < size; ++x)
+			{
+				float u = (float)x / (size - 1), v = (float)y / (size - 1);
+				float height = 0.1f * sinf(u * 12.0f) * cosf(v * 9.0f);
+				fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", u, height, v, u, v,
+					-1.2f * cosf(u * 12.0f) * cosf(v * 9.0f), 1.0f, 0.9f * sinf(u * 12.0f) * sinf(v * 9.0f));
+			}
+			if (y == 0)
+				continue;
+
+			for (UINT x = 0; x + 1 < size; ++x)
+			{
+				int corners[4] = { (int)((y - 1) * size + x), (int)((y - 1) * size + x + 1), (int)(y * size + x + 1), (int)(y * size + x) };
+				fputs("f", file);
+				for (UINT c = 0; c < 4; ++c)
+				{
+					// 1 based, or relative to the end of the row just written
+					int index = y % 2 == 0 ? corners[c] + 1 : corners[c] - (int)((y + 1) * size);
+					fprintf(file, " %d/%d/%d", index, index, index);
+				}
+				fputs("\n", file);
+			}
+		}
+		return fclose(file) == 0;
+	}
+
+	// Largest difference of two attribute arrays, infinite if their sizes differ
+	float GetMaxDifference(const std::vector<tinyobj::real_t>& a, const std::vector<tinyobj::real_t>& b)
+	{
+		if (a.size() != b.size())
+			return INFINITY;
+
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < a.size(); ++i)
+			maxDifference = std::max(maxDifference, fabsf(a[i] - b[i]));
+		return maxDifference;
+	}
+
+	// Face corners of all shapes in file order
+	std::vector<tinyobj::index_t> GetCorners(const std::vector<tinyobj::shape_t>& shapes)
+	{
+		std::vector<tinyobj::index_t> corners;
+		for (size_t s = 0; s < shapes.size(); ++s)
+			corners.insert(corners.end(), shapes[s].mesh.indices.begin(), shapes[s].mesh.indices.end());
+		return corners;
+	}
+
+	// Parses fileName with tinyobj and ObjParser, prints the fastest time of both and
+	// returns false if ObjParser fails or gives other attributes or corners
+	bool BenchmarkObjParse(const std::string& fileName, const std::string& label)
+	{
+		std::error_code error;
+		double megabytes = fs::file_size(fileName, error) / (1024.0 * 1024.0);
+		std::string baseDir = fs::path(fileName).parent_path().string() + (char)fs::path::preferred_separator;
+
+		tinyobj::attrib_t attribs[2];
+		std::vector<tinyobj::shape_t> shapes[2];
+		std::vector<tinyobj::material_t> materials[2];
+		double milliseconds[2] = { 1e30, 1e30 };
+		bool parsed[2] = { true, true };
+		for (UINT i = 0; i < PARSE_ITERATIONS; ++i)
+		{
+			for (UINT p = 0; p < 2; ++p)
+			{
+				attribs[p] = tinyobj::attrib_t();
+				shapes[p].clear();
+				materials[p].clear();
+				std::string err;
+
+				auto start = std::chrono::high_resolution_clock::now();
+				if (p == PARSER_TINYOBJ)
+					parsed[p] = tinyobj::LoadObj(&attribs[p], &shapes[p], &materials[p], &err, fileName.c_str(), baseDir.c_str());
+				else
+					parsed[p] = ObjParser().Parse(fileName, baseDir, attribs[p], shapes[p], materials[p], err);
+				milliseconds[p] = std::min(milliseconds[p], GetMilliseconds(start));
+			}
+		}
+
+		float maxDifference = std::max(GetMaxDifference(attribs[0].vertices, attribs[1].vertices),
+			std::max(GetMaxDifference(attribs[0].normals, attribs[1].normals), GetMaxDifference(attribs[0].texcoords, attribs[1].texcoords)));
+		std::vector<tinyobj::index_t> corners[2] = { GetCorners(shapes[0]), GetCorners(shapes[1]) };
+		bool sameCorners = corners[0].size() == corners[1].size();
+		for (size_t i = 0; i < corners[0].size() && sameCorners; ++i)
+		{
+			sameCorners = corners[0][i].vertex_index == corners[1][i].vertex_index &&
+				corners[0][i].normal_index == corners[1][i].normal_index && corners[0][i].texcoord_index == corners[1][i].texcoord_index;
+		}
+		// both parse the same decimal text, they may round the last bit differently
+		bool passed = parsed[0] && parsed[1] && sameCorners && maxDifference <= 1e-6f;
+
+		std::cout << std::fixed << std::setprecision(1) << label << ", " << megabytes << " MB, " << attribs[0].vertices.size() / 3 << " vertices, "
+			<< corners[0].size() / 3 << " triangles, fastest of " << PARSE_ITERATIONS << "\n";
+		for (UINT p = 0; p < 2; ++p)
+		{
+			std::cout << "  " << std::left << std::setw(10) << GetParserName((ObjParserType)p) << std::right << std::setw(10)
+				<< milliseconds[p] << " ms" << std::setw(10) << megabytes / (milliseconds[p] / 1000.0) << " MB/s\n";
+		}
+		std::cout << "  ObjParser " << std::setprecision(2) << milliseconds[0] / milliseconds[1] << "x of tinyobj, "
+			<< (passed ? "same output" : "FAILED, the output differs from tinyobj") << "\n";
+		return passed;
+	}
+
+	// A camera pose of the culling tests and the counts MeshletCuller has to give
+	struct CullPose
+	{
+		const char* name;
+		XMFLOAT3 eye;
+		XMFLOAT3 at;
+		float farPlane;
+		bool coneCulling;
+		UINT visible;
+		UINT frustumCulled;
+		UINT coneCulled;
+		UINT ranges;
+	};
+
+	// Unit spheres in rows of CULL_GRID_SIZE along x, the rows along z from -45 to 45. Every
+	// meshlet is 3 indices after the previous one, the even rows face -z and the odd rows +z
+	// in a 60 degree cone.
+	std::vector<Meshlet> CreateMeshletGrid()
+	{
+		std::vector<Meshlet> meshlets;
+		for (UINT row = 0; row < CULL_GRID_SIZE; ++row)
+		{
+			for (UINT column = 0; column < CULL_GRID_SIZE; ++column)
+			{
+				Meshlet meshlet;
+				meshlet.indexStart = (UINT)meshlets.size() * 3;
+				meshlet.indexCount = 3;
+				meshlet.bounds = BoundingSphere(XMFLOAT3(column * 10.0f - 45.0f, 0.0f, row * 10.0f - 45.0f), 1.0f);
+				meshlet.coneAxis = XMFLOAT3(0.0f, 0.0f, row % 2 == 0 ? -1.0f : 1.0f);
+				meshlet.coneCutoff = 0.5f;
+				meshlets.push_back(meshlet);
+			}
+		}
+		return meshlets;
+	}
+
+	XMMATRIX GetViewMatrix(const XMFLOAT3& eye, const XMFLOAT3& at)
+	{
+		return XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&at), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	}
+
+	// True if a corner of the triangles of meshlet is inside the clip volume of worldViewProj
+	bool HasCornerInFrustum(const MeshData& meshData, const Meshlet& meshlet, CXMMATRIX worldViewProj)
+	{
+		for (UINT i = meshlet.indexStart; i < meshlet.indexStart + meshlet.indexCount; ++i)
+		{
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&meshData.Vertices[meshData.Indices[i]].Position), worldViewProj));
+			if (fabsf(clip.x) <= clip.w && fabsf(clip.y) <= clip.w && clip.z >= 0.0f && clip.z <= clip.w)
+				return true;
+		}
+		return false;
+	}
+
+	// True if a triangle of meshlet faces the camera, normals as MeshletBuilder builds the cones
+	bool HasFrontFacingTriangle(const MeshData& meshData, const Meshlet& meshlet, const XMFLOAT3& camera)
+	{
+		for (UINT i = meshlet.indexStart; i + 2 < meshlet.indexStart + meshlet.indexCount; i += 3)
+		{
+			const XMFLOAT3& a = meshData.Vertices[meshData.Indices[i]].Position;
+			const XMFLOAT3& b = meshData.Vertices[meshData.Indices[i + 1]].Position;
+			const XMFLOAT3& c = meshData.Vertices[meshData.Indices[i + 2]].Position;
+			XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+			XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+			XMFLOAT3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+			if (n.x * (camera.x - a.x) + n.y * (camera.y - a.y) + n.z * (camera.z - a.z) > 0.0f)
+				return true;
+		}
+		return false;
+	}
+
+	// Encodes count values with encode, decodes them with the current MeshCodec decoder
+	// and compares byte for byte, a truncated encoding has to fail
+	template <typename T, typename Encode, typename Decode>
+	bool RoundTrip(const T* values, size_t count, Encode encode, Decode decode)
+	{
+		std::vector<BYTE> encoded;
+		encode(values, count, encoded);
+
+		// one extra element that must not be written
+		std::vector<T> decoded(count + 1);
+		memset((void*)&decoded[0], 0xcd, sizeof(T) * decoded.size());
+		std::vector<BYTE> guard((const BYTE*)&decoded[count], (const BYTE*)&decoded[count] + sizeof(T));
+		if (!decode(encoded.data(), encoded.size(), &decoded[0], count) ||
+			(count > 0 && memcmp(values, &decoded[0], sizeof(T) * count) != 0) ||
+			memcmp(&guard[0], &decoded[count], sizeof(T)) != 0)
+		{
+			return false;
+		}
+		return encoded.empty() || !decode(encoded.data(), encoded.size() - 1, &decoded[0], count);
+	}
+
+	// Runs function at least CODEC_BENCHMARK_MILLISECONDS and returns the MB/s of bytes per run
+	template <typename Function>
+	double MeasureMegabytesPerSecond(size_t bytes, Function function)
+	{
+		UINT runs = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		double milliseconds = 0.0;
+		do
+		{
+			function();
+			runs++;
+			milliseconds = GetMilliseconds(start);
+		} while (milliseconds < CODEC_BENCHMARK_MILLISECONDS);
+		return (double)bytes * runs / (1024.0 * 1024.0) / (milliseconds / 1000.0);
+	}
+
+	// True if every index of meshData points at a vertex
+	bool HasValidIndices(const MeshData& meshData)
+	{
+		for (size_t i = 0; i < meshData.Indices.size(); ++i)
+		{
+			if (meshData.Indices[i] >= meshData.Vertices.size())
+				return false;
+		}
+		return true;
+	}
+}
+
+MeshTests::MeshTests(const std::string& assetDirectory) : mDirectory(assetDirectory)
+{
+}
+
+bool MeshTests::Run()
+{
+	bool passed = TestObjWelding();
+	passed = TestObjParser() && passed;
+	passed = TestMeshletCulling() && passed;
+	passed = TestMeshCodec() && passed;
+	passed = TestMeshOptimizer() && passed;
+	passed = TestMeshStreaming() && passed;
+
+	std::cout << (passed ? "all mesh tests passed\n" : "mesh tests FAILED\n");
+	return passed;
+}
+
+bool MeshTests::TestObjWelding()
+{
+	bool passed = true;
+
+	// Two shapes, the indices of the second continue the first and it uses the position
+	// of corner 3 without a texcoord, so 4 + 4 vertices
+	std::error_code error;
+	std::string testFile = (fs::temp_directory_path(error) / "AssetCooker_weld.obj").string();
+	{
+		std::ofstream out(testFile, std::ios::out | std::ios::trunc);
+		out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\nv 1 0 1\nv 1 1 1\n"
+			"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n"
+			"g first\nf 1/1/1 2/2/1 3/3/1\nf 1/1/1 3/3/1 4/4/1\n"
+			"g second\nf 5//1 6//1 7//1\nf 5//1 7//1 3//1\n";
+	}
+
+	const ObjParserType parsers[] = { PARSER_TINYOBJ, PARSER_OBJPARSER };
+	std::vector<std::array<float, 9> > teapotTriangles;
+	for (size_t p = 0; p < ARRAYSIZE(parsers); ++p)
+	{
+		MeshData meshData;
+		bool loaded = LoadObj(testFile, parsers[p], meshData);
+		bool welded = loaded && meshData.Vertices.size() == 8 && meshData.Lods[0].indexCount == 12 && HasValidIndices(meshData);
+		std::cout << "weld test, " << GetParserName(parsers[p]) << ": " << (loaded ? meshData.Vertices.size() : 0) << " vertices, "
+			<< (loaded ? meshData.Lods[0].indexCount : 0) << " indices, " << (welded ? "ok" : "FAILED, expected 8 vertices, 12 indices") << "\n";
+		passed = passed && welded;
+
+		std::string teapotFile = (fs::path(mDirectory) / "teapot.obj").string();
+		loaded = LoadObj(teapotFile, parsers[p], meshData);
+		welded = loaded && meshData.Vertices.size() == TEAPOT_VERTICES && meshData.Lods[0].indexCount == TEAPOT_INDICES && HasValidIndices(meshData);
+
+		// both parsers give the same triangles
+		std::vector<std::array<float, 9> > triangles = GetTrianglePositions(meshData);
+		if (p == 0)
+			teapotTriangles.swap(triangles);
+		else
+			welded = welded && triangles == teapotTriangles;
+
+		std::cout << "teapot.obj, " << GetParserName(parsers[p]) << ": " << (loaded ? meshData.Vertices.size() : 0) << " vertices, "
+			<< (loaded ? meshData.Lods[0].indexCount : 0) << " indices, " << (welded ? "ok" : "FAILED") << "\n";
+		if (!welded)
+		{
+			std::cout << "  expected " << TEAPOT_VERTICES << " vertices and " << TEAPOT_INDICES << " indices"
+				<< (p > 0 ? " and the triangles of tinyobj" : "") << "\n";
+		}
+		passed = passed && welded;
+		if (!loaded)
+			continue;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (UINT i = 0; i < LOAD_ITERATIONS; ++i)
+			LoadObj(teapotFile, parsers[p], meshData);
+		std::cout << "  load " << std::fixed << std::setprecision(2) << GetMilliseconds(start) / LOAD_ITERATIONS << " ms average of "
+			<< LOAD_ITERATIONS << " uncached loads\n";
+	}
+
+	fs::remove(testFile, error);
+	return passed;
+}
+
+bool MeshTests::TestObjParser()
+{
+	bool passed = true;
+	std::error_code error;
+	fs::path tempDirectory = fs::temp_directory_path(error);
+
+	// Relative indices resolve from the elements before the face, the files with
+	// one going past the first position, texcoord or normal do not parse
+	const char* faceTests[][2] =
+	{
+		{ "f -3/-3/-1 -2/-2/-1 -1/-1/-1\n", "1" },
+		{ "f -3 -2 -1\nf -4 -3 -2\n", "0" },
+		{ "f -3/-4/-1 -2/-2/-1 -1/-1/-1\n", "0" },
+		{ "f -3/-3/-2 -2/-2/-1 -1/-1/-1\n", "0" },
+		{ "f -3//-5 -2//-1 -1//-1\n", "0" },
+	};
+	std::string testFile = (tempDirectory / "AssetCooker_indices.obj").string();
+	for (size_t t = 0; t < ARRAYSIZE(faceTests); ++t)
+	{
+		{
+			std::ofstream out(testFile, std::ios::out | std::ios::trunc);
+			out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvn 0 0 1\n" << faceTests[t][0];
+		}
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string err;
+		bool parsed = ObjParser().Parse(testFile, tempDirectory.string(), attrib, shapes, materials, err);
+		bool expected = parsed == (faceTests[t][1][0] == '1');
+		if (!expected)
+		{
+			std::string face = faceTests[t][0];
+			std::cout << "relative indices \"" << face.substr(0, face.size() - 1) << "\" " << (parsed ? "parsed" : "rejected") << ", FAILED\n";
+		}
+		passed = passed && expected;
+	}
+	fs::remove(testFile, error);
+	std::cout << "relative indices: " << (passed ? "ok" : "FAILED") << "\n";
+
+	std::string gridFile = (tempDirectory / "AssetCooker_grid.obj").string();
+	if (!WriteGridObj(gridFile, PARSE_GRID_SIZE))
+	{
+		std::cout << "could not write " << gridFile << "\n";
+		return false;
+	}
+	passed = BenchmarkObjParse(gridFile, "generated grid") && passed;
+	fs::remove(gridFile, error);
+
+	passed = BenchmarkObjParse((fs::path(mDirectory) / "teapot.obj").string(), "teapot.obj") && passed;
+	return passed;
+}
+
+bool MeshTests::TestMeshletCulling()
+{
+	bool passed = true;
+	MeshletCuller* culler = MeshletCuller::Instance();
+	XMMATRIX world = XMMatrixIdentity();
+
+	// 90 degree field of view: from z = -100 the frustum is wider than the grid, the far
+	// plane at 100 cuts the grid between the rows at z = -5 and z = 5, at 95 it goes through
+	// the centers of the row at z = -5, which stays
+	const CullPose gridPoses[] =
+	{
+		{ "overview", XMFLOAT3(0.0f, 0.0f, -500.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), 1000.0f, true, 50, 0, 50, 5 },
+		{ "overview, no cones", XMFLOAT3(0.0f, 0.0f, -500.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), 1000.0f, false, 100, 0, 0, 1 },
+		{ "turned away", XMFLOAT3(0.0f, 0.0f, -500.0f), XMFLOAT3(0.0f, 0.0f, -1000.0f), 1000.0f, true, 0, 100, 0, 0 },
+		{ "near half", XMFLOAT3(0.0f, 0.0f, -100.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), 100.0f, true, 30, 50, 20, 3 },
+		{ "far plane through a row", XMFLOAT3(0.0f, 0.0f, -100.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), 95.0f, true, 30, 50, 20, 3 },
+		{ "from above", XMFLOAT3(0.0f, 100.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), 1000.0f, true, 100, 0, 0, 1 },
+	};
+	std::vector<Meshlet> grid = CreateMeshletGrid();
+	std::vector<DrawRange> ranges;
+	for (size_t p = 0; p < ARRAYSIZE(gridPoses); ++p)
+	{
+		const CullPose& pose = gridPoses[p];
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(M_PI / 2.0f, 1.0f, 1.0f, pose.farPlane);
+		MeshletCullStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+
+		culler->SetConeCulling(pose.coneCulling);
+		UINT visible = culler->Cull(&grid[0], grid.size(), world, GetViewMatrix(pose.eye, pose.at), proj, ranges, stats);
+		bool expected = visible == pose.visible && stats.frustumCulled == pose.frustumCulled && stats.coneCulled == pose.coneCulled &&
+			ranges.size() == pose.ranges && stats.meshletCount == grid.size() && stats.trianglesDrawn == visible;
+
+		std::cout << "meshlet grid, " << pose.name << ": " << visible << " visible, " << stats.frustumCulled << " frustum culled, "
+			<< stats.coneCulled << " cone culled, " << ranges.size() << " ranges, " << (expected ? "ok" : "FAILED") << "\n";
+		if (!expected)
+		{
+			std::cout << "  expected " << pose.visible << " visible, " << pose.frustumCulled << " frustum culled, "
+				<< pose.coneCulled << " cone culled, " << pose.ranges << " ranges\n";
+		}
+		passed = passed && expected;
+	}
+	culler->SetConeCulling(true);
+
+	// teapot.obj from around, no culled meshlet may have a corner in view or a triangle facing the camera
+	MeshData meshData;
+	if (!LoadObj((fs::path(mDirectory) / "teapot.obj").string(), PARSER_TINYOBJ, meshData) || meshData.Meshlets.empty())
+	{
+		std::cout << "teapot.obj: no meshlets, FAILED\n";
+		return false;
+	}
+
+	XMFLOAT3 center = meshData.bounds.Center;
+	float radius = sqrtf(meshData.bounds.Extents.x * meshData.bounds.Extents.x + meshData.bounds.Extents.y * meshData.bounds.Extents.y +
+		meshData.bounds.Extents.z * meshData.bounds.Extents.z);
+	MeshletCullStats total;
+	ZeroMemory(&total, sizeof(total));
+	UINT wrongCulls = 0;
+	const UINT teapotPoses = 16;
+	for (UINT p = 0; p < teapotPoses; ++p)
+	{
+		// every second pose close enough and aimed off center so the frustum cuts the mesh
+		float angle = 2.0f * M_PI * p / teapotPoses;
+		float distance = radius * (p % 2 == 0 ? 3.0f : 1.5f);
+		XMFLOAT3 eye(center.x + distance * sinf(angle), center.y + radius * 0.5f, center.z - distance * cosf(angle));
+		float aside = p % 2 == 0 ? 0.0f : radius * 3.0f;
+		XMFLOAT3 at(center.x + aside * cosf(angle), center.y, center.z + aside * sinf(angle));
+		XMMATRIX view = GetViewMatrix(eye, at);
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(M_PI / 3.0f, 16.0f / 9.0f, radius * 0.05f, radius * 10.0f);
+
+		MeshletCullStats stats;
+		ZeroMemory(&stats, sizeof(stats));
+		culler->Cull(&meshData.Meshlets[0], meshData.Meshlets.size(), world, view, proj, ranges, stats);
+
+		// the culled meshlets are the ones outside the emitted ranges
+		std::vector<bool> drawn(meshData.Meshlets.size(), false);
+		for (size_t m = 0; m < meshData.Meshlets.size(); ++m)
+		{
+			for (size_t r = 0; r < ranges.size() && !drawn[m]; ++r)
+			{
+				drawn[m] = meshData.Meshlets[m].indexStart >= ranges[r].indexStart &&
+					meshData.Meshlets[m].indexStart < ranges[r].indexStart + ranges[r].indexCount;
+			}
+			if (!drawn[m] && (HasCornerInFrustum(meshData, meshData.Meshlets[m], world * view * proj) &&
+				HasFrontFacingTriangle(meshData, meshData.Meshlets[m], eye)))
+			{
+				wrongCulls++;
+			}
+		}
+
+		total.meshletCount += stats.meshletCount;
+		total.frustumCulled += stats.frustumCulled;
+		total.coneCulled += stats.coneCulled;
+		total.triangleCount += stats.triangleCount;
+		total.trianglesDrawn += stats.trianglesDrawn;
+		total.drawCount += stats.drawCount;
+	}
+
+	bool teapotPassed = wrongCulls == 0 && total.frustumCulled > 0 && total.coneCulled > 0;
+	std::cout << "teapot.obj, " << meshData.Meshlets.size() << " meshlets from " << teapotPoses << " poses: " << total.frustumCulled
+		<< " frustum culled, " << total.coneCulled << " cone culled, " << total.trianglesDrawn << " of " << total.triangleCount
+		<< " triangles in " << total.drawCount << " ranges, " << wrongCulls << " culled with a visible triangle, "
+		<< (teapotPassed ? "ok" : "FAILED") << "\n";
+	return passed && teapotPassed;
+}
+
+bool MeshTests::TestMeshCodec()
+{
+	MeshCodec* codec = MeshCodec::Instance();
+	auto encodeIndices = [codec](const UINT* indices, size_t count, std::vector<BYTE>& encoded) { codec->EncodeIndices(indices, count, encoded); };
+	auto decodeIndices = [codec](const BYTE* data, size_t size, UINT* indices, size_t count) { return codec->DecodeIndices(data, size, indices, count); };
+	auto encodeVertices = [codec](const Vertex* vertices, size_t count, std::vector<BYTE>& encoded) { codec->EncodeVertices(vertices, count, encoded); };
+	auto decodeVertices = [codec](const BYTE* data, size_t size, Vertex* vertices, size_t count) { return codec->DecodeVertices(data, size, vertices, count); };
+
+	bool hadSimd = codec->GetUseSimd();
+	std::vector<bool> decoders(1, false);
+	if (codec->HasSimdDecode())
+		decoders.push_back(true);
+	else
+		std::cout << "MeshCodec: no SSSE3 on this CPU, only the scalar decoder is tested\n";
+
+	const char* meshes[] = { "teapot.obj", "cube/cube.obj" };
+	bool passed = true;
+	for (size_t m = 0; m < ARRAYSIZE(meshes); ++m)
+	{
+		MeshData meshData;
+		if (!LoadObj((fs::path(mDirectory) / meshes[m]).string(), PARSER_TINYOBJ, meshData) || meshData.Indices.empty())
+		{
+			std::cout << meshes[m] << ": could not load, FAILED\n";
+			passed = false;
+			continue;
+		}
+		const UINT* indices = &meshData.Indices[0];
+		const Vertex* vertices = &meshData.Vertices[0];
+		size_t indexCount = meshData.Indices.size(), vertexCount = meshData.Vertices.size();
+
+		// every group of 4 tail length and a few odd counts, then the whole buffers
+		std::vector<size_t> counts;
+		for (size_t count = 0; count <= 16; ++count)
+			counts.push_back(count);
+		counts.push_back(127);
+		counts.push_back(1001);
+		counts.push_back(std::max(indexCount, vertexCount) - 1);
+		counts.push_back(std::max(indexCount, vertexCount));
+
+		std::vector<BYTE> encodedIndices, encodedVertices;
+		codec->EncodeIndices(indices, indexCount, encodedIndices);
+		codec->EncodeVertices(vertices, vertexCount, encodedVertices);
+		size_t indexBytes = indexCount * sizeof(UINT), vertexBytes = vertexCount * sizeof(Vertex);
+
+		std::cout << meshes[m] << ", " << indexCount << " indices " << std::fixed << std::setprecision(2)
+			<< (double)indexBytes / encodedIndices.size() << ":1, " << vertexCount << " vertices "
+			<< (double)vertexBytes / encodedVertices.size() << ":1\n";
+
+		std::vector<UINT> decodedIndices(indexCount);
+		std::vector<Vertex> decodedVertices(vertexCount);
+		std::cout << "  encode" << std::setprecision(0) << std::setw(10) << MeasureMegabytesPerSecond(indexBytes, [&]() { codec->EncodeIndices(indices, indexCount, encodedIndices); })
+			<< " MB/s indices" << std::setw(10) << MeasureMegabytesPerSecond(vertexBytes, [&]() { codec->EncodeVertices(vertices, vertexCount, encodedVertices); })
+			<< " MB/s vertices\n";
+
+		for (size_t d = 0; d < decoders.size(); ++d)
+		{
+			codec->SetUseSimd(decoders[d]);
+
+			bool exact = true;
+			for (size_t c = 0; c < counts.size(); ++c)
+			{
+				if (counts[c] <= indexCount && !RoundTrip(indices, counts[c], encodeIndices, decodeIndices))
+				{
+					std::cout << "  " << counts[c] << " indices do not round trip\n";
+					exact = false;
+				}
+				if (counts[c] <= vertexCount && !RoundTrip(vertices, counts[c], encodeVertices, decodeVertices))
+				{
+					std::cout << "  " << counts[c] << " vertices do not round trip\n";
+					exact = false;
+				}
+			}
+
+			std::cout << "  decode " << (decoders[d] ? "SSSE3 " : "scalar") << std::setw(8)
+				<< MeasureMegabytesPerSecond(indexBytes, [&]() { codec->DecodeIndices(encodedIndices.data(), encodedIndices.size(), &decodedIndices[0], indexCount); })
+				<< " MB/s indices" << std::setw(10)
+				<< MeasureMegabytesPerSecond(vertexBytes, [&]() { codec->DecodeVertices(encodedVertices.data(), encodedVertices.size(), &decodedVertices[0], vertexCount); })
+				<< " MB/s vertices, " << (exact ? "byte exact" : "FAILED") << "\n";
+			passed = passed && exact;
+		}
+	}
+
+	codec->SetUseSimd(hadSimd);
+	return passed;
+}
+
+bool MeshTests::TestMeshOptimizer()
+{
+	MeshData loaded;
+	if (!LoadObj((fs::path(mDirectory) / "teapot.obj").string(), PARSER_TINYOBJ, loaded) || loaded.Lods.empty())
+	{
+		std::cout << "teapot.obj: could not be loaded, FAILED\n";
+		return false;
+	}
+
+	// LOD 0 in the order it is drawn, the meshlets regroup the triangles after the load time optimization
+	const MeshLod& lod = loaded.Lods[0];
+	MeshData teapot;
+	teapot.Vertices = loaded.Vertices;
+	teapot.Indices.assign(loaded.Indices.begin() + lod.indexStart, loaded.Indices.begin() + lod.indexStart + lod.indexCount);
+	MeshLod teapotLod = { 0, lod.indexCount, 0.0f, 0, 0 };
+	teapot.Lods.push_back(teapotLod);
+
+	// the same triangles in a random order, seeded so every run checks the same one
+	MeshData shuffled = teapot;
+	std::vector<UINT> triangles(teapot.Indices.size() / 3);
+	std::iota(triangles.begin(), triangles.end(), 0);
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(OPTIMIZER_SHUFFLE_SEED));
+	for (size_t t = 0; t < triangles.size(); ++t)
+	{
+		for (UINT c = 0; c < 3; ++c)
+			shuffled.Indices[t * 3 + c] = teapot.Indices[triangles[t] * 3 + c];
+	}
+
+	const MeshData* inputs[] = { &teapot, &shuffled };
+	const char* names[] = { "teapot.obj", "teapot.obj shuffled" };
+	bool passed = true;
+	MeshOptimizer* optimizer = MeshOptimizer::Instance();
+	for (size_t i = 0; i < ARRAYSIZE(inputs); ++i)
+	{
+		MeshData meshData = *inputs[i];
+		VertexCacheStats before = optimizer->AnalyzeVertexCache(&meshData.Indices[0], meshData.Indices.size(), meshData.Vertices.size());
+		optimizer->Optimize(meshData);
+		VertexCacheStats after = optimizer->AnalyzeVertexCache(&meshData.Indices[0], meshData.Indices.size(), meshData.Vertices.size());
+
+		// fewer vertices transformed per triangle and per vertex, from the same triangles
+		bool improved = after.acmr < before.acmr && after.atvr <= before.atvr;
+		bool sameTriangles = GetTrianglePositions(meshData) == GetTrianglePositions(*inputs[i]);
+
+		std::cout << std::fixed << std::setprecision(3) << names[i] << ": ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr << " (cache size " << MeshOptimizer::mDefaultCacheSize << "), "
+			<< (improved && sameTriangles ? "ok" : "FAILED") << "\n";
+		if (!sameTriangles)
+			std::cout << "  the optimized index buffer does not draw the same triangles\n";
+		passed = passed && improved && sameTriangles;
+	}
+	return passed;
+}
+
+bool MeshTests::TestMeshStreaming()
+{
+	// the loader settings of SceneManager
+	ObjLoader* loader = ObjLoader::Instance();
+	loader->SetUseMeshCache(false);
+	loader->SetQuantizeVertices(true);
+
+	MeshStreamer* streamer = MeshStreamer::Instance();
+	StaticBatcher* batcher = StaticBatcher::Instance();
+	float cellSize = batcher->GetCellSize();
+	UINT64 uploadBudget = streamer->GetUploadBudget();
+	batcher->Clear();
+	batcher->SetCellSize(STREAM_CELL_SIZE);
+	streamer->SetUploadBudget(STREAM_UPLOAD_BUDGET);
+	streamer->Init();
+	streamer->ResetStats();
+
+	std::string teapotFile = (fs::path(mDirectory) / "teapot.obj").string();
+	std::string baseDir = mDirectory + (char)fs::path::preferred_separator;
+	std::map<UINT, XMFLOAT4X4> placements;
+	for (UINT z = 0; z < STREAM_GRID_SIZE; ++z)
+	{
+		for (UINT x = 0; x < STREAM_GRID_SIZE; ++x)
+			XMStoreFloat4x4(&placements[streamer->RequestMesh(teapotFile, baseDir)], XMMatrixTranslation(10.0f * x, 0.0f, 10.0f * z));
+	}
+
+	// The render loop of SceneManager::Update: the static meshes go into the batcher, once
+	// all are in the cells are built on the workers, a batch is copied like Mesh::Create does
+	UINT pendingStatics = (UINT)placements.size();
+	std::set<UINT> pendingBatches;
+	UINT batchCount = 0, batchTriangles = 0, failed = 0;
+	UINT64 largestMesh = 0;
+	std::vector<BYTE> uploaded;
+	double worstRenderMilliseconds = 0.0;
+	float frameTime = 0.0f;
+	UINT frame = 0;
+	for (; frame < STREAM_MAX_FRAMES && (pendingStatics > 0 || batcher->GetMeshCount() > 0 || !pendingBatches.empty()); ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<StreamedMesh> ready;
+		streamer->Update(frameTime, ready);
+		for (size_t i = 0; i < ready.size(); ++i)
+		{
+			const MeshData& meshData = ready[i].meshData;
+			largestMesh = std::max(largestMesh, MeshStreamer::GetUploadBytes(meshData));
+			failed += ready[i].loaded ? 0 : 1;
+
+			auto placement = placements.find(ready[i].request);
+			if (placement != placements.end())
+			{
+				pendingStatics--;
+				if (ready[i].loaded)
+					batcher->Add(meshData, meshData.world * XMLoadFloat4x4(&placement->second));
+				continue;
+			}
+
+			pendingBatches.erase(ready[i].request);
+			if (!ready[i].loaded)
+				continue;
+			batchCount++;
+			batchTriangles += meshData.Lods[0].indexCount / 3;
+
+			const BYTE* vertices = meshData.PackedVertices.empty() ? (const BYTE*)meshData.Vertices.data() : (const BYTE*)meshData.PackedVertices.data();
+			size_t vertexBytes = meshData.PackedVertices.empty() ? meshData.Vertices.size() * sizeof(Vertex) : meshData.PackedVertices.size() * sizeof(PackedVertex);
+			uploaded.assign(vertices, vertices + vertexBytes);
+			uploaded.insert(uploaded.end(), (const BYTE*)meshData.Indices.data(), (const BYTE*)(meshData.Indices.data() + meshData.Indices.size()));
+		}
+
+		if (pendingStatics == 0 && batcher->GetMeshCount() > 0)
+		{
+			std::vector<StaticBatchCell> cells;
+			batcher->TakeCells(cells);
+			for (size_t i = 0; i < cells.size(); ++i)
+			{
+				std::shared_ptr<StaticBatchCell> cell = std::make_shared<StaticBatchCell>(std::move(cells[i]));
+				pendingBatches.insert(streamer->RequestBuild("static batch " + std::to_string(cell->index),
+					[cell](MeshData& batch) { StaticBatcher::BuildCell(*cell, batch); return true; }));
+			}
+		}
+
+		worstRenderMilliseconds = std::max(worstRenderMilliseconds, GetMilliseconds(start));
+		std::this_thread::sleep_until(start + std::chrono::duration<double, std::milli>(STREAM_FRAME_MILLISECONDS));
+		frameTime = (float)(GetMilliseconds(start) / 1000.0);
+	}
+
+	// the frame of the last upload is measured by the next Update
+	std::vector<StreamedMesh> ready;
+	streamer->Update(frameTime, ready);
+	MeshStreamStats stats = streamer->GetStats();
+
+	streamer->Release();
+	batcher->Clear();
+	batcher->SetCellSize(cellSize);
+	streamer->SetUploadBudget(uploadBudget);
+	loader->SetQuantizeVertices(false);
+
+	UINT teapotCount = STREAM_GRID_SIZE * STREAM_GRID_SIZE;
+	bool complete = frame < STREAM_MAX_FRAMES && failed == 0 && stats.completed == stats.requested && batchTriangles == teapotCount * TEAPOT_INDICES / 3;
+	bool inBudget = largestMesh <= STREAM_UPLOAD_BUDGET && stats.maxFrameUploadBytes <= STREAM_UPLOAD_BUDGET;
+	bool noHitch = stats.worstFrameTime * 1000.0 <= STREAM_WORST_FRAME_MILLISECONDS;
+
+	std::cout << "streaming " << teapotCount << " static teapots and " << batchCount << " batches of " << batchTriangles << " triangles in "
+		<< frame << " frames, " << (complete ? "ok" : "FAILED") << "\n";
+	if (!complete)
+		std::cout << "  expected every mesh within " << STREAM_MAX_FRAMES << " frames and " << teapotCount * TEAPOT_INDICES / 3 << " batched triangles\n";
+	std::cout << "  most upload " << stats.maxFrameUploadBytes / 1024 << " KB per frame, budget " << STREAM_UPLOAD_BUDGET / 1024
+		<< " KB, largest mesh " << largestMesh / 1024 << " KB, " << (inBudget ? "ok" : "FAILED") << "\n";
+	std::cout << "  worst frame " << std::fixed << std::setprecision(1) << stats.worstFrameTime * 1000.0f << " ms of at most "
+		<< STREAM_WORST_FRAME_MILLISECONDS << " ms in " << stats.streamingFrames << " streaming frames, render thread at most "
+		<< worstRenderMilliseconds << " ms, " << (noHitch ? "ok" : "FAILED") << "\n";
+	std::cout << "  latency max " << stats.maxLatency * 1000.0 << " ms, average "
+		<< (stats.completed > 0 ? stats.totalLatency / stats.completed * 1000.0 : 0.0) << " ms\n";
+
+	return complete && inBudget && noHitch;
+}
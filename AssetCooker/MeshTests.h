@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Util.h"
+
+// MeshTests
+// Headless checks and benchmarks of the mesh pipeline on the meshes of the asset
+// directory, run by AssetCooker --mesh-test. usage:
+// MeshTests tests(assetDirectory); return tests.Run() ? 0 : 1;
+//
+// The meshes are loaded from their sources with the mesh cache off, nothing is written
+// to the asset directory. Every test prints what it measured and fails on the first
+// check that does not hold, Run runs all of them.
+class MeshTests
+{
+public:
+	MeshTests(const std::string& assetDirectory);
+
+	// True if every test passed
+	bool Run();
+
+private:
+	// teapot.obj welds to its exact vertex and index counts with tinyobj and ObjParser,
+	// a generated two shape .obj welds its shared corners, then times the loads
+	bool TestObjWelding();
+
+	// ObjParser rejects relative indices before the first element, parses a generated
+	// multi-chunk .obj and teapot.obj like tinyobj and reports the MB/s of both
+	bool TestObjParser();
+
+	// MeshletCuller gives the exact visible, frustum and cone culled counts of a grid of
+	// meshlets from fixed camera poses, and culls no visible triangle of teapot.obj
+	bool TestMeshletCulling();
+
+	// MeshCodec decodes the buffers of the .obj meshes and of prefixes of every length
+	// up to 16 and a few odd ones byte exact with the scalar and the SSSE3 decoder,
+	// rejects truncated data and reports the ratio and MB/s of both
+	bool TestMeshCodec();
+
+	// MeshOptimizer lowers the ACMR and does not raise the ATVR of teapot.obj in its drawn
+	// order and in a shuffled order, and keeps its triangles
+	bool TestMeshOptimizer();
+
+	// MeshStreamer streams a grid of static teapots and their StaticBatcher cells into a
+	// render loop paced at 60 Hz, never hands out more than the upload budget in a frame
+	// unless a single mesh is larger, and no frame takes longer than two frames
+	bool TestMeshStreaming();
+
+	std::string mDirectory;
+};
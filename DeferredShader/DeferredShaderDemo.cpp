@@ -36,7 +36,10 @@
 #include "Renderer/Camera.h"
 #include "Renderer/GBuffer.h"
 #include "Renderer/SceneManager.h"
+#include "Renderer/MeshStreamer.h"
+#include "Renderer/TextureManager.h"
 #include "Renderer/LightManager.h"
+#include "Renderer/RenderBenchmark.h"
 #include "Renderer/Util.h"
 
 enum RENDER_STATE { BACKBUFFERRT, DEPTHRT, COLSPECRT, NORMALRT, SPECPOWRT };
@@ -126,6 +129,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// --render-benchmark times the SceneManager::Render submission without a window and
+	// prints into the console it was started from, in the working directory of the demo
+	if (strstr(cmdLine, "--render-benchmark") != NULL)
+	{
+		FILE* console = NULL;
+		if (AttachConsole(ATTACH_PARENT_PROCESS))
+			freopen_s(&console, "CONOUT$", "w", stdout);
+
+		RenderBenchmark benchmark;
+		return benchmark.Run() ? 0 : 1;
+	}
+
 	DeferredShaderApp shaderApp(hInstance);
 
 	if (!shaderApp.Init())
@@ -358,6 +373,9 @@ void DeferredShaderApp::Update(float dt)
 
 	mCamera->UpdateViewMatrix();
 
+	// add the meshes that finished streaming in
+	mSceneManager.Update(md3dDevice, dt);
+
 	if (GetAsyncKeyState(VK_F2) & 0x01)
 		mVisualizeGBuffer = !mVisualizeGBuffer;
 
@@ -415,7 +433,7 @@ void DeferredShaderApp::Render()
 	// Generate the shadow maps
 	while (mLightManager.PrepareNextShadowLight(md3dImmediateContext))
 	{
-		mSceneManager.RenderSceneNoShaders(md3dImmediateContext);
+		mSceneManager.RenderSceneNoShaders(md3dImmediateContext, &mLightManager);
 	}
 
 	// Restore the states
@@ -717,6 +735,76 @@ void DeferredShaderApp::RenderGUI()
 
 			}
 
+			if (ImGui::CollapsingHeader("Culling"))
+			{
+				bool meshletCulling = mSceneManager.GetMeshletCulling();
+				ImGui::Checkbox("Meshlet culling", &meshletCulling);
+				mSceneManager.SetMeshletCulling(meshletCulling);
+
+				const MeshletCullStats& cullStats = mSceneManager.GetMeshletCullStats();
+				ImGui::Text("Meshlets: %u", cullStats.meshletCount);
+				ImGui::Text("Frustum culled: %u", cullStats.frustumCulled);
+				ImGui::Text("Cone culled: %u", cullStats.coneCulled);
+				ImGui::Text("Triangles: %u / %u", cullStats.trianglesDrawn, cullStats.triangleCount);
+				ImGui::Text("Draw ranges: %u", cullStats.drawCount);
+
+				const SubmitStats& submitStats = mSceneManager.GetSubmitStats();
+				ImGui::Text("Draws: %u, %u material binds, %u texture binds", submitStats.draws, submitStats.materialBinds, submitStats.textureBinds);
+				ImGui::Text("Submission: %.2f ms CPU", submitStats.milliseconds);
+			}
+
+			if (ImGui::CollapsingHeader("Level of detail"))
+			{
+				float lodPixelError = mSceneManager.GetLodPixelError();
+				ImGui::SliderFloat("Max pixel error", &lodPixelError, 0.0f, 8.0f);
+				mSceneManager.SetLodPixelError(lodPixelError);
+
+				const LodStats& lodStats = mSceneManager.GetLodStats();
+				ImGui::Text("Scene triangles: %u / %u (%u saved)", lodStats.sceneTriangles, lodStats.sceneFullTriangles,
+					lodStats.sceneFullTriangles - lodStats.sceneTriangles);
+				ImGui::Text("Shadow triangles: %u / %u (%u saved)", lodStats.shadowTriangles, lodStats.shadowFullTriangles,
+					lodStats.shadowFullTriangles - lodStats.shadowTriangles);
+			}
+
+			if (ImGui::CollapsingHeader("Streaming"))
+			{
+				int uploadBudgetKB = (int)(MeshStreamer::Instance()->GetUploadBudget() / 1024);
+				ImGui::SliderInt("Upload KB / frame", &uploadBudgetKB, 0, 32 * 1024);
+				MeshStreamer::Instance()->SetUploadBudget((UINT64)uploadBudgetKB * 1024);
+
+				MeshStreamStats streamStats = MeshStreamer::Instance()->GetStats();
+				ImGui::Text("Meshes: %u / %u, %u pending, %u failed", streamStats.completed, streamStats.requested, streamStats.pending, streamStats.failed);
+				ImGui::Text("Uploaded: %.1f MB, max %.1f KB / frame", streamStats.uploadBytes / (1024.0 * 1024.0), streamStats.maxFrameUploadBytes / 1024.0);
+				ImGui::Text("Latency: max %.1f ms, avg %.1f ms", streamStats.maxLatency * 1000.0,
+					streamStats.completed > 0 ? streamStats.totalLatency / streamStats.completed * 1000.0 : 0.0);
+				ImGui::Text("Worst frame while streaming: %.1f ms", streamStats.worstFrameTime * 1000.0f);
+			}
+
+			if (ImGui::CollapsingHeader("Static batching"))
+			{
+				const StaticBatchStats& batchStats = mSceneManager.GetStaticBatchStats();
+				ImGui::Text("Meshes: %u, %u triangles, %u materials", batchStats.meshes, batchStats.triangles, batchStats.materials);
+				ImGui::Text("Cells: %u of %.0f units, %u built", batchStats.cells, StaticBatcher::Instance()->GetCellSize(), batchStats.cellsBuilt);
+				ImGui::Text("Draws: %u instead of %u", batchStats.batchDraws, batchStats.sourceDraws);
+			}
+
+			if (ImGui::CollapsingHeader("Textures"))
+			{
+				int budgetMB = (int)(TextureManager::Instance()->GetBudget() / (1024 * 1024));
+				ImGui::SliderInt("Budget MB", &budgetMB, 0, 2048);
+				TextureManager::Instance()->SetBudget((UINT64)budgetMB * 1024 * 1024);
+
+				TextureStats textureStats = TextureManager::Instance()->GetStats();
+				ImGui::Text("Requested: %u, created %u, failed %u, pending %u", textureStats.requested, textureStats.created, textureStats.failed, textureStats.pending);
+				ImGui::Text("Decoding: %.1f ms (worker threads)", textureStats.decodeMilliseconds);
+				ImGui::Text("Creating: %.1f ms (render thread)", textureStats.createMilliseconds);
+				ImGui::Text("Resident: %.1f MB, needed %.1f MB, mip bias %u", textureStats.residentBytes / (1024.0 * 1024.0),
+					textureStats.requestedBytes / (1024.0 * 1024.0), textureStats.mipBias);
+				ImGui::Text("Stream ins: %u, demotions %u", textureStats.streamIns, textureStats.demotions);
+				ImGui::Text("Stream in latency: last %.1f ms, max %.1f ms, avg %.1f ms", textureStats.lastStreamInLatency * 1000.0,
+					textureStats.maxStreamInLatency * 1000.0, textureStats.streamIns > 0 ? textureStats.totalStreamInLatency / textureStats.streamIns * 1000.0 : 0.0);
+			}
+
 			ImGui::Checkbox("FrameStats (F1)", &mShowRenderStats);
 			ImGui::Checkbox("Visualize Buffers (F2)", &mVisualizeGBuffer);
 			ImGui::Checkbox("Visualize ShadowMap (F3)", &mShowShadowMap);
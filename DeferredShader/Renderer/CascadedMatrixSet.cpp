@@ -155,6 +155,27 @@ void CascadedMatrixSet::Update(const XMVECTOR& directionalDir)
 	}
 }
 
+float CascadedMatrixSet::GetPixelsPerUnit(const BoundingSphere& worldSphere) const
+{
+	for (int iCascadeIdx = 0; iCascadeIdx < mTotalCascades; iCascadeIdx++)
+	{
+		XMFLOAT4X4 toCascade;
+		XMStoreFloat4x4(&toCascade, mArrWorldToCascadeProj[iCascadeIdx]);
+
+		// The cascade projection is orthographic with the same scale on x and y
+		float scale = sqrtf(toCascade._11 * toCascade._11 + toCascade._21 * toCascade._21 + toCascade._31 * toCascade._31);
+		Vector3 vCenterInCascade = XMVector3TransformCoord(XMLoadFloat3(&worldSphere.Center), mArrWorldToCascadeProj[iCascadeIdx]);
+		float radiusInCascade = worldSphere.Radius * scale;
+
+		if (abs(vCenterInCascade.x) - radiusInCascade <= 1.0f && abs(vCenterInCascade.y) - radiusInCascade <= 1.0f)
+		{
+			return 0.5f * mShadowMapSize * scale;
+		}
+	}
+
+	return 0.0f;
+}
+
 void CascadedMatrixSet::ExtractFrustumPoints(float fNear, float fFar, XMVECTOR* arrFrustumCorners)
 {
 	// Get the camera bases
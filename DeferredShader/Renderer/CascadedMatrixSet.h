@@ -1,6 +1,7 @@
 #pragma once
 
 #include "SimpleMath.h"
+#include <DirectXCollision.h>
 
 using namespace DirectX::SimpleMath;
 
@@ -23,6 +24,10 @@ public:
 	const XMFLOAT4 GetToCascadeOffsetY() const { return Vector4(mToCascadeOffsetY); }
 	const XMFLOAT4 GetToCascadeScale() const { return Vector4(mToCascadeScale); }
 
+	// Shadow map texels per world unit in the most detailed cascade that covers
+	// worldSphere, 0 if no cascade does
+	float GetPixelsPerUnit(const BoundingSphere& worldSphere) const;
+
 	static const int mTotalCascades = 3;
 
 private:
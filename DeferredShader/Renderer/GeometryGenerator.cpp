@@ -93,6 +93,8 @@ void GeometryGenerator::CreateBox(float width, float height, float depth, MeshDa
 	i[33] = 20; i[34] = 22; i[35] = 23;
 
 	meshData.Indices.assign(&i[0], &i[36]);
+
+	BoundingBox::CreateFromPoints(meshData.bounds, meshData.Vertices.size(), &meshData.Vertices[0].Position, sizeof(Vertex));
 }
 
 void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, MeshData& meshData)
@@ -148,4 +150,6 @@ void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, Mes
 			k += 6; // next quad
 		}
 	}
+
+	BoundingBox::CreateFromPoints(meshData.bounds, meshData.Vertices.size(), &meshData.Vertices[0].Position, sizeof(Vertex));
 }
@@ -0,0 +1,866 @@
+#include "GltfLoader.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshProcessor.h"
+#include "Parallel.h"
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cmath>
+#include <climits>
+
+namespace
+{
+	const UINT GLB_MAGIC = 0x46546C67;		// 'glTF'
+	const UINT GLB_CHUNK_JSON = 0x4E4F534A;	// 'JSON'
+	const UINT GLB_CHUNK_BIN = 0x004E4942;	// 'BIN\0'
+
+	const int COMPONENT_BYTE = 5120;
+	const int COMPONENT_UNSIGNED_BYTE = 5121;
+	const int COMPONENT_SHORT = 5122;
+	const int COMPONENT_UNSIGNED_SHORT = 5123;
+	const int COMPONENT_UNSIGNED_INT = 5125;
+	const int COMPONENT_FLOAT = 5126;
+
+	const int MODE_TRIANGLES = 4;
+
+	struct BufferData
+	{
+		const BYTE* data;
+		size_t size;
+	};
+
+	// Parsed JSON and the bytes of every buffer. .glb binary chunks and external
+	// .bin files stay memory mapped, only base64 data uris are decoded to memory.
+	struct GltfDocument
+	{
+		JsonValue root;
+		std::vector<BufferData> buffers;
+		std::vector<std::unique_ptr<MappedFile> > bufferFiles;
+		std::vector<std::vector<BYTE> > decodedBuffers;
+	};
+
+	// Typed view of an accessor inside its buffer
+	struct AccessorView
+	{
+		const BYTE* data;
+		size_t count;
+		size_t stride;
+		int componentType;
+		int componentCount;
+		bool normalized;
+	};
+
+	// One mesh primitive of one node, decoded into
+	// [vertexStart, vertexStart + vertexCount) and [indexStart, indexStart + indexCount)
+	struct PrimitiveJob
+	{
+		const JsonValue* primitive;
+		XMFLOAT4X4 transform;	// relative to MeshData::world
+		bool identity;
+		UINT materialId;
+		UINT vertexStart;
+		UINT vertexCount;
+		UINT indexStart;
+		UINT indexCount;
+		bool decoded;
+	};
+
+	size_t GetComponentSize(int componentType)
+	{
+		switch (componentType)
+		{
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE:
+			return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT:
+			return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	int GetComponentCount(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		if (type == "MAT2") return 4;
+		if (type == "MAT3") return 9;
+		if (type == "MAT4") return 16;
+		return 0;
+	}
+
+	std::string GetDirectory(const std::string& fileName)
+	{
+		size_t slash = fileName.find_last_of("\\/");
+		return slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+	}
+
+	// Relative uris may be percent encoded, e.g. "my%20texture.png"
+	std::string DecodeUri(const std::string& uri)
+	{
+		std::string result;
+		result.reserve(uri.size());
+		for (size_t i = 0; i < uri.size(); ++i)
+		{
+			if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2]))
+			{
+				result += (char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+				i += 2;
+			}
+			else
+			{
+				result += uri[i];
+			}
+		}
+		return result;
+	}
+
+	bool DecodeBase64(const char* text, size_t length, std::vector<BYTE>& out)
+	{
+		static signed char table[256];
+		static bool tableReady = false;
+		if (!tableReady)
+		{
+			const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			memset(table, -1, sizeof(table));
+			for (int i = 0; i < 64; ++i)
+				table[(unsigned char)alphabet[i]] = (signed char)i;
+			tableReady = true;
+		}
+
+		out.clear();
+		out.reserve(length / 4 * 3);
+
+		UINT bits = 0;
+		int bitCount = 0;
+		for (size_t i = 0; i < length; ++i)
+		{
+			unsigned char c = (unsigned char)text[i];
+			if (c == '=')
+				break;
+			if (table[c] < 0)
+				return false;
+
+			bits = (bits << 6) | (UINT)table[c];
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				out.push_back((BYTE)(bits >> bitCount));
+			}
+		}
+		return true;
+	}
+
+	bool LoadBuffers(const std::string& fileName, const BufferData& glbBinary, GltfDocument& doc)
+	{
+		const JsonValue& buffers = doc.root["buffers"];
+		doc.buffers.resize(buffers.GetSize());
+
+		for (size_t i = 0; i < buffers.GetSize(); ++i)
+		{
+			const JsonValue& buffer = buffers[i];
+			size_t byteLength = (size_t)buffer["byteLength"].GetNumber();
+			BufferData& data = doc.buffers[i];
+			data.data = NULL;
+			data.size = 0;
+
+			if (!buffer.Has("uri"))
+			{
+				// the first buffer of a .glb without uri is the binary chunk
+				if (i == 0 && glbBinary.data != NULL)
+				{
+					data = glbBinary;
+				}
+			}
+			else
+			{
+				const std::string& uri = buffer["uri"].GetString();
+				if (uri.compare(0, 5, "data:") == 0)
+				{
+					size_t comma = uri.find(";base64,");
+					if (comma == std::string::npos)
+					{
+						std::cerr << "GltfLoader: unsupported data uri in buffer " << i << " of " << fileName << std::endl;
+						return false;
+					}
+
+					doc.decodedBuffers.push_back(std::vector<BYTE>());
+					std::vector<BYTE>& decoded = doc.decodedBuffers.back();
+					if (!DecodeBase64(uri.c_str() + comma + 8, uri.size() - comma - 8, decoded))
+					{
+						std::cerr << "GltfLoader: invalid base64 in buffer " << i << " of " << fileName << std::endl;
+						return false;
+					}
+					data.data = decoded.empty() ? NULL : &decoded[0];
+					data.size = decoded.size();
+				}
+				else
+				{
+					std::unique_ptr<MappedFile> bufferFile(new MappedFile());
+					std::string bufferFileName = GetDirectory(fileName) + DecodeUri(uri);
+					if (!bufferFile->Open(bufferFileName))
+					{
+						std::cerr << "GltfLoader: could not open buffer " << bufferFileName << std::endl;
+						return false;
+					}
+					data.data = bufferFile->GetData();
+					data.size = bufferFile->GetSize();
+					doc.bufferFiles.push_back(std::move(bufferFile));
+				}
+			}
+
+			if (data.size < byteLength)
+			{
+				std::cerr << "GltfLoader: buffer " << i << " of " << fileName << " is smaller than its byteLength" << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Files of the buffers that are neither the .glb binary chunk nor data uris
+	void GetExternalBuffers(const std::string& fileName, const JsonValue& root, std::vector<std::string>& files)
+	{
+		const JsonValue& buffers = root["buffers"];
+		for (size_t i = 0; i < buffers.GetSize(); ++i)
+		{
+			const std::string& uri = buffers[i]["uri"].GetString();
+			if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+			{
+				files.push_back(GetDirectory(fileName) + DecodeUri(uri));
+			}
+		}
+	}
+
+	// Parses the JSON of a .gltf or .glb in place and sets up the buffers
+	bool ParseDocument(const std::string& fileName, const MappedFile& file, GltfDocument& doc, bool loadBuffers = true)
+	{
+		const BYTE* data = file.GetData();
+		size_t size = file.GetSize();
+
+		const char* json = (const char*)data;
+		size_t jsonLength = size;
+		BufferData glbBinary = { NULL, 0 };
+
+		UINT magic = 0;
+		if (size >= 4)
+			memcpy(&magic, data, 4);
+
+		if (magic == GLB_MAGIC)
+		{
+			// 12 byte header, then 8 byte chunk headers each followed by the chunk data
+			UINT header[3];
+			if (size < 20)
+			{
+				std::cerr << "GltfLoader: truncated .glb " << fileName << std::endl;
+				return false;
+			}
+			memcpy(header, data, sizeof(header));
+			if (header[1] != 2)
+			{
+				std::cerr << "GltfLoader: unsupported .glb version " << header[1] << " in " << fileName << std::endl;
+				return false;
+			}
+			size_t totalLength = std::min((size_t)header[2], size);
+
+			json = NULL;
+			size_t offset = 12;
+			while (offset + 8 <= totalLength)
+			{
+				UINT chunk[2];
+				memcpy(chunk, data + offset, sizeof(chunk));
+				offset += 8;
+				if (offset + chunk[0] > totalLength)
+					break;
+
+				if (chunk[1] == GLB_CHUNK_JSON && json == NULL)
+				{
+					json = (const char*)data + offset;
+					jsonLength = chunk[0];
+				}
+				else if (chunk[1] == GLB_CHUNK_BIN && glbBinary.data == NULL)
+				{
+					glbBinary.data = data + offset;
+					glbBinary.size = chunk[0];
+				}
+
+				// chunks are 4 byte aligned
+				offset += (chunk[0] + 3) & ~3u;
+			}
+
+			if (json == NULL)
+			{
+				std::cerr << "GltfLoader: no JSON chunk in " << fileName << std::endl;
+				return false;
+			}
+		}
+
+		std::string error;
+		if (!JsonValue::Parse(json, jsonLength, doc.root, error))
+		{
+			std::cerr << "GltfLoader: " << fileName << ": " << error << std::endl;
+			return false;
+		}
+
+		const std::string& version = doc.root["asset"]["version"].GetString();
+		if (version.empty() || version[0] != '2')
+		{
+			std::cerr << "GltfLoader: " << fileName << " is not glTF 2.0" << std::endl;
+			return false;
+		}
+
+		return !loadBuffers || LoadBuffers(fileName, glbBinary, doc);
+	}
+
+	bool GetAccessor(const GltfDocument& doc, int accessorIndex, AccessorView& view)
+	{
+		const JsonValue& accessor = doc.root["accessors"][accessorIndex];
+		if (accessor.IsNull() || accessor.Has("sparse") || !accessor.Has("bufferView"))
+			return false;
+
+		const JsonValue& bufferView = doc.root["bufferViews"][accessor["bufferView"].GetInt(-1)];
+		int bufferIndex = bufferView["buffer"].GetInt(-1);
+		if (bufferView.IsNull() || bufferIndex < 0 || bufferIndex >= (int)doc.buffers.size())
+			return false;
+
+		const BufferData& buffer = doc.buffers[bufferIndex];
+
+		view.componentType = accessor["componentType"].GetInt();
+		view.componentCount = GetComponentCount(accessor["type"].GetString());
+		view.normalized = accessor["normalized"].GetBool();
+		view.count = (size_t)accessor["count"].GetNumber();
+
+		size_t elementSize = GetComponentSize(view.componentType) * view.componentCount;
+		if (elementSize == 0)
+			return false;
+
+		size_t viewOffset = (size_t)bufferView["byteOffset"].GetNumber();
+		size_t viewLength = (size_t)bufferView["byteLength"].GetNumber();
+		size_t accessorOffset = (size_t)accessor["byteOffset"].GetNumber();
+		view.stride = bufferView.Has("byteStride") ? (size_t)bufferView["byteStride"].GetNumber() : elementSize;
+
+		if (viewOffset + viewLength > buffer.size || view.stride < elementSize)
+			return false;
+		if (view.count > 0 && accessorOffset + view.stride * (view.count - 1) + elementSize > viewLength)
+			return false;
+
+		view.data = buffer.data + viewOffset + accessorOffset;
+		return true;
+	}
+
+	// Reads count components of element index as floats, integer components
+	// are converted as normalized when the accessor says so
+	void ReadFloats(const AccessorView& view, size_t index, float* out, int count)
+	{
+		const BYTE* element = view.data + index * view.stride;
+		int components = std::min(count, view.componentCount);
+
+		if (view.componentType == COMPONENT_FLOAT)
+		{
+			memcpy(out, element, components * sizeof(float));
+		}
+		else
+		{
+			for (int c = 0; c < components; ++c)
+			{
+				float value = 0.0f;
+				switch (view.componentType)
+				{
+				case COMPONENT_BYTE:
+				{
+					signed char v = ((const signed char*)element)[c];
+					value = view.normalized ? std::max(v / 127.0f, -1.0f) : v;
+					break;
+				}
+				case COMPONENT_UNSIGNED_BYTE:
+				{
+					BYTE v = element[c];
+					value = view.normalized ? v / 255.0f : v;
+					break;
+				}
+				case COMPONENT_SHORT:
+				{
+					short v;
+					memcpy(&v, element + c * 2, 2);
+					value = view.normalized ? std::max(v / 32767.0f, -1.0f) : v;
+					break;
+				}
+				case COMPONENT_UNSIGNED_SHORT:
+				{
+					unsigned short v;
+					memcpy(&v, element + c * 2, 2);
+					value = view.normalized ? v / 65535.0f : v;
+					break;
+				}
+				case COMPONENT_UNSIGNED_INT:
+				{
+					UINT v;
+					memcpy(&v, element + c * 4, 4);
+					value = (float)v;
+					break;
+				}
+				}
+				out[c] = value;
+			}
+		}
+
+		for (int c = components; c < count; ++c)
+			out[c] = 0.0f;
+	}
+
+	UINT ReadIndex(const AccessorView& view, size_t index)
+	{
+		const BYTE* element = view.data + index * view.stride;
+		switch (view.componentType)
+		{
+		case COMPONENT_UNSIGNED_BYTE:
+			return element[0];
+		case COMPONENT_UNSIGNED_SHORT:
+		{
+			unsigned short v;
+			memcpy(&v, element, 2);
+			return v;
+		}
+		case COMPONENT_UNSIGNED_INT:
+		{
+			UINT v;
+			memcpy(&v, element, 4);
+			return v;
+		}
+		default:
+			return UINT_MAX;
+		}
+	}
+
+	// Local transform of a node in row vector convention
+	XMMATRIX GetNodeTransform(const JsonValue& node)
+	{
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.GetSize() == 16)
+		{
+			// glTF stores column major matrices for column vectors, read as rows
+			// that is the transposed matrix, which is what row vectors need
+			XMFLOAT4X4 m;
+			float* values = &m._11;
+			for (int i = 0; i < 16; ++i)
+				values[i] = matrix[i].GetFloat();
+			return XMLoadFloat4x4(&m);
+		}
+
+		const JsonValue& t = node["translation"];
+		const JsonValue& r = node["rotation"];
+		const JsonValue& s = node["scale"];
+		XMMATRIX scale = XMMatrixScaling(s[0].GetFloat(1.0f), s[1].GetFloat(1.0f), s[2].GetFloat(1.0f));
+		XMMATRIX rotation = XMMatrixRotationQuaternion(XMVectorSet(r[0].GetFloat(), r[1].GetFloat(), r[2].GetFloat(), r[3].GetFloat(1.0f)));
+		XMMATRIX translation = XMMatrixTranslation(t[0].GetFloat(), t[1].GetFloat(), t[2].GetFloat());
+		return scale * rotation * translation;
+	}
+
+	// Depth first over the node hierarchy, collects (mesh, world transform) of every mesh node
+	void CollectMeshNodes(const JsonValue& nodes, int nodeIndex, CXMMATRIX parent, int depth,
+		std::vector<std::pair<int, XMFLOAT4X4> >& meshNodes)
+	{
+		const JsonValue& node = nodes[nodeIndex];
+		if (node.IsNull() || depth > 64)
+			return;
+
+		XMMATRIX world = GetNodeTransform(node) * parent;
+		if (node.Has("mesh"))
+		{
+			XMFLOAT4X4 transform;
+			XMStoreFloat4x4(&transform, world);
+			meshNodes.push_back(std::make_pair(node["mesh"].GetInt(), transform));
+		}
+
+		const JsonValue& children = node["children"];
+		for (size_t i = 0; i < children.GetSize(); ++i)
+		{
+			CollectMeshNodes(nodes, children[i].GetInt(-1), world, depth + 1, meshNodes);
+		}
+	}
+
+	// Decodes the vertices and indices of one primitive into the final arrays
+	bool DecodePrimitive(const GltfDocument& doc, PrimitiveJob& job, MeshData& meshData)
+	{
+		const JsonValue& attributes = (*job.primitive)["attributes"];
+
+		AccessorView positions, normals, texcoords, indices;
+		if (!GetAccessor(doc, attributes["POSITION"].GetInt(-1), positions))
+			return false;
+		bool hasNormals = GetAccessor(doc, attributes["NORMAL"].GetInt(-1), normals) && normals.count >= positions.count;
+		bool hasTexcoords = GetAccessor(doc, attributes["TEXCOORD_0"].GetInt(-1), texcoords) && texcoords.count >= positions.count;
+		bool hasIndices = (*job.primitive).Has("indices");
+		if (hasIndices && !GetAccessor(doc, (*job.primitive)["indices"].GetInt(-1), indices))
+			return false;
+
+		XMMATRIX transform = XMLoadFloat4x4(&job.transform);
+		XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(NULL, transform));
+
+		Vertex* vertices = &meshData.Vertices[job.vertexStart];
+		for (UINT v = 0; v < job.vertexCount; ++v)
+		{
+			Vertex& vertex = vertices[v];
+			ReadFloats(positions, v, &vertex.Position.x, 3);
+			if (hasNormals)
+				ReadFloats(normals, v, &vertex.Normal.x, 3);
+			else
+				vertex.Normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			if (hasTexcoords)
+				ReadFloats(texcoords, v, &vertex.Tex.x, 2);
+			else
+				vertex.Tex = XMFLOAT2(0.0f, 0.0f);
+
+			if (!job.identity)
+			{
+				XMStoreFloat3(&vertex.Position, XMVector3TransformCoord(XMLoadFloat3(&vertex.Position), transform));
+				XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), normalTransform)));
+			}
+		}
+
+		UINT* out = &meshData.Indices[job.indexStart];
+		for (UINT i = 0; i < job.indexCount; ++i)
+		{
+			UINT index = hasIndices ? ReadIndex(indices, i) : i;
+			if (index >= job.vertexCount)
+				return false;
+			out[i] = job.vertexStart + index;
+		}
+
+		// mirroring transforms flip the winding
+		if (!job.identity && XMVectorGetX(XMMatrixDeterminant(transform)) < 0.0f)
+		{
+			for (UINT i = 0; i + 2 < job.indexCount; i += 3)
+				std::swap(out[i + 1], out[i + 2]);
+		}
+
+		return true;
+	}
+
+	// File of the image of a textureInfo, empty if there is none or it is embedded
+	std::string GetTextureFile(const GltfDocument& doc, const JsonValue& textureInfo, const std::string& textureBaseDir, size_t materialIndex)
+	{
+		const JsonValue& texture = doc.root["textures"][textureInfo["index"].GetInt(-1)];
+		const JsonValue& image = doc.root["images"][texture["source"].GetInt(-1)];
+		const std::string& uri = image["uri"].GetString();
+		if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+		{
+			return textureBaseDir + DecodeUri(uri);
+		}
+		else if (!image.IsNull())
+		{
+			std::cerr << "GltfLoader: embedded image of material " << materialIndex << " is not supported" << std::endl;
+		}
+		return std::string();
+	}
+
+	void LoadMaterials(const GltfDocument& doc, const std::string& textureBaseDir, MeshData& meshData)
+	{
+		const JsonValue& materials = doc.root["materials"];
+		for (size_t i = 0; i < materials.GetSize(); ++i)
+		{
+			const JsonValue& pbr = materials[i]["pbrMetallicRoughness"];
+			const JsonValue& baseColor = pbr["baseColorFactor"];
+
+			Material mat;
+			mat.Diffuse = XMFLOAT4(baseColor[0].GetFloat(1.0f), baseColor[1].GetFloat(1.0f), baseColor[2].GetFloat(1.0f), baseColor[3].GetFloat(1.0f));
+
+			// Blinn-Phong exponent of the GGX roughness, alpha = roughness^2
+			float roughness = std::min(std::max(pbr["roughnessFactor"].GetFloat(1.0f), 0.0f), 1.0f);
+			float alpha = std::max(roughness * roughness, 0.01f);
+			mat.specExp = std::min(std::max(2.0f / (alpha * alpha) - 2.0f, 1.0f), 250.0f);
+			mat.specIntensivity = 0.25f;
+
+			mat.diffuseTexture = GetTextureFile(doc, pbr["baseColorTexture"], textureBaseDir, i);
+			mat.normalTexture = GetTextureFile(doc, materials[i]["normalTexture"], textureBaseDir, i);
+
+			meshData.materials[(UINT)i] = mat;
+		}
+	}
+}
+
+GltfLoader* GltfLoader::mInstance = 0;
+
+GltfLoader* GltfLoader::Instance()
+{
+	if (mInstance == 0)
+	{
+		mInstance = new GltfLoader();
+	}
+	return mInstance;
+}
+
+GltfLoader::GltfLoader() : mUseMeshCache(true), mQuantizeVertices(false)
+{
+}
+
+GltfLoader::~GltfLoader()
+{
+}
+
+bool GltfLoader::GetDependencies(const std::string& fileName, std::vector<std::string>& dependencies)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	GltfDocument doc;
+	if (!ParseDocument(fileName, file, doc, false))
+		return false;
+
+	GetExternalBuffers(fileName, doc.root, dependencies);
+	return true;
+}
+
+bool GltfLoader::LoadToMesh(std::string fileName, std::string textureBaseDir, MeshData& meshData)
+{
+	auto loadStart = std::chrono::high_resolution_clock::now();
+
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		std::cerr << "GltfLoader: could not open " << fileName << std::endl;
+		return false;
+	}
+
+	GltfDocument doc;
+	if (!ParseDocument(fileName, file, doc))
+		return false;
+
+	const JsonValue& root = doc.root;
+	const JsonValue& nodes = root["nodes"];
+	const JsonValue& meshes = root["meshes"];
+
+	// Mesh nodes of the default scene, scene roots are the nodes nobody references as a child
+	std::vector<std::pair<int, XMFLOAT4X4> > meshNodes;
+	const JsonValue& scene = root["scenes"][root["scene"].GetInt(0)];
+	if (!scene.IsNull())
+	{
+		const JsonValue& sceneNodes = scene["nodes"];
+		for (size_t i = 0; i < sceneNodes.GetSize(); ++i)
+			CollectMeshNodes(nodes, sceneNodes[i].GetInt(-1), XMMatrixIdentity(), 0, meshNodes);
+	}
+	else
+	{
+		std::vector<bool> isChild(nodes.GetSize(), false);
+		for (size_t i = 0; i < nodes.GetSize(); ++i)
+		{
+			const JsonValue& children = nodes[i]["children"];
+			for (size_t c = 0; c < children.GetSize(); ++c)
+			{
+				int child = children[c].GetInt(-1);
+				if (child >= 0 && child < (int)isChild.size())
+					isChild[child] = true;
+			}
+		}
+		for (size_t i = 0; i < nodes.GetSize(); ++i)
+		{
+			if (!isChild[i])
+				CollectMeshNodes(nodes, (int)i, XMMatrixIdentity(), 0, meshNodes);
+		}
+	}
+
+	// Files without nodes just list meshes
+	if (nodes.GetSize() == 0)
+	{
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		for (size_t i = 0; i < meshes.GetSize(); ++i)
+			meshNodes.push_back(std::make_pair((int)i, identity));
+	}
+
+	if (meshNodes.empty())
+	{
+		std::cerr << "GltfLoader: no meshes in " << fileName << std::endl;
+		return false;
+	}
+
+	// The first mesh node is the mesh transform, the others are baked relative to it,
+	// the node transform is not part of the cooked mesh
+	XMMATRIX world = XMLoadFloat4x4(&meshNodes[0].second);
+
+	// The cooked mesh depends on the .gltf and its external buffers, their stamps are
+	// checked and they are only hashed when the mesh has to be cooked
+	std::vector<std::string> sourceFiles(1, fileName);
+	UINT64 sourceStamp = 0;
+	if (mUseMeshCache)
+	{
+		GetExternalBuffers(fileName, doc.root, sourceFiles);
+		sourceStamp = MeshCache::StampFiles(sourceFiles);
+
+		if (sourceStamp != 0 && MeshCache::Instance()->LoadUnchanged(fileName, sourceStamp, meshData))
+		{
+			meshData.world = world;
+			if (mQuantizeVertices)
+			{
+				MeshProcessor::Instance()->QuantizeVertices(fileName, meshData);
+			}
+
+			auto cacheEnd = std::chrono::high_resolution_clock::now();
+			DebugLog("GltfLoader: %s loaded from mesh cache in %.2f ms, %u vertices, %u indices\n", fileName.c_str(),
+				std::chrono::duration<double, std::milli>(cacheEnd - loadStart).count(),
+				(UINT)meshData.Vertices.size(), (UINT)meshData.Indices.size());
+			return true;
+		}
+	}
+
+	meshData.world = world;
+	XMMATRIX worldInverse = XMMatrixInverse(NULL, world);
+
+	UINT materialCount = (UINT)root["materials"].GetSize();
+	bool useDefaultMaterial = false;
+
+	std::vector<PrimitiveJob> jobs;
+	for (size_t n = 0; n < meshNodes.size(); ++n)
+	{
+		const JsonValue& primitives = meshes[meshNodes[n].first]["primitives"];
+		XMMATRIX relative = XMLoadFloat4x4(&meshNodes[n].second) * worldInverse;
+
+		for (size_t p = 0; p < primitives.GetSize(); ++p)
+		{
+			const JsonValue& primitive = primitives[p];
+			if (primitive["mode"].GetInt(MODE_TRIANGLES) != MODE_TRIANGLES)
+			{
+				std::cerr << "GltfLoader: skipping non triangle primitive in " << fileName << std::endl;
+				continue;
+			}
+
+			const JsonValue& positions = root["accessors"][primitive["attributes"]["POSITION"].GetInt(-1)];
+			const JsonValue& indices = root["accessors"][primitive["indices"].GetInt(-1)];
+			size_t vertexCount = (size_t)positions["count"].GetNumber();
+			size_t indexCount = primitive.Has("indices") ? (size_t)indices["count"].GetNumber() : vertexCount;
+			if (vertexCount == 0 || indexCount < 3)
+				continue;
+
+			PrimitiveJob job;
+			job.primitive = &primitive;
+			XMStoreFloat4x4(&job.transform, relative);
+			job.identity = n == 0 || XMMatrixIsIdentity(relative);
+			job.vertexCount = (UINT)vertexCount;
+			job.indexCount = (UINT)(indexCount / 3 * 3);
+			job.decoded = false;
+
+			int material = primitive["material"].GetInt(-1);
+			if (material < 0 || material >= (int)materialCount)
+			{
+				material = (int)materialCount;
+				useDefaultMaterial = true;
+			}
+			job.materialId = (UINT)material;
+
+			jobs.push_back(job);
+		}
+	}
+
+	// Primitives of the same material end up next to each other, so every
+	// material is one submesh without sorting the triangles afterwards
+	std::stable_sort(jobs.begin(), jobs.end(), [](const PrimitiveJob& a, const PrimitiveJob& b) { return a.materialId < b.materialId; });
+
+	UINT64 totalVertices = 0;
+	UINT64 totalIndices = 0;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		jobs[i].vertexStart = (UINT)totalVertices;
+		jobs[i].indexStart = (UINT)totalIndices;
+		totalVertices += jobs[i].vertexCount;
+		totalIndices += jobs[i].indexCount;
+	}
+	if (jobs.empty() || totalVertices > UINT_MAX || totalIndices > UINT_MAX)
+	{
+		std::cerr << "GltfLoader: no triangles or too many vertices in " << fileName << std::endl;
+		return false;
+	}
+
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+
+	// Every primitive decodes straight from the mapped buffers into its own
+	// range of the final arrays, that is the only copy of the vertex data
+	meshData.Vertices.resize((size_t)totalVertices);
+	meshData.Indices.resize((size_t)totalIndices);
+	ParallelFor(jobs.size(), [&](size_t i)
+	{
+		jobs[i].decoded = DecodePrimitive(doc, jobs[i], meshData);
+	});
+
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (!jobs[i].decoded)
+		{
+			std::cerr << "GltfLoader: invalid or unsupported accessors in " << fileName << std::endl;
+			meshData.Vertices.clear();
+			meshData.Indices.clear();
+			return false;
+		}
+	}
+
+	auto decodeEnd = std::chrono::high_resolution_clock::now();
+	DebugLog("GltfLoader: %s decoded %u primitives in %.2f ms on %u threads\n", fileName.c_str(), (UINT)jobs.size(),
+		std::chrono::duration<double, std::milli>(decodeEnd - decodeStart).count(), GetWorkerThreadCount());
+
+	meshData.Submeshes.clear();
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (!meshData.Submeshes.empty() && meshData.Submeshes.back().materialId == jobs[i].materialId)
+		{
+			meshData.Submeshes.back().indexCount += jobs[i].indexCount;
+		}
+		else
+		{
+			Submesh submesh = { jobs[i].materialId, jobs[i].indexStart, jobs[i].indexCount, 0, 0 };
+			meshData.Submeshes.push_back(submesh);
+		}
+	}
+
+	LoadMaterials(doc, textureBaseDir, meshData);
+	if (useDefaultMaterial)
+	{
+		Material mat;
+		mat.diffuseTexture = "";
+		mat.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+		mat.specExp = 250.0f;
+		mat.specIntensivity = 0.25f;
+		meshData.materials[materialCount] = mat;
+	}
+
+	// Vertex cache / overdraw order, bounds, meshlets and LODs
+	MeshProcessor::Instance()->Process(meshData);
+
+	if (mUseMeshCache && sourceStamp != 0)
+	{
+		UINT64 sourceHash = MeshCache::Instance()->HashFile(sourceFiles[0]);
+		for (size_t i = 1; i < sourceFiles.size(); ++i)
+		{
+			sourceHash = (sourceHash ^ MeshCache::Instance()->HashFile(sourceFiles[i])) * 0x100000001b3ULL;
+		}
+
+		if (!MeshCache::Instance()->Save(fileName, sourceHash, sourceStamp, meshData))
+		{
+			std::cerr << "GltfLoader: could not write mesh cache for " << fileName << std::endl;
+		}
+	}
+
+	if (mQuantizeVertices)
+	{
+		MeshProcessor::Instance()->QuantizeVertices(fileName, meshData);
+	}
+
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+	DebugLog("GltfLoader: %s loaded in %.2f ms, %u vertices, %u indices, %u materials, %u meshlets\n", fileName.c_str(),
+		std::chrono::duration<double, std::milli>(loadEnd - loadStart).count(),
+		(UINT)meshData.Vertices.size(), (UINT)meshData.Lods[0].indexCount, meshData.Lods[0].submeshCount,
+		(UINT)meshData.Meshlets.size());
+	MeshProcessor::Instance()->LogLods(fileName, meshData);
+
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+
+// GltfLoader
+// singleton class, usage:
+// GltfLoader::Instance()->LoadToMesh("..\\Assets\\scene.glb", "..\\Assets\\", meshData)
+// loads the triangle primitives of a glTF 2.0 (.gltf or .glb) file to a MeshData object.
+// Buffers are memory mapped and the accessors read in place, every primitive is
+// decoded straight into the final vertex and index arrays on a worker thread.
+// Each material becomes a submesh, the transform of the first mesh node goes to
+// MeshData::world and other mesh nodes are baked relative to it.
+// Like ObjLoader the result is cooked to a MeshCache file next to the source.
+class GltfLoader
+{
+public:
+	static GltfLoader* Instance();
+
+	bool LoadToMesh(std::string fileName, std::string textureBaseDir, MeshData& meshData);
+
+	// Appends the external buffer files of fileName, the textures are in the
+	// materials of the loaded MeshData
+	bool GetDependencies(const std::string& fileName, std::vector<std::string>& dependencies);
+
+	// Enable/disable reading and writing the binary mesh cache, on by default
+	void SetUseMeshCache(bool useMeshCache) { mUseMeshCache = useMeshCache; }
+
+	// Enable/disable packing the vertices into the 16 byte PackedVertex format, off by default
+	void SetQuantizeVertices(bool quantizeVertices) { mQuantizeVertices = quantizeVertices; }
+
+private:
+	GltfLoader();
+	~GltfLoader();
+
+	bool mUseMeshCache;
+	bool mQuantizeVertices;
+
+	static GltfLoader* mInstance;
+};
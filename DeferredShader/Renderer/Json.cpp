@@ -0,0 +1,355 @@
+#include "Json.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const JsonValue JsonValue::mNull;
+
+// Recursive descent parser over [mText, mEnd)
+class JsonValue::Parser
+{
+public:
+	Parser(const char* text, size_t length) : mText(text), mCurrent(text), mEnd(text + length), mDepth(0) {}
+
+	bool ParseDocument(JsonValue& root, std::string& error)
+	{
+		if (!ParseValue(root))
+		{
+			error = mError;
+			return false;
+		}
+
+		SkipWhitespace();
+		if (mCurrent != mEnd && *mCurrent != '\0')
+		{
+			Fail("unexpected data after the root value");
+			error = mError;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static const int mMaxDepth = 256;
+
+	bool Fail(const char* message)
+	{
+		if (mError.empty())
+		{
+			char buffer[128];
+			snprintf(buffer, sizeof(buffer), "JSON error at offset %u: %s", (unsigned)(mCurrent - mText), message);
+			mError = buffer;
+		}
+		return false;
+	}
+
+	void SkipWhitespace()
+	{
+		while (mCurrent != mEnd && (*mCurrent == ' ' || *mCurrent == '\t' || *mCurrent == '\n' || *mCurrent == '\r'))
+			mCurrent++;
+	}
+
+	bool Match(const char* literal)
+	{
+		size_t length = strlen(literal);
+		if ((size_t)(mEnd - mCurrent) < length || memcmp(mCurrent, literal, length) != 0)
+			return false;
+		mCurrent += length;
+		return true;
+	}
+
+	bool ParseValue(JsonValue& value)
+	{
+		SkipWhitespace();
+		if (mCurrent == mEnd)
+			return Fail("unexpected end of text");
+
+		switch (*mCurrent)
+		{
+		case '{':
+			return ParseObject(value);
+		case '[':
+			return ParseArray(value);
+		case '"':
+			value.mType = TYPE_STRING;
+			return ParseString(value.mString);
+		case 't':
+			value.mType = TYPE_BOOL;
+			value.mBool = true;
+			return Match("true") || Fail("invalid literal");
+		case 'f':
+			value.mType = TYPE_BOOL;
+			value.mBool = false;
+			return Match("false") || Fail("invalid literal");
+		case 'n':
+			value.mType = TYPE_NULL;
+			return Match("null") || Fail("invalid literal");
+		default:
+			return ParseNumber(value);
+		}
+	}
+
+	bool ParseObject(JsonValue& value)
+	{
+		if (++mDepth > mMaxDepth)
+			return Fail("nesting too deep");
+
+		value.mType = TYPE_OBJECT;
+		mCurrent++;
+
+		SkipWhitespace();
+		if (mCurrent != mEnd && *mCurrent == '}')
+		{
+			mCurrent++;
+			mDepth--;
+			return true;
+		}
+
+		for (;;)
+		{
+			SkipWhitespace();
+			value.mMembers.push_back(std::pair<std::string, JsonValue>());
+			std::pair<std::string, JsonValue>& member = value.mMembers.back();
+			if (mCurrent == mEnd || *mCurrent != '"')
+				return Fail("expected a member name");
+			if (!ParseString(member.first))
+				return false;
+
+			SkipWhitespace();
+			if (mCurrent == mEnd || *mCurrent != ':')
+				return Fail("expected ':'");
+			mCurrent++;
+
+			if (!ParseValue(member.second))
+				return false;
+
+			SkipWhitespace();
+			if (mCurrent != mEnd && *mCurrent == ',')
+			{
+				mCurrent++;
+				continue;
+			}
+			if (mCurrent != mEnd && *mCurrent == '}')
+			{
+				mCurrent++;
+				mDepth--;
+				return true;
+			}
+			return Fail("expected ',' or '}'");
+		}
+	}
+
+	bool ParseArray(JsonValue& value)
+	{
+		if (++mDepth > mMaxDepth)
+			return Fail("nesting too deep");
+
+		value.mType = TYPE_ARRAY;
+		mCurrent++;
+
+		SkipWhitespace();
+		if (mCurrent != mEnd && *mCurrent == ']')
+		{
+			mCurrent++;
+			mDepth--;
+			return true;
+		}
+
+		for (;;)
+		{
+			value.mElements.push_back(JsonValue());
+			if (!ParseValue(value.mElements.back()))
+				return false;
+
+			SkipWhitespace();
+			if (mCurrent != mEnd && *mCurrent == ',')
+			{
+				mCurrent++;
+				continue;
+			}
+			if (mCurrent != mEnd && *mCurrent == ']')
+			{
+				mCurrent++;
+				mDepth--;
+				return true;
+			}
+			return Fail("expected ',' or ']'");
+		}
+	}
+
+	static int HexDigit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	bool ParseHex4(unsigned& codePoint)
+	{
+		if (mEnd - mCurrent < 4)
+			return Fail("truncated \\u escape");
+		codePoint = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			int digit = HexDigit(*mCurrent++);
+			if (digit < 0)
+				return Fail("invalid \\u escape");
+			codePoint = codePoint * 16 + digit;
+		}
+		return true;
+	}
+
+	static void AppendUtf8(std::string& out, unsigned codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			out += (char)codePoint;
+		}
+		else if (codePoint < 0x800)
+		{
+			out += (char)(0xC0 | (codePoint >> 6));
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			out += (char)(0xE0 | (codePoint >> 12));
+			out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | (codePoint >> 18));
+			out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+			out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	bool ParseString(std::string& out)
+	{
+		mCurrent++;
+
+		// Copy runs without escapes in one go
+		const char* runStart = mCurrent;
+		while (mCurrent != mEnd)
+		{
+			char c = *mCurrent;
+			if (c == '"')
+			{
+				out.append(runStart, mCurrent);
+				mCurrent++;
+				return true;
+			}
+			if (c != '\\')
+			{
+				mCurrent++;
+				continue;
+			}
+
+			out.append(runStart, mCurrent);
+			mCurrent++;
+			if (mCurrent == mEnd)
+				break;
+
+			switch (*mCurrent++)
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				unsigned codePoint;
+				if (!ParseHex4(codePoint))
+					return false;
+
+				// surrogate pair
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && mEnd - mCurrent >= 6 && mCurrent[0] == '\\' && mCurrent[1] == 'u')
+				{
+					mCurrent += 2;
+					unsigned low;
+					if (!ParseHex4(low))
+						return false;
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(out, codePoint);
+				break;
+			}
+			default:
+				return Fail("invalid escape");
+			}
+			runStart = mCurrent;
+		}
+		return Fail("unterminated string");
+	}
+
+	bool ParseNumber(JsonValue& value)
+	{
+		// strtod needs a terminated string, numbers are short so copy the token
+		char buffer[64];
+		size_t length = 0;
+		while (mCurrent + length != mEnd && length + 1 < sizeof(buffer) && strchr("+-0123456789.eE", mCurrent[length]) != NULL && mCurrent[length] != '\0')
+		{
+			buffer[length] = mCurrent[length];
+			length++;
+		}
+		buffer[length] = '\0';
+
+		char* end = NULL;
+		value.mNumber = strtod(buffer, &end);
+		if (length == 0 || end != buffer + length)
+			return Fail("invalid number");
+
+		value.mType = TYPE_NUMBER;
+		mCurrent += length;
+		return true;
+	}
+
+	const char* mText;
+	const char* mCurrent;
+	const char* mEnd;
+	int mDepth;
+	std::string mError;
+};
+
+JsonValue::JsonValue() : mType(TYPE_NULL), mBool(false), mNumber(0.0)
+{
+}
+
+bool JsonValue::Parse(const char* text, size_t length, JsonValue& root, std::string& error)
+{
+	root = JsonValue();
+	Parser parser(text, length);
+	return parser.ParseDocument(root, error);
+}
+
+bool JsonValue::Has(const char* key) const
+{
+	return &(*this)[key] != &mNull;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	if (mType != TYPE_ARRAY || index >= mElements.size())
+		return mNull;
+	return mElements[index];
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+	if (mType != TYPE_OBJECT)
+		return mNull;
+
+	for (size_t i = 0; i < mMembers.size(); ++i)
+	{
+		if (mMembers[i].first == key)
+			return mMembers[i].second;
+	}
+	return mNull;
+}
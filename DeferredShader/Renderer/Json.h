@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// JsonValue
+// Minimal read only JSON document, enough for glTF. Lookups of missing
+// keys or indices return a shared null value, so chains like
+// root["accessors"][3]["count"].GetInt() never fail.
+// usage:
+// JsonValue root;
+// if (JsonValue::Parse(text, length, root, error)) root["asset"]["version"].GetString()
+class JsonValue
+{
+public:
+	enum Type
+	{
+		TYPE_NULL,
+		TYPE_BOOL,
+		TYPE_NUMBER,
+		TYPE_STRING,
+		TYPE_ARRAY,
+		TYPE_OBJECT
+	};
+
+	JsonValue();
+
+	// Parses text[0, length), the text does not need to be zero terminated
+	static bool Parse(const char* text, size_t length, JsonValue& root, std::string& error);
+
+	Type GetType() const { return mType; }
+	bool IsNull() const { return mType == TYPE_NULL; }
+	bool IsNumber() const { return mType == TYPE_NUMBER; }
+	bool IsString() const { return mType == TYPE_STRING; }
+	bool IsArray() const { return mType == TYPE_ARRAY; }
+	bool IsObject() const { return mType == TYPE_OBJECT; }
+
+	bool GetBool(bool defaultValue = false) const { return mType == TYPE_BOOL ? mBool : defaultValue; }
+	double GetNumber(double defaultValue = 0.0) const { return mType == TYPE_NUMBER ? mNumber : defaultValue; }
+	int GetInt(int defaultValue = 0) const { return mType == TYPE_NUMBER ? (int)mNumber : defaultValue; }
+	float GetFloat(float defaultValue = 0.0f) const { return mType == TYPE_NUMBER ? (float)mNumber : defaultValue; }
+	const std::string& GetString() const { return mString; }
+
+	// Element count of arrays and member count of objects
+	size_t GetSize() const { return mType == TYPE_ARRAY ? mElements.size() : mType == TYPE_OBJECT ? mMembers.size() : 0; }
+
+	bool Has(const char* key) const;
+
+	const JsonValue& operator[](size_t index) const;
+	const JsonValue& operator[](int index) const { return index < 0 ? mNull : (*this)[(size_t)index]; }
+	const JsonValue& operator[](const char* key) const;
+
+private:
+	class Parser;
+
+	Type mType;
+	bool mBool;
+	double mNumber;
+	std::string mString;
+	std::vector<JsonValue> mElements;
+	std::vector<std::pair<std::string, JsonValue> > mMembers;
+
+	static const JsonValue mNull;
+};
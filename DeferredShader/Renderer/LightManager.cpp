@@ -108,7 +108,7 @@ LightManager::LightManager()
 	mShadowGenVSLayout = NULL;
 
 	mSpotShadowGenVertexShader = NULL;
-	mSpotShadowGenVertexCB = NULL;
+	XMStoreFloat4x4(&mSpotShadowGenMatrix, XMMatrixIdentity());
 	
 
 	mPCFSamplerState = NULL;
@@ -191,10 +191,6 @@ HRESULT LightManager::Init(ID3D11Device* device, Camera* camera)
 	cbDesc.ByteWidth = sizeof(CB_SPOT_LIGHT_PIXEL);
 	V_RETURN(device->CreateBuffer(&cbDesc, NULL, &mSpotLightPixelCB));
 
-	cbDesc.ByteWidth = sizeof(XMMATRIX);
-	V_RETURN(device->CreateBuffer(&cbDesc, NULL, &mSpotShadowGenVertexCB));
-	DX_SetDebugName(mSpotShadowGenVertexCB, "Spot Shadow Gen Vertex CB");
-
 	cbDesc.ByteWidth = 6 * sizeof(XMMATRIX);
 	V_RETURN(device->CreateBuffer(&cbDesc, NULL, &mPointShadowGenGeometryCB));
 	DX_SetDebugName(mPointShadowGenGeometryCB, "Point Shadow Gen Vertex CB");
@@ -584,7 +580,6 @@ void LightManager::Release()
 	SAFE_RELEASE(mShadowGenVSLayout);
 
 	SAFE_RELEASE(mSpotShadowGenVertexShader);
-	SAFE_RELEASE(mSpotShadowGenVertexCB);
 
 	SAFE_RELEASE(mPointShadowGenVertexShader);
 	SAFE_RELEASE(mPointShadowGenGeometryShader);
@@ -826,6 +821,32 @@ bool LightManager::PrepareNextShadowLight(ID3D11DeviceContext* pd3dImmediateCont
 	return false;
 }
 
+float LightManager::GetShadowPixelsPerUnit(const BoundingSphere& worldSphere) const
+{
+	if (mLastShadowLight >= 0 && mLastShadowLight < (int)mArrLights.size())
+	{
+		// Spot and point shadow maps are perspective projections from the light
+		const LIGHT& light = mArrLights[mLastShadowLight];
+		float fov = light.eLightType == TYPE_SPOT ? 2.0f * light.fOuterAngle : M_PI * 0.5f;
+
+		XMVECTOR toCenter = XMLoadFloat3(&worldSphere.Center) - XMLoadFloat3(&light.vPosition);
+		float distance = max(XMVectorGetX(XMVector3Length(toCenter)) - worldSphere.Radius, mShadowNear);
+
+		return 0.5f * mShadowMapSize / (tanf(0.5f * fov) * distance);
+	}
+
+	return mCascadedMatrixSet->GetPixelsPerUnit(worldSphere);
+}
+
+bool LightManager::GetSpotShadowMatrix(XMMATRIX& worldToShadow) const
+{
+	if (mLastShadowLight < 0 || mLastShadowLight >= (int)mArrLights.size() || mArrLights[mLastShadowLight].eLightType != TYPE_SPOT)
+		return false;
+
+	worldToShadow = XMLoadFloat4x4(&mSpotShadowGenMatrix);
+	return true;
+}
+
 void LightManager::DirectionalLight(ID3D11DeviceContext* pd3dImmediateContext)
 {
 	HRESULT hr;
@@ -1062,8 +1083,6 @@ void LightManager::SpotLight(ID3D11DeviceContext* pd3dImmediateContext, const XM
 
 void LightManager::SpotShadowGen(ID3D11DeviceContext* pd3dImmediateContext, const LIGHT& light)
 {
-	HRESULT hr;
-
 	D3D11_VIEWPORT vp[1] = { { 0, 0, mShadowMapSize, mShadowMapSize, 0.0f, 1.0f } };
 	pd3dImmediateContext->RSSetViewports(1, vp);
 
@@ -1094,14 +1113,9 @@ void LightManager::SpotShadowGen(ID3D11DeviceContext* pd3dImmediateContext, cons
 	XMMATRIX matSpotProj;
 	matSpotProj = XMMatrixPerspectiveFovLH(2.0f * light.fOuterAngle, 1.0, mShadowNear, light.fRange);
 
-	// Fill the shadow generation matrix constant buffer
-	D3D11_MAPPED_SUBRESOURCE MappedResource;
-	V(pd3dImmediateContext->Map(mSpotShadowGenVertexCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
-	XMMATRIX * shadowGenMat = (XMMATRIX*)MappedResource.pData;
-	XMMATRIX toShadow = matSpotView * matSpotProj;
-	shadowGenMat = &XMMatrixTranspose(toShadow);
-	pd3dImmediateContext->Unmap(mSpotShadowGenVertexCB, 0);
-	pd3dImmediateContext->VSSetConstantBuffers(0, 1, &mSpotShadowGenVertexCB);
+	// The casters combine it with their world matrix and dequantization in their
+	// per object constants, see GetSpotShadowMatrix
+	XMStoreFloat4x4(&mSpotShadowGenMatrix, matSpotView * matSpotProj);
 
 	// Set the vertex layout
 	pd3dImmediateContext->IASetInputLayout(mShadowGenVSLayout);
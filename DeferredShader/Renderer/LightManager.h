@@ -88,6 +88,14 @@ public:
 	// Prepare shadow generation for the next shadow casting light
 	bool PrepareNextShadowLight(ID3D11DeviceContext* pd3dImmediateContext);
 
+	// Shadow map texels per world unit at worldSphere for the light prepared
+	// by PrepareNextShadowLight, used for the caster level of detail
+	float GetShadowPixelsPerUnit(const BoundingSphere& worldSphere) const;
+
+	// World to clip space of the spot shadow map prepared by PrepareNextShadowLight,
+	// false while a point or the cascaded shadow map is prepared
+	bool GetSpotShadowMatrix(XMMATRIX& worldToShadow) const;
+
 	// Visualize shadowmap 
 	void VisualizeShadowMap(ID3D11DeviceContext* pd3dImmediateContext);
 
@@ -168,9 +176,9 @@ private:
 	// Shadowmap generation layout
 	ID3D11InputLayout* mShadowGenVSLayout;
 
-	// Spot Shadowmap assets
+	// Spot Shadowmap assets, the per object constants are set by the caster pass
 	ID3D11VertexShader* mSpotShadowGenVertexShader;
-	ID3D11Buffer*		mSpotShadowGenVertexCB;
+	XMFLOAT4X4			mSpotShadowGenMatrix;
 
 	// Point shadow generation assets
 	ID3D11VertexShader*		mPointShadowGenVertexShader;
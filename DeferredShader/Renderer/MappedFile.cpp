@@ -0,0 +1,134 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mData(NULL), mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& fileName)
+{
+	Close();
+
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mData = (const BYTE*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mData == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = (size_t)fileSize.QuadPart;
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != NULL)
+	{
+		UnmapViewOfFile(mData);
+		mData = NULL;
+	}
+
+	if (mMapping != NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	if (mFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+
+	mSize = 0;
+}
+
+#else
+
+MappedFile::MappedFile() : mFile(-1), mData(NULL), mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& fileName)
+{
+	Close();
+
+	mFile = open(fileName.c_str(), O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(mFile, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	mData = (const BYTE*)data;
+	mSize = (size_t)fileStat.st_size;
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != NULL)
+	{
+		munmap((void*)mData, mSize);
+		mData = NULL;
+	}
+
+	if (mFile >= 0)
+	{
+		close(mFile);
+		mFile = -1;
+	}
+
+	mSize = 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Util.h"
+
+// MappedFile
+// Read only memory mapping of a whole file. The mapped bytes stay valid
+// until Close() is called or the object is destroyed, so data can be handed
+// straight to the loaders / D3D without reading it into a temporary buffer.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Maps fileName, returns false if the file does not exist or is empty
+	bool Open(const std::string& fileName);
+	void Close();
+
+	bool IsOpen() const { return mData != NULL; }
+	const BYTE* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+private:
+	MappedFile(const MappedFile& rhs);
+	MappedFile& operator=(const MappedFile& rhs);
+
+#ifdef _WIN32
+	HANDLE mFile;
+	HANDLE mMapping;
+#else
+	int mFile;
+#endif
+	const BYTE* mData;
+	size_t mSize;
+};
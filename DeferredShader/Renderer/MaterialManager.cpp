@@ -0,0 +1,82 @@
+#include "MaterialManager.h"
+
+MaterialManager* MaterialManager::mInstance = NULL;
+
+MaterialManager* MaterialManager::Instance()
+{
+	if (!mInstance)
+		mInstance = new MaterialManager;
+	return mInstance;
+}
+
+MaterialManager::MaterialManager()
+{
+	Release();
+}
+
+MaterialManager::~MaterialManager()
+{
+}
+
+bool MaterialManager::MaterialLess::operator()(const Material& a, const Material& b) const
+{
+	if (a.Diffuse.x != b.Diffuse.x)
+		return a.Diffuse.x < b.Diffuse.x;
+	if (a.Diffuse.y != b.Diffuse.y)
+		return a.Diffuse.y < b.Diffuse.y;
+	if (a.Diffuse.z != b.Diffuse.z)
+		return a.Diffuse.z < b.Diffuse.z;
+	if (a.Diffuse.w != b.Diffuse.w)
+		return a.Diffuse.w < b.Diffuse.w;
+	if (a.specExp != b.specExp)
+		return a.specExp < b.specExp;
+	if (a.specIntensivity != b.specIntensivity)
+		return a.specIntensivity < b.specIntensivity;
+	if (a.diffuseTexture != b.diffuseTexture)
+		return a.diffuseTexture < b.diffuseTexture;
+	return a.normalTexture < b.normalTexture;
+}
+
+MaterialHandle MaterialManager::AddMaterial(const Material& material)
+{
+	auto it = mHandles.find(material);
+	if (it != mHandles.end())
+		return it->second;
+
+	RenderMaterial renderMaterial;
+	renderMaterial.Diffuse = material.Diffuse;
+	renderMaterial.specExp = material.specExp;
+	renderMaterial.specIntensivity = material.specIntensivity;
+
+	// materials whose textures share an atlas share its shader resource view
+	AtlasEntry atlas;
+	if (TextureAtlas::Instance()->Find(material.diffuseTexture, atlas))
+	{
+		renderMaterial.diffuseTexture = TextureManager::Instance()->RequestTexture(atlas.atlasFile);
+		renderMaterial.diffuseTransform = atlas.uvTransform;
+	}
+	else
+	{
+		renderMaterial.diffuseTexture = TextureManager::Instance()->RequestTexture(material.diffuseTexture);
+		renderMaterial.diffuseTransform = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+	}
+
+	renderMaterial.normalTexture = TextureManager::Instance()->RequestTexture(material.normalTexture, TEXTURE_NORMAL_MAP);
+
+	MaterialHandle handle = (MaterialHandle)mMaterials.size();
+	mMaterials.push_back(renderMaterial);
+	mHandles[material] = handle;
+	return handle;
+}
+
+void MaterialManager::Release()
+{
+	mMaterials.clear();
+	mHandles.clear();
+
+	// handle 0, what a submesh without a material draws with
+	Material defaultMaterial;
+	RenderMaterial renderMaterial = { defaultMaterial.Diffuse, defaultMaterial.specExp, defaultMaterial.specIntensivity, InvalidTextureHandle, InvalidTextureHandle, XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f) };
+	mMaterials.push_back(renderMaterial);
+	mHandles[defaultMaterial] = 0;
+}
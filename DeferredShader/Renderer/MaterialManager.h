@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+#include "TextureManager.h"
+#include "TextureAtlas.h"
+
+// Interned material id, index into the MaterialManager table. 0 is the default material.
+typedef UINT MaterialHandle;
+
+// Material as the render path uses it, the texture filenames resolved to TextureManager handles
+struct RenderMaterial
+{
+	XMFLOAT4 Diffuse;
+	float specExp;
+	float specIntensivity;
+	TextureHandle diffuseTexture;
+	TextureHandle normalTexture;
+	XMFLOAT4 diffuseTransform;	// UV scale in xy and bias in zw, the rectangle of the diffuse texture in its atlas
+};
+
+// MaterialManager
+// singleton class, interns the materials of the meshes into a flat table
+// usage:
+// MaterialHandle handle = MaterialManager::Instance()->AddMaterial(material) once when a mesh is created
+// const RenderMaterial& material = MaterialManager::Instance()->GetMaterial(handle) per draw
+//
+// Equal materials of different meshes share one handle, so the draws can skip
+// binding a material that is already bound. Adding requests the textures from
+// TextureManager, the render path never touches a filename. A diffuse texture the
+// AssetCooker packed into an atlas is replaced by its atlas and diffuseTransform.
+// Call from the render thread only.
+class MaterialManager
+{
+public:
+	static MaterialManager* Instance();
+
+	// Handle of material, added to the table if no equal material is in there
+	MaterialHandle AddMaterial(const Material& material);
+
+	// Flat table lookup, handle must come from AddMaterial
+	const RenderMaterial& GetMaterial(MaterialHandle handle) const { return mMaterials[handle]; }
+
+	UINT GetMaterialCount() const { return (UINT)mMaterials.size(); }
+
+	// Drops every material but the default one, the handles handed out are invalid afterwards
+	void Release();
+
+private:
+	MaterialManager();
+	~MaterialManager();
+
+	// Strict weak order over the Material fields for the intern map
+	struct MaterialLess
+	{
+		bool operator()(const Material& a, const Material& b) const;
+	};
+
+	std::vector<RenderMaterial> mMaterials;
+	std::map<Material, MaterialHandle, MaterialLess> mHandles;
+
+	static MaterialManager* mInstance;
+};
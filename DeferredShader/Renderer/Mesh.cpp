@@ -1,7 +1,11 @@
 #include "Mesh.h"
+#include "VertexQuantizer.h"
 
+#include <cmath>
 
-Mesh::Mesh() : mVB(NULL), mIB(NULL), mIndexCount(0), mVertexCount(0)
+
+Mesh::Mesh() : mVB(NULL), mIB(NULL), mPositionVB(NULL), mIndexCount(0), mVertexCount(0), mPacked(false), mVertexStride(sizeof(Vertex)),
+mPositionStride(sizeof(XMFLOAT3)), mPositionScale(1.0f, 1.0f, 1.0f, 0.0f), mPositionOffset(0.0f, 0.0f, 0.0f, 0.0f), mUVDensity(0.0f)
 {
 }
 
@@ -10,23 +14,147 @@ Mesh::~Mesh()
 	Destroy();
 }
 
-void Mesh::Create(ID3D11Device* device, MeshData meshData)
+void Mesh::Create(ID3D11Device* device, const MeshData& meshData, bool positionStream)
 {
 	mMaterials = meshData.materials;
+	mMeshlets = meshData.Meshlets;
+	mLods = meshData.Lods;
+	mSubmeshes = meshData.Submeshes;
+
+	CreateBuffers(device, meshData, positionStream);
+}
+
+void Mesh::Create(ID3D11Device* device, MeshData&& meshData, bool positionStream)
+{
+	mMaterials.swap(meshData.materials);
+	mMeshlets.swap(meshData.Meshlets);
+	mLods.swap(meshData.Lods);
+	mSubmeshes.swap(meshData.Submeshes);
+
+	CreateBuffers(device, meshData, positionStream);
+
+	// The GPU buffers have their own copy, swap releases the memory where clear would not
+	std::vector<Vertex>().swap(meshData.Vertices);
+	std::vector<PackedVertex>().swap(meshData.PackedVertices);
+	std::vector<UINT>().swap(meshData.Indices);
+	meshData.materials.clear();
+	meshData.Meshlets.clear();
+	meshData.Lods.clear();
+	meshData.Submeshes.clear();
+}
+
+void Mesh::CreateBuffers(ID3D11Device* device, const MeshData& meshData, bool positionStream)
+{
 	mWorld = meshData.world;
+	mBounds = meshData.bounds;
+	if (mLods.empty())
+	{
+		MeshLod fullLod = { 0, (UINT)meshData.Indices.size(), 0.0f, 0, 0 };
+		mLods.push_back(fullLod);
+	}
+
+	// Without material ranges every level is a single submesh of the first material
+	if (mSubmeshes.empty())
+	{
+		UINT materialId = mMaterials.empty() ? 0 : mMaterials.begin()->first;
+		for (size_t i = 0; i < mLods.size(); ++i)
+		{
+			Submesh submesh = { materialId, mLods[i].indexStart, mLods[i].indexCount, 0, i == 0 ? (UINT)mMeshlets.size() : 0 };
+			mLods[i].submeshStart = (UINT)mSubmeshes.size();
+			mLods[i].submeshCount = 1;
+			mSubmeshes.push_back(submesh);
+		}
+	}
+
+	// Resolve the materials once, the draws look them up by handle
+	mSubmeshMaterials.resize(mSubmeshes.size());
+	for (size_t i = 0; i < mSubmeshes.size(); ++i)
+	{
+		auto it = mMaterials.find(mSubmeshes[i].materialId);
+		mSubmeshMaterials[i] = it != mMaterials.end() ? MaterialManager::Instance()->AddMaterial(it->second) : 0;
+	}
 	mIndexCount = meshData.Indices.size();
-	mVertexCount = meshData.Vertices.size();
+
+	// Texture space area per object space area, SceneManager picks the texture mips from it
+	double uvArea = 0.0, area = 0.0;
+	for (UINT i = 0; i + 2 < mLods[0].indexCount; i += 3)
+	{
+		Vertex v[3];
+		for (UINT k = 0; k < 3; ++k)
+		{
+			UINT index = meshData.Indices[mLods[0].indexStart + i + k];
+			v[k] = meshData.PackedVertices.empty() ? meshData.Vertices[index] :
+				VertexQuantizer::DecodeVertex(meshData.PackedVertices[index], meshData.positionScale, meshData.positionOffset);
+		}
+
+		XMFLOAT3 e1(v[1].Position.x - v[0].Position.x, v[1].Position.y - v[0].Position.y, v[1].Position.z - v[0].Position.z);
+		XMFLOAT3 e2(v[2].Position.x - v[0].Position.x, v[2].Position.y - v[0].Position.y, v[2].Position.z - v[0].Position.z);
+		XMFLOAT3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+		area += 0.5 * sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+
+		float du1 = v[1].Tex.x - v[0].Tex.x, dv1 = v[1].Tex.y - v[0].Tex.y;
+		float du2 = v[2].Tex.x - v[0].Tex.x, dv2 = v[2].Tex.y - v[0].Tex.y;
+		uvArea += 0.5 * fabs((double)du1 * dv2 - (double)dv1 * du2);
+	}
+	mUVDensity = area > 0.0 ? (float)sqrt(uvArea / area) : 0.0f;
+
+	mPacked = !meshData.PackedVertices.empty();
+	if (mPacked)
+	{
+		mVertexCount = meshData.PackedVertices.size();
+		mVertexStride = sizeof(PackedVertex);
+		mPositionScale = XMFLOAT4(meshData.positionScale.x, meshData.positionScale.y, meshData.positionScale.z, 0.0f);
+		mPositionOffset = XMFLOAT4(meshData.positionOffset.x, meshData.positionOffset.y, meshData.positionOffset.z, 0.0f);
+	}
+	else
+	{
+		mVertexCount = meshData.Vertices.size();
+		mVertexStride = sizeof(Vertex);
+		mPositionScale = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f);
+		mPositionOffset = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
 
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex)*meshData.Vertices.size();
+	vbd.ByteWidth = mVertexStride * mVertexCount;
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	D3D11_SUBRESOURCE_DATA vinitData;
-	vinitData.pSysMem = &meshData.Vertices[0]; 
+	if (mPacked)
+		vinitData.pSysMem = &meshData.PackedVertices[0];
+	else
+		vinitData.pSysMem = &meshData.Vertices[0];
 	HR(device->CreateBuffer(&vbd, &vinitData, &mVB));
 
+	// Tightly packed copy of the positions, depth only passes fetch nothing else
+	if (positionStream)
+	{
+		std::vector<BYTE> positions;
+		if (mPacked)
+		{
+			mPositionStride = sizeof(meshData.PackedVertices[0].Position);
+			positions.resize(mPositionStride * mVertexCount);
+			for (UINT i = 0; i < mVertexCount; ++i)
+			{
+				memcpy(&positions[i * mPositionStride], meshData.PackedVertices[i].Position, mPositionStride);
+			}
+		}
+		else
+		{
+			mPositionStride = sizeof(XMFLOAT3);
+			positions.resize(mPositionStride * mVertexCount);
+			for (UINT i = 0; i < mVertexCount; ++i)
+			{
+				memcpy(&positions[i * mPositionStride], &meshData.Vertices[i].Position, mPositionStride);
+			}
+		}
+
+		vbd.ByteWidth = mPositionStride * mVertexCount;
+		vinitData.pSysMem = &positions[0];
+		HR(device->CreateBuffer(&vbd, &vinitData, &mPositionVB));
+	}
+
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
 	ibd.ByteWidth = sizeof(UINT) * meshData.Indices.size();
@@ -40,22 +168,100 @@ void Mesh::Create(ID3D11Device* device, MeshData meshData)
 
 void Mesh::Render(ID3D11DeviceContext* pd3dDeviceContext)
 {
-	UINT stride = sizeof(Vertex);
+	Render(pd3dDeviceContext, 0);
+}
+
+void Mesh::Render(ID3D11DeviceContext* pd3dDeviceContext, UINT lod)
+{
+	if (mLods.empty())
+		return;
+
+	const MeshLod& meshLod = mLods[std::min(lod, (UINT)mLods.size() - 1)];
+
+	SetBuffers(pd3dDeviceContext);
+
+	pd3dDeviceContext->DrawIndexed(meshLod.indexCount, meshLod.indexStart, 0);
+}
+
+void Mesh::RenderPositions(ID3D11DeviceContext* pd3dDeviceContext, UINT lod)
+{
+	if (mPositionVB == NULL)
+	{
+		Render(pd3dDeviceContext, lod);
+		return;
+	}
+
+	if (mLods.empty())
+		return;
+
+	const MeshLod& meshLod = mLods[std::min(lod, (UINT)mLods.size() - 1)];
+
+	UINT stride = mPositionStride;
+	UINT offset = 0;
+
+	pd3dDeviceContext->IASetVertexBuffers(0, 1, &mPositionVB, &stride, &offset);
+	pd3dDeviceContext->IASetIndexBuffer(mIB, DXGI_FORMAT_R32_UINT, 0);
+
+	pd3dDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	pd3dDeviceContext->DrawIndexed(meshLod.indexCount, meshLod.indexStart, 0);
+}
+
+UINT Mesh::SelectLod(float pixelsPerUnit, float maxPixelError) const
+{
+	UINT lod = 0;
+	for (UINT i = 1; i < mLods.size(); ++i)
+	{
+		if (mLods[i].error * pixelsPerUnit > maxPixelError)
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+void Mesh::Render(ID3D11DeviceContext* pd3dDeviceContext, const std::vector<DrawRange>& ranges)
+{
+	if (ranges.empty())
+		return;
+
+	SetBuffers(pd3dDeviceContext);
+	Draw(pd3dDeviceContext, ranges);
+}
+
+void Mesh::SetBuffers(ID3D11DeviceContext* pd3dDeviceContext)
+{
+	UINT stride = mVertexStride;
 	UINT offset = 0;
 
 	pd3dDeviceContext->IASetVertexBuffers(0, 1, &mVB, &stride, &offset);
 	pd3dDeviceContext->IASetIndexBuffer(mIB, DXGI_FORMAT_R32_UINT, 0);
 
 	pd3dDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void Mesh::Draw(ID3D11DeviceContext* pd3dDeviceContext, const DrawRange& range)
+{
+	pd3dDeviceContext->DrawIndexed(range.indexCount, range.indexStart, 0);
+}
 
-	pd3dDeviceContext->DrawIndexed(mIndexCount, 0, 0);
+void Mesh::Draw(ID3D11DeviceContext* pd3dDeviceContext, const std::vector<DrawRange>& ranges)
+{
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		pd3dDeviceContext->DrawIndexed(ranges[i].indexCount, ranges[i].indexStart, 0);
+	}
 }
 
 void Mesh::Destroy()
 {
 	ReleaseCOM(mVB);
 	ReleaseCOM(mIB);
+	ReleaseCOM(mPositionVB);
 	mIndexCount = 0;
 	mVertexCount = 0;
 	mMaterials.clear();
+	mMeshlets.clear();
+	mLods.clear();
+	mSubmeshes.clear();
+	mSubmeshMaterials.clear();
 }
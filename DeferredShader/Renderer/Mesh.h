@@ -1,71 +1,56 @@
 #pragma once
 
-#include "Util.h"
+#include "MeshData.h"
+#include "MaterialManager.h"
 
 
-struct Vertex
+class Mesh
 {
-	Vertex() : Position(0.0f, 0.0f, 0.0f), Normal(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f) {}
-	Vertex(const XMFLOAT3& p, const XMFLOAT3& n, const XMFLOAT2& uv)
-		: Position(p), Normal(n), Tex(uv) {}
-	Vertex(
-		float px, float py, float pz,
-		float nx, float ny, float nz,
-		float u, float v)
-		: Position(px, py, pz), Normal(nx, ny, nz), Tex(u, v) {}
-	Vertex(
-		float px, float py, float pz)
-		: Position(px, py, pz), Normal(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f) {}
-
-	XMFLOAT3 Position;
-	XMFLOAT3 Normal;
-	XMFLOAT2 Tex;
-};
+public:
+	Mesh();
+	~Mesh();
 
+	// Reads data from Param meshData and creates vertex,Index buffers, Material info
+	// and the material handles through MaterialManager, which requests the textures.
+	// positionStream also creates the position only vertex buffer for RenderPositions.
+	void Create(ID3D11Device* device, const MeshData& meshData, bool positionStream = true);
 
-struct Material
-{
-	Material() {
-		ZeroMemory(this, sizeof(this));
-	};
+	// Same as above without copying: the materials, meshlets and LODs are moved
+	// into the mesh and the vertex and index arrays are freed once the GPU
+	// buffers hold them, meshData is left empty.
+	void Create(ID3D11Device* device, MeshData&& meshData, bool positionStream = true);
 
-	XMFLOAT4 Diffuse;
-	std::string diffuseTexture;
-	float specExp;
-	float specIntensivity;
 
-};
+	void Render(ID3D11DeviceContext* pd3dDeviceContext);
 
-struct MeshData
-{
-	std::vector<Vertex> Vertices;
-	std::vector<UINT> Indices;
-	std::map<UINT, Material> materials;
-	XMMATRIX world;
-};
+	// sets vertex and index buffers and draws the given level of detail
+	void Render(ID3D11DeviceContext* pd3dDeviceContext, UINT lod);
 
-class Mesh
-{
-public:
-	Mesh();
-	~Mesh();
+	// sets vertex and index buffers and draws only the given index ranges
+	void Render(ID3D11DeviceContext* pd3dDeviceContext, const std::vector<DrawRange>& ranges);
 
-	// Reads data from Param meshData and creates vertex,Index buffers, Material info.
-	void Create(ID3D11Device* device, MeshData meshData);
+	// sets the position only vertex buffer (the full one if there is none) and
+	// the index buffer and draws the given level of detail, for depth only passes
+	void RenderPositions(ID3D11DeviceContext* pd3dDeviceContext, UINT lod);
 
+	// sets vertex and index buffers, for drawing submeshes with Draw
+	void SetBuffers(ID3D11DeviceContext* pd3dDeviceContext);
 
-	void Render(ID3D11DeviceContext* pd3dDeviceContext);
+	// draws index ranges with the buffers set by SetBuffers
+	void Draw(ID3D11DeviceContext* pd3dDeviceContext, const DrawRange& range);
+	void Draw(ID3D11DeviceContext* pd3dDeviceContext, const std::vector<DrawRange>& ranges);
 	
 	// sets vertex and index buffers and calls draw
 	void Destroy();
 
 	ID3D11Buffer* mVB;	// Vertex buffer
 	ID3D11Buffer* mIB;	// Index buffer
+	ID3D11Buffer* mPositionVB;	// Position only vertex buffer, NULL if not created
 	UINT mVertexCount;
 	UINT mIndexCount;
 
-	// material indices
-	std::vector<UINT> mMaterialIndices;
+	// MaterialManager handle of every submesh, same order as mSubmeshes
+	std::vector<MaterialHandle> mSubmeshMaterials;
 
 	// material list.
 	std::map<UINT, Material> mMaterials;
@@ -73,4 +58,41 @@ public:
 	// world matrix
 	XMMATRIX mWorld;
 
+	// object space bounds
+	BoundingBox mBounds;
+
+	// texture coordinate change per object space unit, the square root of the
+	// texture to object space area ratio of the LOD 0 triangles. 0 without texture coordinates.
+	float mUVDensity;
+
+	// meshlets for CPU cluster culling
+	std::vector<Meshlet> mMeshlets;
+
+	// levels of detail, mLods[0] is the full mesh
+	std::vector<MeshLod> mLods;
+
+	// material ranges of all levels, see MeshLod::submeshStart
+	std::vector<Submesh> mSubmeshes;
+
+	// Coarsest level whose error stays below maxPixelError on screen,
+	// pixelsPerUnit is the screen pixels per object space unit at the mesh
+	UINT SelectLod(float pixelsPerUnit, float maxPixelError) const;
+
+	// true when the vertex buffer holds PackedVertex instead of Vertex
+	bool mPacked;
+	UINT mVertexStride;
+
+	// Stride of mPositionVB, XMFLOAT3 or the 4x16 bit packed position.
+	// The position is at offset 0 in both streams so the same input layout fits both.
+	UINT mPositionStride;
+
+	// position dequantization constants for the vertex shader,
+	// scale 1 and offset 0 for unpacked meshes
+	XMFLOAT4 mPositionScale;
+	XMFLOAT4 mPositionOffset;
+
+private:
+	// Creates the GPU buffers from meshData, the materials, meshlets and LODs
+	// are already in the members
+	void CreateBuffers(ID3D11Device* device, const MeshData& meshData, bool positionStream);
 };
@@ -0,0 +1,386 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "MeshCodec.h"
+#include "TextureCache.h"
+
+#include <chrono>
+
+// vertices and indices are MeshCodec streams
+const UINT MESH_CACHE_COMPRESSED = 0x1;
+
+// the diffuse / normal texture name is relative to the directory of the source file
+const UINT MESH_CACHE_TEXTURE_RELATIVE = 0x1;
+const UINT MESH_CACHE_NORMAL_TEXTURE_RELATIVE = 0x2;
+
+namespace
+{
+	std::string GetDirectory(const std::string& fileName)
+	{
+		size_t slash = fileName.find_last_of("\\/");
+		return slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+	}
+
+	// Strips directory from textureName and sets relativeFlag in flags if the texture is inside it
+	std::string GetCachedTextureName(const std::string& textureName, const std::string& directory, UINT relativeFlag, UINT& flags)
+	{
+		if (textureName.empty() || directory.empty() || textureName.compare(0, directory.size(), directory) != 0)
+			return textureName;
+
+		flags |= relativeFlag;
+		return textureName.substr(directory.size());
+	}
+}
+
+#pragma pack(push,1)
+struct MeshCacheHeader
+{
+	UINT magic;
+	UINT version;
+	UINT64 sourceHash;
+	UINT64 sourceStamp;
+	UINT flags;
+	UINT vertexSize;
+	UINT vertexCount;
+	UINT indexCount;
+	UINT materialCount;
+	UINT meshletCount;
+	UINT lodCount;
+	UINT submeshCount;
+	XMFLOAT3 boundsCenter;
+	XMFLOAT3 boundsExtents;
+	UINT64 vertexOffset;
+	UINT64 vertexBytes;
+	UINT64 indexOffset;
+	UINT64 indexBytes;
+	UINT64 meshletOffset;
+	UINT64 lodOffset;
+	UINT64 submeshOffset;
+	UINT64 materialOffset;
+};
+
+struct MeshCacheMaterial
+{
+	UINT id;
+	XMFLOAT4 diffuse;
+	float specExp;
+	float specIntensivity;
+	UINT flags;
+	UINT textureNameLength;
+	UINT normalTextureNameLength;
+};
+#pragma pack(pop)
+
+MeshCache* MeshCache::mInstance = 0;
+
+MeshCache* MeshCache::Instance()
+{
+	if (mInstance == 0)
+	{
+		mInstance = new MeshCache();
+	}
+	return mInstance;
+}
+
+MeshCache::MeshCache() : mCompress(true)
+{
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+std::string MeshCache::GetCacheFileName(const std::string& sourceFile)
+{
+	return sourceFile + ".meshcache";
+}
+
+UINT64 MeshCache::HashFile(const std::string& fileName)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return 0;
+
+	// FNV-1a over 8 byte words, the tail is hashed byte by byte
+	const UINT64 prime = 0x100000001b3ULL;
+	UINT64 hash = 0xcbf29ce484222325ULL;
+
+	const BYTE* data = file.GetData();
+	size_t size = file.GetSize();
+	size_t words = size / sizeof(UINT64);
+	for (size_t i = 0; i < words; ++i)
+	{
+		UINT64 word;
+		memcpy(&word, data + i * sizeof(UINT64), sizeof(UINT64));
+		hash = (hash ^ word) * prime;
+	}
+	for (size_t i = words * sizeof(UINT64); i < size; ++i)
+	{
+		hash = (hash ^ data[i]) * prime;
+	}
+
+	hash ^= (UINT64)size;
+
+	// 0 is reserved for "no source"
+	return hash != 0 ? hash : 1;
+}
+
+UINT64 MeshCache::StampFiles(const std::vector<std::string>& fileNames)
+{
+	const UINT64 prime = 0x100000001b3ULL;
+	UINT64 stamp = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < fileNames.size(); ++i)
+	{
+		TextureCache::SourceStamp fileStamp;
+		if (!TextureCache::GetSourceStamp(fileNames[i], fileStamp))
+			return 0;
+		stamp = (stamp ^ fileStamp.size) * prime;
+		stamp = (stamp ^ fileStamp.writeTime) * prime;
+	}
+
+	// 0 is reserved for "no source"
+	return stamp != 0 ? stamp : 1;
+}
+
+bool MeshCache::Load(const std::string& sourceFile, UINT64 sourceHash, MeshData& meshData)
+{
+	return Read(sourceFile, sourceHash, 0, meshData);
+}
+
+bool MeshCache::LoadUnchanged(const std::string& sourceFile, UINT64 sourceStamp, MeshData& meshData)
+{
+	return Read(sourceFile, 0, sourceStamp, meshData);
+}
+
+bool MeshCache::Read(const std::string& sourceFile, UINT64 sourceHash, UINT64 sourceStamp, MeshData& meshData)
+{
+	MappedFile file;
+	if (!file.Open(GetCacheFileName(sourceFile)))
+		return false;
+
+	const BYTE* data = file.GetData();
+	size_t size = file.GetSize();
+
+	if (size < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != mMagic || header.version != mVersion || header.vertexSize != sizeof(Vertex))
+		return false;
+
+	if ((sourceHash != 0 && header.sourceHash != sourceHash) || (sourceStamp != 0 && header.sourceStamp != sourceStamp))
+		return false;
+
+	bool compressed = (header.flags & MESH_CACHE_COMPRESSED) != 0;
+	UINT64 vertexBytes = compressed ? header.vertexBytes : (UINT64)header.vertexCount * sizeof(Vertex);
+	UINT64 indexBytes = compressed ? header.indexBytes : (UINT64)header.indexCount * sizeof(UINT);
+	UINT64 meshletBytes = (UINT64)header.meshletCount * sizeof(Meshlet);
+	UINT64 lodBytes = (UINT64)header.lodCount * sizeof(MeshLod);
+	UINT64 submeshBytes = (UINT64)header.submeshCount * sizeof(Submesh);
+	if (header.vertexOffset + vertexBytes > size || header.indexOffset + indexBytes > size ||
+		header.meshletOffset + meshletBytes > size || header.lodOffset + lodBytes > size ||
+		header.submeshOffset + submeshBytes > size || header.materialOffset > size)
+		return false;
+
+	if (compressed)
+	{
+		// decoded straight into the final arrays
+		auto decodeStart = std::chrono::high_resolution_clock::now();
+
+		meshData.Vertices.resize(header.vertexCount);
+		meshData.Indices.resize(header.indexCount);
+		if ((header.vertexCount > 0 && !MeshCodec::Instance()->DecodeVertices(data + header.vertexOffset, (size_t)vertexBytes, &meshData.Vertices[0], header.vertexCount)) ||
+			(header.indexCount > 0 && !MeshCodec::Instance()->DecodeIndices(data + header.indexOffset, (size_t)indexBytes, &meshData.Indices[0], header.indexCount)))
+		{
+			meshData.Vertices.clear();
+			meshData.Indices.clear();
+			return false;
+		}
+
+		auto decodeEnd = std::chrono::high_resolution_clock::now();
+		double decodeSeconds = std::chrono::duration<double>(decodeEnd - decodeStart).count();
+		double rawBytes = (double)header.vertexCount * sizeof(Vertex) + (double)header.indexCount * sizeof(UINT);
+		DebugLog("MeshCache: %s decoded %.1f KB -> %.1f KB in %.2f ms (%.2f GB/s, %s)\n", sourceFile.c_str(),
+			(vertexBytes + indexBytes) / 1024.0, rawBytes / 1024.0, decodeSeconds * 1000.0,
+			decodeSeconds > 0.0 ? rawBytes / decodeSeconds / 1e9 : 0.0, MeshCodec::Instance()->GetUseSimd() ? "SSSE3" : "scalar");
+	}
+	else
+	{
+		// vertices and indices are copied as is, no per vertex work
+		const Vertex* vertices = (const Vertex*)(data + header.vertexOffset);
+		const UINT* indices = (const UINT*)(data + header.indexOffset);
+		meshData.Vertices.assign(vertices, vertices + header.vertexCount);
+		meshData.Indices.assign(indices, indices + header.indexCount);
+	}
+
+	const Meshlet* meshlets = (const Meshlet*)(data + header.meshletOffset);
+	meshData.Meshlets.assign(meshlets, meshlets + header.meshletCount);
+
+	const MeshLod* lods = (const MeshLod*)(data + header.lodOffset);
+	meshData.Lods.assign(lods, lods + header.lodCount);
+
+	const Submesh* submeshes = (const Submesh*)(data + header.submeshOffset);
+	meshData.Submeshes.assign(submeshes, submeshes + header.submeshCount);
+
+	meshData.materials.clear();
+	std::string sourceDirectory = GetDirectory(sourceFile);
+	UINT64 offset = header.materialOffset;
+	for (UINT i = 0; i < header.materialCount; ++i)
+	{
+		MeshCacheMaterial cachedMat;
+		if (offset + sizeof(cachedMat) > size)
+			return false;
+		memcpy(&cachedMat, data + offset, sizeof(cachedMat));
+		offset += sizeof(cachedMat);
+
+		if (offset + cachedMat.textureNameLength + cachedMat.normalTextureNameLength > size)
+			return false;
+
+		Material mat;
+		mat.Diffuse = cachedMat.diffuse;
+		mat.specExp = cachedMat.specExp;
+		mat.specIntensivity = cachedMat.specIntensivity;
+		mat.diffuseTexture.assign((const char*)(data + offset), cachedMat.textureNameLength);
+		offset += cachedMat.textureNameLength;
+		if (cachedMat.flags & MESH_CACHE_TEXTURE_RELATIVE)
+		{
+			mat.diffuseTexture = sourceDirectory + mat.diffuseTexture;
+		}
+		mat.normalTexture.assign((const char*)(data + offset), cachedMat.normalTextureNameLength);
+		offset += cachedMat.normalTextureNameLength;
+		if (cachedMat.flags & MESH_CACHE_NORMAL_TEXTURE_RELATIVE)
+		{
+			mat.normalTexture = sourceDirectory + mat.normalTexture;
+		}
+
+		meshData.materials[cachedMat.id] = mat;
+	}
+
+	meshData.bounds = BoundingBox(header.boundsCenter, header.boundsExtents);
+	meshData.world = XMMatrixIdentity();
+
+	return true;
+}
+
+bool MeshCache::Save(const std::string& sourceFile, UINT64 sourceHash, UINT64 sourceStamp, const MeshData& meshData)
+{
+	std::string cacheFile = GetCacheFileName(sourceFile);
+	std::ofstream out(cacheFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	MeshCacheHeader header = {};
+	header.version = mVersion;
+	header.sourceHash = sourceHash;
+	header.sourceStamp = sourceStamp;
+	header.vertexSize = sizeof(Vertex);
+	header.vertexCount = (UINT)meshData.Vertices.size();
+	header.indexCount = (UINT)meshData.Indices.size();
+	header.materialCount = (UINT)meshData.materials.size();
+	header.meshletCount = (UINT)meshData.Meshlets.size();
+	header.lodCount = (UINT)meshData.Lods.size();
+	header.submeshCount = (UINT)meshData.Submeshes.size();
+	header.boundsCenter = meshData.bounds.Center;
+	header.boundsExtents = meshData.bounds.Extents;
+
+	std::vector<BYTE> encodedVertices;
+	std::vector<BYTE> encodedIndices;
+	if (mCompress)
+	{
+		header.flags |= MESH_CACHE_COMPRESSED;
+		MeshCodec::Instance()->EncodeVertices(meshData.Vertices.empty() ? NULL : &meshData.Vertices[0], meshData.Vertices.size(), encodedVertices);
+		MeshCodec::Instance()->EncodeIndices(meshData.Indices.empty() ? NULL : &meshData.Indices[0], meshData.Indices.size(), encodedIndices);
+		header.vertexBytes = encodedVertices.size();
+		header.indexBytes = encodedIndices.size();
+
+#if defined(DEBUG) || defined(_DEBUG)
+		// round trip check of the codec on every cooked mesh
+		std::vector<Vertex> decodedVertices(meshData.Vertices.size());
+		std::vector<UINT> decodedIndices(meshData.Indices.size());
+		bool roundTrip =
+			(decodedVertices.empty() || MeshCodec::Instance()->DecodeVertices(&encodedVertices[0], encodedVertices.size(), &decodedVertices[0], decodedVertices.size())) &&
+			(decodedIndices.empty() || MeshCodec::Instance()->DecodeIndices(&encodedIndices[0], encodedIndices.size(), &decodedIndices[0], decodedIndices.size())) &&
+			(decodedVertices.empty() || memcmp(&decodedVertices[0], &meshData.Vertices[0], decodedVertices.size() * sizeof(Vertex)) == 0) &&
+			(decodedIndices.empty() || memcmp(&decodedIndices[0], &meshData.Indices[0], decodedIndices.size() * sizeof(UINT)) == 0);
+		assert(roundTrip);
+		if (!roundTrip)
+			return false;
+#endif
+
+		UINT64 rawVertexBytes = (UINT64)header.vertexCount * sizeof(Vertex);
+		UINT64 rawIndexBytes = (UINT64)header.indexCount * sizeof(UINT);
+		DebugLog("MeshCache: %s vertices %.1f KB -> %.1f KB (%.3f), indices %.1f KB -> %.1f KB (%.3f)\n", sourceFile.c_str(),
+			rawVertexBytes / 1024.0, header.vertexBytes / 1024.0, rawVertexBytes > 0 ? (double)header.vertexBytes / rawVertexBytes : 0.0,
+			rawIndexBytes / 1024.0, header.indexBytes / 1024.0, rawIndexBytes > 0 ? (double)header.indexBytes / rawIndexBytes : 0.0);
+	}
+	else
+	{
+		header.vertexBytes = (UINT64)header.vertexCount * sizeof(Vertex);
+		header.indexBytes = (UINT64)header.indexCount * sizeof(UINT);
+	}
+
+	header.vertexOffset = sizeof(MeshCacheHeader);
+	header.indexOffset = header.vertexOffset + header.vertexBytes;
+	header.meshletOffset = header.indexOffset + header.indexBytes;
+	header.lodOffset = header.meshletOffset + (UINT64)header.meshletCount * sizeof(Meshlet);
+	header.submeshOffset = header.lodOffset + (UINT64)header.lodCount * sizeof(MeshLod);
+	header.materialOffset = header.submeshOffset + (UINT64)header.submeshCount * sizeof(Submesh);
+
+	// The header is written with a zero magic first and patched once everything
+	// else is on disk, so a partially written cache is never accepted.
+	out.write((const char*)&header, sizeof(header));
+	if (mCompress)
+	{
+		if (!encodedVertices.empty())
+			out.write((const char*)&encodedVertices[0], encodedVertices.size());
+		if (!encodedIndices.empty())
+			out.write((const char*)&encodedIndices[0], encodedIndices.size());
+	}
+	else
+	{
+		if (!meshData.Vertices.empty())
+			out.write((const char*)&meshData.Vertices[0], sizeof(Vertex) * meshData.Vertices.size());
+		if (!meshData.Indices.empty())
+			out.write((const char*)&meshData.Indices[0], sizeof(UINT) * meshData.Indices.size());
+	}
+	if (!meshData.Meshlets.empty())
+		out.write((const char*)&meshData.Meshlets[0], sizeof(Meshlet) * meshData.Meshlets.size());
+	if (!meshData.Lods.empty())
+		out.write((const char*)&meshData.Lods[0], sizeof(MeshLod) * meshData.Lods.size());
+	if (!meshData.Submeshes.empty())
+		out.write((const char*)&meshData.Submeshes[0], sizeof(Submesh) * meshData.Submeshes.size());
+
+	// Textures next to the source are stored relative to it, so cooked files
+	// stay valid when the asset directory is cooked from somewhere else
+	std::string sourceDirectory = GetDirectory(sourceFile);
+	for (auto it = meshData.materials.begin(); it != meshData.materials.end(); ++it)
+	{
+		MeshCacheMaterial cachedMat;
+		cachedMat.id = it->first;
+		cachedMat.diffuse = it->second.Diffuse;
+		cachedMat.specExp = it->second.specExp;
+		cachedMat.specIntensivity = it->second.specIntensivity;
+		cachedMat.flags = 0;
+		std::string textureName = GetCachedTextureName(it->second.diffuseTexture, sourceDirectory, MESH_CACHE_TEXTURE_RELATIVE, cachedMat.flags);
+		std::string normalTextureName = GetCachedTextureName(it->second.normalTexture, sourceDirectory, MESH_CACHE_NORMAL_TEXTURE_RELATIVE, cachedMat.flags);
+		cachedMat.textureNameLength = (UINT)textureName.size();
+		cachedMat.normalTextureNameLength = (UINT)normalTextureName.size();
+		out.write((const char*)&cachedMat, sizeof(cachedMat));
+		out.write(textureName.c_str(), cachedMat.textureNameLength);
+		out.write(normalTextureName.c_str(), cachedMat.normalTextureNameLength);
+	}
+
+	header.magic = mMagic;
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+
+	if (!out)
+	{
+		out.close();
+		remove(cacheFile.c_str());
+		return false;
+	}
+
+	return true;
+}
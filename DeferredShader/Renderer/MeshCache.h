@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// MeshCache
+// singleton class, cooks MeshData into a binary file next to the source asset
+// so the text formats only need to be parsed once. usage:
+// UINT64 stamp = MeshCache::StampFiles(std::vector<std::string>(1, "..\\Assets\\bunny.obj"));
+// if (!MeshCache::Instance()->LoadUnchanged("..\\Assets\\bunny.obj", stamp, meshData)) {
+//     parse the .obj, then
+//     MeshCache::Instance()->Save("..\\Assets\\bunny.obj", MeshCache::Instance()->HashFile("..\\Assets\\bunny.obj"), stamp, meshData)
+// }
+// The runtime checks the sizes and last write times of the sources and only reads them
+// to cook a missing or stale cache, the cooker checks the content hash.
+// Cache file layout: MeshCacheHeader, vertices, indices, meshlets, lods, submeshes, materials.
+// Vertices and indices are MeshCodec compressed unless compression is turned off.
+// Each material is a MeshCacheMaterial followed by its diffuse and normal texture names,
+// textures in the directory of the source file are stored relative to it.
+class MeshCache
+{
+public:
+	static MeshCache* Instance();
+
+	// Loads the cooked mesh of sourceFile. Fails if there is no cache, the cache
+	// was written by another version or the source hash does not match.
+	// sourceHash 0 means the source is not available and any valid cache is accepted.
+	bool Load(const std::string& sourceFile, UINT64 sourceHash, MeshData& meshData);
+
+	// Load for the runtime, without reading the sources: sourceStamp has to be the one Save stored.
+	// sourceStamp 0 means the sources are not available and any valid cache is accepted.
+	bool LoadUnchanged(const std::string& sourceFile, UINT64 sourceStamp, MeshData& meshData);
+
+	// Writes the cooked mesh of sourceFile, sourceStamp is the StampFiles of its sources
+	bool Save(const std::string& sourceFile, UINT64 sourceHash, UINT64 sourceStamp, const MeshData& meshData);
+
+	// Content hash of a file, returns 0 if the file can not be read
+	UINT64 HashFile(const std::string& fileName);
+
+	// Hash of the sizes and last write times of the files a mesh is cooked from,
+	// returns 0 if one of them is not a file
+	static UINT64 StampFiles(const std::vector<std::string>& fileNames);
+
+	// Name of the cache file for sourceFile
+	static std::string GetCacheFileName(const std::string& sourceFile);
+
+	// Enable/disable MeshCodec compression of the vertices and indices written by Save, on by default.
+	// Load reads both kinds of files.
+	void SetCompression(bool compress) { mCompress = compress; }
+
+	// 'DSMC'
+	static const UINT mMagic = 0x434D5344;
+	// bump this whenever the layout or the cooked data changes
+	static const UINT mVersion = 10;
+
+private:
+	MeshCache();
+	~MeshCache();
+
+	// Load and LoadUnchanged, a zero sourceHash or sourceStamp is not checked
+	bool Read(const std::string& sourceFile, UINT64 sourceHash, UINT64 sourceStamp, MeshData& meshData);
+
+	bool mCompress;
+
+	static MeshCache* mInstance;
+};
@@ -0,0 +1,266 @@
+#include "MeshCodec.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MESHCODEC_SSSE3
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MESHCODEC_TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define MESHCODEC_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace
+{
+	const BYTE INDEX_WIDTHS[4] = { 0, 1, 2, 4 };
+	const BYTE VERTEX_WIDTHS[4] = { 0, 2, 3, 4 };
+
+	// Vertices are coded as 12 consecutive 32 bit values, 3 groups
+	const size_t VERTEX_VALUES = sizeof(Vertex) / sizeof(UINT);
+	const size_t VERTEX_GROUPS = VERTEX_VALUES / 4;
+	static_assert(sizeof(Vertex) == 12 * sizeof(float), "MeshCodec expects Vertex to be 12 floats");
+
+	inline UINT ZigzagEncode(UINT delta)
+	{
+		return (delta << 1) ^ (UINT)((int)delta >> 31);
+	}
+
+	inline UINT ZigzagDecode(UINT value)
+	{
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	bool CpuHasSsse3()
+	{
+#if defined(MESHCODEC_SSSE3) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#elif defined(MESHCODEC_SSSE3)
+		unsigned int eax, ebx, ecx, edx;
+		return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 9)) != 0;
+#else
+		return false;
+#endif
+	}
+
+#ifdef MESHCODEC_SSSE3
+	MESHCODEC_TARGET_SSSE3
+	inline __m128i DecodeGroup(const BYTE*& values, BYTE control, const BYTE lengths[256], const BYTE shuffles[256][16])
+	{
+		__m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)values), _mm_loadu_si128((const __m128i*)shuffles[control]));
+		values += lengths[control];
+
+		// zigzag decode
+		return _mm_xor_si128(_mm_srli_epi32(x, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(x, _mm_set1_epi32(1))));
+	}
+#endif
+}
+
+MeshCodec* MeshCodec::mInstance = NULL;
+
+MeshCodec* MeshCodec::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshCodec;
+	return mInstance;
+}
+
+MeshCodec::MeshCodec()
+{
+	BuildCode(INDEX_WIDTHS, mIndexCode);
+	BuildCode(VERTEX_WIDTHS, mVertexCode);
+
+	mHasSsse3 = CpuHasSsse3();
+	mUseSimd = mHasSsse3;
+}
+
+MeshCodec::~MeshCodec()
+{
+}
+
+void MeshCodec::BuildCode(const BYTE widths[4], ByteGroupCode& code)
+{
+	memcpy(code.widths, widths, sizeof(code.widths));
+
+	for (UINT control = 0; control < 256; ++control)
+	{
+		BYTE offset = 0;
+		for (UINT lane = 0; lane < 4; ++lane)
+		{
+			BYTE width = widths[(control >> (lane * 2)) & 3];
+			for (UINT b = 0; b < 4; ++b)
+			{
+				// 0x80 makes pshufb write a zero byte
+				code.shuffles[control][lane * 4 + b] = b < width ? (BYTE)(offset + b) : 0x80;
+			}
+			offset += width;
+		}
+		code.lengths[control] = offset;
+	}
+}
+
+size_t MeshCodec::GetEncodedBound(size_t count)
+{
+	return (count + 3) / 4 + count * sizeof(UINT);
+}
+
+void MeshCodec::Encode(const ByteGroupCode& code, const UINT* values, size_t count, size_t stride, std::vector<BYTE>& encoded)
+{
+	size_t groupCount = (count + 3) / 4;
+	size_t controlStart = encoded.size();
+	encoded.reserve(controlStart + GetEncodedBound(count));
+	encoded.resize(controlStart + groupCount);
+
+	for (size_t g = 0; g < groupCount; ++g)
+	{
+		BYTE control = 0;
+		for (size_t lane = 0; lane < 4 && g * 4 + lane < count; ++lane)
+		{
+			size_t i = g * 4 + lane;
+			UINT prediction = i >= stride ? values[i - stride] : 0;
+			UINT value = ZigzagEncode(values[i] - prediction);
+
+			// smallest width the value fits in, unused lanes of the last group keep code 0
+			UINT c = 0;
+			while (code.widths[c] < 4 && (value >> (code.widths[c] * 8)) != 0)
+				c++;
+
+			control |= (BYTE)(c << (lane * 2));
+			for (UINT b = 0; b < code.widths[c]; ++b)
+				encoded.push_back((BYTE)(value >> (b * 8)));
+		}
+		encoded[controlStart + g] = control;
+	}
+}
+
+void MeshCodec::EncodeIndices(const UINT* indices, size_t indexCount, std::vector<BYTE>& encoded)
+{
+	encoded.clear();
+	Encode(mIndexCode, indices, indexCount, 1, encoded);
+}
+
+void MeshCodec::EncodeVertices(const Vertex* vertices, size_t vertexCount, std::vector<BYTE>& encoded)
+{
+	encoded.clear();
+	Encode(mVertexCode, (const UINT*)vertices, vertexCount * VERTEX_VALUES, VERTEX_VALUES, encoded);
+}
+
+bool MeshCodec::Validate(const ByteGroupCode& code, const BYTE* data, size_t size, size_t count)
+{
+	size_t groupCount = (count + 3) / 4;
+	if (groupCount > size)
+		return false;
+
+	size_t dataSize = 0;
+	for (size_t g = 0; g < groupCount; ++g)
+		dataSize += code.lengths[data[g]];
+
+	return groupCount + dataSize <= size;
+}
+
+void MeshCodec::DecodeScalar(const ByteGroupCode& code, const BYTE* controls, const BYTE* values, UINT* out, size_t first, size_t count, size_t stride)
+{
+	for (size_t i = first; i < count; ++i)
+	{
+		UINT width = code.widths[(controls[i / 4] >> ((i & 3) * 2)) & 3];
+		UINT value = 0;
+		for (UINT b = 0; b < width; ++b)
+			value |= (UINT)values[b] << (b * 8);
+		values += width;
+
+		UINT prediction = i >= stride ? out[i - stride] : 0;
+		out[i] = prediction + ZigzagDecode(value);
+	}
+}
+
+bool MeshCodec::DecodeIndices(const BYTE* data, size_t size, UINT* indices, size_t indexCount)
+{
+	if (!Validate(mIndexCode, data, size, indexCount))
+		return false;
+
+#ifdef MESHCODEC_SSSE3
+	if (mUseSimd)
+	{
+		DecodeIndicesSimd(data, indices, indexCount, data + size);
+		return true;
+	}
+#endif
+
+	DecodeScalar(mIndexCode, data, data + (indexCount + 3) / 4, indices, 0, indexCount, 1);
+	return true;
+}
+
+bool MeshCodec::DecodeVertices(const BYTE* data, size_t size, Vertex* vertices, size_t vertexCount)
+{
+	size_t count = vertexCount * VERTEX_VALUES;
+	if (!Validate(mVertexCode, data, size, count))
+		return false;
+
+#ifdef MESHCODEC_SSSE3
+	if (mUseSimd)
+	{
+		DecodeVerticesSimd(data, vertices, vertexCount, data + size);
+		return true;
+	}
+#endif
+
+	DecodeScalar(mVertexCode, data, data + count / 4, (UINT*)vertices, 0, count, VERTEX_VALUES);
+	return true;
+}
+
+#ifdef MESHCODEC_SSSE3
+MESHCODEC_TARGET_SSSE3
+void MeshCodec::DecodeIndicesSimd(const BYTE* data, UINT* indices, size_t indexCount, const BYTE* end)
+{
+	const BYTE* controls = data;
+	const BYTE* values = data + (indexCount + 3) / 4;
+
+	// Full groups while a 16 byte load stays inside the data, the rest is scalar
+	__m128i previous = _mm_setzero_si128();
+	size_t g = 0;
+	for (; g < indexCount / 4 && values + 16 <= end; ++g)
+	{
+		__m128i x = DecodeGroup(values, controls[g], mIndexCode.lengths, mIndexCode.shuffles);
+
+		// prefix sum of the deltas plus the last index of the previous group
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi32(x, previous);
+		_mm_storeu_si128((__m128i*)(indices + g * 4), x);
+
+		previous = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	DecodeScalar(mIndexCode, controls, values, indices, g * 4, indexCount, 1);
+}
+
+MESHCODEC_TARGET_SSSE3
+void MeshCodec::DecodeVerticesSimd(const BYTE* data, Vertex* vertices, size_t vertexCount, const BYTE* end)
+{
+	const BYTE* controls = data;
+	const BYTE* values = data + vertexCount * VERTEX_VALUES / 4;
+
+	// A vertex is three groups, the components of the previous vertex stay in registers
+	__m128i previous0 = _mm_setzero_si128();
+	__m128i previous1 = _mm_setzero_si128();
+	__m128i previous2 = _mm_setzero_si128();
+	size_t v = 0;
+	for (; v < vertexCount && values + 16 * VERTEX_GROUPS <= end; ++v)
+	{
+		const BYTE* control = controls + v * VERTEX_GROUPS;
+		previous0 = _mm_add_epi32(previous0, DecodeGroup(values, control[0], mVertexCode.lengths, mVertexCode.shuffles));
+		previous1 = _mm_add_epi32(previous1, DecodeGroup(values, control[1], mVertexCode.lengths, mVertexCode.shuffles));
+		previous2 = _mm_add_epi32(previous2, DecodeGroup(values, control[2], mVertexCode.lengths, mVertexCode.shuffles));
+
+		__m128i* out = (__m128i*)(vertices + v);
+		_mm_storeu_si128(out + 0, previous0);
+		_mm_storeu_si128(out + 1, previous1);
+		_mm_storeu_si128(out + 2, previous2);
+	}
+
+	DecodeScalar(mVertexCode, controls, values, (UINT*)vertices, v * VERTEX_VALUES, vertexCount * VERTEX_VALUES, VERTEX_VALUES);
+}
+#endif
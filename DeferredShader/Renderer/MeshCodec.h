@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// MeshCodec
+// singleton class, lossless compression of cooked vertex and index buffers
+// usage:
+// std::vector<BYTE> encoded;
+// MeshCodec::Instance()->EncodeIndices(&indices[0], indices.size(), encoded)
+// MeshCodec::Instance()->DecodeIndices(&encoded[0], encoded.size(), &indices[0], indices.size())
+//
+// Both streams are filtered into small unsigned integers and stored with a
+// byte group code: every group of four values has one control byte holding
+// a 2 bit width code per value, the control bytes are followed by the value
+// bytes. A group decodes with a single shuffle, so decoding runs at memory
+// speed with SSSE3 and falls back to scalar code on other CPUs.
+// - Indices: delta to the previous index, zigzag, widths 0/1/2/4 bytes.
+//   After the vertex cache optimization most deltas take one byte.
+// - Vertices: every float component (position, normal, texcoord, tangent) is a delta
+//   chain of its bit pattern against the same component of the previous
+//   vertex, zigzag, widths 0/2/3/4 bytes. OptimizeVertexFetch orders vertices
+//   by first use, so neighbouring vertices are neighbours on the surface too
+//   and most deltas only differ in the mantissa.
+class MeshCodec
+{
+public:
+	static MeshCodec* Instance();
+
+	// Largest encoded size of count values
+	static size_t GetEncodedBound(size_t count);
+
+	void EncodeIndices(const UINT* indices, size_t indexCount, std::vector<BYTE>& encoded);
+	void EncodeVertices(const Vertex* vertices, size_t vertexCount, std::vector<BYTE>& encoded);
+
+	// Decode exactly indexCount / vertexCount elements, return false on
+	// truncated or malformed data
+	bool DecodeIndices(const BYTE* data, size_t size, UINT* indices, size_t indexCount);
+	bool DecodeVertices(const BYTE* data, size_t size, Vertex* vertices, size_t vertexCount);
+
+	// SSSE3 decoding is used when the CPU supports it, can be turned off to compare
+	bool HasSimdDecode() const { return mHasSsse3; }
+	bool GetUseSimd() const { return mUseSimd; }
+	void SetUseSimd(bool useSimd) { mUseSimd = useSimd && mHasSsse3; }
+
+private:
+	MeshCodec();
+	~MeshCodec();
+
+	// Byte widths of the four codes, data bytes and pshufb mask of every control byte
+	struct ByteGroupCode
+	{
+		BYTE widths[4];
+		BYTE lengths[256];
+		BYTE shuffles[256][16];
+	};
+
+	static void BuildCode(const BYTE widths[4], ByteGroupCode& code);
+
+	// value i is predicted by value i - stride, stride is 1 for indices and 12 for vertices
+	static void Encode(const ByteGroupCode& code, const UINT* values, size_t count, size_t stride, std::vector<BYTE>& encoded);
+
+	// Checks that the control bytes and the data they describe fit into size
+	static bool Validate(const ByteGroupCode& code, const BYTE* data, size_t size, size_t count);
+
+	// Decodes values [first, count), first is a multiple of 4 and values reads
+	// the data of group first / 4
+	static void DecodeScalar(const ByteGroupCode& code, const BYTE* controls, const BYTE* values, UINT* out, size_t first, size_t count, size_t stride);
+
+	void DecodeIndicesSimd(const BYTE* data, UINT* indices, size_t indexCount, const BYTE* end);
+	void DecodeVerticesSimd(const BYTE* data, Vertex* vertices, size_t vertexCount, const BYTE* end);
+
+	ByteGroupCode mIndexCode;
+	ByteGroupCode mVertexCode;
+
+	bool mHasSsse3;
+	bool mUseSimd;
+
+	static MeshCodec* mInstance;
+};
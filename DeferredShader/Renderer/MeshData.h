@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Util.h"
+#include <DirectXCollision.h>
+#include <DirectXPackedVector.h>
+
+// CPU side mesh data filled by the loaders and the mesh processing steps,
+// Mesh::Create uploads it. Free of D3D so the asset tools can cook meshes.
+
+struct Vertex
+{
+	Vertex() : Position(0.0f, 0.0f, 0.0f), Normal(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f), Tangent(1.0f, 0.0f, 0.0f, 1.0f) {}
+	Vertex(const XMFLOAT3& p, const XMFLOAT3& n, const XMFLOAT2& uv)
+		: Position(p), Normal(n), Tex(uv), Tangent(1.0f, 0.0f, 0.0f, 1.0f) {}
+	Vertex(
+		float px, float py, float pz,
+		float nx, float ny, float nz,
+		float u, float v)
+		: Position(px, py, pz), Normal(nx, ny, nz), Tex(u, v), Tangent(1.0f, 0.0f, 0.0f, 1.0f) {}
+	Vertex(
+		float px, float py, float pz)
+		: Position(px, py, pz), Normal(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f), Tangent(1.0f, 0.0f, 0.0f, 1.0f) {}
+
+	XMFLOAT3 Position;
+	XMFLOAT3 Normal;
+	XMFLOAT2 Tex;
+
+	// MikkTSpace tangent, w is the bitangent sign: bitangent = w * cross(Normal, Tangent.xyz)
+	XMFLOAT4 Tangent;
+};
+
+// Compact 16 byte vertex used when the loader quantizes the mesh:
+// position is 16 bit UNORM relative to the mesh AABB, normal is octahedral
+// encoded in 2x16 bit SNORM and texcoord is half float.
+// Dequantize the position with MeshData::positionScale / positionOffset.
+// Position[3] holds the tangent, see VertexQuantizer::EncodeTangent.
+struct PackedVertex
+{
+	USHORT Position[4];
+	SHORT Normal[2];
+	DirectX::PackedVector::HALF Tex[2];
+};
+
+// Cluster of consecutive triangles, a contiguous range of the index buffer
+// with object space bounds for CPU cluster culling
+struct Meshlet
+{
+	UINT indexStart;
+	UINT indexCount;
+	BoundingSphere bounds;
+
+	// Normal cone: every triangle faces within the cone around coneAxis.
+	// coneCutoff is the sine of the cone half angle, 1 disables the cone test.
+	XMFLOAT3 coneAxis;
+	float coneCutoff;
+};
+
+// Index range of one level of detail, all levels share the vertex buffer
+struct MeshLod
+{
+	UINT indexStart;
+	UINT indexCount;
+	float error;	// object space geometric error of the level, 0 for the full mesh
+
+	// submeshes of the level, they split [indexStart, indexStart + indexCount) by material
+	UINT submeshStart;
+	UINT submeshCount;
+};
+
+// Triangles of one material in one level of detail, a contiguous range of the index buffer.
+// Only LOD 0 submeshes have meshlets, a range of MeshData::Meshlets.
+struct Submesh
+{
+	UINT materialId;
+	UINT indexStart;
+	UINT indexCount;
+	UINT meshletStart;
+	UINT meshletCount;
+};
+
+// Range of the index buffer for DrawIndexed
+struct DrawRange
+{
+	UINT indexStart;
+	UINT indexCount;
+};
+
+
+struct Material
+{
+	Material() : Diffuse(0.0f, 0.0f, 0.0f, 0.0f), specExp(0.0f), specIntensivity(0.0f) {}
+
+	XMFLOAT4 Diffuse;
+	std::string diffuseTexture;
+	std::string normalTexture;	// tangent space normal map
+	float specExp;
+	float specIntensivity;
+
+};
+
+struct MeshData
+{
+	std::vector<Vertex> Vertices;
+	std::vector<UINT> Indices;
+	std::map<UINT, Material> materials;
+	XMMATRIX world;
+
+	// object space bounds of the vertices
+	BoundingBox bounds;
+
+	// Quantized copy of Vertices, uploaded instead of them when not empty.
+	// object space position = packed position * positionScale + positionOffset
+	std::vector<PackedVertex> PackedVertices;
+	XMFLOAT3 positionScale;
+	XMFLOAT3 positionOffset;
+
+	// Meshlets covering the LOD 0 indices in order, see MeshletBuilder
+	std::vector<Meshlet> Meshlets;
+
+	// Levels of detail, ranges of Indices from full to coarsest, see MeshSimplifier.
+	// Empty means Indices is a single full level.
+	std::vector<MeshLod> Lods;
+
+	// Per material index ranges of all levels, sorted by material within a level.
+	// Before the LODs are generated these are the LOD 0 ranges, empty means
+	// every level is drawn with the first material.
+	std::vector<Submesh> Submeshes;
+};
@@ -0,0 +1,575 @@
+#include "MeshOptimizer.h"
+#include "Parallel.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline float Length(const XMFLOAT3& a)
+	{
+		return sqrtf(Dot(a, a));
+	}
+
+	// Cluster of consecutive triangles for the overdraw sort
+	struct TriangleCluster
+	{
+		size_t start;
+		size_t count;
+		float sortKey;
+	};
+}
+
+MeshOptimizer* MeshOptimizer::mInstance = 0;
+
+MeshOptimizer* MeshOptimizer::Instance()
+{
+	if (mInstance == 0)
+	{
+		mInstance = new MeshOptimizer();
+	}
+	return mInstance;
+}
+
+MeshOptimizer::MeshOptimizer() : mAnalyzeOverdraw(false)
+{
+}
+
+MeshOptimizer::~MeshOptimizer()
+{
+}
+
+void MeshOptimizer::Optimize(MeshData& meshData)
+{
+	if (meshData.Indices.empty() || meshData.Vertices.empty())
+		return;
+
+	// Triangles are only reordered inside their material range
+	std::vector<DrawRange> ranges;
+	for (size_t i = 0; i < meshData.Submeshes.size(); ++i)
+	{
+		DrawRange range = { meshData.Submeshes[i].indexStart, meshData.Submeshes[i].indexCount };
+		ranges.push_back(range);
+	}
+	if (ranges.empty())
+	{
+		DrawRange range = { 0, (UINT)meshData.Indices.size() };
+		ranges.push_back(range);
+	}
+
+	size_t indexCount = meshData.Indices.size();
+	VertexCacheStats before = AnalyzeVertexCache(&meshData.Indices[0], indexCount, meshData.Vertices.size());
+
+	std::vector<UINT> originalIndices(meshData.Indices);
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		OptimizeVertexCache(&meshData.Indices[ranges[i].indexStart], ranges[i].indexCount, meshData.Vertices.size());
+	}
+
+	// keep the input order if it was already better, e.g. meshes exported in strip order
+	VertexCacheStats optimized = AnalyzeVertexCache(&meshData.Indices[0], indexCount, meshData.Vertices.size());
+	if (optimized.acmr > before.acmr)
+	{
+		meshData.Indices.swap(originalIndices);
+	}
+
+	// cluster sort for less overdraw, when analyzed only if it helps
+	OverdrawStats overdrawBefore = { 0, 0, 0.0f };
+	if (mAnalyzeOverdraw)
+	{
+		overdrawBefore = AnalyzeOverdraw(&meshData.Indices[0], indexCount, &meshData.Vertices[0], meshData.Vertices.size());
+	}
+	OverdrawStats overdrawAfter = overdrawBefore;
+
+	std::vector<UINT> cacheOrderIndices;
+	if (mAnalyzeOverdraw)
+	{
+		cacheOrderIndices = meshData.Indices;
+	}
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		OptimizeOverdraw(&meshData.Indices[ranges[i].indexStart], ranges[i].indexCount, &meshData.Vertices[0], meshData.Vertices.size());
+	}
+	if (mAnalyzeOverdraw)
+	{
+		overdrawAfter = AnalyzeOverdraw(&meshData.Indices[0], indexCount, &meshData.Vertices[0], meshData.Vertices.size());
+		if (overdrawAfter.overdraw > overdrawBefore.overdraw)
+		{
+			meshData.Indices.swap(cacheOrderIndices);
+			overdrawAfter = overdrawBefore;
+		}
+	}
+
+	OptimizeVertexFetch(meshData);
+
+	VertexCacheStats after = AnalyzeVertexCache(&meshData.Indices[0], indexCount, meshData.Vertices.size());
+
+	if (mAnalyzeOverdraw)
+	{
+		DebugLog("MeshOptimizer: %u triangles in %u ranges, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (cache size %u), overdraw %.3f -> %.3f\n",
+			(UINT)(indexCount / 3), (UINT)ranges.size(), before.acmr, after.acmr, before.atvr, after.atvr, mDefaultCacheSize,
+			overdrawBefore.overdraw, overdrawAfter.overdraw);
+	}
+	else
+	{
+		DebugLog("MeshOptimizer: %u triangles in %u ranges, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (cache size %u)\n",
+			(UINT)(indexCount / 3), (UINT)ranges.size(), before.acmr, after.acmr, before.atvr, after.atvr, mDefaultCacheSize);
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT* indices, size_t indexCount, size_t vertexCount, UINT cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// Vertex -> triangle adjacency, liveTriangles[v] counts the not yet emitted triangles of v
+	std::vector<UINT> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		liveTriangles[indices[i]]++;
+	}
+
+	std::vector<UINT> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<UINT> adjacency(triangleCount * 3);
+	std::vector<UINT> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			UINT v = indices[t * 3 + k];
+			adjacency[fill[v]++] = (UINT)t;
+		}
+	}
+
+	std::vector<UINT> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<UINT> deadEnd;
+	std::vector<UINT> candidates;
+	deadEnd.reserve(triangleCount * 3);
+	candidates.reserve(64);
+
+	std::vector<UINT> output;
+	output.reserve(triangleCount * 3);
+
+	UINT time = cacheSize + 1;
+	size_t cursor = 0;
+
+	// start from the first referenced vertex
+	int fanVertex = -1;
+	while (cursor < vertexCount && fanVertex < 0)
+	{
+		if (liveTriangles[cursor] > 0)
+			fanVertex = (int)cursor;
+		++cursor;
+	}
+
+	while (fanVertex >= 0)
+	{
+		candidates.clear();
+
+		// emit all remaining triangles around the fanning vertex
+		for (UINT a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; ++a)
+		{
+			UINT t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT v = indices[t * 3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+
+				// not in cache anymore, the vertex gets transformed again
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time;
+					time++;
+				}
+			}
+
+			emitted[t] = true;
+		}
+
+		// next fanning vertex, prefer the one that stays in cache for all its triangles
+		int bestVertex = -1;
+		int bestPriority = -1;
+		for (size_t c = 0; c < candidates.size(); ++c)
+		{
+			UINT v = candidates[c];
+			if (liveTriangles[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = (int)(time - cacheTime[v]);
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				bestVertex = (int)v;
+			}
+		}
+
+		// dead end, backtrack through the recently emitted vertices and then scan in input order
+		while (bestVertex < 0 && !deadEnd.empty())
+		{
+			UINT v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				bestVertex = (int)v;
+		}
+
+		while (bestVertex < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0)
+				bestVertex = (int)cursor;
+			++cursor;
+		}
+
+		fanVertex = bestVertex;
+	}
+
+	memcpy(indices, &output[0], output.size() * sizeof(UINT));
+}
+
+void MeshOptimizer::OptimizeOverdraw(UINT* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	float threshold, UINT cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// Hard boundaries: triangles whose three vertices all miss the cache,
+	// that is where Tipsify jumped to a new fan
+	std::vector<size_t> hardBoundaries;
+	{
+		std::vector<UINT> insertTime(vertexCount, 0);
+		UINT time = cacheSize + 1;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT v = indices[t * 3 + k];
+				if (time - insertTime[v] > cacheSize)
+				{
+					insertTime[v] = time;
+					time++;
+					misses++;
+				}
+			}
+
+			if (t == 0 || misses == 3)
+				hardBoundaries.push_back(t);
+		}
+		hardBoundaries.push_back(triangleCount);
+	}
+
+	// Soft boundaries: split a hard cluster as soon as the part so far has an ACMR
+	// within threshold of the whole hard cluster, each part starting with a cold cache
+	std::vector<TriangleCluster> clusters;
+	std::vector<UINT> insertTime(vertexCount, 0);
+	UINT time = cacheSize + 1;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+	{
+		size_t start = hardBoundaries[h];
+		size_t end = hardBoundaries[h + 1];
+
+		time += cacheSize + 1;
+		UINT hardMisses = 0;
+		for (size_t i = start * 3; i < end * 3; ++i)
+		{
+			UINT v = indices[i];
+			if (time - insertTime[v] > cacheSize)
+			{
+				insertTime[v] = time;
+				time++;
+				hardMisses++;
+			}
+		}
+		float hardAcmr = (float)hardMisses / (end - start);
+
+		time += cacheSize + 1;
+		size_t clusterStart = start;
+		UINT clusterMisses = 0;
+		for (size_t t = start; t < end; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT v = indices[t * 3 + k];
+				if (time - insertTime[v] > cacheSize)
+				{
+					insertTime[v] = time;
+					time++;
+					clusterMisses++;
+				}
+			}
+
+			size_t clusterTriangles = t + 1 - clusterStart;
+			if ((float)clusterMisses / clusterTriangles <= hardAcmr * threshold || t + 1 == end)
+			{
+				TriangleCluster cluster = { clusterStart, clusterTriangles, 0.0f };
+				clusters.push_back(cluster);
+
+				clusterStart = t + 1;
+				clusterMisses = 0;
+				time += cacheSize + 1;
+			}
+		}
+	}
+
+	// Area weighted centroid of the whole mesh
+	XMFLOAT3 meshCentroid(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const XMFLOAT3& a = vertices[indices[t * 3 + 0]].Position;
+		const XMFLOAT3& b = vertices[indices[t * 3 + 1]].Position;
+		const XMFLOAT3& c = vertices[indices[t * 3 + 2]].Position;
+		float area = Length(Cross(Sub(b, a), Sub(c, a)));
+		meshCentroid.x += (a.x + b.x + c.x) * area;
+		meshCentroid.y += (a.y + b.y + c.y) * area;
+		meshCentroid.z += (a.z + b.z + c.z) * area;
+		meshArea += area * 3.0f;
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid.x /= meshArea;
+		meshCentroid.y /= meshArea;
+		meshCentroid.z /= meshArea;
+	}
+
+	// Sort key: how far the cluster lies outwards along its own average normal.
+	// Clusters on the outside facing away from the center are likely to occlude the others.
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		XMFLOAT3 centroid(0.0f, 0.0f, 0.0f);
+		XMFLOAT3 normal(0.0f, 0.0f, 0.0f);
+		float clusterArea = 0.0f;
+		for (size_t t = clusters[c].start; t < clusters[c].start + clusters[c].count; ++t)
+		{
+			const XMFLOAT3& a = vertices[indices[t * 3 + 0]].Position;
+			const XMFLOAT3& b = vertices[indices[t * 3 + 1]].Position;
+			const XMFLOAT3& p = vertices[indices[t * 3 + 2]].Position;
+			XMFLOAT3 n = Cross(Sub(b, a), Sub(p, a));
+			float area = Length(n);
+			centroid.x += (a.x + b.x + p.x) * area;
+			centroid.y += (a.y + b.y + p.y) * area;
+			centroid.z += (a.z + b.z + p.z) * area;
+			normal.x += n.x;
+			normal.y += n.y;
+			normal.z += n.z;
+			clusterArea += area * 3.0f;
+		}
+
+		float normalLength = Length(normal);
+		if (clusterArea > 0.0f && normalLength > 0.0f)
+		{
+			centroid = XMFLOAT3(centroid.x / clusterArea, centroid.y / clusterArea, centroid.z / clusterArea);
+			normal = XMFLOAT3(normal.x / normalLength, normal.y / normalLength, normal.z / normalLength);
+			clusters[c].sortKey = Dot(Sub(centroid, meshCentroid), normal);
+		}
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(),
+		[](const TriangleCluster& a, const TriangleCluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<UINT> output;
+	output.reserve(triangleCount * 3);
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		output.insert(output.end(), indices + clusters[c].start * 3, indices + (clusters[c].start + clusters[c].count) * 3);
+	}
+
+	memcpy(indices, &output[0], output.size() * sizeof(UINT));
+}
+
+void MeshOptimizer::OptimizeVertexFetch(MeshData& meshData)
+{
+	const UINT unused = 0xffffffff;
+	std::vector<UINT> remap(meshData.Vertices.size(), unused);
+	std::vector<Vertex> vertices;
+	vertices.reserve(meshData.Vertices.size());
+
+	for (size_t i = 0; i < meshData.Indices.size(); ++i)
+	{
+		UINT& index = meshData.Indices[i];
+		if (remap[index] == unused)
+		{
+			remap[index] = (UINT)vertices.size();
+			vertices.push_back(meshData.Vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	meshData.Vertices.swap(vertices);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const UINT* indices, size_t indexCount, size_t vertexCount, UINT cacheSize)
+{
+	VertexCacheStats stats;
+	stats.cacheMisses = 0;
+
+	// FIFO: a vertex is in the cache if it was inserted less than cacheSize misses ago
+	std::vector<UINT> insertTime(vertexCount, 0);
+	UINT time = cacheSize + 1;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		UINT v = indices[i];
+		if (time - insertTime[v] > cacheSize)
+		{
+			insertTime[v] = time;
+			time++;
+			stats.cacheMisses++;
+		}
+	}
+
+	size_t triangleCount = indexCount / 3;
+	stats.acmr = triangleCount > 0 ? (float)stats.cacheMisses / triangleCount : 0.0f;
+	stats.atvr = vertexCount > 0 ? (float)stats.cacheMisses / vertexCount : 0.0f;
+
+	return stats;
+}
+
+OverdrawStats MeshOptimizer::AnalyzeOverdraw(const UINT* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	UINT viewCount, UINT resolution)
+{
+	OverdrawStats stats;
+	stats.pixelsCovered = 0;
+	stats.pixelsShaded = 0;
+	stats.overdraw = 0.0f;
+
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0 || viewCount == 0)
+		return stats;
+
+	// Bounding sphere from the AABB, all views fit it to the viewport
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const XMFLOAT3& p = vertices[v].Position;
+		boundsMin = XMFLOAT3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+		boundsMax = XMFLOAT3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+	}
+	XMFLOAT3 center((boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f);
+	float radius = Length(Sub(boundsMax, center));
+	if (radius <= 0.0f)
+		return stats;
+
+	std::vector<UINT> viewCovered(viewCount, 0);
+	std::vector<UINT> viewShaded(viewCount, 0);
+
+	ParallelFor(viewCount, [&](size_t view)
+	{
+		// Fibonacci sphere directions
+		float y = 1.0f - 2.0f * (view + 0.5f) / viewCount;
+		float r = sqrtf(std::max(0.0f, 1.0f - y * y));
+		float phi = view * 2.39996323f;
+		XMFLOAT3 forward(r * cosf(phi), y, r * sinf(phi));
+
+		XMFLOAT3 up = fabsf(forward.y) < 0.99f ? XMFLOAT3(0.0f, 1.0f, 0.0f) : XMFLOAT3(1.0f, 0.0f, 0.0f);
+		XMFLOAT3 right = Cross(up, forward);
+		float rightLength = Length(right);
+		right = XMFLOAT3(right.x / rightLength, right.y / rightLength, right.z / rightLength);
+		up = Cross(forward, right);
+
+		float scale = resolution * 0.5f / radius;
+		std::vector<float> depth(resolution * resolution, FLT_MAX);
+		std::vector<bool> covered(resolution * resolution, false);
+		UINT shaded = 0;
+
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			const XMFLOAT3& a = vertices[indices[t * 3 + 0]].Position;
+			const XMFLOAT3& b = vertices[indices[t * 3 + 1]].Position;
+			const XMFLOAT3& c = vertices[indices[t * 3 + 2]].Position;
+
+			// back face culling, front faces have their geometric normal towards the viewer
+			if (Dot(Cross(Sub(b, a), Sub(c, a)), forward) >= 0.0f)
+				continue;
+
+			float sx[3], sy[3], sz[3];
+			const XMFLOAT3* corners[3] = { &a, &b, &c };
+			for (int k = 0; k < 3; ++k)
+			{
+				XMFLOAT3 p = Sub(*corners[k], center);
+				sx[k] = Dot(p, right) * scale + resolution * 0.5f;
+				sy[k] = Dot(p, up) * scale + resolution * 0.5f;
+				sz[k] = Dot(p, forward);
+			}
+
+			float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+			if (area == 0.0f)
+				continue;
+
+			int minX = std::max(0, (int)floorf(std::min(sx[0], std::min(sx[1], sx[2]))));
+			int maxX = std::min((int)resolution - 1, (int)ceilf(std::max(sx[0], std::max(sx[1], sx[2]))));
+			int minY = std::max(0, (int)floorf(std::min(sy[0], std::min(sy[1], sy[2]))));
+			int maxY = std::min((int)resolution - 1, (int)ceilf(std::max(sy[0], std::max(sy[1], sy[2]))));
+
+			float invArea = 1.0f / area;
+			for (int py = minY; py <= maxY; ++py)
+			{
+				for (int px = minX; px <= maxX; ++px)
+				{
+					float cx = px + 0.5f;
+					float cy = py + 0.5f;
+
+					// barycentrics, sign independent of the winding
+					float w0 = ((sx[1] - cx) * (sy[2] - cy) - (sx[2] - cx) * (sy[1] - cy)) * invArea;
+					float w1 = ((sx[2] - cx) * (sy[0] - cy) - (sx[0] - cx) * (sy[2] - cy)) * invArea;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+
+					float z = w0 * sz[0] + w1 * sz[1] + w2 * sz[2];
+					size_t pixel = py * resolution + px;
+					if (z < depth[pixel])
+					{
+						depth[pixel] = z;
+						covered[pixel] = true;
+						shaded++;
+					}
+				}
+			}
+		}
+
+		viewShaded[view] = shaded;
+		viewCovered[view] = (UINT)std::count(covered.begin(), covered.end(), true);
+	});
+
+	for (UINT view = 0; view < viewCount; ++view)
+	{
+		stats.pixelsCovered += viewCovered[view];
+		stats.pixelsShaded += viewShaded[view];
+	}
+	stats.overdraw = stats.pixelsCovered > 0 ? (float)stats.pixelsShaded / stats.pixelsCovered : 0.0f;
+
+	return stats;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// Post-transform vertex cache statistics, computed with a simulated FIFO cache
+struct VertexCacheStats
+{
+	UINT cacheMisses;	// vertices transformed by the vertex shader
+	float acmr;			// average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3.0 worst)
+	float atvr;			// average transformed vertex ratio, transformed vertices per vertex (1.0 is ideal)
+};
+
+// Overdraw statistics, computed by rasterizing the mesh on the CPU from a set of view directions
+struct OverdrawStats
+{
+	UINT pixelsCovered;	// pixels covered by the mesh, summed over all views
+	UINT pixelsShaded;	// fragments that passed the depth test when drawn, summed over all views
+	float overdraw;		// pixelsShaded / pixelsCovered (1.0 is ideal)
+};
+
+// MeshOptimizer
+// singleton class, reorders mesh data for the GPU vertex caches and less overdraw at load time
+// usage:
+// MeshOptimizer::Instance()->Optimize(meshData)
+class MeshOptimizer
+{
+public:
+	static MeshOptimizer* Instance();
+
+	// Runs the vertex cache, overdraw and vertex fetch optimizations on meshData
+	// and logs ACMR/ATVR before and after, and the overdraw if it is analyzed.
+	// Triangles stay inside their meshData.Submeshes range.
+	void Optimize(MeshData& meshData);
+
+	// Enable/disable measuring the overdraw around the overdraw optimization, off by default.
+	// When on the cluster order is only kept if AnalyzeOverdraw finds less overdraw, which
+	// rasterizes the mesh twice, so only the cooker turns it on.
+	void SetAnalyzeOverdraw(bool analyzeOverdraw) { mAnalyzeOverdraw = analyzeOverdraw; }
+
+	// Reorders the triangles of indices[0, indexCount) in place for post-transform
+	// vertex cache reuse using Tipsify (Sander et al. 2007).
+	void OptimizeVertexCache(UINT* indices, size_t indexCount, size_t vertexCount, UINT cacheSize = mDefaultCacheSize);
+
+	// Reorders clusters of the vertex cache optimized indices[0, indexCount) so triangles
+	// that face outwards are drawn first (Sander et al. 2007). The index buffer is split
+	// where the vertex cache restarts and further where the cluster ACMR stays within
+	// threshold of the original, so vertex cache efficiency is mostly kept.
+	void OptimizeOverdraw(UINT* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+		float threshold = 1.05f, UINT cacheSize = mDefaultCacheSize);
+
+	// Renumbers the vertices in the order the index buffer first references them
+	// so vertex fetch walks the vertex buffer linearly, unreferenced vertices are dropped.
+	void OptimizeVertexFetch(MeshData& meshData);
+
+	// Simulates a FIFO post-transform cache of cacheSize entries over the index buffer
+	VertexCacheStats AnalyzeVertexCache(const UINT* indices, size_t indexCount, size_t vertexCount, UINT cacheSize = mDefaultCacheSize);
+
+	// Rasterizes the mesh with depth test and back face culling from viewCount directions
+	// around the mesh into resolution x resolution orthographic views
+	OverdrawStats AnalyzeOverdraw(const UINT* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+		UINT viewCount = 16, UINT resolution = 256);
+
+	// Cache size used for optimizing and for the reported stats
+	static const UINT mDefaultCacheSize = 16;
+
+private:
+	MeshOptimizer();
+	~MeshOptimizer();
+
+	bool mAnalyzeOverdraw;
+
+	static MeshOptimizer* mInstance;
+};
@@ -0,0 +1,67 @@
+#include "MeshProcessor.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "VertexQuantizer.h"
+#include "TangentGenerator.h"
+
+MeshProcessor* MeshProcessor::mInstance = NULL;
+
+MeshProcessor* MeshProcessor::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshProcessor;
+	return mInstance;
+}
+
+MeshProcessor::MeshProcessor()
+{
+}
+
+MeshProcessor::~MeshProcessor()
+{
+}
+
+void MeshProcessor::Process(MeshData& meshData)
+{
+	// Fill in missing normals and build the tangent frames for normal mapping,
+	// splitting mirrored UV vertices before the vertex order is optimized
+	TangentGenerator::Instance()->GenerateNormals(meshData);
+	TangentGenerator::Instance()->GenerateTangents(meshData);
+
+	// Reorder for the post-transform vertex cache and vertex fetch
+	MeshOptimizer::Instance()->Optimize(meshData);
+
+	if (!meshData.Vertices.empty())
+	{
+		BoundingBox::CreateFromPoints(meshData.bounds, meshData.Vertices.size(), &meshData.Vertices[0].Position, sizeof(Vertex));
+	}
+
+	// Split into meshlets for CPU cluster culling and append the simplified LOD levels,
+	// the triangles are regrouped so the vertices are renumbered for fetch order again
+	MeshletBuilder::Instance()->Build(meshData);
+	MeshSimplifier::Instance()->GenerateLods(meshData);
+	MeshOptimizer::Instance()->OptimizeVertexFetch(meshData);
+}
+
+void MeshProcessor::QuantizeVertices(const std::string& fileName, MeshData& meshData)
+{
+	if (meshData.Vertices.empty())
+		return;
+
+	QuantizationError error = VertexQuantizer::Instance()->Quantize(meshData);
+
+	float boundsSize = 2.0f * std::max(meshData.bounds.Extents.x, std::max(meshData.bounds.Extents.y, meshData.bounds.Extents.z));
+	DebugLog("MeshProcessor: %s quantized to %u byte vertices, max position error %g (%.4f%% of bounds), max normal error %.3f deg, max tangent error %.3f deg, max texcoord error %g\n",
+		fileName.c_str(), (UINT)sizeof(PackedVertex), error.maxPositionError,
+		boundsSize > 0.0f ? 100.0f * error.maxPositionError / boundsSize : 0.0f, error.maxNormalError, error.maxTangentError, error.maxTexError);
+}
+
+void MeshProcessor::LogLods(const std::string& fileName, const MeshData& meshData)
+{
+	for (size_t i = 1; i < meshData.Lods.size(); ++i)
+	{
+		DebugLog("MeshProcessor: %s LOD %u, %u triangles, error %g\n", fileName.c_str(), (UINT)i,
+			meshData.Lods[i].indexCount / 3, meshData.Lods[i].error);
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// MeshProcessor
+// singleton class, the load time processing shared by the mesh loaders
+// usage:
+// fill meshData.Vertices, Indices, Submeshes and materials, then
+// MeshProcessor::Instance()->Process(meshData)
+// save the mesh cache, then optionally MeshProcessor::Instance()->QuantizeVertices(fileName, meshData)
+class MeshProcessor
+{
+public:
+	static MeshProcessor* Instance();
+
+	// Generates missing normals and the tangents, optimizes the triangle and vertex
+	// order, computes the bounds and builds the meshlets and the LOD chain
+	void Process(MeshData& meshData);
+
+	// Packs meshData.Vertices into PackedVertices and logs the error
+	void QuantizeVertices(const std::string& fileName, MeshData& meshData);
+
+	// Logs the triangle count and error of every generated LOD
+	void LogLods(const std::string& fileName, const MeshData& meshData);
+
+private:
+	MeshProcessor();
+	~MeshProcessor();
+
+	static MeshProcessor* mInstance;
+};
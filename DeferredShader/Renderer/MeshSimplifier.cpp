@@ -0,0 +1,437 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <cfloat>
+#include <unordered_map>
+
+namespace
+{
+	// Symmetric 4x4 plane quadric, sum of squared distances to a set of planes
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double planes;
+
+		void Clear()
+		{
+			a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0;
+			planes = 0.0;
+		}
+
+		void AddPlane(double a, double b, double c, double d)
+		{
+			a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+			b2 += b * b; bc += b * c; bd += b * d;
+			c2 += c * c; cd += c * d;
+			d2 += d * d;
+			planes += 1.0;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			planes += q.planes;
+		}
+
+		double Evaluate(const XMFLOAT3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double result = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+				+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+				+ c2 * z * z + 2.0 * cd * z
+				+ d2;
+			return result > 0.0 ? result : 0.0;
+		}
+
+		// mean squared distance of p to the planes
+		double Error(const XMFLOAT3& p) const
+		{
+			return planes > 0.0 ? Evaluate(p) / planes : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		UINT from;
+		UINT to;
+		double cost;
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const XMFLOAT3& p) const
+		{
+			UINT bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+
+	inline XMFLOAT3 TriangleNormal(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+	{
+		XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		return XMFLOAT3(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+	}
+}
+
+MeshSimplifier* MeshSimplifier::mInstance = NULL;
+
+MeshSimplifier* MeshSimplifier::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshSimplifier;
+	return mInstance;
+}
+
+MeshSimplifier::MeshSimplifier()
+{
+	LodSettings lods[] = {
+		{ 0.5f, 0.0025f },
+		{ 0.25f, 0.005f },
+		{ 0.125f, 0.01f },
+		{ 0.0625f, 0.02f },
+	};
+	mLodSettings.assign(lods, lods + ARRAYSIZE(lods));
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::GenerateLods(MeshData& meshData)
+{
+	meshData.Lods.clear();
+
+	// The submeshes are the LOD 0 material ranges at this point
+	if (meshData.Submeshes.empty())
+	{
+		Submesh submesh = { meshData.materials.empty() ? 0 : meshData.materials.begin()->first, 0, (UINT)meshData.Indices.size(),
+			0, (UINT)meshData.Meshlets.size() };
+		meshData.Submeshes.push_back(submesh);
+	}
+
+	MeshLod fullLod = { 0, (UINT)meshData.Indices.size(), 0.0f, 0, (UINT)meshData.Submeshes.size() };
+	meshData.Lods.push_back(fullLod);
+
+	if (meshData.Indices.empty())
+		return;
+
+	float boundsSize = 2.0f * std::max(meshData.bounds.Extents.x, std::max(meshData.bounds.Extents.y, meshData.bounds.Extents.z));
+
+	// Every level simplifies the previous one, which is cheaper and keeps the levels nested.
+	// Submeshes are simplified on their own, the material boundaries are open borders
+	// for Simplify so they are kept and the materials don't bleed into each other.
+	std::vector<UINT> levelIndices;
+	std::vector<Submesh> levelSubmeshes;
+	std::vector<UINT> result;
+	for (size_t i = 0; i < mLodSettings.size(); ++i)
+	{
+		const MeshLod& source = meshData.Lods.back();
+		float targetError = mLodSettings[i].maxError * boundsSize;
+		float error = source.error;
+
+		levelIndices.clear();
+		levelSubmeshes.clear();
+		for (UINT s = 0; s < source.submeshCount; ++s)
+		{
+			const Submesh& sourceSubmesh = meshData.Submeshes[source.submeshStart + s];
+
+			// The ratio is relative to the LOD 0 range of the same material
+			UINT fullIndexCount = sourceSubmesh.indexCount;
+			for (UINT f = 0; f < fullLod.submeshCount; ++f)
+			{
+				if (meshData.Submeshes[f].materialId == sourceSubmesh.materialId)
+					fullIndexCount = meshData.Submeshes[f].indexCount;
+			}
+			size_t targetIndexCount = (size_t)(fullIndexCount * mLodSettings[i].indexRatio) / 3 * 3;
+
+			error = std::max(error, Simplify(meshData, &meshData.Indices[sourceSubmesh.indexStart], sourceSubmesh.indexCount,
+				targetIndexCount, targetError, result));
+			if (result.empty())
+				continue;
+
+			MeshOptimizer::Instance()->OptimizeVertexCache(&result[0], result.size(), meshData.Vertices.size());
+
+			Submesh submesh = { sourceSubmesh.materialId, (UINT)(meshData.Indices.size() + levelIndices.size()), (UINT)result.size(), 0, 0 };
+			levelSubmeshes.push_back(submesh);
+			levelIndices.insert(levelIndices.end(), result.begin(), result.end());
+		}
+
+		// Not worth a level if it saves less than 10% over the previous one
+		if (levelIndices.empty() || levelIndices.size() > source.indexCount * 9 / 10)
+			break;
+
+		MeshLod lod;
+		lod.indexStart = (UINT)meshData.Indices.size();
+		lod.indexCount = (UINT)levelIndices.size();
+		lod.error = error;
+		lod.submeshStart = (UINT)meshData.Submeshes.size();
+		lod.submeshCount = (UINT)levelSubmeshes.size();
+		meshData.Lods.push_back(lod);
+		meshData.Indices.insert(meshData.Indices.end(), levelIndices.begin(), levelIndices.end());
+		meshData.Submeshes.insert(meshData.Submeshes.end(), levelSubmeshes.begin(), levelSubmeshes.end());
+	}
+}
+
+float MeshSimplifier::Simplify(const MeshData& meshData, const UINT* indices, size_t indexCount,
+	size_t targetIndexCount, float targetError, std::vector<UINT>& result)
+{
+	result.assign(indices, indices + indexCount);
+
+	size_t vertexCount = meshData.Vertices.size();
+	if (indexCount / 3 == 0 || vertexCount == 0)
+		return 0.0f;
+
+	// Vertices with the same position are split by normal or texcoord seams, an edge
+	// with a single triangle is on an open border. Those vertices are never moved
+	// so the seams and borders stay intact.
+	std::vector<UINT> positionId(vertexCount);
+	std::vector<UINT> positionWedges;
+	{
+		std::unordered_map<XMFLOAT3, UINT, PositionHash, PositionEqual> positions;
+		positions.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			auto inserted = positions.insert(std::make_pair(meshData.Vertices[v].Position, (UINT)positionWedges.size()));
+			if (inserted.second)
+				positionWedges.push_back(0);
+			positionId[v] = inserted.first->second;
+			positionWedges[positionId[v]]++;
+		}
+	}
+
+	std::vector<bool> locked(vertexCount, false);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		locked[v] = positionWedges[positionId[v]] > 1;
+	}
+	{
+		// count directed edges by position, a border edge has no opposite
+		std::unordered_map<UINT64, int> edges;
+		edges.reserve(indexCount);
+		for (size_t t = 0; t < indexCount / 3; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT a = positionId[result[t * 3 + k]];
+				UINT b = positionId[result[t * 3 + (k + 1) % 3]];
+				edges[((UINT64)a << 32) | b]++;
+			}
+		}
+		for (size_t t = 0; t < indexCount / 3; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT a = positionId[result[t * 3 + k]];
+				UINT b = positionId[result[t * 3 + (k + 1) % 3]];
+				if (edges.find(((UINT64)b << 32) | a) == edges.end())
+				{
+					locked[result[t * 3 + k]] = true;
+					locked[result[t * 3 + (k + 1) % 3]] = true;
+				}
+			}
+		}
+	}
+
+	// Plane quadrics of the adjacent triangles per vertex
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		quadrics[v].Clear();
+	}
+	for (size_t t = 0; t < indexCount / 3; ++t)
+	{
+		const XMFLOAT3& a = meshData.Vertices[result[t * 3 + 0]].Position;
+		const XMFLOAT3& b = meshData.Vertices[result[t * 3 + 1]].Position;
+		const XMFLOAT3& c = meshData.Vertices[result[t * 3 + 2]].Position;
+		XMFLOAT3 n = TriangleNormal(a, b, c);
+		double length = sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+		if (length <= 0.0)
+			continue;
+
+		double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+		double d = -(nx * a.x + ny * a.y + nz * a.z);
+		for (int k = 0; k < 3; ++k)
+		{
+			quadrics[result[t * 3 + k]].AddPlane(nx, ny, nz, d);
+		}
+	}
+
+	double maxCost = (double)targetError * targetError;
+	double resultCost = 0.0;
+
+	std::vector<UINT> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<UINT> adjacencyOffsets;
+	std::vector<UINT> adjacency;
+
+	size_t triangleCount = indexCount / 3;
+	size_t targetTriangles = targetIndexCount / 3;
+
+	// Each pass sorts the candidate collapses by cost and performs the cheapest ones
+	// that don't share a neighbourhood, then compacts the triangle list
+	while (triangleCount > targetTriangles)
+	{
+		// vertex to triangle adjacency of the current triangles
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			adjacencyOffsets[result[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(triangleCount * 3);
+		{
+			std::vector<UINT> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < triangleCount * 3; ++i)
+			{
+				adjacency[fill[result[i]]++] = (UINT)(i / 3);
+			}
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				UINT a = result[t * 3 + k];
+				UINT b = result[t * 3 + (k + 1) % 3];
+
+				// each edge is seen from both triangles, try both directions once
+				if (a > b)
+					continue;
+
+				Quadric q = quadrics[a];
+				q.Add(quadrics[b]);
+
+				if (!locked[a])
+				{
+					Collapse collapse = { a, b, q.Error(meshData.Vertices[b].Position) };
+					if (collapse.cost <= maxCost)
+						collapses.push_back(collapse);
+				}
+				if (!locked[b])
+				{
+					Collapse collapse = { b, a, q.Error(meshData.Vertices[a].Position) };
+					if (collapse.cost <= maxCost)
+						collapses.push_back(collapse);
+				}
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(),
+			[](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			remap[v] = (UINT)v;
+		}
+		touched.assign(vertexCount, false);
+
+		size_t removedTriangles = 0;
+		size_t passLimit = (triangleCount - targetTriangles);
+		size_t performed = 0;
+
+		for (size_t c = 0; c < collapses.size() && removedTriangles < passLimit; ++c)
+		{
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// reject collapses that flip or degenerate a remaining triangle around from
+			const XMFLOAT3& target = meshData.Vertices[collapse.to].Position;
+			bool flips = false;
+			size_t sharedTriangles = 0;
+			for (UINT a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+			{
+				const UINT* tri = &result[adjacency[a] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					sharedTriangles++;
+					continue;
+				}
+
+				XMFLOAT3 p[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					p[k] = meshData.Vertices[tri[k]].Position;
+				}
+				XMFLOAT3 before = TriangleNormal(p[0], p[1], p[2]);
+				for (int k = 0; k < 3; ++k)
+				{
+					if (tri[k] == collapse.from)
+						p[k] = target;
+				}
+				XMFLOAT3 after = TriangleNormal(p[0], p[1], p[2]);
+
+				float beforeLength = sqrtf(before.x * before.x + before.y * before.y + before.z * before.z);
+				float afterLength = sqrtf(after.x * after.x + after.y * after.y + after.z * after.z);
+				float dot = before.x * after.x + before.y * after.y + before.z * after.z;
+				flips = afterLength <= 0.0f || dot < 0.25f * beforeLength * afterLength;
+			}
+			if (flips || sharedTriangles == 0)
+				continue;
+
+			// lock the neighbourhood of both vertices for the rest of the pass
+			for (UINT a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+			{
+				const UINT* tri = &result[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+			for (UINT a = adjacencyOffsets[collapse.to]; a < adjacencyOffsets[collapse.to + 1]; ++a)
+			{
+				const UINT* tri = &result[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			resultCost = std::max(resultCost, collapse.cost);
+			removedTriangles += sharedTriangles;
+			performed++;
+		}
+
+		if (performed == 0)
+			break;
+
+		// apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			UINT a = remap[result[t * 3 + 0]];
+			UINT b = remap[result[t * 3 + 1]];
+			UINT c = remap[result[t * 3 + 2]];
+			if (a == b || a == c || b == c)
+				continue;
+
+			result[write * 3 + 0] = a;
+			result[write * 3 + 1] = b;
+			result[write * 3 + 2] = c;
+			write++;
+		}
+		triangleCount = write;
+	}
+
+	result.resize(triangleCount * 3);
+
+	return (float)sqrt(resultCost);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// Target for one generated LOD level
+struct LodSettings
+{
+	float indexRatio;	// target index count relative to LOD 0
+	float maxError;		// largest allowed error relative to the mesh bounds size
+};
+
+// MeshSimplifier
+// singleton class, quadric error metric edge collapse simplifier (Garland & Heckbert 1997)
+// that builds LOD index buffers sharing the vertex buffer of the full mesh
+// usage:
+// MeshSimplifier::Instance()->GenerateLods(meshData)
+class MeshSimplifier
+{
+public:
+	static MeshSimplifier* Instance();
+
+	// Appends a simplified index range per LodSettings level to meshData.Indices
+	// and fills meshData.Lods, LOD 0 being the original indices. Every submesh is
+	// simplified separately and the level's submeshes are appended to meshData.Submeshes.
+	// Stops early when a level no longer removes enough triangles.
+	void GenerateLods(MeshData& meshData);
+
+	// Collapses edges of indices[0, indexCount) until targetIndexCount is reached or the next
+	// collapse would exceed targetError (object space distance). Only original vertices
+	// are kept, so result indexes meshData.Vertices. Returns the error of the result.
+	float Simplify(const MeshData& meshData, const UINT* indices, size_t indexCount,
+		size_t targetIndexCount, float targetError, std::vector<UINT>& result);
+
+	// Levels generated by GenerateLods, 4 levels halving the triangles by default
+	void SetLodSettings(const std::vector<LodSettings>& lodSettings) { mLodSettings = lodSettings; }
+	const std::vector<LodSettings>& GetLodSettings() const { return mLodSettings; }
+
+private:
+	MeshSimplifier();
+	~MeshSimplifier();
+
+	std::vector<LodSettings> mLodSettings;
+
+	static MeshSimplifier* mInstance;
+};
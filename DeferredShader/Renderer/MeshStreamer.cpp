@@ -0,0 +1,226 @@
+#include "MeshStreamer.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "MeshProcessor.h"
+#include "TangentGenerator.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "VertexQuantizer.h"
+#include "Parallel.h"
+
+MeshStreamer* MeshStreamer::mInstance = NULL;
+
+MeshStreamer* MeshStreamer::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshStreamer;
+	return mInstance;
+}
+
+MeshStreamer::MeshStreamer() : mQuit(false), mLoading(0), mNextRequest(1), mUploadBudget(8 * 1024 * 1024), mStreaming(false)
+{
+	ZeroMemory(&mStats, sizeof(mStats));
+}
+
+MeshStreamer::~MeshStreamer()
+{
+	Release();
+}
+
+void MeshStreamer::Init(UINT threadCount)
+{
+	Release();
+
+	if (threadCount == 0)
+		threadCount = std::max(GetWorkerThreadCount(), 2u) - 1;
+
+	// The loaders and processing steps are singletons created on first use,
+	// create them here before the workers race to do it
+	ObjLoader::Instance();
+	GltfLoader::Instance();
+	MeshCache::Instance();
+	MeshCodec::Instance();
+	MeshProcessor::Instance();
+	TangentGenerator::Instance();
+	MeshOptimizer::Instance();
+	MeshletBuilder::Instance();
+	MeshSimplifier::Instance();
+	VertexQuantizer::Instance();
+
+	mQuit = false;
+	for (UINT i = 0; i < threadCount; ++i)
+		mThreads.push_back(std::thread(&MeshStreamer::WorkerThread, this));
+}
+
+void MeshStreamer::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+		mRequests.clear();
+	}
+	mRequestReady.notify_all();
+
+	// a worker finishes the mesh it is loading first
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		mThreads[i].join();
+	mThreads.clear();
+
+	mLoaded.clear();
+	mLoading = 0;
+	mStreaming = false;
+}
+
+UINT MeshStreamer::RequestMesh(const std::string& fileName, const std::string& baseDir)
+{
+	Request request;
+	request.fileName = fileName;
+	request.baseDir = baseDir;
+	return Queue(request);
+}
+
+UINT MeshStreamer::RequestBuild(const std::string& name, const std::function<bool(MeshData&)>& build)
+{
+	Request request;
+	request.fileName = name;
+	request.build = build;
+	return Queue(request);
+}
+
+UINT MeshStreamer::Queue(Request& request)
+{
+	request.requestTime = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		request.id = mNextRequest++;
+		mRequests.push_back(request);
+		mStats.requested++;
+	}
+	mRequestReady.notify_one();
+
+	return request.id;
+}
+
+void MeshStreamer::WorkerThread()
+{
+	for (;;)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mRequestReady.wait(lock, [this]() { return mQuit || !mRequests.empty(); });
+			if (mQuit)
+				return;
+
+			request = mRequests.front();
+			mRequests.pop_front();
+			mLoading++;
+		}
+
+		LoadedMesh loaded;
+		loaded.mesh.request = request.id;
+		loaded.mesh.fileName = request.fileName;
+		loaded.requestTime = request.requestTime;
+
+		std::string extension = request.fileName.substr(std::min(request.fileName.find_last_of('.'), request.fileName.size()));
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (request.build)
+			loaded.mesh.loaded = request.build(loaded.mesh.meshData);
+		else if (extension == ".gltf" || extension == ".glb")
+			loaded.mesh.loaded = GltfLoader::Instance()->LoadToMesh(request.fileName, request.baseDir, loaded.mesh.meshData);
+		else
+			loaded.mesh.loaded = ObjLoader::Instance()->LoadToMesh(request.fileName, request.baseDir, loaded.mesh.meshData);
+
+		if (!loaded.mesh.loaded)
+		{
+			loaded.mesh.meshData = MeshData();
+			DebugLog("MeshStreamer: %s %s failed\n", request.build ? "building" : "loading", request.fileName.c_str());
+		}
+		else if (mLoadedCallback)
+		{
+			mLoadedCallback(loaded.mesh.meshData);
+		}
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLoading--;
+		mLoaded.push_back(std::move(loaded));
+	}
+}
+
+void MeshStreamer::Update(float frameTime, std::vector<StreamedMesh>& ready)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mStreaming)
+	{
+		mStats.worstFrameTime = std::max(mStats.worstFrameTime, frameTime);
+		mStats.streamingFrames++;
+	}
+
+	Clock::time_point now = Clock::now();
+	UINT64 frameBytes = 0;
+	while (!mLoaded.empty())
+	{
+		LoadedMesh& loaded = mLoaded.front();
+
+		UINT64 bytes = GetUploadBytes(loaded.mesh.meshData);
+		if (mUploadBudget > 0 && frameBytes > 0 && frameBytes + bytes > mUploadBudget)
+			break;
+		frameBytes += bytes;
+
+		double latency = std::chrono::duration<double>(now - loaded.requestTime).count();
+		mStats.completed++;
+		mStats.failed += loaded.mesh.loaded ? 0 : 1;
+		mStats.lastLatency = latency;
+		mStats.maxLatency = std::max(mStats.maxLatency, latency);
+		mStats.totalLatency += latency;
+
+		ready.push_back(std::move(loaded.mesh));
+		mLoaded.pop_front();
+	}
+
+	mStats.uploadBytes += frameBytes;
+	mStats.maxFrameUploadBytes = std::max(mStats.maxFrameUploadBytes, frameBytes);
+	mStats.pending = (UINT)(mRequests.size() + mLoaded.size()) + mLoading;
+
+	// The upload shows up in the next frame time, so that frame counts as streaming too
+	bool streaming = mStats.pending > 0 || frameBytes > 0;
+	if (mStreaming && !streaming)
+	{
+		DebugLog("MeshStreamer: %u meshes streamed in, %.1f MB, latency max %.1f ms avg %.1f ms, worst frame %.1f ms in %u frames\n",
+			mStats.completed, mStats.uploadBytes / (1024.0 * 1024.0), mStats.maxLatency * 1000.0,
+			mStats.completed > 0 ? mStats.totalLatency / mStats.completed * 1000.0 : 0.0, mStats.worstFrameTime * 1000.0f, mStats.streamingFrames);
+	}
+	mStreaming = streaming;
+}
+
+bool MeshStreamer::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRequests.empty() && mLoaded.empty() && mLoading == 0;
+}
+
+MeshStreamStats MeshStreamer::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void MeshStreamer::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	UINT pending = mStats.pending;
+	ZeroMemory(&mStats, sizeof(mStats));
+	mStats.pending = pending;
+}
+
+UINT64 MeshStreamer::GetUploadBytes(const MeshData& meshData)
+{
+	UINT64 vertexCount = meshData.PackedVertices.empty() ? meshData.Vertices.size() : meshData.PackedVertices.size();
+	UINT64 vertexStride = meshData.PackedVertices.empty() ? sizeof(Vertex) : sizeof(PackedVertex);
+	UINT64 positionStride = meshData.PackedVertices.empty() ? sizeof(XMFLOAT3) : sizeof(PackedVertex().Position);
+	return vertexCount * (vertexStride + positionStride) + meshData.Indices.size() * sizeof(UINT);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <functional>
+
+// Mesh loaded by MeshStreamer, ready for Mesh::Create
+struct StreamedMesh
+{
+	UINT request;		// id returned by RequestMesh
+	std::string fileName;
+	bool loaded;		// false if loading failed, meshData is empty then
+	MeshData meshData;
+};
+
+// Streaming counters, all times in seconds
+struct MeshStreamStats
+{
+	UINT requested;
+	UINT completed;		// handed out by Update, failed loads included
+	UINT failed;
+	UINT pending;		// queued, loading or waiting for upload budget
+
+	UINT64 uploadBytes;			// bytes of all handed out meshes
+	UINT64 maxFrameUploadBytes;	// most bytes handed out in one Update
+
+	// request to hand out latency of the completed meshes
+	double lastLatency;
+	double maxLatency;
+	double totalLatency;
+
+	// longest frame while meshes were streaming, the hitch metric
+	float worstFrameTime;
+	UINT streamingFrames;
+};
+
+// MeshStreamer
+// singleton class, loads meshes on worker threads and meters the GPU upload per frame
+// usage:
+// MeshStreamer::Instance()->Init()
+// UINT request = MeshStreamer::Instance()->RequestMesh("..\\Assets\\teapot.obj", "..\\Assets\\")
+// every frame on the render thread:
+// std::vector<StreamedMesh> ready;
+// MeshStreamer::Instance()->Update(dt, ready)
+// mesh->Create(device, std::move(ready[i].meshData)) for every loaded mesh
+//
+// File IO, parsing and processing run on the worker threads through ObjLoader
+// (.obj) and GltfLoader (.gltf/.glb), meshes built in code (the static batches)
+// through their build function. Update hands out loaded meshes in load
+// order while their vertex and index bytes fit into the per frame upload
+// budget, at least one per frame so meshes larger than the budget still come in.
+// The caller skips a mesh until it has been handed out. The stats need no
+// device, a headless run can drive Update with its own frame times and check them.
+class MeshStreamer
+{
+public:
+	static MeshStreamer* Instance();
+
+	// Starts the worker threads, 0 uses every hardware thread but the render thread
+	void Init(UINT threadCount = 0);
+
+	// Stops the workers, pending requests are dropped
+	void Release();
+
+	// Queues a mesh for loading, returns the request id reported back in StreamedMesh.
+	// baseDir is the .mtl / texture directory given to the loader.
+	UINT RequestMesh(const std::string& fileName, const std::string& baseDir);
+
+	// Queues a mesh that build fills on a worker thread instead of a loader, it is handed
+	// out through the upload budget like a loaded mesh. name is its StreamedMesh fileName.
+	UINT RequestBuild(const std::string& name, const std::function<bool(MeshData&)>& build);
+
+	// Call once per frame, frameTime is the duration of the last frame.
+	// Appends the meshes to upload this frame to ready.
+	void Update(float frameTime, std::vector<StreamedMesh>& ready);
+
+	// Called on the worker thread for every mesh loaded or built, before it waits for its
+	// upload, set it before Init. SceneManager requests the textures of the materials here.
+	void SetLoadedCallback(const std::function<void(const MeshData&)>& loaded) { mLoadedCallback = loaded; }
+
+	// Vertex and index bytes handed out per frame, 0 hands out everything loaded
+	void SetUploadBudget(UINT64 bytesPerFrame) { mUploadBudget = bytesPerFrame; }
+	UINT64 GetUploadBudget() const { return mUploadBudget; }
+
+	// true when no request is queued, loading or waiting for upload
+	bool IsIdle();
+
+	MeshStreamStats GetStats();
+	void ResetStats();
+
+	// GPU bytes Mesh::Create allocates for meshData: vertices, indices and the position stream
+	static UINT64 GetUploadBytes(const MeshData& meshData);
+
+private:
+	MeshStreamer();
+	~MeshStreamer();
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Request
+	{
+		UINT id;
+		std::string fileName;
+		std::string baseDir;
+		std::function<bool(MeshData&)> build;	// fills the mesh instead of loading fileName
+		Clock::time_point requestTime;
+	};
+
+	struct LoadedMesh
+	{
+		StreamedMesh mesh;
+		Clock::time_point requestTime;
+	};
+
+	// Stamps request with its id and request time and hands it to the workers
+	UINT Queue(Request& request);
+
+	void WorkerThread();
+
+	std::vector<std::thread> mThreads;
+	bool mQuit;
+
+	// mRequests, mLoaded, mLoading, mQuit and mStats are guarded by mMutex
+	std::mutex mMutex;
+	std::condition_variable mRequestReady;
+	std::deque<Request> mRequests;
+	std::deque<LoadedMesh> mLoaded;
+	UINT mLoading;
+	UINT mNextRequest;
+
+	UINT64 mUploadBudget;
+	std::function<void(const MeshData&)> mLoadedCallback;
+
+	MeshStreamStats mStats;
+	bool mStreaming;	// meshes were pending during the last frame
+
+	static MeshStreamer* mInstance;
+};
@@ -0,0 +1,258 @@
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <climits>
+#include <cfloat>
+
+MeshletBuilder* MeshletBuilder::mInstance = NULL;
+
+MeshletBuilder* MeshletBuilder::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshletBuilder;
+	return mInstance;
+}
+
+MeshletBuilder::MeshletBuilder()
+{
+}
+
+MeshletBuilder::~MeshletBuilder()
+{
+}
+
+void MeshletBuilder::Build(MeshData& meshData, UINT maxVertices, UINT maxTriangles)
+{
+	meshData.Meshlets.clear();
+	for (size_t s = 0; s < meshData.Submeshes.size(); ++s)
+	{
+		meshData.Submeshes[s].meshletStart = 0;
+		meshData.Submeshes[s].meshletCount = 0;
+	}
+
+	size_t triangleCount = meshData.Indices.size() / 3;
+	size_t vertexCount = meshData.Vertices.size();
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	const UINT* indices = &meshData.Indices[0];
+
+	// Submesh of every triangle, growth stays within the submesh of the seed
+	std::vector<UINT> triangleSubmesh(triangleCount, 0);
+	for (size_t s = 0; s < meshData.Submeshes.size(); ++s)
+	{
+		const Submesh& submesh = meshData.Submeshes[s];
+		std::fill(triangleSubmesh.begin() + submesh.indexStart / 3, triangleSubmesh.begin() + (submesh.indexStart + submesh.indexCount) / 3, (UINT)s);
+	}
+
+	// Vertex to triangle adjacency
+	std::vector<UINT> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		adjacencyOffsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<UINT> adjacency(triangleCount * 3);
+	{
+		std::vector<UINT> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			adjacency[fill[indices[i]]++] = (UINT)(i / 3);
+		}
+	}
+
+	// Unit triangle normals, zero for degenerate triangles
+	std::vector<XMFLOAT3> triangleNormals(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const XMFLOAT3& a = meshData.Vertices[indices[t * 3 + 0]].Position;
+		const XMFLOAT3& b = meshData.Vertices[indices[t * 3 + 1]].Position;
+		const XMFLOAT3& c = meshData.Vertices[indices[t * 3 + 2]].Position;
+		XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		XMFLOAT3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+		float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		triangleNormals[t] = length > 0.0f ? XMFLOAT3(n.x / length, n.y / length, n.z / length) : XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+
+	// meshlet that last used each vertex, to count unique vertices per meshlet
+	std::vector<UINT> vertexMeshlet(vertexCount, UINT_MAX);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<UINT> meshletVertexList;
+	meshletVertexList.reserve(maxVertices);
+
+	std::vector<UINT> output;
+	output.reserve(triangleCount * 3);
+	std::vector<UINT> localIndices;
+
+	size_t seed = 0;
+	while (output.size() < triangleCount * 3)
+	{
+		// Seeds follow the optimized triangle order, so the overdraw order mostly survives
+		while (emitted[seed])
+			seed++;
+		UINT submeshIndex = triangleSubmesh[seed];
+
+		UINT meshletIndex = (UINT)meshData.Meshlets.size();
+		Meshlet meshlet;
+		meshlet.indexStart = (UINT)output.size();
+		meshlet.indexCount = 0;
+		meshletVertexList.clear();
+		XMFLOAT3 normalSum(0.0f, 0.0f, 0.0f);
+
+		size_t triangle = seed;
+		while (triangle != SIZE_MAX)
+		{
+			const UINT* tri = &indices[triangle * 3];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (vertexMeshlet[tri[k]] != meshletIndex)
+				{
+					vertexMeshlet[tri[k]] = meshletIndex;
+					meshletVertexList.push_back(tri[k]);
+				}
+				output.push_back(tri[k]);
+			}
+			emitted[triangle] = true;
+			meshlet.indexCount += 3;
+			normalSum = XMFLOAT3(normalSum.x + triangleNormals[triangle].x, normalSum.y + triangleNormals[triangle].y,
+				normalSum.z + triangleNormals[triangle].z);
+
+			if (meshlet.indexCount / 3 >= maxTriangles)
+				break;
+
+			// Grow through triangles sharing a vertex with the meshlet. Fewer new vertices
+			// win, ties go to the triangle facing closest to the meshlet so far,
+			// which keeps the normal cones tight.
+			triangle = SIZE_MAX;
+			UINT bestNewVertices = 4;
+			float bestFacing = -FLT_MAX;
+			for (size_t v = 0; v < meshletVertexList.size(); ++v)
+			{
+				UINT vertex = meshletVertexList[v];
+				for (UINT a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a)
+				{
+					UINT candidate = adjacency[a];
+					if (emitted[candidate] || triangleSubmesh[candidate] != submeshIndex)
+						continue;
+
+					const UINT* c = &indices[candidate * 3];
+					UINT newVertices = 0;
+					for (int k = 0; k < 3; ++k)
+					{
+						if (vertexMeshlet[c[k]] != meshletIndex && (k == 0 || c[k] != c[0]) && (k < 2 || c[k] != c[1]))
+							newVertices++;
+					}
+					if (meshletVertexList.size() + newVertices > maxVertices)
+						continue;
+
+					const XMFLOAT3& n = triangleNormals[candidate];
+					float facing = n.x * normalSum.x + n.y * normalSum.y + n.z * normalSum.z;
+					if (newVertices < bestNewVertices || (newVertices == bestNewVertices && facing > bestFacing))
+					{
+						triangle = candidate;
+						bestNewVertices = newVertices;
+						bestFacing = facing;
+					}
+				}
+			}
+
+			// Nothing connected left. Tiny meshlets (triangle soup, small patches) continue
+			// with the next triangle in the optimized order so they don't end up as
+			// one draw range each, larger ones stop here to keep their cones tight.
+			if (triangle == SIZE_MAX && meshlet.indexCount / 3 < maxTriangles / 4)
+			{
+				while (seed < triangleCount && emitted[seed])
+					seed++;
+				if (seed < triangleCount && triangleSubmesh[seed] == submeshIndex && meshletVertexList.size() + 3 <= maxVertices)
+					triangle = seed;
+			}
+		}
+
+		// Growth order favours tight cones over cache reuse, so reorder the triangles
+		// inside the meshlet for the vertex cache on meshlet local vertex ids
+		localIndices.resize(meshlet.indexCount);
+		for (UINT i = 0; i < meshlet.indexCount; ++i)
+		{
+			UINT vertex = output[meshlet.indexStart + i];
+			localIndices[i] = (UINT)(std::find(meshletVertexList.begin(), meshletVertexList.end(), vertex) - meshletVertexList.begin());
+		}
+		MeshOptimizer::Instance()->OptimizeVertexCache(&localIndices[0], localIndices.size(), meshletVertexList.size());
+		for (UINT i = 0; i < meshlet.indexCount; ++i)
+		{
+			output[meshlet.indexStart + i] = meshletVertexList[localIndices[i]];
+		}
+
+		ComputeBounds(meshData, output, meshlet);
+		meshData.Meshlets.push_back(meshlet);
+
+		if (submeshIndex < meshData.Submeshes.size())
+		{
+			Submesh& submesh = meshData.Submeshes[submeshIndex];
+			if (submesh.meshletCount == 0)
+				submesh.meshletStart = meshletIndex;
+			submesh.meshletCount++;
+		}
+	}
+
+	meshData.Indices.swap(output);
+}
+
+void MeshletBuilder::ComputeBounds(const MeshData& meshData, const std::vector<UINT>& indexBuffer, Meshlet& meshlet)
+{
+	const UINT* indices = &indexBuffer[meshlet.indexStart];
+
+	std::vector<XMFLOAT3> points(meshlet.indexCount);
+	for (UINT i = 0; i < meshlet.indexCount; ++i)
+	{
+		points[i] = meshData.Vertices[indices[i]].Position;
+	}
+	BoundingSphere::CreateFromPoints(meshlet.bounds, points.size(), &points[0], sizeof(XMFLOAT3));
+
+	// Average the unit triangle normals for the cone axis
+	std::vector<XMFLOAT3> normals;
+	normals.reserve(meshlet.indexCount / 3);
+	XMFLOAT3 axis(0.0f, 0.0f, 0.0f);
+	for (UINT i = 0; i + 2 < meshlet.indexCount; i += 3)
+	{
+		const XMFLOAT3& a = points[i];
+		const XMFLOAT3& b = points[i + 1];
+		const XMFLOAT3& c = points[i + 2];
+
+		XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		XMFLOAT3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+		float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+
+		// degenerate triangles are never visible, they don't limit the cone
+		if (length <= 0.0f)
+			continue;
+
+		n = XMFLOAT3(n.x / length, n.y / length, n.z / length);
+		normals.push_back(n);
+		axis = XMFLOAT3(axis.x + n.x, axis.y + n.y, axis.z + n.z);
+	}
+
+	meshlet.coneAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	meshlet.coneCutoff = 1.0f;
+
+	float axisLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+	if (normals.empty() || axisLength <= 0.0f)
+		return;
+
+	axis = XMFLOAT3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength);
+
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); ++i)
+	{
+		minDot = std::min(minDot, normals[i].x * axis.x + normals[i].y * axis.y + normals[i].z * axis.z);
+	}
+
+	// A cone wider than a hemisphere can always be seen from somewhere
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : sqrtf(1.0f - minDot * minDot);
+}
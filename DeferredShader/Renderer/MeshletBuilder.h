@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// MeshletBuilder
+// singleton class, splits the index buffer into meshlets at load time
+// usage:
+// MeshletBuilder::Instance()->Build(meshData)
+class MeshletBuilder
+{
+public:
+	static MeshletBuilder* Instance();
+
+	// Fills meshData.Meshlets and reorders meshData.Indices so every meshlet is a
+	// contiguous index range. Meshlets are seeded in index buffer order and grown
+	// through adjacent triangles up to maxVertices unique vertices and maxTriangles.
+	// Meshlets never cross a submesh, the submesh ranges stay and get their meshlet ranges.
+	void Build(MeshData& meshData, UINT maxVertices = mDefaultMaxVertices, UINT maxTriangles = mDefaultMaxTriangles);
+
+	static const UINT mDefaultMaxVertices = 64;
+	static const UINT mDefaultMaxTriangles = 124;
+
+private:
+	MeshletBuilder();
+	~MeshletBuilder();
+
+	// Computes the bounding sphere and normal cone of meshlet from its triangles in indexBuffer
+	void ComputeBounds(const MeshData& meshData, const std::vector<UINT>& indexBuffer, Meshlet& meshlet);
+
+	static MeshletBuilder* mInstance;
+};
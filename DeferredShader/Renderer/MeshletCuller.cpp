@@ -0,0 +1,126 @@
+#include "MeshletCuller.h"
+
+#include <cmath>
+
+MeshletCuller* MeshletCuller::mInstance = NULL;
+
+MeshletCuller* MeshletCuller::Instance()
+{
+	if (!mInstance)
+		mInstance = new MeshletCuller;
+	return mInstance;
+}
+
+MeshletCuller::MeshletCuller() : mConeCulling(true)
+{
+}
+
+MeshletCuller::~MeshletCuller()
+{
+}
+
+void MeshletCuller::ExtractFrustumPlanes(CXMMATRIX worldViewProj, XMFLOAT4 planes[6])
+{
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, worldViewProj);
+
+	planes[0] = XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);	// left
+	planes[1] = XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);	// right
+	planes[2] = XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);	// bottom
+	planes[3] = XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);	// top
+	planes[4] = XMFLOAT4(m._13, m._23, m._33, m._43);									// near
+	planes[5] = XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);	// far
+
+	for (int i = 0; i < 6; ++i)
+	{
+		float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+		if (length > 0.0f)
+		{
+			planes[i] = XMFLOAT4(planes[i].x / length, planes[i].y / length, planes[i].z / length, planes[i].w / length);
+		}
+	}
+}
+
+bool MeshletCuller::IsVisible(const BoundingSphere& bounds, CXMMATRIX world, CXMMATRIX view, CXMMATRIX proj)
+{
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(world * view * proj, planes);
+
+	const XMFLOAT3& center = bounds.Center;
+	for (int p = 0; p < 6; ++p)
+	{
+		if (planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w < -bounds.Radius)
+			return false;
+	}
+	return true;
+}
+
+UINT MeshletCuller::Cull(const Meshlet* meshlets, size_t meshletCount, CXMMATRIX world, CXMMATRIX view, CXMMATRIX proj,
+	std::vector<DrawRange>& ranges, MeshletCullStats& stats)
+{
+	ranges.clear();
+
+	// Frustum planes in object space. Testing the object space spheres
+	// against them is exact even with non uniform scale in world.
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(world * view * proj, planes);
+
+	// Camera position in object space for the cone test
+	XMMATRIX viewToObject = XMMatrixInverse(NULL, world * view);
+	XMFLOAT3 camera;
+	XMStoreFloat3(&camera, XMVector3TransformCoord(XMVectorZero(), viewToObject));
+
+	UINT visible = 0;
+	for (size_t i = 0; i < meshletCount; ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		const XMFLOAT3& center = meshlet.bounds.Center;
+		float radius = meshlet.bounds.Radius;
+
+		stats.meshletCount++;
+		stats.triangleCount += meshlet.indexCount / 3;
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p)
+		{
+			outside = planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w < -radius;
+		}
+		if (outside)
+		{
+			stats.frustumCulled++;
+			continue;
+		}
+
+		// Every triangle faces away when the camera is outside the cone
+		// widened by the bounding sphere (meshoptimizer's cone test)
+		if (mConeCulling && meshlet.coneCutoff < 1.0f)
+		{
+			XMFLOAT3 toCenter(center.x - camera.x, center.y - camera.y, center.z - camera.z);
+			float distance = sqrtf(toCenter.x * toCenter.x + toCenter.y * toCenter.y + toCenter.z * toCenter.z);
+			float axisDot = toCenter.x * meshlet.coneAxis.x + toCenter.y * meshlet.coneAxis.y + toCenter.z * meshlet.coneAxis.z;
+			if (axisDot >= meshlet.coneCutoff * distance + radius)
+			{
+				stats.coneCulled++;
+				continue;
+			}
+		}
+
+		visible++;
+		stats.trianglesDrawn += meshlet.indexCount / 3;
+
+		// meshlets are consecutive in the index buffer, extend the previous range when possible
+		if (!ranges.empty() && ranges.back().indexStart + ranges.back().indexCount == meshlet.indexStart)
+		{
+			ranges.back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			DrawRange range = { meshlet.indexStart, meshlet.indexCount };
+			ranges.push_back(range);
+		}
+	}
+
+	stats.drawCount += (UINT)ranges.size();
+
+	return visible;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// Meshlet culling counters, accumulated over all culled meshes
+struct MeshletCullStats
+{
+	UINT meshletCount;		// meshlets tested
+	UINT frustumCulled;		// meshlets outside the view frustum
+	UINT coneCulled;		// meshlets facing away from the camera
+	UINT triangleCount;		// triangles of all tested meshes
+	UINT trianglesDrawn;	// triangles in the emitted ranges
+	UINT drawCount;			// emitted DrawIndexed ranges
+};
+
+// MeshletCuller
+// singleton class, CPU cluster culling against the camera frustum and normal cones
+// usage:
+// MeshletCuller::Instance()->Cull(&mesh->mMeshlets[0], mesh->mMeshlets.size(), world, view, proj, ranges, stats)
+// mesh->Render(context, ranges)
+class MeshletCuller
+{
+public:
+	static MeshletCuller* Instance();
+
+	// Tests meshlets[0, meshletCount) with the object to world matrix world against the camera
+	// and fills ranges with the visible index ranges, neighbouring ranges merged.
+	// Returns the number of visible meshlets and adds to stats.
+	UINT Cull(const Meshlet* meshlets, size_t meshletCount, CXMMATRIX world, CXMMATRIX view, CXMMATRIX proj,
+		std::vector<DrawRange>& ranges, MeshletCullStats& stats);
+
+	// Frustum test of a whole mesh by its object space bounding sphere, for meshes
+	// drawn without meshlets (simplified LODs)
+	bool IsVisible(const BoundingSphere& bounds, CXMMATRIX world, CXMMATRIX view, CXMMATRIX proj);
+
+	// Enable/disable the normal cone test, on by default
+	void SetConeCulling(bool coneCulling) { mConeCulling = coneCulling; }
+
+private:
+	MeshletCuller();
+	~MeshletCuller();
+
+	// Normalized object space frustum planes of worldViewProj (Gribb/Hartmann)
+	void ExtractFrustumPlanes(CXMMATRIX worldViewProj, XMFLOAT4 planes[6]);
+
+	bool mConeCulling;
+
+	static MeshletCuller* mInstance;
+};
@@ -0,0 +1,405 @@
+#include "MipGenerator.h"
+#include "Parallel.h"
+
+#include <cmath>
+
+namespace
+{
+	// Kaiser filter radius in texels of the smaller mip and its window shape
+	const double KaiserRadius = 3.0;
+	const double KaiserAlpha = 4.0;
+
+	// Rows of the smaller mip filtered by one task, the source rows its vertical
+	// taps reach beyond the band are filtered horizontally by both neighbours
+	const UINT BandRows = 16;
+
+	// The source texels every texel of the smaller mip blends along one axis. Every texel
+	// has the same number of taps, the unused ones have a zero weight.
+	struct FilterTaps
+	{
+		UINT count;
+		std::vector<UINT> indices;	// clamped to the edge
+		std::vector<float> weights;	// sum to 1 per texel
+	};
+
+	double Sinc(double x)
+	{
+		if (std::fabs(x) < 1e-6)
+			return 1.0;
+		x *= 3.14159265358979323846;
+		return std::sin(x) / x;
+	}
+
+	// Modified Bessel function of the first kind, order 0
+	double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+		{
+			term *= (x * x) / (4.0 * k * k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	double Kaiser(double x)
+	{
+		double t = x / KaiserRadius;
+		if (std::fabs(t) >= 1.0)
+			return 0.0;
+		return Sinc(x) * BesselI0(KaiserAlpha * std::sqrt(1.0 - t * t)) / BesselI0(KaiserAlpha);
+	}
+
+	void BuildTaps(UINT sourceSize, UINT destSize, MipFilter filter, FilterTaps& taps)
+	{
+		taps.indices.clear();
+		taps.weights.clear();
+
+		// a side that is 1 texel already stays as it is
+		if (sourceSize == destSize)
+		{
+			taps.count = 1;
+			for (UINT x = 0; x < destSize; ++x)
+			{
+				taps.indices.push_back(x);
+				taps.weights.push_back(1.0f);
+			}
+			return;
+		}
+
+		// odd sizes scale by slightly more than 2, the footprints cover the whole source
+		double scale = (double)sourceSize / destSize;
+		double halfWidth = filter == MIP_FILTER_KAISER ? KaiserRadius * scale : 0.5 * scale;
+
+		std::vector<std::vector<std::pair<int, double> > > texelTaps(destSize);
+		taps.count = 0;
+		for (UINT x = 0; x < destSize; ++x)
+		{
+			double center = (x + 0.5) * scale;
+			int first = (int)std::floor(center - halfWidth);
+			int last = (int)std::ceil(center + halfWidth);
+			double sum = 0.0;
+			for (int i = first; i <= last; ++i)
+			{
+				double weight;
+				if (filter == MIP_FILTER_KAISER)
+					weight = Kaiser((i + 0.5 - center) / scale);
+				else
+					weight = std::max(std::min(i + 1.0, center + halfWidth) - std::max((double)i, center - halfWidth), 0.0);
+				if (weight == 0.0)
+					continue;
+				int index = std::min(std::max(i, 0), (int)sourceSize - 1);
+				texelTaps[x].push_back(std::make_pair(index, weight));
+				sum += weight;
+			}
+			for (size_t k = 0; k < texelTaps[x].size(); ++k)
+				texelTaps[x][k].second /= sum;
+			taps.count = std::max(taps.count, (UINT)texelTaps[x].size());
+		}
+
+		for (UINT x = 0; x < destSize; ++x)
+		{
+			for (UINT k = 0; k < taps.count; ++k)
+			{
+				bool used = k < texelTaps[x].size();
+				taps.indices.push_back(used ? texelTaps[x][k].first : texelTaps[x].back().first);
+				taps.weights.push_back(used ? (float)texelTaps[x][k].second : 0.0f);
+			}
+		}
+	}
+
+	// Filters a row of RGBA texels along x. Every level sums the products in tap order
+	// without fused multiply adds, so they all round the same.
+	typedef void (*FilterRowFunc)(const float* source, const FilterTaps& taps, UINT destWidth, float* dest);
+
+	// dest = sum of weights[k] * rows[k], count floats
+	typedef void (*BlendRowsFunc)(const float* const* rows, const float* weights, UINT rowCount, UINT count, float* dest);
+
+	void FilterRowScalar(const float* source, const FilterTaps& taps, UINT destWidth, float* dest)
+	{
+		const UINT* indices = &taps.indices[0];
+		const float* weights = &taps.weights[0];
+		for (UINT x = 0; x < destWidth; ++x, indices += taps.count, weights += taps.count)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (UINT k = 0; k < taps.count; ++k)
+			{
+				const float* texel = source + indices[k] * 4;
+				for (UINT c = 0; c < 4; ++c)
+					sum[c] = sum[c] + weights[k] * texel[c];
+			}
+			for (UINT c = 0; c < 4; ++c)
+				dest[x * 4 + c] = sum[c];
+		}
+	}
+
+	void BlendRowsScalar(const float* const* rows, const float* weights, UINT rowCount, UINT count, float* dest)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < rowCount; ++k)
+				sum = sum + weights[k] * rows[k][i];
+			dest[i] = sum;
+		}
+	}
+
+#ifdef SIMD_X86
+	// A texel is 4 floats, one register
+	SIMD_TARGET_SSE2
+	void FilterRowSse2(const float* source, const FilterTaps& taps, UINT destWidth, float* dest)
+	{
+		const UINT* indices = &taps.indices[0];
+		const float* weights = &taps.weights[0];
+		for (UINT x = 0; x < destWidth; ++x, indices += taps.count, weights += taps.count)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (UINT k = 0; k < taps.count; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(source + indices[k] * 4)));
+			_mm_storeu_ps(dest + x * 4, sum);
+		}
+	}
+
+	SIMD_TARGET_SSE2
+	void BlendRowsSse2(const float* const* rows, const float* weights, UINT rowCount, UINT count, float* dest)
+	{
+		UINT i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (UINT k = 0; k < rowCount; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+			_mm_storeu_ps(dest + i, sum);
+		}
+		for (; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < rowCount; ++k)
+				sum = sum + weights[k] * rows[k][i];
+			dest[i] = sum;
+		}
+	}
+
+	// Two texels of the smaller mip per register, their taps load the two halves
+	SIMD_TARGET_AVX2
+	void FilterRowAvx2(const float* source, const FilterTaps& taps, UINT destWidth, float* dest)
+	{
+		const UINT* indices = &taps.indices[0];
+		const float* weights = &taps.weights[0];
+		UINT x = 0;
+		for (; x + 2 <= destWidth; x += 2, indices += taps.count * 2, weights += taps.count * 2)
+		{
+			const UINT* indices1 = indices + taps.count;
+			const float* weights1 = weights + taps.count;
+			__m256 sum = _mm256_setzero_ps();
+			for (UINT k = 0; k < taps.count; ++k)
+			{
+				__m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(source + indices[k] * 4)), _mm_loadu_ps(source + indices1[k] * 4), 1);
+				__m256 weight = _mm256_insertf128_ps(_mm256_set1_ps(weights[k]), _mm_set1_ps(weights1[k]), 1);
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(weight, texels));
+			}
+			_mm256_storeu_ps(dest + x * 4, sum);
+		}
+		if (x < destWidth)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (UINT k = 0; k < taps.count; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(source + indices[k] * 4)));
+			_mm_storeu_ps(dest + x * 4, sum);
+		}
+	}
+
+	SIMD_TARGET_AVX2
+	void BlendRowsAvx2(const float* const* rows, const float* weights, UINT rowCount, UINT count, float* dest)
+	{
+		UINT i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (UINT k = 0; k < rowCount; ++k)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+			_mm256_storeu_ps(dest + i, sum);
+		}
+		for (; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < rowCount; ++k)
+				sum = sum + weights[k] * rows[k][i];
+			dest[i] = sum;
+		}
+	}
+#endif
+
+	void GetFilterFuncs(SimdLevel level, FilterRowFunc& filterRow, BlendRowsFunc& blendRows)
+	{
+		filterRow = FilterRowScalar;
+		blendRows = BlendRowsScalar;
+#ifdef SIMD_X86
+		if (level == SIMD_AVX2)
+		{
+			filterRow = FilterRowAvx2;
+			blendRows = BlendRowsAvx2;
+		}
+		else if (level == SIMD_SSE2)
+		{
+			filterRow = FilterRowSse2;
+			blendRows = BlendRowsSse2;
+		}
+#endif
+	}
+
+	BYTE ToUnorm(float value)
+	{
+		return (BYTE)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+MipGenerator* MipGenerator::mInstance = NULL;
+
+MipGenerator* MipGenerator::Instance()
+{
+	if (!mInstance)
+		mInstance = new MipGenerator;
+	return mInstance;
+}
+
+MipGenerator::MipGenerator()
+{
+	mMaxSimdLevel = GetCpuSimdLevel();
+	mSimdLevel = mMaxSimdLevel;
+
+	for (UINT i = 0; i < 256; ++i)
+	{
+		double s = i / 255.0;
+		mToFloat[TEXTURE_COLOR][i] = (float)(s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4));
+		mToFloat[TEXTURE_NORMAL_MAP][i] = (float)(s * 2.0 - 1.0);
+		mToFloat[TEXTURE_LINEAR][i] = (float)s;
+	}
+	for (UINT i = 0; i < LinearToSrgbSize; ++i)
+	{
+		double l = (double)i / (LinearToSrgbSize - 1);
+		double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+		mLinearToSrgb[i] = (BYTE)(s * 255.0 + 0.5);
+	}
+}
+
+MipGenerator::~MipGenerator()
+{
+}
+
+void MipGenerator::DecodeRow(const BYTE* source, UINT width, TextureContent content, float* dest) const
+{
+	const float* toFloat = mToFloat[content];
+	const float* alphaToFloat = mToFloat[TEXTURE_LINEAR];
+	for (UINT x = 0; x < width; ++x, source += 4, dest += 4)
+	{
+		dest[0] = toFloat[source[0]];
+		dest[1] = toFloat[source[1]];
+		dest[2] = toFloat[source[2]];
+		dest[3] = alphaToFloat[source[3]];
+	}
+}
+
+void MipGenerator::EncodeRow(float* source, UINT width, TextureContent content, BYTE* dest) const
+{
+	for (UINT x = 0; x < width; ++x, source += 4, dest += 4)
+	{
+		if (content == TEXTURE_COLOR)
+		{
+			for (UINT c = 0; c < 3; ++c)
+			{
+				float value = std::min(std::max(source[c], 0.0f), 1.0f);
+				dest[c] = mLinearToSrgb[(UINT)(value * (LinearToSrgbSize - 1) + 0.5f)];
+			}
+		}
+		else if (content == TEXTURE_NORMAL_MAP)
+		{
+			// normals that cancel out are left pointing out of the surface
+			float length = std::sqrt(source[0] * source[0] + source[1] * source[1] + source[2] * source[2]);
+			float normal[3] = { 0.0f, 0.0f, 1.0f };
+			if (length > 1e-6f)
+			{
+				for (UINT c = 0; c < 3; ++c)
+					normal[c] = source[c] / length;
+			}
+			for (UINT c = 0; c < 3; ++c)
+				dest[c] = ToUnorm(normal[c] * 0.5f + 0.5f);
+		}
+		else
+		{
+			for (UINT c = 0; c < 3; ++c)
+				dest[c] = ToUnorm(source[c]);
+		}
+		dest[3] = ToUnorm(source[3]);
+	}
+}
+
+bool MipGenerator::Generate(TextureData& textureData, const MipOptions& options)
+{
+	if ((textureData.format != DXGI_FORMAT_R8G8B8A8_UNORM && textureData.format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) ||
+		textureData.mips.empty() || textureData.width == 0 || textureData.height == 0 ||
+		textureData.pixels.size() < textureData.mips[0].offset + (size_t)textureData.mips[0].rowPitch * textureData.height)
+	{
+		return false;
+	}
+
+	textureData.mips.resize(1);
+
+	// size of the whole chain up front, the levels are appended in place
+	size_t chainBytes = textureData.mips[0].offset;
+	UINT mipCount = GetMipCount(textureData.width, textureData.height);
+	for (UINT m = 0; m < mipCount; ++m)
+		chainBytes += (size_t)GetSurfaceBytes(textureData.format, std::max(textureData.width >> m, 1u), std::max(textureData.height >> m, 1u));
+	textureData.pixels.resize(chainBytes);
+
+	FilterRowFunc filterRow;
+	BlendRowsFunc blendRows;
+	GetFilterFuncs(mSimdLevel, filterRow, blendRows);
+
+	FilterTaps tapsX, tapsY;
+	for (UINT m = 1; m < mipCount; ++m)
+	{
+		const TextureMip source = textureData.mips[m - 1];
+		TextureMip mip;
+		mip.width = std::max(source.width / 2, 1u);
+		mip.height = std::max(source.height / 2, 1u);
+		mip.rowPitch = mip.width * 4;
+		mip.offset = source.offset + (size_t)source.rowPitch * source.height;
+
+		BuildTaps(source.width, mip.width, options.filter, tapsX);
+		BuildTaps(source.height, mip.height, options.filter, tapsY);
+
+		// each band filters the source rows its taps reach along x, then blends them along y
+		UINT bandCount = (mip.height + BandRows - 1) / BandRows;
+		ParallelFor(bandCount, [&](size_t band)
+		{
+			UINT firstRow = (UINT)band * BandRows;
+			UINT lastRow = std::min(firstRow + BandRows, mip.height);
+			const UINT* rowIndices = &tapsY.indices[firstRow * tapsY.count];
+			UINT rowTapCount = (lastRow - firstRow) * tapsY.count;
+			UINT firstSource = *std::min_element(rowIndices, rowIndices + rowTapCount);
+			UINT lastSource = *std::max_element(rowIndices, rowIndices + rowTapCount);
+
+			std::vector<float> decoded((size_t)source.width * 4);
+			std::vector<float> filtered((size_t)(lastSource - firstSource + 1) * mip.width * 4);
+			for (UINT y = firstSource; y <= lastSource; ++y)
+			{
+				DecodeRow(&textureData.pixels[source.offset + (size_t)y * source.rowPitch], source.width, options.content, &decoded[0]);
+				filterRow(&decoded[0], tapsX, mip.width, &filtered[(size_t)(y - firstSource) * mip.width * 4]);
+			}
+
+			std::vector<const float*> rows(tapsY.count);
+			std::vector<float> blended((size_t)mip.width * 4);
+			for (UINT y = firstRow; y < lastRow; ++y)
+			{
+				for (UINT k = 0; k < tapsY.count; ++k)
+					rows[k] = &filtered[(size_t)(tapsY.indices[y * tapsY.count + k] - firstSource) * mip.width * 4];
+				blendRows(&rows[0], &tapsY.weights[y * tapsY.count], tapsY.count, mip.width * 4, &blended[0]);
+				EncodeRow(&blended[0], mip.width, options.content, &textureData.pixels[mip.offset + (size_t)y * mip.rowPitch]);
+			}
+		});
+
+		textureData.mips.push_back(mip);
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+#include "Simd.h"
+
+// How the texels of a texture are interpreted when its mips are filtered
+enum TextureContent
+{
+	TEXTURE_COLOR,		// sRGB encoded color, alpha linear
+	TEXTURE_NORMAL_MAP,	// xyz = rgb * 2 - 1, renormalized after filtering, alpha linear
+	TEXTURE_LINEAR		// masks and other data, every channel linear
+};
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,		// average of the texels under the footprint, 2x2 for even sizes
+	MIP_FILTER_KAISER	// Kaiser windowed sinc over 3 texels of the smaller mip each side, sharper
+};
+
+struct MipOptions
+{
+	MipOptions() : filter(MIP_FILTER_KAISER), content(TEXTURE_COLOR) {}
+
+	MipFilter filter;
+	TextureContent content;
+};
+
+// MipGenerator
+// singleton class, builds the mip chain of RGBA8 textures on the CPU
+// usage:
+// MipGenerator::Instance()->Generate(textureData, options)
+//
+// Every mip is filtered from the one above it, separably, in linear space: color
+// is decoded from sRGB first, so averaging does not darken distant surfaces the way
+// filtering the gamma encoded bytes does. Normal maps are filtered as vectors and
+// renormalized. The edges clamp. Bands of rows are spread over all hardware threads,
+// the filter loops run a texel (SSE2) or two (AVX2) per instruction and every SIMD
+// level writes the same bytes. Thread safe.
+class MipGenerator
+{
+public:
+	static MipGenerator* Instance();
+
+	// Replaces the mips below mips[0] of an R8G8B8A8 textureData with the full chain
+	// down to 1x1. Returns false for other formats.
+	bool Generate(TextureData& textureData, const MipOptions& options = MipOptions());
+
+	// The best instruction set the CPU supports is used, it can be lowered to compare
+	SimdLevel GetMaxSimdLevel() const { return mMaxSimdLevel; }
+	SimdLevel GetSimdLevel() const { return mSimdLevel; }
+	void SetSimdLevel(SimdLevel level) { mSimdLevel = std::min(level, mMaxSimdLevel); }
+
+private:
+	MipGenerator();
+	~MipGenerator();
+
+	// Converts a row of width texels to float RGBA, color channels to linear
+	void DecodeRow(const BYTE* source, UINT width, TextureContent content, float* dest) const;
+
+	// Converts a float RGBA row back to bytes, normal maps are renormalized first
+	void EncodeRow(float* source, UINT width, TextureContent content, BYTE* dest) const;
+
+	SimdLevel mMaxSimdLevel;
+	SimdLevel mSimdLevel;
+
+	// linear values are rounded to this many steps to look up their sRGB byte
+	static const UINT LinearToSrgbSize = 4096;
+
+	// byte to float of the rgb channels by TextureContent, alpha is always linear
+	float mToFloat[3][256];
+	BYTE mLinearToSrgb[LinearToSrgbSize];
+
+	static MipGenerator* mInstance;
+};
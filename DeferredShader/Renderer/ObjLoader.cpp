@@ -1,11 +1,39 @@
 #include "ObjLoader.h"
+#include "ObjParser.h"
+#include "MappedFile.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
 #include "tiny_obj_loader.h"
 
 #include <iostream>
+#include <chrono>
+#include <unordered_map>
 
-#include "TextureManager.h"
+#include "MeshCache.h"
+#include "MeshProcessor.h"
+
+namespace
+{
+	// Hashes the (position, normal, texcoord) index triple of a face corner
+	struct IndexTripleHash
+	{
+		size_t operator()(const tinyobj::index_t& idx) const
+		{
+			size_t h = std::hash<int>()(idx.vertex_index);
+			h ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct IndexTripleEqual
+	{
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+		{
+			return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+		}
+	};
+}
 
 ObjLoader* ObjLoader::mInstance = 0;
 
@@ -18,27 +46,68 @@ ObjLoader* ObjLoader::Instance()
 	return mInstance;
 }
 
-ObjLoader::ObjLoader()
+ObjLoader::ObjLoader() : mUseMeshCache(true), mParallelParseThreshold(16 * 1024 * 1024), mQuantizeVertices(false)
 {
 }
 
 ObjLoader::~ObjLoader()
 {
-	if (mInstance != NULL)
-	{
-		delete mInstance;
-		mInstance = NULL;
-	}
 }
 
 bool ObjLoader::LoadToMesh(std::string fileName, std::string mtlBaseDir, MeshData& meshData)
 {
+	auto loadStart = std::chrono::high_resolution_clock::now();
+
+	// Use the cooked binary mesh if the .obj has not changed since it was cooked,
+	// the .obj is only read when it has to be parsed
+	UINT64 sourceStamp = 0;
+	if (mUseMeshCache)
+	{
+		sourceStamp = MeshCache::StampFiles(std::vector<std::string>(1, fileName));
+		if (MeshCache::Instance()->LoadUnchanged(fileName, sourceStamp, meshData))
+		{
+			QuantizeVertices(fileName, meshData);
+
+			auto cacheEnd = std::chrono::high_resolution_clock::now();
+			DebugLog("ObjLoader: %s loaded from mesh cache in %.2f ms, %u vertices, %u indices\n", fileName.c_str(),
+				std::chrono::duration<double, std::milli>(cacheEnd - loadStart).count(),
+				(UINT)meshData.Vertices.size(), (UINT)meshData.Indices.size());
+			return true;
+		}
+	}
+
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 
+	// Large files go through the multithreaded parser
+	size_t fileSize = 0;
+	{
+		std::ifstream sizeStream(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+		if (sizeStream)
+			fileSize = (size_t)sizeStream.tellg();
+	}
+	bool parallelParse = mParallelParseThreshold > 0 && fileSize >= mParallelParseThreshold;
+
+	auto parseStart = std::chrono::high_resolution_clock::now();
+
 	std::string err;
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), mtlBaseDir.c_str());
+	bool ret;
+	if (parallelParse)
+	{
+		ObjParser parser;
+		ret = parser.Parse(fileName, mtlBaseDir, attrib, shapes, materials, err);
+	}
+	else
+	{
+		ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), mtlBaseDir.c_str());
+	}
+
+	auto parseEnd = std::chrono::high_resolution_clock::now();
+	double parseSeconds = std::chrono::duration<double>(parseEnd - parseStart).count();
+	DebugLog("ObjLoader: %s parsed with %s, %.1f MB in %.2f ms (%.1f MB/s)\n", fileName.c_str(),
+		parallelParse ? "ObjParser" : "tinyobj", fileSize / (1024.0 * 1024.0), parseSeconds * 1000.0,
+		parseSeconds > 0.0 ? fileSize / (1024.0 * 1024.0) / parseSeconds : 0.0);
 
 	if (!err.empty()) { // `err` may contain warning message.
 		std::cerr << err << std::endl;
@@ -48,83 +117,218 @@ bool ObjLoader::LoadToMesh(std::string fileName, std::string mtlBaseDir, MeshDat
 		return false;
 	}
 
-	// Loop over shapes
-	for (size_t s = 0; s < shapes.size(); s++) {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-			int fv = shapes[s].mesh.num_face_vertices[f];
-
-			// Loop over vertices in the face.
-			for (size_t v = 0; v < fv; v++) {
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-				tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-				tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-				tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-				
-				tinyobj::real_t tx = 0;
-				tinyobj::real_t ty = 0;
-				if (idx.texcoord_index >= 0)
-				{
-					tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-					ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-				}
-				
-				// Optional: vertex colors
-				// tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
-				// tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
-				// tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
-
-				Vertex vertex;
-				vertex.Position.x = vx;
-				vertex.Position.y = vy;
-				vertex.Position.z = vz;
-				vertex.Normal.x = nx;
-				vertex.Normal.y = ny;
-				vertex.Normal.z = nz;
-				vertex.Tex.x = tx;
-				vertex.Tex.y = ty;
-				meshData.Vertices.push_back(vertex);
-				meshData.Indices.push_back(index_offset + v);
-				
+	// Material of every face, faces without a material get the default one
+	// added after the .mtl materials
+	UINT defaultMaterialId = (UINT)materials.size();
+	bool useDefaultMaterial = materials.empty();
+	auto faceMaterial = [&](const tinyobj::mesh_t& mesh, size_t f)
+	{
+		int materialId = f < mesh.material_ids.size() ? mesh.material_ids[f] : -1;
+		return materialId < 0 || materialId >= (int)materials.size() ? defaultMaterialId : (UINT)materialId;
+	};
 
-			}
-			index_offset += fv;
+	// Count the faces of every material first, so the index buffer is allocated
+	// once and every triangle is written straight to its slot in material order.
+	// The sort is stable, the file order is kept inside every material.
+	size_t cornerCount = 0;
+	std::vector<UINT> materialOffsets(materials.size() + 2, 0);
+	for (size_t s = 0; s < shapes.size(); s++)
+	{
+		const tinyobj::mesh_t& mesh = shapes[s].mesh;
+		cornerCount += mesh.indices.size();
+		for (size_t f = 0; f < mesh.num_face_vertices.size(); f++)
+		{
+			UINT materialId = faceMaterial(mesh, f);
+			useDefaultMaterial = useDefaultMaterial || materialId == defaultMaterialId;
+			materialOffsets[materialId + 1]++;
+		}
+	}
 
-			// per-face material
-			if (!materials.empty())
-			{
-				// TODO support for per-face materials
-				// shapes[s].mesh.material_ids[f];
+	meshData.Submeshes.clear();
+	for (UINT m = 0; m + 1 < materialOffsets.size(); ++m)
+	{
+		if (materialOffsets[m + 1] > 0)
+		{
+			Submesh submesh = { m, materialOffsets[m] * 3, materialOffsets[m + 1] * 3, 0, 0 };
+			meshData.Submeshes.push_back(submesh);
+		}
+		materialOffsets[m + 1] += materialOffsets[m];
+	}
+
+	// Weld the face corners: tinyobj gives a (position, normal, texcoord) index triple
+	// for every corner, identical triples become one shared vertex in the vertex buffer.
+	// Only the triples of the new vertices are kept here, the vertices are built
+	// after the weld map and the faces are released.
+	std::vector<tinyobj::index_t> vertexCorners;
+	{
+		std::unordered_map<tinyobj::index_t, UINT, IndexTripleHash, IndexTripleEqual> weldMap;
+		weldMap.reserve(cornerCount);
+		meshData.Indices.clear();
+		meshData.Indices.resize(cornerCount);
+
+		// Loop over shapes
+		for (size_t s = 0; s < shapes.size(); s++) {
+			const tinyobj::mesh_t& mesh = shapes[s].mesh;
+			// Loop over faces(polygon), the faces are triangulated
+			size_t index_offset = 0;
+			for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+				size_t fv = mesh.num_face_vertices[f];
+				UINT* triangle = &meshData.Indices[materialOffsets[faceMaterial(mesh, f)]++ * 3];
+
+				// Loop over vertices in the face.
+				for (size_t v = 0; v < fv; v++) {
+					// access to vertex
+					tinyobj::index_t idx = mesh.indices[index_offset + v];
+
+					// reuse the vertex if this index triple was already emitted
+					auto inserted = weldMap.insert(std::make_pair(idx, (UINT)vertexCorners.size()));
+					if (inserted.second)
+						vertexCorners.push_back(idx);
+					triangle[v] = inserted.first->second;
+				}
+				index_offset += fv;
 			}
 		}
 	}
+	std::vector<tinyobj::shape_t>().swap(shapes);
+
+	meshData.Vertices.clear();
+	meshData.Vertices.resize(vertexCorners.size());
+	for (size_t i = 0; i < vertexCorners.size(); i++)
+	{
+		const tinyobj::index_t& idx = vertexCorners[i];
+
+		tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
+		tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
+		tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
+		// faces without vn get a zero normal, MeshProcessor generates it
+		tinyobj::real_t nx = 0;
+		tinyobj::real_t ny = 0;
+		tinyobj::real_t nz = 0;
+		if (idx.normal_index >= 0)
+		{
+			nx = attrib.normals[3 * idx.normal_index + 0];
+			ny = attrib.normals[3 * idx.normal_index + 1];
+			nz = attrib.normals[3 * idx.normal_index + 2];
+		}
+
+		tinyobj::real_t tx = 0;
+		tinyobj::real_t ty = 0;
+		if (idx.texcoord_index >= 0)
+		{
+			tx = attrib.texcoords[2 * idx.texcoord_index + 0];
+			ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+		}
+
+		// Optional: vertex colors
+		// tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
+		// tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
+		// tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
+
+		Vertex& vertex = meshData.Vertices[i];
+		vertex.Position.x = vx;
+		vertex.Position.y = vy;
+		vertex.Position.z = vz;
+		vertex.Normal.x = nx;
+		vertex.Normal.y = ny;
+		vertex.Normal.z = nz;
+		vertex.Tex.x = tx;
+		vertex.Tex.y = ty;
+	}
+	std::vector<tinyobj::index_t>().swap(vertexCorners);
+	attrib = tinyobj::attrib_t();
 
-	if (!materials.empty())
+	for (size_t i = 0; i < materials.size(); ++i)
 	{
 		Material mat;
-		tinyobj::material_t m = materials[0];
-		mat.diffuseTexture = mtlBaseDir + m.diffuse_texname;
-		TextureManager::Instance()->CreateTexture(mat.diffuseTexture);
+		const tinyobj::material_t& m = materials[i];
+		if (!m.diffuse_texname.empty())
+		{
+			mat.diffuseTexture = mtlBaseDir + m.diffuse_texname;
+		}
+		if (!m.normal_texname.empty())
+		{
+			mat.normalTexture = mtlBaseDir + m.normal_texname;
+		}
 		mat.Diffuse = XMFLOAT4(m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f);
 		mat.specExp = m.shininess;
 		mat.specIntensivity = 0.25f;
-		meshData.materials[0] = mat;
+		meshData.materials[(UINT)i] = mat;
 	}
-	else {
+	if (useDefaultMaterial) {
 		Material mat;
 		mat.diffuseTexture = "";
 		mat.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 		mat.specExp = 250.0f;
 		mat.specIntensivity = 0.25f;
-		meshData.materials[0] = mat;
+		meshData.materials[defaultMaterialId] = mat;
 	}
 
 	meshData.world = XMMatrixIdentity();
 
+	// Vertex cache / overdraw order, bounds, meshlets and LODs
+	MeshProcessor::Instance()->Process(meshData);
+
+	// Cook the mesh so the next load can skip parsing
+	if (mUseMeshCache && sourceStamp != 0)
+	{
+		if (!MeshCache::Instance()->Save(fileName, MeshCache::Instance()->HashFile(fileName), sourceStamp, meshData))
+		{
+			std::cerr << "ObjLoader: could not write mesh cache for " << fileName << std::endl;
+		}
+	}
+
+	QuantizeVertices(fileName, meshData);
+
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+	DebugLog("ObjLoader: %s loaded in %.2f ms, %u corners welded to %u vertices, %u indices, %u materials, %u meshlets\n", fileName.c_str(),
+		std::chrono::duration<double, std::milli>(loadEnd - loadStart).count(),
+		(UINT)cornerCount, (UINT)meshData.Vertices.size(), (UINT)meshData.Lods[0].indexCount, meshData.Lods[0].submeshCount,
+		(UINT)meshData.Meshlets.size());
+	MeshProcessor::Instance()->LogLods(fileName, meshData);
+
 	return true;
 }
+
+bool ObjLoader::GetDependencies(const std::string& fileName, const std::string& mtlBaseDir, std::vector<std::string>& dependencies)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	const char* text = (const char*)file.GetData();
+	const char* end = text + file.GetSize();
+	for (const char* line = text; line < end;)
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (lineEnd == NULL)
+			lineEnd = end;
+
+		const char* p = line;
+		while (p < lineEnd && (*p == ' ' || *p == '\t'))
+			p++;
+
+		// tinyobj takes the first library that opens out of a whitespace separated list
+		if (lineEnd - p > 7 && memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+		{
+			std::istringstream names(std::string(p + 7, lineEnd));
+			std::string name;
+			while (names >> name)
+			{
+				dependencies.push_back(mtlBaseDir + name);
+			}
+		}
+
+		line = lineEnd + 1;
+	}
+
+	return true;
+}
+
+void ObjLoader::QuantizeVertices(const std::string& fileName, MeshData& meshData)
+{
+	if (mQuantizeVertices)
+	{
+		MeshProcessor::Instance()->QuantizeVertices(fileName, meshData);
+	}
+}
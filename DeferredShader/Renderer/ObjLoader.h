@@ -1,13 +1,15 @@
 #pragma once
 
 #include "Util.h"
-#include "Mesh.h"
+#include "MeshData.h"
 
 
 // ObjLoader
 // singleton class, usage:
 // ObjLoader::Instance()->LoadToMesh("..\\Assets\\bunny.obj",  "..\\Assets\\", meshData)
 // loads .obj file to MeshData object
+// Parsed meshes are cooked to a binary MeshCache file next to the .obj and
+// loaded from there as long as the .obj content does not change.
 class ObjLoader
 {
 public:
@@ -15,9 +17,30 @@ public:
 
 	bool LoadToMesh(std::string fileName, std::string mtlBaseDir, MeshData& meshData);
 
+	// Appends the .mtl libraries referenced by fileName, the textures are in the
+	// materials of the loaded MeshData
+	bool GetDependencies(const std::string& fileName, const std::string& mtlBaseDir, std::vector<std::string>& dependencies);
+
+	// Enable/disable reading and writing the binary mesh cache, on by default
+	void SetUseMeshCache(bool useMeshCache) { mUseMeshCache = useMeshCache; }
+
+	// .obj files of at least this many bytes are parsed with the multithreaded ObjParser
+	// instead of tinyobj, 0 always uses tinyobj
+	void SetParallelParseThreshold(size_t bytes) { mParallelParseThreshold = bytes; }
+
+	// Enable/disable packing the vertices into the 16 byte PackedVertex format, off by default
+	void SetQuantizeVertices(bool quantizeVertices) { mQuantizeVertices = quantizeVertices; }
+
 private:
 	ObjLoader();
 	~ObjLoader();
 
+	// Packs meshData.Vertices when quantization is enabled and logs the error
+	void QuantizeVertices(const std::string& fileName, MeshData& meshData);
+
+	bool mUseMeshCache;
+	size_t mParallelParseThreshold;
+	bool mQuantizeVertices;
+
 	static ObjLoader* mInstance;
 };
\ No newline at end of file
@@ -0,0 +1,471 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Size of the blocks the file is split into, rounded up to the next line end
+	const size_t ChunkSize = 4 * 1024 * 1024;
+
+	// Face index encoding inside a chunk: positive .obj indices are already global
+	// and stored as 0 based values, negative (relative) indices can only be resolved
+	// once the vertex counts of the previous chunks are known, they are stored
+	// relative to the chunk start minus RelativeBias so they stay negative.
+	const int MissingIndex = INT_MIN;
+	const int RelativeBias = 1 << 30;
+
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> vertices;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+
+		// 3 encoded corners per triangle
+		std::vector<tinyobj::index_t> indices;
+
+		// per triangle index to materialNames, -1 uses the material active at the chunk start
+		std::vector<int> faceMaterials;
+		std::vector<std::string> materialNames;
+		int lastMaterial;
+
+		std::vector<std::string> mtlLibs;
+	};
+
+	const double Pow10Table[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char* SkipSpace(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			++p;
+		return p;
+	}
+
+	inline const char* SkipToken(const char* p, const char* end)
+	{
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			++p;
+		return p;
+	}
+
+	// Parses a decimal float, up to 19 significant digits are accumulated into an
+	// integer mantissa and scaled once, no locale or strtod overhead.
+	const char* ParseFloat(const char* p, const char* end, float& out)
+	{
+		p = SkipSpace(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		UINT64 mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		while (p < end && IsDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0)
+					++digits;
+			}
+			else
+			{
+				++exponent;
+			}
+			++p;
+		}
+
+		if (p < end && *p == '.')
+		{
+			++p;
+			while (p < end && IsDigit(*p))
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0)
+						++digits;
+					--exponent;
+				}
+				++p;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExp = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExp = *p == '-';
+				++p;
+			}
+			int e = 0;
+			while (p < end && IsDigit(*p))
+			{
+				if (e < 10000)
+					e = e * 10 + (*p - '0');
+				++p;
+			}
+			exponent += negativeExp ? -e : e;
+		}
+
+		double value = (double)mantissa;
+		if (exponent != 0 && mantissa != 0)
+		{
+			int absExp = exponent < 0 ? -exponent : exponent;
+			double scale = absExp <= 22 ? Pow10Table[absExp] : pow(10.0, (double)absExp);
+			value = exponent < 0 ? value / scale : value * scale;
+		}
+
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	const char* ParseInt(const char* p, const char* end, int& out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		int value = 0;
+		while (p < end && IsDigit(*p))
+		{
+			value = value * 10 + (*p - '0');
+			++p;
+		}
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// Encodes an .obj index, see RelativeBias. Relative indices reaching further back
+	// are clamped, they still resolve below zero and are rejected by DecodeIndex.
+	inline int EncodeIndex(int objIndex, size_t localCount)
+	{
+		if (objIndex > 0)
+			return objIndex - 1;
+		if (objIndex < 0)
+			return (int)localCount + std::max(objIndex, 1 - RelativeBias) - RelativeBias;
+		return MissingIndex;
+	}
+
+	// Resolves an encoded index of a chunk to a global index, -1 if it is missing.
+	// False if the index is outside the count elements of the file.
+	inline bool DecodeIndex(int encoded, size_t chunkBase, int count, int& index)
+	{
+		if (encoded == MissingIndex)
+		{
+			index = -1;
+			return true;
+		}
+		index = encoded < 0 ? encoded + RelativeBias + (int)chunkBase : encoded;
+		return index >= 0 && index < count;
+	}
+
+	// Parses one "v/vt/vn" face corner
+	const char* ParseCorner(const char* p, const char* end, const ObjChunk& chunk, tinyobj::index_t& idx)
+	{
+		int value = 0;
+		p = ParseInt(p, end, value);
+		idx.vertex_index = EncodeIndex(value, chunk.vertices.size() / 3);
+		idx.texcoord_index = MissingIndex;
+		idx.normal_index = MissingIndex;
+
+		if (p < end && *p == '/')
+		{
+			++p;
+			if (p < end && *p != '/')
+			{
+				p = ParseInt(p, end, value);
+				idx.texcoord_index = EncodeIndex(value, chunk.texcoords.size() / 2);
+			}
+			if (p < end && *p == '/')
+			{
+				++p;
+				p = ParseInt(p, end, value);
+				idx.normal_index = EncodeIndex(value, chunk.normals.size() / 3);
+			}
+		}
+
+		return SkipToken(p, end);
+	}
+
+	std::string ParseName(const char* p, const char* lineEnd)
+	{
+		p = SkipSpace(p, lineEnd);
+		const char* nameEnd = lineEnd;
+		while (nameEnd > p && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t' || nameEnd[-1] == '\r'))
+			--nameEnd;
+		return std::string(p, nameEnd);
+	}
+
+	void ParseChunk(ObjChunk& chunk)
+	{
+		// rough reservation, a typical line is around 30 bytes
+		size_t estimatedLines = (chunk.end - chunk.begin) / 32;
+		chunk.vertices.reserve(estimatedLines * 3 / 2);
+		chunk.indices.reserve(estimatedLines * 3 / 2);
+		chunk.lastMaterial = -1;
+
+		int currentMaterial = -1;
+		std::vector<tinyobj::index_t> polygon;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+			if (lineEnd == NULL)
+				lineEnd = chunk.end;
+
+			p = SkipSpace(p, lineEnd);
+
+			if (lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				float x, y, z;
+				p = ParseFloat(p + 2, lineEnd, x);
+				p = ParseFloat(p, lineEnd, y);
+				ParseFloat(p, lineEnd, z);
+				chunk.vertices.push_back(x);
+				chunk.vertices.push_back(y);
+				chunk.vertices.push_back(z);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+			{
+				float x, y, z;
+				p = ParseFloat(p + 3, lineEnd, x);
+				p = ParseFloat(p, lineEnd, y);
+				ParseFloat(p, lineEnd, z);
+				chunk.normals.push_back(x);
+				chunk.normals.push_back(y);
+				chunk.normals.push_back(z);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+			{
+				float u, v;
+				p = ParseFloat(p + 3, lineEnd, u);
+				ParseFloat(p, lineEnd, v);
+				chunk.texcoords.push_back(u);
+				chunk.texcoords.push_back(v);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				polygon.clear();
+				p = SkipSpace(p + 2, lineEnd);
+				while (p < lineEnd && *p != '\r')
+				{
+					tinyobj::index_t idx;
+					p = ParseCorner(p, lineEnd, chunk, idx);
+					polygon.push_back(idx);
+					p = SkipSpace(p, lineEnd);
+				}
+
+				// polygons are split into a triangle fan
+				for (size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					chunk.indices.push_back(polygon[0]);
+					chunk.indices.push_back(polygon[i]);
+					chunk.indices.push_back(polygon[i + 1]);
+					chunk.faceMaterials.push_back(currentMaterial);
+				}
+			}
+			else if (lineEnd - p >= 7 && strncmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+			{
+				std::string name = ParseName(p + 7, lineEnd);
+				auto found = std::find(chunk.materialNames.begin(), chunk.materialNames.end(), name);
+				currentMaterial = (int)(found - chunk.materialNames.begin());
+				if (found == chunk.materialNames.end())
+					chunk.materialNames.push_back(name);
+				chunk.lastMaterial = currentMaterial;
+			}
+			else if (lineEnd - p >= 7 && strncmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+			{
+				chunk.mtlLibs.push_back(ParseName(p + 7, lineEnd));
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+}
+
+ObjParser::ObjParser()
+{
+}
+
+ObjParser::~ObjParser()
+{
+}
+
+bool ObjParser::Parse(const std::string& fileName, const std::string& mtlBaseDir,
+	tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+	std::vector<tinyobj::material_t>& materials, std::string& err)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		err += "Cannot open file [" + fileName + "]\n";
+		return false;
+	}
+
+	const char* data = (const char*)file.GetData();
+	const char* dataEnd = data + file.GetSize();
+
+	// Split at line boundaries
+	std::vector<ObjChunk> chunks;
+	const char* chunkBegin = data;
+	while (chunkBegin < dataEnd)
+	{
+		const char* chunkEnd = chunkBegin + std::min<size_t>(ChunkSize, dataEnd - chunkBegin);
+		if (chunkEnd < dataEnd)
+		{
+			const char* lineEnd = (const char*)memchr(chunkEnd, '\n', dataEnd - chunkEnd);
+			chunkEnd = lineEnd != NULL ? lineEnd + 1 : dataEnd;
+		}
+
+		ObjChunk chunk;
+		chunk.begin = chunkBegin;
+		chunk.end = chunkEnd;
+		chunks.push_back(chunk);
+
+		chunkBegin = chunkEnd;
+	}
+
+	ParallelFor(chunks.size(), [&](size_t i) { ParseChunk(chunks[i]); });
+
+	// Materials, every library is loaded once in file order
+	std::map<std::string, int> materialMap;
+	std::vector<std::string> loadedLibs;
+	for (size_t c = 0; c < chunks.size(); ++c)
+	{
+		for (size_t l = 0; l < chunks[c].mtlLibs.size(); ++l)
+		{
+			const std::string& lib = chunks[c].mtlLibs[l];
+			if (std::find(loadedLibs.begin(), loadedLibs.end(), lib) != loadedLibs.end())
+				continue;
+			loadedLibs.push_back(lib);
+
+			std::ifstream mtlStream(mtlBaseDir + lib);
+			if (!mtlStream)
+			{
+				err += "Material file [" + mtlBaseDir + lib + "] not found.\n";
+				continue;
+			}
+
+			std::string warning;
+			tinyobj::LoadMtl(&materialMap, &materials, &mtlStream, &warning);
+			err += warning;
+		}
+	}
+
+	// Running totals of the chunks and the material active at each chunk start
+	size_t chunkCount = chunks.size();
+	std::vector<size_t> vertexBase(chunkCount + 1, 0);
+	std::vector<size_t> normalBase(chunkCount + 1, 0);
+	std::vector<size_t> texcoordBase(chunkCount + 1, 0);
+	std::vector<size_t> cornerBase(chunkCount + 1, 0);
+	std::vector<int> startMaterial(chunkCount, -1);
+	std::vector<std::vector<int> > chunkMaterialIds(chunkCount);
+
+	int activeMaterial = -1;
+	for (size_t c = 0; c < chunkCount; ++c)
+	{
+		vertexBase[c + 1] = vertexBase[c] + chunks[c].vertices.size() / 3;
+		normalBase[c + 1] = normalBase[c] + chunks[c].normals.size() / 3;
+		texcoordBase[c + 1] = texcoordBase[c] + chunks[c].texcoords.size() / 2;
+		cornerBase[c + 1] = cornerBase[c] + chunks[c].indices.size();
+
+		for (size_t m = 0; m < chunks[c].materialNames.size(); ++m)
+		{
+			auto found = materialMap.find(chunks[c].materialNames[m]);
+			chunkMaterialIds[c].push_back(found != materialMap.end() ? found->second : -1);
+		}
+
+		startMaterial[c] = activeMaterial;
+		if (chunks[c].lastMaterial >= 0)
+			activeMaterial = chunkMaterialIds[c][chunks[c].lastMaterial];
+	}
+
+	attrib.vertices.resize(vertexBase[chunkCount] * 3);
+	attrib.normals.resize(normalBase[chunkCount] * 3);
+	attrib.texcoords.resize(texcoordBase[chunkCount] * 2);
+
+	shapes.resize(1);
+	tinyobj::shape_t& shape = shapes[0];
+	shape.name = fileName;
+	shape.mesh.indices.resize(cornerBase[chunkCount]);
+	shape.mesh.num_face_vertices.assign(cornerBase[chunkCount] / 3, 3);
+	shape.mesh.material_ids.resize(cornerBase[chunkCount] / 3);
+
+	int totalVertices = (int)vertexBase[chunkCount];
+	int totalNormals = (int)normalBase[chunkCount];
+	int totalTexcoords = (int)texcoordBase[chunkCount];
+	std::atomic<bool> invalidIndex(false);
+
+	// Merge, each chunk copies its attributes and fixes up its faces in parallel
+	ParallelFor(chunkCount, [&](size_t c)
+	{
+		ObjChunk& chunk = chunks[c];
+
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib.vertices.begin() + vertexBase[c] * 3);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + normalBase[c] * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + texcoordBase[c] * 2);
+
+		tinyobj::index_t* outIndices = shape.mesh.indices.data() + cornerBase[c];
+		for (size_t i = 0; i < chunk.indices.size(); ++i)
+		{
+			// every corner needs a position, texcoords and normals are optional
+			tinyobj::index_t idx;
+			bool valid = DecodeIndex(chunk.indices[i].vertex_index, vertexBase[c], totalVertices, idx.vertex_index) && idx.vertex_index >= 0;
+			valid = DecodeIndex(chunk.indices[i].normal_index, normalBase[c], totalNormals, idx.normal_index) && valid;
+			valid = DecodeIndex(chunk.indices[i].texcoord_index, texcoordBase[c], totalTexcoords, idx.texcoord_index) && valid;
+			if (!valid)
+				invalidIndex = true;
+
+			outIndices[i] = idx;
+		}
+
+		int* outMaterials = shape.mesh.material_ids.data() + cornerBase[c] / 3;
+		for (size_t f = 0; f < chunk.faceMaterials.size(); ++f)
+		{
+			int local = chunk.faceMaterials[f];
+			outMaterials[f] = local >= 0 ? chunkMaterialIds[c][local] : startMaterial[c];
+		}
+
+		// the chunk data is not needed anymore
+		std::vector<float>().swap(chunk.vertices);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<float>().swap(chunk.texcoords);
+		std::vector<tinyobj::index_t>().swap(chunk.indices);
+	});
+
+	if (invalidIndex)
+	{
+		err += "Face index out of range in [" + fileName + "]\n";
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Util.h"
+#include "tiny_obj_loader.h"
+
+// ObjParser
+// Multithreaded .obj parser for very large meshes, used by ObjLoader.
+// The memory mapped file is split into chunks at line boundaries, every chunk
+// parses its v/vn/vt/f/usemtl records on its own thread and the chunks are then
+// merged with the face indices fixed up to global indices.
+// The output has the same layout tinyobj::LoadObj produces, faces are
+// triangulated and all groups end up in a single shape.
+class ObjParser
+{
+public:
+	ObjParser();
+	~ObjParser();
+
+	bool Parse(const std::string& fileName, const std::string& mtlBaseDir,
+		tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+		std::vector<tinyobj::material_t>& materials, std::string& err);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// Number of worker threads used by ParallelFor
+inline unsigned int GetWorkerThreadCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+// Calls func(i) for every i in [0, count) spread over all hardware threads.
+// Items are handed out one at a time, so uneven work per item balances itself.
+// Blocks until every item is done.
+template<typename Func>
+void ParallelFor(size_t count, Func func)
+{
+	if (count == 0)
+		return;
+
+	size_t threadCount = std::min<size_t>(GetWorkerThreadCount(), count);
+	if (threadCount <= 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+			func(i);
+		return;
+	}
+
+	std::atomic<size_t> nextItem(0);
+	auto worker = [&]()
+	{
+		for (size_t i = nextItem++; i < count; i = nextItem++)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (size_t t = 0; t + 1 < threadCount; ++t)
+		threads.push_back(std::thread(worker));
+
+	// the calling thread works too
+	worker();
+
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+}
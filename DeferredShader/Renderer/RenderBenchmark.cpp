@@ -0,0 +1,115 @@
+#include "RenderBenchmark.h"
+#include "Camera.h"
+#include "SceneManager.h"
+#include "TextureManager.h"
+
+#include <chrono>
+#include <cstdio>
+
+RenderBenchmark::RenderBenchmark() : md3dDevice(NULL), md3dImmediateContext(NULL)
+{
+}
+
+RenderBenchmark::~RenderBenchmark()
+{
+	ReleaseCOM(md3dImmediateContext);
+	ReleaseCOM(md3dDevice);
+}
+
+bool RenderBenchmark::Run()
+{
+	// the null driver comes with the Graphics Tools optional feature of Windows
+	const D3D_DRIVER_TYPE driverTypes[] = { D3D_DRIVER_TYPE_NULL, D3D_DRIVER_TYPE_WARP };
+	const char* driverNames[] = { "null", "WARP" };
+	const D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+	HRESULT hr = E_FAIL;
+	UINT driver = 0;
+	for (; driver < ARRAYSIZE(driverTypes) && FAILED(hr); ++driver)
+		hr = D3D11CreateDevice(NULL, driverTypes[driver], NULL, 0, &featureLevel, 1, D3D11_SDK_VERSION, &md3dDevice, NULL, &md3dImmediateContext);
+	if (FAILED(hr))
+	{
+		printf("RenderBenchmark: creating a null or WARP device failed (0x%08x)\n", (unsigned int)hr);
+		return false;
+	}
+	printf("RenderBenchmark: %u meshes, %u materials, %s driver, average of %u frames\n", MeshCount, MaterialCount, driverNames[driver - 1], FrameCount);
+
+	TextureManager::Instance()->Init(md3dDevice);
+	bool passed = RunScene(false);
+	passed = RunScene(true) && passed;
+	TextureManager::Instance()->Release();
+
+	return passed;
+}
+
+bool RenderBenchmark::RunScene(bool sortByMaterial)
+{
+	Camera camera;
+	camera.SetLens(0.25f*M_PI, 1280.0f / 720.0f, 1.0f, 1000.0f);
+	camera.LookAt(XMFLOAT3(50.0f, 80.0f, -40.0f), XMFLOAT3(50.0f, 0.0f, 50.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	camera.UpdateViewMatrix();
+
+	// Render picks the LODs from the viewport
+	D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+	md3dImmediateContext->RSSetViewports(1, &viewport);
+
+	// every mesh is drawn at LOD 0 with one draw
+	SceneManager scene;
+	if (!scene.Init(md3dDevice, &camera, false))
+	{
+		printf("RenderBenchmark: creating the scene shaders failed\n");
+		return false;
+	}
+	scene.SetMeshletCulling(false);
+	scene.SetLodPixelError(0.0f);
+
+	// A triangle per mesh on a 100 x 100 grid, the materials differ in their color
+	// and share a diffuse texture
+	const UINT gridSize = 100;
+	for (UINT i = 0; i < MeshCount; ++i)
+	{
+		MeshData meshData;
+		meshData.Vertices.push_back(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f));
+		meshData.Vertices.push_back(Vertex(0.0f, 0.0f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f));
+		meshData.Vertices.push_back(Vertex(0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f));
+		meshData.Indices.push_back(0);
+		meshData.Indices.push_back(1);
+		meshData.Indices.push_back(2);
+		BoundingBox::CreateFromPoints(meshData.bounds, meshData.Vertices.size(), &meshData.Vertices[0].Position, sizeof(Vertex));
+		meshData.world = XMMatrixTranslation((float)(i % gridSize), 0.0f, (float)(i / gridSize));
+
+		UINT material = sortByMaterial ? i / (MeshCount / MaterialCount) : i % MaterialCount;
+		Material& meshMaterial = meshData.materials[0];
+		meshMaterial.Diffuse = XMFLOAT4((float)material / MaterialCount, 0.5f, 0.5f, 1.0f);
+		meshMaterial.diffuseTexture = "..\\Assets\\cube\\default.png";
+		meshMaterial.specExp = 10.0f;
+		meshMaterial.specIntensivity = 1.0f;
+
+		Mesh* mesh = new Mesh();
+		mesh->Create(md3dDevice, std::move(meshData), false);
+		scene.AddMesh(mesh);
+	}
+	TextureManager::Instance()->Update(true);
+
+	// The null driver records the calls into a command buffer, flushed outside of the timing
+	scene.Render(md3dImmediateContext);
+	md3dImmediateContext->Flush();
+
+	double milliseconds = 0.0;
+	for (UINT frame = 0; frame < FrameCount; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		scene.Render(md3dImmediateContext);
+		milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		md3dImmediateContext->Flush();
+	}
+	milliseconds /= FrameCount;
+
+	const SubmitStats& stats = scene.GetSubmitStats();
+	printf("  %-12s %.3f ms per frame, %.0f ns per draw, %u draws, %u material binds, %u texture binds\n",
+		sortByMaterial ? "sorted" : "interleaved", milliseconds, stats.draws > 0 ? milliseconds * 1000000.0 / stats.draws : 0.0,
+		stats.draws, stats.materialBinds, stats.textureBinds);
+
+	scene.Release();
+	md3dImmediateContext->ClearState();
+	return stats.draws == MeshCount;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Util.h"
+
+// RenderBenchmark
+// CPU cost of the SceneManager::Render draw submission, run by DeferredShader.exe --render-benchmark.
+// usage:
+// RenderBenchmark benchmark; return benchmark.Run() ? 0 : 1;
+//
+// Render draws into a device of the null driver: the runtime validates and records
+// every call but nothing is drawn, so the time is the CPU side of the submission
+// only. WARP stands in where the null driver is not installed. The scene is
+// MeshCount single submesh meshes sharing MaterialCount materials, submitted once
+// with the materials interleaved and once sorted by material.
+class RenderBenchmark
+{
+public:
+	static const UINT MeshCount = 10000;
+	static const UINT MaterialCount = 100;
+
+	// Frames every order is timed over, after one warm up frame
+	static const UINT FrameCount = 50;
+
+	RenderBenchmark();
+	~RenderBenchmark();
+
+	// Prints the time per frame and per draw of both orders to stdout, false if the
+	// device or the scene could not be created
+	bool Run();
+
+private:
+	// Times Render on a scene whose mesh i draws material i % MaterialCount, or
+	// i / (MeshCount / MaterialCount) with sortByMaterial
+	bool RunScene(bool sortByMaterial);
+
+	ID3D11Device* md3dDevice;
+	ID3D11DeviceContext* md3dImmediateContext;
+};
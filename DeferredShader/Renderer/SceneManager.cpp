@@ -1,14 +1,21 @@
 #include "SceneManager.h"
 #include "LightManager.h"
 #include "ObjLoader.h"
+#include "MeshStreamer.h"
 #include "GeometryGenerator.h"
 #include "TextureManager.h"
+#include "MaterialManager.h"
+#include "TextureAtlas.h"
+
+#include <chrono>
 
 #pragma pack(push,1)
 struct CB_VS_PER_OBJECT
 {
 	XMMATRIX mWorldViewProjection;
 	XMMATRIX mWorld;
+	XMFLOAT4 mPositionScale;
+	XMFLOAT4 mPositionOffset;
 };
 
 struct CB_PS_PER_OBJECT
@@ -16,18 +23,25 @@ struct CB_PS_PER_OBJECT
 	XMFLOAT4 mdiffuseColor;
 	float mSpecExp;
 	float mSpecIntensity;
-	bool mUseDiffuseTexture;
-	bool mUseSpecularTexture;
-	bool mUseNormalMapTexture;
-	bool mUseAlphaTexture;
-	float pad;
+	BOOL mUseDiffuseTexture;	// HLSL bools are 4 bytes
+	BOOL mUseSpecularTexture;
+	BOOL mUseNormalMapTexture;
+	BOOL mUseAlphaTexture;
+	float pad[2];
+	XMFLOAT4 mDiffuseTransform;
 };
 #pragma pack(pop)
 
 
 SceneManager::SceneManager() : mSceneVertexShaderCB(NULL), mScenePixelShaderCB(NULL), mSceneVertexShader(NULL), mSceneVSLayout(NULL), mCamera(NULL),
-mScenePixelShader(NULL)
+mScenePixelShader(NULL), mScenePackedVertexShader(NULL), mScenePackedVSLayout(NULL), mShadowGenVSLayout(NULL), mShadowGenPackedVSLayout(NULL), mMeshletCulling(true), mLodPixelError(1.0f), mPendingStaticMeshes(0)
 {
+	ZeroMemory(&mStaticBatchStats, sizeof(mStaticBatchStats));
+	ZeroMemory(&mMeshletCullStats, sizeof(mMeshletCullStats));
+	ZeroMemory(&mLodStats, sizeof(mLodStats));
+	ZeroMemory(&mLastLodStats, sizeof(mLastLodStats));
+	ZeroMemory(&mSubmitStats, sizeof(mSubmitStats));
+	mBoundTextures[0] = mBoundTextures[1] = NULL;
 }
 
 SceneManager::~SceneManager()
@@ -35,53 +49,14 @@ SceneManager::~SceneManager()
 	Release();
 }
 
-bool SceneManager::Init(ID3D11Device* device, Camera* camera)
+bool SceneManager::Init(ID3D11Device* device, Camera* camera, bool requestScene)
 {
 	HRESULT hr;
 
 	mMeshes.clear();
 
-	// Load the models
-	MeshData meshData;
-	if (!ObjLoader::Instance()->LoadToMesh("..\\Assets\\bunny.obj",  "..\\Assets\\", meshData))
-		return false;
-
-	Mesh* mesh = new Mesh();
-	mesh->Create(device, meshData);
-	XMMATRIX matTranslate = XMMatrixTranslation(-1.0f, 0.0f, -1.0f);
-	XMMATRIX matScale = XMMatrixScaling(4.0f, 4.0f, 4.0f);
-	XMMATRIX matRot = XMMatrixRotationY(M_PI);
-	mesh->mWorld = matTranslate * matScale * matRot; 
-	mMeshes.push_back(mesh);
-	
-	MeshData meshDataTP;
-	if (!ObjLoader::Instance()->LoadToMesh("..\\Assets\\teapot.obj", "..\\Assets\\", meshDataTP))
-		return false;
-
-	Mesh* mesh2 = new Mesh();
-	mesh2->Create(device, meshDataTP);
-	matTranslate = XMMatrixTranslation(4.0f, 0.0f, -2.0f);
-	matScale = XMMatrixScaling(1.0f, 1.0f, 1.0f);
-	matRot = XMMatrixRotationY(0.4*M_PI);
-	mesh2->mWorld = matTranslate * matScale * matRot;
-	mMeshes.push_back(mesh2);
-	
-	// Grid 
-	//GeometryGenerator::Instance()->CreateGrid(12.0f, 12.0f, 4, 4, meshData);
-	MeshData meshData2;
-	if (!ObjLoader::Instance()->LoadToMesh("..\\Assets\\cube\\cube.obj", "..\\Assets\\cube\\", meshData2))
-				return false;
-	//Material gridMat;
-	//gridMat.Diffuse = XMFLOAT4(0.6f, 0.6f, 0.6f, 1.0f);
-	//gridMat.specExp = 10.0f;
-	//gridMat.specIntensivity = 1.0f;
-	//meshData.materials[0] = gridMat;
-	mesh = new Mesh();
-	mesh->Create(device, meshData2);
-	//mesh->mMaterials[0] = gridMat;
-	matScale = XMMatrixScaling(20.0f, 0.1f, 20.0f);
-	mesh->mWorld = XMMatrixIdentity() * matScale;
-	mMeshes.push_back(mesh);
+	if (requestScene)
+		RequestScene();
 
 	// Create constant buffers
 	D3D11_BUFFER_DESC cbDesc;
@@ -123,6 +98,7 @@ bool SceneManager::Init(ID3D11Device* device, Camera* camera)
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT",  0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	};
 
 	hr = device->CreateInputLayout(layout, ARRAYSIZE(layout), pShaderBlob->GetBufferPointer(),
@@ -131,6 +107,46 @@ bool SceneManager::Init(ID3D11Device* device, Camera* camera)
 	if (FAILED(hr))
 		return false;
 
+	// Same shader for the packed vertex format
+	D3D10_SHADER_MACRO packedMacros[] = { { "PACKED_VERTEX", "1" }, { NULL, NULL } };
+	if (FAILED(CompileShader(str, packedMacros, "RenderSceneVS", "vs_5_0", dwShaderFlags, &pShaderBlob)))
+		return false;
+
+	if (FAILED(device->CreateVertexShader(pShaderBlob->GetBufferPointer(),
+		pShaderBlob->GetBufferSize(), NULL, &mScenePackedVertexShader)))
+	{
+		return false;
+	}
+
+	const D3D11_INPUT_ELEMENT_DESC packedLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0,  8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+
+	hr = device->CreateInputLayout(packedLayout, ARRAYSIZE(packedLayout), pShaderBlob->GetBufferPointer(),
+		pShaderBlob->GetBufferSize(), &mScenePackedVSLayout);
+	SAFE_RELEASE(pShaderBlob);
+	if (FAILED(hr))
+		return false;
+
+	// Position only layouts matching the shadow generation vertex shader
+	WCHAR shadowGenSrc[MAX_PATH] = L"..\\DeferredShader\\Shaders\\ShadowGen.hlsl";
+	if (FAILED(CompileShader(shadowGenSrc, NULL, "ShadowMapGenVS", "vs_5_0", dwShaderFlags, &pShaderBlob)))
+		return false;
+
+	hr = device->CreateInputLayout(layout, 1, pShaderBlob->GetBufferPointer(),
+		pShaderBlob->GetBufferSize(), &mShadowGenVSLayout);
+	if (SUCCEEDED(hr))
+	{
+		hr = device->CreateInputLayout(packedLayout, 1, pShaderBlob->GetBufferPointer(),
+			pShaderBlob->GetBufferSize(), &mShadowGenPackedVSLayout);
+	}
+	SAFE_RELEASE(pShaderBlob);
+	if (FAILED(hr))
+		return false;
+
 	if (FAILED(CompileShader(str, NULL, "RenderScenePS", "ps_5_0", dwShaderFlags, &pShaderBlob)))
 		return false;
 	hr = device->CreatePixelShader(pShaderBlob->GetBufferPointer(),
@@ -144,8 +160,139 @@ bool SceneManager::Init(ID3D11Device* device, Camera* camera)
 	return true;
 }
 
+void SceneManager::RequestScene()
+{
+	// Upload the meshes in the 16 byte packed vertex format
+	ObjLoader::Instance()->SetQuantizeVertices(true);
+
+	// Load the models on the streaming threads, Update adds them to the scene once loaded.
+	// The props never move, they are drawn as static batches. The textures decode while
+	// the meshes wait for their upload. An atlased diffuse texture is drawn from its atlas,
+	// as MaterialManager::AddMaterial does, its own file is never decoded.
+	MeshStreamer::Instance()->SetLoadedCallback([](const MeshData& meshData)
+	{
+		for (auto it = meshData.materials.begin(); it != meshData.materials.end(); ++it)
+		{
+			AtlasEntry atlas;
+			if (TextureAtlas::Instance()->Find(it->second.diffuseTexture, atlas))
+				TextureManager::Instance()->RequestTexture(atlas.atlasFile);
+			else
+				TextureManager::Instance()->RequestTexture(it->second.diffuseTexture);
+			TextureManager::Instance()->RequestTexture(it->second.normalTexture, TEXTURE_NORMAL_MAP);
+		}
+	});
+	MeshStreamer::Instance()->Init();
+
+	XMMATRIX matTranslate = XMMatrixTranslation(-1.0f, 0.0f, -1.0f);
+	XMMATRIX matScale = XMMatrixScaling(4.0f, 4.0f, 4.0f);
+	XMMATRIX matRot = XMMatrixRotationY(M_PI);
+	RequestMesh("..\\Assets\\bunny.obj", "..\\Assets\\", matTranslate * matScale * matRot, true);
+
+	matTranslate = XMMatrixTranslation(4.0f, 0.0f, -2.0f);
+	matScale = XMMatrixScaling(1.0f, 1.0f, 1.0f);
+	matRot = XMMatrixRotationY(0.4*M_PI);
+	RequestMesh("..\\Assets\\teapot.obj", "..\\Assets\\", matTranslate * matScale * matRot, true);
+
+	// Grid 
+	//GeometryGenerator::Instance()->CreateGrid(12.0f, 12.0f, 4, 4, meshData);
+	//Material gridMat;
+	//gridMat.Diffuse = XMFLOAT4(0.6f, 0.6f, 0.6f, 1.0f);
+	//gridMat.specExp = 10.0f;
+	//gridMat.specIntensivity = 1.0f;
+	//meshData.materials[0] = gridMat;
+	matScale = XMMatrixScaling(20.0f, 0.1f, 20.0f);
+	RequestMesh("..\\Assets\\cube\\cube.obj", "..\\Assets\\cube\\", XMMatrixIdentity() * matScale, true);
+}
+
+void SceneManager::RequestMesh(const std::string& fileName, const std::string& baseDir, const XMMATRIX& world, bool isStatic)
+{
+	PendingMesh pending;
+	XMStoreFloat4x4(&pending.world, world);
+	pending.isStatic = isStatic;
+	pending.isBatch = false;
+	mPendingMeshes[MeshStreamer::Instance()->RequestMesh(fileName, baseDir)] = pending;
+	if (isStatic)
+		mPendingStaticMeshes++;
+}
+
+void SceneManager::Update(ID3D11Device* device, float dt)
+{
+	// textures decoded since the last frame, before the meshes using them are created
+	TextureManager::Instance()->Update();
+
+	mStreamedMeshes.clear();
+	MeshStreamer::Instance()->Update(dt, mStreamedMeshes);
+
+	for (size_t i = 0; i < mStreamedMeshes.size(); ++i)
+	{
+		auto pending = mPendingMeshes.find(mStreamedMeshes[i].request);
+		if (pending == mPendingMeshes.end())
+			continue;
+
+		XMMATRIX placement = XMLoadFloat4x4(&pending->second.world);
+		bool isStatic = pending->second.isStatic;
+		bool isBatch = pending->second.isBatch;
+		mPendingMeshes.erase(pending);
+		if (isStatic)
+			mPendingStaticMeshes--;
+
+		if (!mStreamedMeshes[i].loaded)
+			continue;
+
+		if (isBatch)
+		{
+			const MeshData& batch = mStreamedMeshes[i].meshData;
+			mStaticBatchStats.cellsBuilt++;
+			mStaticBatchStats.batchDraws += batch.Lods.empty() ? 1 : batch.Lods[0].submeshCount;
+		}
+
+		// the loader world matrix (glTF node transforms) is placed in the scene
+		if (isStatic)
+		{
+			StaticBatcher::Instance()->Add(mStreamedMeshes[i].meshData, mStreamedMeshes[i].meshData.world * placement);
+			continue;
+		}
+
+		Mesh* mesh = new Mesh();
+		mesh->Create(device, std::move(mStreamedMeshes[i].meshData));
+		mesh->mWorld = mesh->mWorld * placement;
+		mMeshes.push_back(mesh);
+	}
+	mStreamedMeshes.clear();
+
+	// Every static mesh is in, merge them into one mesh per grid cell. The cells are
+	// built on the MeshStreamer workers and come back through the upload budget.
+	if (mPendingStaticMeshes == 0 && StaticBatcher::Instance()->GetMeshCount() > 0)
+	{
+		std::vector<StaticBatchCell> cells;
+		mStaticBatchStats = StaticBatcher::Instance()->TakeCells(cells);
+
+		PendingMesh pending;
+		XMStoreFloat4x4(&pending.world, XMMatrixIdentity());
+		pending.isStatic = false;
+		pending.isBatch = true;
+		for (size_t i = 0; i < cells.size(); ++i)
+		{
+			std::shared_ptr<StaticBatchCell> cell = std::make_shared<StaticBatchCell>();
+			cell->index = cells[i].index;
+			cell->source = cells[i].source;
+			cell->triangles.swap(cells[i].triangles);
+			UINT request = MeshStreamer::Instance()->RequestBuild("static batch " + std::to_string(cell->index),
+				[cell](MeshData& batch) { StaticBatcher::BuildCell(*cell, batch); return true; });
+			mPendingMeshes[request] = pending;
+		}
+	}
+}
+
 void SceneManager::Release()
 {
+	// Stop loading first, meshes still streaming are dropped
+	MeshStreamer::Instance()->Release();
+	mPendingMeshes.clear();
+	mStreamedMeshes.clear();
+	mPendingStaticMeshes = 0;
+	StaticBatcher::Instance()->Clear();
+
 	if (mMeshes.size() > 0)
 	{
 		for (int i = 0; i < mMeshes.size(); ++i)
@@ -158,11 +305,18 @@ void SceneManager::Release()
 		}
 	}
 
+	MaterialManager::Instance()->Release();
+	TextureAtlas::Instance()->Release();
+
 	SAFE_RELEASE(mSceneVertexShaderCB);
 	SAFE_RELEASE(mScenePixelShaderCB);
 	SAFE_RELEASE(mSceneVertexShader);
 	SAFE_RELEASE(mSceneVSLayout);
 	SAFE_RELEASE(mScenePixelShader);
+	SAFE_RELEASE(mScenePackedVertexShader);
+	SAFE_RELEASE(mScenePackedVSLayout);
+	SAFE_RELEASE(mShadowGenVSLayout);
+	SAFE_RELEASE(mShadowGenPackedVSLayout);
 }
 
 
@@ -175,6 +329,24 @@ void SceneManager::Render(ID3D11DeviceContext* pd3dImmediateContext)
 	XMMATRIX mProj = mCamera->Proj();
 
 
+	ZeroMemory(&mMeshletCullStats, sizeof(mMeshletCullStats));
+
+	auto submitStart = std::chrono::high_resolution_clock::now();
+	SubmitStats submitStats;
+	ZeroMemory(&submitStats, sizeof(submitStats));
+
+	// no material is bound yet, the first draw binds its own. The other passes
+	// bind their own textures, so nothing bound before counts.
+	MaterialHandle boundMaterial = (MaterialHandle)-1;
+	mBoundTextures[0] = mBoundTextures[1] = NULL;
+
+	// Pixels per world unit at distance 1 from the camera
+	D3D11_VIEWPORT viewport;
+	UINT numViewports = 1;
+	pd3dImmediateContext->RSGetViewports(&numViewports, &viewport);
+	float projScale = 0.5f * viewport.Height / tanf(0.5f * mCamera->GetFovY());
+	XMVECTOR eyePosition = mCamera->GetPositionXM();
+
 	// Render the meshes
 	for (int i = 0; i < mMeshes.size(); ++i)
 	{
@@ -182,71 +354,174 @@ void SceneManager::Render(ID3D11DeviceContext* pd3dImmediateContext)
 		XMMATRIX mWorld = mMeshes[i]->mWorld;
 		XMMATRIX mWorldViewProjection = mWorld * mView * mProj;
 
-		// Set the constant buffers
-		HRESULT hr;
-		D3D11_MAPPED_SUBRESOURCE MappedResource;
-		HR(pd3dImmediateContext->Map(mSceneVertexShaderCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
-		CB_VS_PER_OBJECT* pVSPerObject = (CB_VS_PER_OBJECT*)MappedResource.pData;
-		pVSPerObject->mWorldViewProjection = XMMatrixTranspose(mWorldViewProjection);
-		pVSPerObject->mWorld = XMMatrixTranspose(mWorld);
-		pd3dImmediateContext->Unmap(mSceneVertexShaderCB, 0);
-		pd3dImmediateContext->VSSetConstantBuffers(0, 1, &mSceneVertexShaderCB);
-
-		HR(pd3dImmediateContext->Map(mScenePixelShaderCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
-		CB_PS_PER_OBJECT* pPSPerObject = (CB_PS_PER_OBJECT*)MappedResource.pData;
-		//pPSPerObject->mEyePosition = mCamera->GetPosition();
-		// set per object properties
-		pPSPerObject->mSpecExp = mMeshes[i]->mMaterials[0].specExp;
-		pPSPerObject->mSpecIntensity = mMeshes[i]->mMaterials[0].specIntensivity;
-		pPSPerObject->mdiffuseColor = mMeshes[i]->mMaterials[0].Diffuse;
-		
-		if (TextureManager::Instance()->GetTexture(mMeshes[i]->mMaterials[0].diffuseTexture) != NULL)
+		// Pick the LOD from the projected size of the bounding sphere at its nearest point
+		BoundingSphere objectSphere, worldSphere;
+		float worldScale;
+		GetBoundingSpheres(mMeshes[i], objectSphere, worldSphere, worldScale);
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldSphere.Center) - eyePosition)) - worldSphere.Radius;
+		float pixelsPerUnit = projScale / std::max(distance, mCamera->GetNearZ()) * worldScale;
+		UINT lod = mLodPixelError > 0.0f ? mMeshes[i]->SelectLod(pixelsPerUnit, mLodPixelError) : 0;
+
+		// texture coordinate change per pixel, TextureManager keeps the mips it needs resident
+		float uvPerPixel = mMeshes[i]->mUVDensity / pixelsPerUnit;
+
+		// Meshlets cover LOD 0 only, the simplified levels are culled as a whole
+		bool culled = lod == 0 && mMeshletCulling && !mMeshes[i]->mMeshlets.empty();
+		if (lod > 0 && !MeshletCuller::Instance()->IsVisible(objectSphere, mWorld, mView, mProj))
+			continue;
+
+		mLodStats.sceneFullTriangles += mMeshes[i]->mLods[0].indexCount / 3;
+		mLodStats.sceneTriangles += mMeshes[i]->mLods[lod].indexCount / 3;
+
+		// Submeshes are sorted by material, every material of the mesh is set once
+		const MeshLod& meshLod = mMeshes[i]->mLods[lod];
+		bool meshStateSet = false;
+		for (UINT s = 0; s < meshLod.submeshCount; ++s)
 		{
-			 
-			ID3D11ShaderResourceView* srv = TextureManager::Instance()->GetTexture(mMeshes[i]->mMaterials[0].diffuseTexture);
-			pd3dImmediateContext->PSSetShaderResources(0, 1, &srv);
+			const Submesh& submesh = mMeshes[i]->mSubmeshes[meshLod.submeshStart + s];
 
-			
-			pPSPerObject->mUseDiffuseTexture = true;
-		}
-		else {
-			pPSPerObject->mUseDiffuseTexture = false;
-		
+			// Cull the meshlets first, fully culled submeshes skip the constant buffer updates too
+			if (culled && (submesh.meshletCount == 0 || MeshletCuller::Instance()->Cull(&mMeshes[i]->mMeshlets[submesh.meshletStart],
+				submesh.meshletCount, mWorld, mView, mProj, mDrawRanges, mMeshletCullStats) == 0))
+				continue;
+
+			if (!meshStateSet)
+			{
+				// Set the constant buffers
+				HRESULT hr;
+				D3D11_MAPPED_SUBRESOURCE MappedResource;
+				HR(pd3dImmediateContext->Map(mSceneVertexShaderCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
+				CB_VS_PER_OBJECT* pVSPerObject = (CB_VS_PER_OBJECT*)MappedResource.pData;
+				pVSPerObject->mWorldViewProjection = XMMatrixTranspose(mWorldViewProjection);
+				pVSPerObject->mWorld = XMMatrixTranspose(mWorld);
+				pVSPerObject->mPositionScale = mMeshes[i]->mPositionScale;
+				pVSPerObject->mPositionOffset = mMeshes[i]->mPositionOffset;
+				pd3dImmediateContext->Unmap(mSceneVertexShaderCB, 0);
+				pd3dImmediateContext->VSSetConstantBuffers(0, 1, &mSceneVertexShaderCB);
+
+				// Set the vertex layout
+				pd3dImmediateContext->IASetInputLayout(mMeshes[i]->mPacked ? mScenePackedVSLayout : mSceneVSLayout);
+
+				// Set the shaders
+				pd3dImmediateContext->VSSetShader(mMeshes[i]->mPacked ? mScenePackedVertexShader : mSceneVertexShader, NULL, 0);
+				pd3dImmediateContext->PSSetShader(mScenePixelShader, NULL, 0);
+
+				mMeshes[i]->SetBuffers(pd3dImmediateContext);
+				meshStateSet = true;
+			}
+
+			// Equal materials share a handle, consecutive draws with the same one keep it bound
+			MaterialHandle material = mMeshes[i]->mSubmeshMaterials[meshLod.submeshStart + s];
+			const RenderMaterial& renderMaterial = MaterialManager::Instance()->GetMaterial(material);
+			if (material != boundMaterial)
+			{
+				submitStats.textureBinds += SetMaterial(pd3dImmediateContext, renderMaterial);
+				boundMaterial = material;
+				submitStats.materialBinds++;
+			}
+			submitStats.draws++;
+
+			// an atlased texture covers a part of its atlas, the atlas needs finer mips
+			float atlasScale = std::max(renderMaterial.diffuseTransform.x, renderMaterial.diffuseTransform.y);
+			TextureManager::Instance()->MarkUsed(renderMaterial.diffuseTexture, uvPerPixel * atlasScale);
+			TextureManager::Instance()->MarkUsed(renderMaterial.normalTexture, uvPerPixel);
+
+			// render
+			if (culled)
+			{
+				mMeshes[i]->Draw(pd3dImmediateContext, mDrawRanges);
+			}
+			else
+			{
+				DrawRange range = { submesh.indexStart, submesh.indexCount };
+				mMeshes[i]->Draw(pd3dImmediateContext, range);
+			}
 		}
+	}
 
-		pPSPerObject->mUseSpecularTexture = false;
-		pPSPerObject->mUseNormalMapTexture = false;
-		pPSPerObject->mUseAlphaTexture = false;
+	// The shadow passes run before Render, so this closes the frame
+	mLastLodStats = mLodStats;
+	ZeroMemory(&mLodStats, sizeof(mLodStats));
 
-		pd3dImmediateContext->Unmap(mScenePixelShaderCB, 0);
-		pd3dImmediateContext->PSSetConstantBuffers(0, 1, &mScenePixelShaderCB);
+	submitStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+	mSubmitStats = submitStats;
 
-		// Set the vertex layout
-		pd3dImmediateContext->IASetInputLayout(mSceneVSLayout);
+}
 
-		// Set the shaders
-		pd3dImmediateContext->VSSetShader(mSceneVertexShader, NULL, 0);
-		pd3dImmediateContext->PSSetShader(mScenePixelShader, NULL, 0);
+UINT SceneManager::SetMaterial(ID3D11DeviceContext* pd3dImmediateContext, const RenderMaterial& material)
+{
+	UINT textureBinds = 0;
+	HRESULT hr;
+	D3D11_MAPPED_SUBRESOURCE MappedResource;
+	HR(pd3dImmediateContext->Map(mScenePixelShaderCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
+	CB_PS_PER_OBJECT* pPSPerObject = (CB_PS_PER_OBJECT*)MappedResource.pData;
+	//pPSPerObject->mEyePosition = mCamera->GetPosition();
+	// set per object properties
+	pPSPerObject->mSpecExp = material.specExp;
+	pPSPerObject->mSpecIntensity = material.specIntensivity;
+	pPSPerObject->mdiffuseColor = material.Diffuse;
+	pPSPerObject->mDiffuseTransform = material.diffuseTransform;
+
+	// materials sharing an atlas keep it bound
+	ID3D11ShaderResourceView* srv = TextureManager::Instance()->GetTexture(material.diffuseTexture);
+	if (srv != NULL)
+	{
+		if (srv != mBoundTextures[0])
+		{
+			pd3dImmediateContext->PSSetShaderResources(0, 1, &srv);
+			mBoundTextures[0] = srv;
+			textureBinds++;
+		}
+		pPSPerObject->mUseDiffuseTexture = true;
+	}
+	else {
+		pPSPerObject->mUseDiffuseTexture = false;
+	}
 
-		// render
-		mMeshes[i]->Render(pd3dImmediateContext);
+	// tangents are generated for every mesh, any normal map can be used.
+	// There is no neutral fallback for a normal map, it is off until it is loaded.
+	srv = TextureManager::Instance()->GetTexture(material.normalTexture, false);
+	if (srv != NULL)
+	{
+		if (srv != mBoundTextures[1])
+		{
+			pd3dImmediateContext->PSSetShaderResources(1, 1, &srv);
+			mBoundTextures[1] = srv;
+			textureBinds++;
+		}
+		pPSPerObject->mUseNormalMapTexture = true;
+	}
+	else {
+		pPSPerObject->mUseNormalMapTexture = false;
 	}
 
+	pPSPerObject->mUseSpecularTexture = false;
+	pPSPerObject->mUseAlphaTexture = false;
+
+	pd3dImmediateContext->Unmap(mScenePixelShaderCB, 0);
+	pd3dImmediateContext->PSSetConstantBuffers(0, 1, &mScenePixelShaderCB);
 
+	return textureBinds;
 }
 
-void SceneManager::RenderSceneNoShaders(ID3D11DeviceContext * pd3dImmediateContext)
+void SceneManager::RenderSceneNoShaders(ID3D11DeviceContext * pd3dImmediateContext, LightManager* lightManager)
 {
 
 	XMMATRIX mView = mCamera->View();
 	XMMATRIX mProj = mCamera->Proj();
 
+	// The spot shadow pass projects in the vertex shader, the point and cascaded
+	// passes only take the world position and project in their geometry shader
+	XMMATRIX mViewProj = mView * mProj;
+	if (lightManager != NULL)
+		lightManager->GetSpotShadowMatrix(mViewProj);
+
 	// render meshes
 	for (int i = 0; i < mMeshes.size(); ++i)
 	{
 		// set object world matrix
 		XMMATRIX mWorld = mMeshes[i]->mWorld;
-		XMMATRIX mWorldViewProjection = mWorld * mView * mProj;
+		XMMATRIX mWorldViewProjection = mWorld * mViewProj;
 
 		// Set the constant buffers
 		HRESULT hr;
@@ -255,11 +530,37 @@ void SceneManager::RenderSceneNoShaders(ID3D11DeviceContext * pd3dImmediateConte
 		CB_VS_PER_OBJECT* pVSPerObject = (CB_VS_PER_OBJECT*)MappedResource.pData;
 		pVSPerObject->mWorldViewProjection = XMMatrixTranspose(mWorldViewProjection);
 		pVSPerObject->mWorld = XMMatrixTranspose(mWorld);
+		pVSPerObject->mPositionScale = mMeshes[i]->mPositionScale;
+		pVSPerObject->mPositionOffset = mMeshes[i]->mPositionOffset;
 		pd3dImmediateContext->Unmap(mSceneVertexShaderCB, 0);
 		pd3dImmediateContext->VSSetConstantBuffers(0, 1, &mSceneVertexShaderCB);
 
-		// render mesh, sets vertex and index buffers
-		mMeshes[i]->Render(pd3dImmediateContext);
+		// position only layout for the mesh vertex format
+		pd3dImmediateContext->IASetInputLayout(mMeshes[i]->mPacked ? mShadowGenPackedVSLayout : mShadowGenVSLayout);
+
+		// Pick the LOD from the shadow map texel size at the mesh
+		UINT lod = 0;
+		if (lightManager != NULL && mLodPixelError > 0.0f)
+		{
+			BoundingSphere objectSphere, worldSphere;
+			float worldScale;
+			GetBoundingSpheres(mMeshes[i], objectSphere, worldSphere, worldScale);
+			float pixelsPerUnit = lightManager->GetShadowPixelsPerUnit(worldSphere) * worldScale;
+			lod = mMeshes[i]->SelectLod(pixelsPerUnit, mLodPixelError);
+
+			mLodStats.shadowFullTriangles += mMeshes[i]->mLods[0].indexCount / 3;
+			mLodStats.shadowTriangles += mMeshes[i]->mLods[lod].indexCount / 3;
+		}
+
+		// render mesh, sets the position only vertex buffer and the index buffer
+		mMeshes[i]->RenderPositions(pd3dImmediateContext, lod);
 	}
 
 }
+
+void SceneManager::GetBoundingSpheres(const Mesh* mesh, BoundingSphere& objectSphere, BoundingSphere& worldSphere, float& worldScale) const
+{
+	BoundingSphere::CreateFromBoundingBox(objectSphere, mesh->mBounds);
+	objectSphere.Transform(worldSphere, mesh->mWorld);
+	worldScale = objectSphere.Radius > 0.0f ? worldSphere.Radius / objectSphere.Radius : 1.0f;
+}
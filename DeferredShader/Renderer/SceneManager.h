@@ -2,8 +2,31 @@
 
 #include "Camera.h"
 #include "Mesh.h"
+#include "MeshletCuller.h"
+#include "MeshStreamer.h"
+#include "StaticBatcher.h"
 #include "Util.h"
 
+class LightManager;
+
+// Level of detail triangle counts, the full counts are what LOD 0 would have drawn
+struct LodStats
+{
+	UINT sceneFullTriangles;
+	UINT sceneTriangles;
+	UINT shadowFullTriangles;
+	UINT shadowTriangles;
+};
+
+// Draw submission counters of the last Render
+struct SubmitStats
+{
+	UINT draws;
+	UINT materialBinds;		// draws that had to bind their material
+	UINT textureBinds;		// shader resource views bound, materials sharing an atlas skip theirs
+	double milliseconds;	// CPU time of Render
+};
+
 // SceneManager class
 // Simple scenemanager that holds Scenes meshes and camera
 // Just for testing simple scene this holds hardcoded
@@ -14,20 +37,81 @@ public:
 	SceneManager();
 	~SceneManager();
 
-	bool Init(ID3D11Device* device, Camera* camera);
+	// Creates the shaders and requests the scene meshes from MeshStreamer,
+	// the meshes are added by Update as they finish loading. Without requestScene
+	// the scene starts empty, for the meshes of AddMesh.
+	bool Init(ID3D11Device* device, Camera* camera, bool requestScene = true);
 	void Release();
 
+	// Adds a created mesh to the scene, the scene destroys it in Release
+	void AddMesh(Mesh* mesh) { mMeshes.push_back(mesh); }
+
+	// Creates the GPU buffers of the meshes MeshStreamer hands out this frame,
+	// call once per frame before rendering
+	void Update(ID3D11Device* device, float dt);
+
 	// Renders the scene meshes into the GBuffer
 	void Render(ID3D11DeviceContext* pd3dImmediateContext);
 
-	// Renders the scene with no shaders
-	void RenderSceneNoShaders(ID3D11DeviceContext* pd3dImmediateContext);
+	// Renders the scene with no shaders, with a lightManager the mesh LODs
+	// are picked for the resolution of its current shadow map
+	void RenderSceneNoShaders(ID3D11DeviceContext* pd3dImmediateContext, LightManager* lightManager = NULL);
+
+	// Enable/disable CPU meshlet culling in Render, on by default
+	void SetMeshletCulling(bool meshletCulling) { mMeshletCulling = meshletCulling; }
+	bool GetMeshletCulling() const { return mMeshletCulling; }
+
+	// Meshlet culling counters of the last Render
+	const MeshletCullStats& GetMeshletCullStats() const { return mMeshletCullStats; }
+
+	// Largest allowed LOD simplification error in pixels, 0 always draws LOD 0
+	void SetLodPixelError(float lodPixelError) { mLodPixelError = lodPixelError; }
+	float GetLodPixelError() const { return mLodPixelError; }
+
+	// LOD triangle counts of the last frame's shadow passes and Render
+	const LodStats& GetLodStats() const { return mLastLodStats; }
+
+	// Draw submission counters and CPU time of the last Render
+	const SubmitStats& GetSubmitStats() const { return mSubmitStats; }
+
+	// Draw counts of the static batches, batchDraws grows as the batches come in
+	const StaticBatchStats& GetStaticBatchStats() const { return mStaticBatchStats; }
 
 private:
 
+	// Maps the pixel shader constants of material and binds its diffuse and normal texture
+	// unless they are bound already, returns the number of textures bound
+	UINT SetMaterial(ID3D11DeviceContext* pd3dImmediateContext, const RenderMaterial& material);
+
+	// Starts MeshStreamer and requests the meshes of the hardcoded scene
+	void RequestScene();
+
+	// Requests a mesh from MeshStreamer, world places it in the scene once loaded.
+	// Static meshes never move, they are merged into the static batches once all of them are loaded.
+	void RequestMesh(const std::string& fileName, const std::string& baseDir, const XMMATRIX& world, bool isStatic = false);
+
+	// Object and world space bounding spheres of the mesh bounds and the scale from object to world units
+	void GetBoundingSpheres(const Mesh* mesh, BoundingSphere& objectSphere, BoundingSphere& worldSphere, float& worldScale) const;
+
 	// Scene meshes
 	std::vector<Mesh*> mMeshes;
 
+	// Placement of a streamed mesh until it is loaded
+	struct PendingMesh
+	{
+		XMFLOAT4X4 world;
+		bool isStatic;
+		bool isBatch;	// a static batch built by the MeshStreamer workers
+	};
+
+	// Streamed meshes by MeshStreamer request id, until they are loaded
+	std::map<UINT, PendingMesh> mPendingMeshes;
+	std::vector<StreamedMesh> mStreamedMeshes;
+
+	// Static meshes still loading, StaticBatcher hands out the cells when this reaches 0
+	UINT mPendingStaticMeshes;
+	StaticBatchStats mStaticBatchStats;
+
 	// Scene meshes shader constant buffers
 	ID3D11Buffer* mSceneVertexShaderCB;
 	ID3D11Buffer* mScenePixelShaderCB;
@@ -37,5 +121,28 @@ private:
 	ID3D11InputLayout* mSceneVSLayout;
 	ID3D11PixelShader* mScenePixelShader;
 
+	// Vertex shader and layout for meshes with PackedVertex vertices
+	ID3D11VertexShader* mScenePackedVertexShader;
+	ID3D11InputLayout* mScenePackedVSLayout;
+
+	// Position only layouts for the shadow passes, set per mesh vertex format
+	ID3D11InputLayout* mShadowGenVSLayout;
+	ID3D11InputLayout* mShadowGenPackedVSLayout;
+
 	Camera* mCamera;
+
+	// CPU meshlet culling state
+	bool mMeshletCulling;
+	MeshletCullStats mMeshletCullStats;
+	std::vector<DrawRange> mDrawRanges;
+
+	// LOD selection state, mLodStats accumulates until the end of Render
+	float mLodPixelError;
+	LodStats mLodStats;
+	LodStats mLastLodStats;
+
+	SubmitStats mSubmitStats;
+
+	// Shader resource views of slot 0 and 1 bound by SetMaterial during Render
+	ID3D11ShaderResourceView* mBoundTextures[2];
 };
\ No newline at end of file
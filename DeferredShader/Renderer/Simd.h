@@ -0,0 +1,71 @@
+#pragma once
+
+// Instruction set levels of the SIMD code paths, each level includes the ones before it
+enum SimdLevel
+{
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+// SIMD_TARGET_SSE2 / SIMD_TARGET_AVX2 mark functions that use the intrinsics of a level,
+// so the files build without /arch or -m flags and the level is picked at run time
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Best level the CPU supports, AVX2 also needs the OS to save the YMM registers
+inline SimdLevel GetCpuSimdLevel()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	if ((info[3] & (1 << 26)) == 0)
+		return SIMD_SCALAR;
+	bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	if (osAvx && maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		if ((info[1] & (1 << 5)) != 0)
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE2;
+#elif defined(SIMD_X86)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (edx & (1 << 26)) == 0)
+		return SIMD_SCALAR;
+	bool osAvx = false;
+	if ((ecx & (1 << 27)) != 0 && (ecx & (1 << 28)) != 0)
+	{
+		unsigned int xcr0, xcr0High;
+		__asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+		osAvx = (xcr0 & 6) == 6;
+	}
+	if (osAvx && __get_cpuid_max(0, 0) >= 7)
+	{
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((ebx & (1 << 5)) != 0)
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+inline const char* GetSimdLevelName(SimdLevel level)
+{
+	return level == SIMD_AVX2 ? "AVX2" : level == SIMD_SSE2 ? "SSE2" : "scalar";
+}
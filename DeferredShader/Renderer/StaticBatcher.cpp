@@ -0,0 +1,271 @@
+#include "StaticBatcher.h"
+#include "TextureAtlas.h"
+#include "MeshProcessor.h"
+#include "VertexQuantizer.h"
+
+#include <cmath>
+#include <chrono>
+#include <unordered_map>
+
+namespace
+{
+	bool IsEqual(const Material& a, const Material& b)
+	{
+		return a.Diffuse.x == b.Diffuse.x && a.Diffuse.y == b.Diffuse.y && a.Diffuse.z == b.Diffuse.z && a.Diffuse.w == b.Diffuse.w &&
+			a.specExp == b.specExp && a.specIntensivity == b.specIntensivity &&
+			a.diffuseTexture == b.diffuseTexture && a.normalTexture == b.normalTexture;
+	}
+}
+
+StaticBatcher* StaticBatcher::mInstance = NULL;
+
+StaticBatcher* StaticBatcher::Instance()
+{
+	if (!mInstance)
+		mInstance = new StaticBatcher;
+	return mInstance;
+}
+
+StaticBatcher::StaticBatcher() : mSourceDraws(0), mTriangles(0), mCellSize(32.0f)
+{
+	Clear();
+}
+
+StaticBatcher::~StaticBatcher()
+{
+}
+
+UINT StaticBatcher::FindMaterial(const Material& material)
+{
+	std::vector<Material>& materials = mSource->materials;
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		if (IsEqual(materials[i], material))
+			return (UINT)i;
+	}
+	materials.push_back(material);
+	return (UINT)materials.size() - 1;
+}
+
+void StaticBatcher::Add(const MeshData& meshData, const XMMATRIX& world)
+{
+	bool packed = meshData.Vertices.empty();
+	size_t vertexCount = packed ? meshData.PackedVertices.size() : meshData.Vertices.size();
+	if (vertexCount == 0)
+		return;
+	mSource->quantize = mSource->quantize || !meshData.PackedVertices.empty();
+
+	UINT meshIndex = (UINT)mSource->meshes.size();
+	mSource->meshes.push_back(StaticBatchSource::StaticMesh());
+	StaticBatchSource::StaticMesh& mesh = mSource->meshes.back();
+
+	// mirroring transforms flip the winding and the bitangent
+	XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(NULL, world));
+	bool mirrored = XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f;
+
+	mesh.vertices.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		Vertex vertex = packed ? VertexQuantizer::DecodeVertex(meshData.PackedVertices[v], meshData.positionScale, meshData.positionOffset) : meshData.Vertices[v];
+
+		XMFLOAT3 tangent(vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z);
+		XMStoreFloat3(&vertex.Position, XMVector3TransformCoord(XMLoadFloat3(&vertex.Position), world));
+		XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), normalTransform)));
+		XMStoreFloat3(&tangent, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&tangent), world)));
+		vertex.Tangent = XMFLOAT4(tangent.x, tangent.y, tangent.z, mirrored ? -vertex.Tangent.w : vertex.Tangent.w);
+
+		mesh.vertices[v] = vertex;
+	}
+	BoundingBox::CreateFromPoints(mesh.bounds, vertexCount, &mesh.vertices[0].Position, sizeof(Vertex));
+
+	// The LOD 0 material ranges, without submeshes all of LOD 0 uses the first material
+	UINT indexStart = meshData.Lods.empty() ? 0 : meshData.Lods[0].indexStart;
+	UINT indexCount = meshData.Lods.empty() ? (UINT)meshData.Indices.size() : meshData.Lods[0].indexCount;
+	std::vector<Submesh> submeshes;
+	if (meshData.Submeshes.empty())
+	{
+		Submesh submesh = { meshData.materials.empty() ? 0 : meshData.materials.begin()->first, indexStart, indexCount, 0, 0 };
+		submeshes.push_back(submesh);
+	}
+	else if (meshData.Lods.empty())
+	{
+		submeshes = meshData.Submeshes;
+	}
+	else
+	{
+		submeshes.assign(meshData.Submeshes.begin() + meshData.Lods[0].submeshStart,
+			meshData.Submeshes.begin() + meshData.Lods[0].submeshStart + meshData.Lods[0].submeshCount);
+	}
+
+	// The submesh using each vertex, MultipleSubmeshes if several do
+	const UINT NoSubmesh = (UINT)-1, MultipleSubmeshes = (UINT)-2;
+	std::vector<UINT> vertexSubmeshes(vertexCount, NoSubmesh);
+	for (UINT s = 0; s < (UINT)submeshes.size(); ++s)
+	{
+		for (UINT i = 0; i < submeshes[s].indexCount; ++i)
+		{
+			UINT& vertexSubmesh = vertexSubmeshes[meshData.Indices[submeshes[s].indexStart + i]];
+			vertexSubmesh = vertexSubmesh == NoSubmesh || vertexSubmesh == s ? s : MultipleSubmeshes;
+		}
+	}
+
+	mesh.indices.reserve(indexCount);
+	mesh.triangleMaterials.reserve(indexCount / 3);
+	for (size_t s = 0; s < submeshes.size(); ++s)
+	{
+		auto it = meshData.materials.find(submeshes[s].materialId);
+		Material submeshMaterial = it != meshData.materials.end() ? it->second : Material();
+
+		// A diffuse texture in an atlas: UVs in [0, 1] move into its rectangle and the
+		// material samples the whole atlas, so materials that only differ in textures
+		// of the same atlas merge. Tiling UVs need the wrap in the shader and stay.
+		AtlasEntry atlas;
+		if (TextureAtlas::Instance()->Find(submeshMaterial.diffuseTexture, atlas))
+		{
+			bool remap = true;
+			for (UINT i = 0; i < submeshes[s].indexCount && remap; ++i)
+			{
+				UINT vertex = meshData.Indices[submeshes[s].indexStart + i];
+				const XMFLOAT2& uv = mesh.vertices[vertex].Tex;
+				remap = vertexSubmeshes[vertex] == (UINT)s && uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+			}
+			if (remap)
+			{
+				for (UINT v = 0; v < (UINT)vertexCount; ++v)
+				{
+					if (vertexSubmeshes[v] != (UINT)s)
+						continue;
+					XMFLOAT2& uv = mesh.vertices[v].Tex;
+					uv.x = uv.x * atlas.uvTransform.x + atlas.uvTransform.z;
+					uv.y = uv.y * atlas.uvTransform.y + atlas.uvTransform.w;
+				}
+				submeshMaterial.diffuseTexture = atlas.atlasFile;
+			}
+		}
+		UINT material = FindMaterial(submeshMaterial);
+
+		const UINT* indices = &meshData.Indices[submeshes[s].indexStart];
+		for (UINT i = 0; i + 2 < submeshes[s].indexCount; i += 3)
+		{
+			mesh.indices.push_back(indices[i]);
+			mesh.indices.push_back(indices[mirrored ? i + 2 : i + 1]);
+			mesh.indices.push_back(indices[mirrored ? i + 1 : i + 2]);
+			mesh.triangleMaterials.push_back(material);
+		}
+	}
+	mSourceDraws += (UINT)submeshes.size();
+
+	// Bucket the triangles into the cells, small meshes stay in one piece so
+	// props on a cell border do not turn into slivers in the neighbour cells
+	float invCellSize = mCellSize > 0.0f ? 1.0f / mCellSize : 0.0f;
+	const XMFLOAT3& extents = mesh.bounds.Extents;
+	bool split = 2.0f * std::max(extents.x, std::max(extents.y, extents.z)) > mCellSize;
+
+	const XMFLOAT3& center = mesh.bounds.Center;
+	CellKey key = { (int)floorf(center.x * invCellSize), (int)floorf(center.y * invCellSize), (int)floorf(center.z * invCellSize) };
+	std::vector<StaticBatchTriangle>* cell = split ? NULL : &mCells[key];
+	for (UINT t = 0; t < (UINT)mesh.triangleMaterials.size(); ++t)
+	{
+		if (split)
+		{
+			const XMFLOAT3& a = mesh.vertices[mesh.indices[t * 3 + 0]].Position;
+			const XMFLOAT3& b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+			const XMFLOAT3& c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+
+			float third = invCellSize / 3.0f;
+			key.x = (int)floorf((a.x + b.x + c.x) * third);
+			key.y = (int)floorf((a.y + b.y + c.y) * third);
+			key.z = (int)floorf((a.z + b.z + c.z) * third);
+			cell = &mCells[key];
+		}
+		StaticBatchTriangle triangle = { mesh.triangleMaterials[t], meshIndex, t };
+		cell->push_back(triangle);
+	}
+	mTriangles += (UINT)mesh.triangleMaterials.size();
+}
+
+StaticBatchStats StaticBatcher::TakeCells(std::vector<StaticBatchCell>& cells)
+{
+	StaticBatchStats stats;
+	ZeroMemory(&stats, sizeof(stats));
+	stats.meshes = (UINT)mSource->meshes.size();
+	stats.triangles = mTriangles;
+	stats.materials = (UINT)mSource->materials.size();
+	stats.cells = (UINT)mCells.size();
+	stats.sourceDraws = mSourceDraws;
+
+	UINT index = 0;
+	for (auto it = mCells.begin(); it != mCells.end(); ++it)
+	{
+		cells.push_back(StaticBatchCell());
+		cells.back().index = index++;
+		cells.back().source = mSource;
+		cells.back().triangles.swap(it->second);
+	}
+
+	DebugLog("StaticBatcher: %u meshes, %u triangles, %u materials in %u cells of %g units, %u draws before batching\n",
+		stats.meshes, stats.triangles, stats.materials, stats.cells, mCellSize, stats.sourceDraws);
+
+	Clear();
+	return stats;
+}
+
+UINT StaticBatcher::BuildCell(const StaticBatchCell& cell, MeshData& batch)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const StaticBatchSource& source = *cell.source;
+
+	// material order, the meshes and triangles keep their order within a material
+	std::vector<StaticBatchTriangle> triangles(cell.triangles);
+	std::stable_sort(triangles.begin(), triangles.end(), [](const StaticBatchTriangle& a, const StaticBatchTriangle& b) { return a.material < b.material; });
+
+	batch = MeshData();
+	batch.world = XMMatrixIdentity();
+	batch.Indices.reserve(triangles.size() * 3);
+
+	// The vertices of a mesh used in the cell, keyed by mesh and vertex index
+	std::unordered_map<UINT64, UINT> vertexMap;
+	vertexMap.reserve(triangles.size() * 2);
+	for (size_t t = 0; t < triangles.size(); ++t)
+	{
+		const StaticBatchTriangle& triangle = triangles[t];
+		const StaticBatchSource::StaticMesh& mesh = source.meshes[triangle.mesh];
+
+		if (batch.Submeshes.empty() || batch.Submeshes.back().materialId != triangle.material)
+		{
+			Submesh submesh = { triangle.material, (UINT)batch.Indices.size(), 0, 0, 0 };
+			batch.Submeshes.push_back(submesh);
+			batch.materials[triangle.material] = source.materials[triangle.material];
+		}
+
+		for (UINT k = 0; k < 3; ++k)
+		{
+			UINT vertex = mesh.indices[triangle.triangle * 3 + k];
+			auto inserted = vertexMap.insert(std::make_pair(((UINT64)triangle.mesh << 32) | vertex, (UINT)batch.Vertices.size()));
+			if (inserted.second)
+				batch.Vertices.push_back(mesh.vertices[vertex]);
+			batch.Indices.push_back(inserted.first->second);
+		}
+		batch.Submeshes.back().indexCount += 3;
+	}
+
+	// Vertex order, bounds, meshlets and LODs of the merged cell
+	MeshProcessor::Instance()->Process(batch);
+	if (source.quantize)
+		MeshProcessor::Instance()->QuantizeVertices("static batch " + std::to_string(cell.index), batch);
+
+	UINT draws = batch.Lods.empty() ? 1 : batch.Lods[0].submeshCount;
+	DebugLog("StaticBatcher: cell %u, %u triangles, %u draws built in %.2f ms\n", cell.index, (UINT)triangles.size(), draws,
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	return draws;
+}
+
+void StaticBatcher::Clear()
+{
+	// cells taken before keep the old meshes alive
+	mSource = std::make_shared<StaticBatchSource>();
+	mSource->quantize = false;
+	mCells.clear();
+	mSourceDraws = 0;
+	mTriangles = 0;
+}
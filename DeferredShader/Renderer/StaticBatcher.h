@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+#include <memory>
+
+// Counters of the meshes StaticBatcher::TakeCells hands out
+struct StaticBatchStats
+{
+	UINT meshes;		// static meshes merged
+	UINT triangles;		// LOD 0 triangles of the meshes
+	UINT materials;		// distinct materials after merging equal ones
+	UINT cells;			// batches to build
+	UINT sourceDraws;	// draws of the meshes on their own, one per mesh and material
+	UINT cellsBuilt;	// batches built so far
+	UINT batchDraws;	// draws of the batches built so far, one per cell and material
+};
+
+// World space copies of the meshes added to StaticBatcher, shared by the cells taken together
+struct StaticBatchSource
+{
+	struct StaticMesh
+	{
+		std::vector<Vertex> vertices;
+		std::vector<UINT> indices;				// LOD 0 triangles
+		std::vector<UINT> triangleMaterials;	// materials index of every triangle
+		BoundingBox bounds;						// world space
+	};
+
+	std::vector<StaticMesh> meshes;
+	std::vector<Material> materials;
+	bool quantize;		// an added mesh was quantized
+};
+
+// Triangle of an added mesh in a cell
+struct StaticBatchTriangle
+{
+	UINT material;
+	UINT mesh;
+	UINT triangle;
+};
+
+// The triangles of one grid cell, StaticBatcher::BuildCell turns it into a batch
+struct StaticBatchCell
+{
+	UINT index;		// of the cell among the cells taken together, names the batch
+	std::shared_ptr<const StaticBatchSource> source;
+	std::vector<StaticBatchTriangle> triangles;
+};
+
+// StaticBatcher
+// singleton class, merges static meshes into pre-transformed batches on a world space grid
+// usage:
+// StaticBatcher::Instance()->Add(meshData, world) for every static mesh
+// std::vector<StaticBatchCell> cells;
+// StaticBatcher::Instance()->TakeCells(cells)
+// StaticBatcher::BuildCell(cells[i], batch) for every cell on any thread
+// mesh->Create(device, std::move(batch)) for every batch, their world matrix is identity
+//
+// The LOD 0 triangles of the meshes are transformed to world space and bucketed
+// into grid cells: meshes that fit into a cell go to the cell of their bounds
+// center as a whole, larger ones (terrain, floors) are split by triangle centroid.
+// Every cell becomes one MeshData with its triangles sorted by material, equal
+// materials of different meshes are merged, so a cell takes one transform update
+// and one draw per material. The cells run through MeshProcessor again (vertex
+// order, meshlets, LODs), meshlet culling and LOD selection work per cell.
+// Quantized meshes are decoded when added and the batches are quantized again.
+// Submeshes with an atlased diffuse texture and UVs in [0, 1] get their UVs moved
+// into the atlas, their materials then merge with the others of that atlas.
+//
+// Add buckets the triangles of a mesh right away and TakeCells only hands the cells
+// over, so the thread adding the meshes pays for each mesh as it comes in. BuildCell,
+// the MeshProcessor run, does not touch the batcher: SceneManager queues the cells
+// on the MeshStreamer workers and the batches come back through the upload budget.
+class StaticBatcher
+{
+public:
+	static StaticBatcher* Instance();
+
+	// Copies the LOD 0 triangles of meshData placed in the world by world into their cells
+	void Add(const MeshData& meshData, const XMMATRIX& world);
+
+	// Appends the non-empty cells to cells and clears the added meshes, the cells keep them
+	StaticBatchStats TakeCells(std::vector<StaticBatchCell>& cells);
+
+	// Merges the triangles of cell into batch and processes it, thread safe.
+	// Returns the draws of the batch.
+	static UINT BuildCell(const StaticBatchCell& cell, MeshData& batch);
+
+	// Drops the added meshes
+	void Clear();
+
+	// Number of meshes added since the last TakeCells
+	UINT GetMeshCount() const { return (UINT)mSource->meshes.size(); }
+
+	// Edge length of the grid cells in world units, larger cells mean fewer draws but coarser culling.
+	// Set it before adding the meshes.
+	void SetCellSize(float cellSize) { mCellSize = cellSize; }
+	float GetCellSize() const { return mCellSize; }
+
+private:
+	StaticBatcher();
+	~StaticBatcher();
+
+	// Grid cell coordinates
+	struct CellKey
+	{
+		int x, y, z;
+
+		bool operator<(const CellKey& other) const
+		{
+			if (x != other.x)
+				return x < other.x;
+			if (y != other.y)
+				return y < other.y;
+			return z < other.z;
+		}
+	};
+
+	// Index of the material in mSource->materials, added when no equal material is there
+	UINT FindMaterial(const Material& material);
+
+	std::shared_ptr<StaticBatchSource> mSource;
+	std::map<CellKey, std::vector<StaticBatchTriangle> > mCells;
+	UINT mSourceDraws;
+	UINT mTriangles;
+
+	float mCellSize;
+
+	static StaticBatcher* mInstance;
+};
@@ -0,0 +1,324 @@
+#include "TangentGenerator.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <chrono>
+#include <climits>
+#include <unordered_map>
+
+namespace
+{
+	// Triangles per thread below which a thread is not worth its accumulation arrays
+	const size_t MIN_THREAD_TRIANGLES = 16 * 1024;
+
+	// Elements per ParallelFor item when the thread arrays are summed
+	const size_t REDUCE_BLOCK = 4096;
+
+	struct PositionHash
+	{
+		size_t operator()(const XMFLOAT3& p) const
+		{
+			UINT bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+
+	inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	// Normalizes v, returns false and leaves v alone if it has no direction
+	inline bool Normalize(XMFLOAT3& v)
+	{
+		float lengthSq = Dot(v, v);
+		if (!(lengthSq > 1e-30f))
+			return false;
+		float invLength = 1.0f / sqrtf(lengthSq);
+		v = XMFLOAT3(v.x * invLength, v.y * invLength, v.z * invLength);
+		return true;
+	}
+
+	// Angle at corner a of the triangle (a, b, c)
+	inline float CornerAngle(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+	{
+		XMFLOAT3 e1 = Sub(b, a);
+		XMFLOAT3 e2 = Sub(c, a);
+		if (!Normalize(e1) || !Normalize(e2))
+			return 0.0f;
+		return acosf(std::max(-1.0f, std::min(1.0f, Dot(e1, e2))));
+	}
+
+	// Any unit vector perpendicular to n, for vertices without a usable UV direction
+	inline XMFLOAT3 Perpendicular(XMFLOAT3 n)
+	{
+		Normalize(n);
+		XMFLOAT3 t = fabsf(n.x) < 0.9f ? Cross(n, XMFLOAT3(1.0f, 0.0f, 0.0f)) : Cross(n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+		if (!Normalize(t))
+			t = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		return t;
+	}
+
+	// Adds the arrays of threads 1..n to the array of thread 0
+	template<typename T, typename Add>
+	void Reduce(std::vector<std::vector<T> >& sums, Add add)
+	{
+		if (sums.size() <= 1)
+			return;
+
+		size_t count = sums[0].size();
+		ParallelFor((count + REDUCE_BLOCK - 1) / REDUCE_BLOCK, [&](size_t block)
+		{
+			size_t end = std::min(count, (block + 1) * REDUCE_BLOCK);
+			for (size_t t = 1; t < sums.size(); ++t)
+			{
+				for (size_t i = block * REDUCE_BLOCK; i < end; ++i)
+					add(sums[0][i], sums[t][i]);
+			}
+		});
+	}
+}
+
+TangentGenerator* TangentGenerator::mInstance = NULL;
+
+TangentGenerator* TangentGenerator::Instance()
+{
+	if (!mInstance)
+		mInstance = new TangentGenerator;
+	return mInstance;
+}
+
+TangentGenerator::TangentGenerator()
+{
+}
+
+TangentGenerator::~TangentGenerator()
+{
+}
+
+UINT TangentGenerator::GetThreadCount(size_t triangleCount)
+{
+	return (UINT)std::max<size_t>(1, std::min<size_t>(GetWorkerThreadCount(), triangleCount / MIN_THREAD_TRIANGLES));
+}
+
+UINT TangentGenerator::GenerateNormals(MeshData& meshData)
+{
+	size_t vertexCount = meshData.Vertices.size();
+	size_t triangleCount = meshData.Indices.size() / 3;
+
+	UINT missingCount = 0;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (!(Dot(meshData.Vertices[v].Normal, meshData.Vertices[v].Normal) > 1e-12f))
+			missingCount++;
+	}
+	if (missingCount == 0 || triangleCount == 0)
+		return 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Vertices at the same position get the same normal, texcoord seams stay smooth
+	std::vector<UINT> positionId(vertexCount);
+	size_t positionCount = 0;
+	{
+		std::unordered_map<XMFLOAT3, UINT, PositionHash, PositionEqual> positions;
+		positions.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			auto inserted = positions.insert(std::make_pair(meshData.Vertices[v].Position, (UINT)positionCount));
+			if (inserted.second)
+				positionCount++;
+			positionId[v] = inserted.first->second;
+		}
+	}
+
+	// Every thread sums the angle weighted face normals of its triangles into its own array
+	UINT threadCount = GetThreadCount(triangleCount);
+	std::vector<std::vector<XMFLOAT3> > sums(threadCount, std::vector<XMFLOAT3>(positionCount, XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	ParallelFor(threadCount, [&](size_t thread)
+	{
+		std::vector<XMFLOAT3>& sum = sums[thread];
+		size_t end = triangleCount * (thread + 1) / threadCount;
+		for (size_t t = triangleCount * thread / threadCount; t < end; ++t)
+		{
+			const UINT* triangle = &meshData.Indices[t * 3];
+			const XMFLOAT3& a = meshData.Vertices[triangle[0]].Position;
+			const XMFLOAT3& b = meshData.Vertices[triangle[1]].Position;
+			const XMFLOAT3& c = meshData.Vertices[triangle[2]].Position;
+
+			// counter clockwise front faces like the .obj and glTF files
+			XMFLOAT3 normal = Cross(Sub(b, a), Sub(c, a));
+			if (!Normalize(normal))
+				continue;
+
+			float angles[3] = { CornerAngle(a, b, c), CornerAngle(b, c, a), CornerAngle(c, a, b) };
+			for (UINT k = 0; k < 3; ++k)
+			{
+				XMFLOAT3& n = sum[positionId[triangle[k]]];
+				n.x += normal.x * angles[k];
+				n.y += normal.y * angles[k];
+				n.z += normal.z * angles[k];
+			}
+		}
+	});
+
+	Reduce(sums, [](XMFLOAT3& a, const XMFLOAT3& b) { a.x += b.x; a.y += b.y; a.z += b.z; });
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		Vertex& vertex = meshData.Vertices[v];
+		if (Dot(vertex.Normal, vertex.Normal) > 1e-12f)
+			continue;
+
+		vertex.Normal = sums[0][positionId[v]];
+		if (!Normalize(vertex.Normal))
+			vertex.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	DebugLog("TangentGenerator: %u of %u normals generated in %.2f ms on %u threads\n", missingCount, (UINT)vertexCount,
+		std::chrono::duration<double, std::milli>(end - start).count(), threadCount);
+
+	return missingCount;
+}
+
+UINT TangentGenerator::GenerateTangents(MeshData& meshData)
+{
+	size_t vertexCount = meshData.Vertices.size();
+	size_t triangleCount = meshData.Indices.size() / 3;
+	if (vertexCount == 0)
+		return 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Two sums per vertex, [v * 2] for the triangles with counterclockwise UVs and
+	// [v * 2 + 1] for the mirrored ones, xyz is the tangent sum and w the weight sum
+	UINT threadCount = GetThreadCount(triangleCount);
+	std::vector<std::vector<XMFLOAT4> > sums(threadCount, std::vector<XMFLOAT4>(vertexCount * 2, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f)));
+	std::vector<BYTE> mirrored(triangleCount, 0);
+	ParallelFor(threadCount, [&](size_t thread)
+	{
+		std::vector<XMFLOAT4>& sum = sums[thread];
+		size_t end = triangleCount * (thread + 1) / threadCount;
+		for (size_t t = triangleCount * thread / threadCount; t < end; ++t)
+		{
+			const UINT* triangle = &meshData.Indices[t * 3];
+			const Vertex* corners[3] = { &meshData.Vertices[triangle[0]], &meshData.Vertices[triangle[1]], &meshData.Vertices[triangle[2]] };
+
+			XMFLOAT3 e1 = Sub(corners[1]->Position, corners[0]->Position);
+			XMFLOAT3 e2 = Sub(corners[2]->Position, corners[0]->Position);
+			float du1 = corners[1]->Tex.x - corners[0]->Tex.x;
+			float dv1 = corners[1]->Tex.y - corners[0]->Tex.y;
+			float du2 = corners[2]->Tex.x - corners[0]->Tex.x;
+			float dv2 = corners[2]->Tex.y - corners[0]->Tex.y;
+
+			// The sign of the UV area is the orientation, the tangent points along +u
+			float uvArea = du1 * dv2 - du2 * dv1;
+			if (uvArea == 0.0f)
+				continue;
+			mirrored[t] = uvArea < 0.0f ? 1 : 0;
+
+			float scale = uvArea > 0.0f ? 1.0f : -1.0f;
+			XMFLOAT3 faceTangent((e1.x * dv2 - e2.x * dv1) * scale, (e1.y * dv2 - e2.y * dv1) * scale, (e1.z * dv2 - e2.z * dv1) * scale);
+
+			for (UINT k = 0; k < 3; ++k)
+			{
+				// project into the tangent plane of the vertex normal, file normals need not be unit length
+				XMFLOAT3 n = corners[k]->Normal;
+				Normalize(n);
+				float d = Dot(n, faceTangent);
+				XMFLOAT3 tangent(faceTangent.x - n.x * d, faceTangent.y - n.y * d, faceTangent.z - n.z * d);
+				if (!Normalize(tangent))
+					continue;
+
+				float angle = CornerAngle(corners[k]->Position, corners[(k + 1) % 3]->Position, corners[(k + 2) % 3]->Position);
+				XMFLOAT4& s = sum[triangle[k] * 2 + mirrored[t]];
+				s.x += tangent.x * angle;
+				s.y += tangent.y * angle;
+				s.z += tangent.z * angle;
+				s.w += angle;
+			}
+		}
+	});
+
+	Reduce(sums, [](XMFLOAT4& a, const XMFLOAT4& b) { a.x += b.x; a.y += b.y; a.z += b.z; a.w += b.w; });
+
+	// Vertices shared by both orientations become two vertices, the mirrored triangles use the copy
+	std::vector<UINT> splitVertex(vertexCount, UINT_MAX);
+	UINT splitCount = 0;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (sums[0][v * 2].w > 0.0f && sums[0][v * 2 + 1].w > 0.0f)
+			splitVertex[v] = (UINT)(vertexCount + splitCount++);
+	}
+	meshData.Vertices.resize(vertexCount + splitCount);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const XMFLOAT4& front = sums[0][v * 2];
+		const XMFLOAT4& back = sums[0][v * 2 + 1];
+
+		if (splitVertex[v] != UINT_MAX)
+			meshData.Vertices[splitVertex[v]] = meshData.Vertices[v];
+
+		for (UINT side = 0; side < 2; ++side)
+		{
+			// without a split the vertex takes the orientation that has triangles
+			bool isMirrored = splitVertex[v] != UINT_MAX ? side == 1 : back.w > front.w;
+			const XMFLOAT4& s = isMirrored ? back : front;
+			Vertex& vertex = meshData.Vertices[side == 1 && splitVertex[v] != UINT_MAX ? splitVertex[v] : v];
+
+			XMFLOAT3 tangent(s.x, s.y, s.z);
+			if (!Normalize(tangent))
+				tangent = Perpendicular(vertex.Normal);
+			vertex.Tangent = XMFLOAT4(tangent.x, tangent.y, tangent.z, isMirrored ? -1.0f : 1.0f);
+
+			if (splitVertex[v] == UINT_MAX)
+				break;
+		}
+	}
+
+	if (splitCount > 0)
+	{
+		ParallelFor(threadCount, [&](size_t thread)
+		{
+			size_t end = triangleCount * (thread + 1) / threadCount;
+			for (size_t t = triangleCount * thread / threadCount; t < end; ++t)
+			{
+				if (!mirrored[t])
+					continue;
+				for (UINT k = 0; k < 3; ++k)
+				{
+					UINT& index = meshData.Indices[t * 3 + k];
+					if (splitVertex[index] != UINT_MAX)
+						index = splitVertex[index];
+				}
+			}
+		});
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	DebugLog("TangentGenerator: tangents of %u vertices in %.2f ms on %u threads, %u vertices split for mirrored UVs\n",
+		(UINT)vertexCount, std::chrono::duration<double, std::milli>(end - start).count(), threadCount, splitCount);
+
+	return splitCount;
+}
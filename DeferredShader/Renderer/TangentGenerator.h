@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// TangentGenerator
+// singleton class, generates missing vertex normals and the tangent frames for normal mapping
+// usage:
+// TangentGenerator::Instance()->GenerateNormals(meshData)
+// TangentGenerator::Instance()->GenerateTangents(meshData)
+//
+// Normals: vertices whose normal is zero (the .obj had no vn, the glTF no NORMAL)
+// get the corner angle weighted average of the face normals around their position,
+// so the normals stay smooth across texture seams.
+// Tangents follow MikkTSpace: per corner the triangle's UV tangent is projected
+// into the vertex normal plane and accumulated with the corner angle as weight,
+// w is the bitangent sign (bitangent = w * cross(normal, tangent)). Vertices used
+// by triangles of both UV orientations (mirrored UVs) are split in two.
+// Both run over the triangles on all hardware threads, every thread accumulates
+// into its own arrays and the arrays are summed afterwards, no atomics needed.
+class TangentGenerator
+{
+public:
+	static TangentGenerator* Instance();
+
+	// Fills the zero normals of meshData.Vertices, returns the number of normals generated
+	UINT GenerateNormals(MeshData& meshData);
+
+	// Fills the Tangent of every vertex, may append vertices to split mirrored UVs.
+	// Returns the number of vertices added.
+	UINT GenerateTangents(MeshData& meshData);
+
+private:
+	TangentGenerator();
+	~TangentGenerator();
+
+	// Threads used for triangleCount triangles, small meshes are not worth the per thread arrays
+	static UINT GetThreadCount(size_t triangleCount);
+
+	static TangentGenerator* mInstance;
+};
@@ -0,0 +1,169 @@
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+
+#pragma pack(push,1)
+struct AtlasEntryHeader
+{
+	UINT magic;
+	UINT version;
+	UINT64 sourceHash;
+	UINT64 sourceSize;		// TextureCache::SourceStamp of the texture
+	UINT64 sourceWriteTime;
+	XMFLOAT4 uvTransform;
+	UINT atlasFileLength;	// followed by the atlas filename, no terminator
+};
+#pragma pack(pop)
+
+namespace
+{
+	// Drops the "." and "dir\.." parts of path, so every texture names an atlas by the same
+	// filename and TextureManager hands out one handle for it
+	std::string NormalizePath(const std::string& path)
+	{
+		char separator = path.find('\\') != std::string::npos ? '\\' : '/';
+		bool absolute = !path.empty() && (path[0] == '\\' || path[0] == '/');
+
+		std::vector<std::string> parts;
+		size_t start = 0;
+		while (start <= path.size())
+		{
+			size_t end = path.find_first_of("\\/", start);
+			if (end == std::string::npos)
+				end = path.size();
+			std::string part = path.substr(start, end - start);
+			if (part == ".." && !parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!part.empty() && part != ".")
+				parts.push_back(part);
+			start = end + 1;
+		}
+
+		std::string result = absolute ? std::string(1, separator) : std::string();
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			if (i > 0)
+				result += separator;
+			result += parts[i];
+		}
+		return result;
+	}
+}
+
+TextureAtlas* TextureAtlas::mInstance = 0;
+
+TextureAtlas* TextureAtlas::Instance()
+{
+	if (mInstance == 0)
+	{
+		mInstance = new TextureAtlas();
+	}
+	return mInstance;
+}
+
+TextureAtlas::TextureAtlas()
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+}
+
+std::string TextureAtlas::GetEntryFileName(const std::string& textureFile)
+{
+	return textureFile + ".atlas";
+}
+
+bool TextureAtlas::Find(const std::string& textureFile, AtlasEntry& entry)
+{
+	if (textureFile.empty())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find(textureFile);
+		if (it != mEntries.end())
+		{
+			entry = it->second.entry;
+			return it->second.found;
+		}
+	}
+
+	// the file reads run outside the lock, a race only reads the entry twice
+	CachedEntry cached;
+	UINT64 sourceHash;
+	cached.found = Load(textureFile, cached.entry, sourceHash);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries[textureFile] = cached;
+	entry = cached.entry;
+	return cached.found;
+}
+
+bool TextureAtlas::IsValid(const std::string& textureFile, UINT64 sourceHash)
+{
+	AtlasEntry entry;
+	UINT64 entryHash;
+	return Load(textureFile, entry, entryHash) && entryHash == sourceHash;
+}
+
+bool TextureAtlas::Load(const std::string& textureFile, AtlasEntry& entry, UINT64& sourceHash)
+{
+	std::ifstream in(GetEntryFileName(textureFile), std::ios::in | std::ios::binary);
+	if (!in)
+		return false;
+
+	AtlasEntryHeader header;
+	if (!in.read((char*)&header, sizeof(header)) || header.magic != mMagic || header.version != mVersion ||
+		header.atlasFileLength == 0 || header.atlasFileLength > 4096)
+	{
+		return false;
+	}
+
+	std::string atlasFile(header.atlasFileLength, '\0');
+	if (!in.read(&atlasFile[0], atlasFile.size()))
+		return false;
+
+	// a changed source is drawn on its own until the atlases are cooked again
+	TextureCache::SourceStamp stamp;
+	if (TextureCache::GetSourceStamp(textureFile, stamp) && (stamp.size != header.sourceSize || stamp.writeTime != header.sourceWriteTime))
+		return false;
+	sourceHash = header.sourceHash;
+
+	size_t separator = textureFile.find_last_of("\\/");
+	entry.atlasFile = NormalizePath(separator != std::string::npos ? textureFile.substr(0, separator + 1) + atlasFile : atlasFile);
+	entry.uvTransform = header.uvTransform;
+	return true;
+}
+
+bool TextureAtlas::Save(const std::string& textureFile, UINT64 sourceHash, const AtlasEntry& entry)
+{
+	if (entry.atlasFile.empty())
+		return false;
+
+	std::ofstream out(GetEntryFileName(textureFile), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	TextureCache::SourceStamp stamp;
+	if (!TextureCache::GetSourceStamp(textureFile, stamp))
+		return false;
+
+	AtlasEntryHeader header;
+	header.magic = mMagic;
+	header.version = mVersion;
+	header.sourceHash = sourceHash;
+	header.sourceSize = stamp.size;
+	header.sourceWriteTime = stamp.writeTime;
+	header.uvTransform = entry.uvTransform;
+	header.atlasFileLength = (UINT)entry.atlasFile.size();
+
+	out.write((const char*)&header, sizeof(header));
+	out.write(entry.atlasFile.data(), entry.atlasFile.size());
+	return out.good();
+}
+
+void TextureAtlas::Release()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.clear();
+}
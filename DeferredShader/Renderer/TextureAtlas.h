@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Util.h"
+
+#include <mutex>
+
+// Where a texture was packed by the AssetCooker
+struct AtlasEntry
+{
+	std::string atlasFile;		// TextureManager filename of the atlas, a TextureCache file without a source image
+	XMFLOAT4 uvTransform;		// scale in xy and bias in zw from the texture's UVs into the atlas
+};
+
+// TextureAtlas
+// singleton class, reads and writes the atlas entries of the textures the AssetCooker
+// packed into shared atlases: a small file next to the source image naming the atlas
+// and the rectangle of the texture in it. usage:
+// AtlasEntry entry;
+// if (TextureAtlas::Instance()->Find("..\\Assets\\cube\\default.png", entry)) {
+//     RequestTexture(entry.atlasFile) and sample frac(uv) * entry.uvTransform.xy + entry.uvTransform.zw
+// }
+// The atlas keeps a gutter of wrapped texels around every texture, so tiling UVs wrap
+// with frac in the shader and bilinear filtering does not bleed in the neighbours.
+// Materials whose textures share an atlas share the shader resource view as well.
+class TextureAtlas
+{
+public:
+	static TextureAtlas* Instance();
+
+	// Atlas entry of textureFile, false if it is not in an atlas or the size or write time
+	// of its source changed since the atlas was built, the source is not read. The result
+	// is kept per filename. Thread safe.
+	bool Find(const std::string& textureFile, AtlasEntry& entry);
+
+	// Writes the atlas entry of textureFile with the source hash and the size and write
+	// time of textureFile, entry.atlasFile relative to the directory of textureFile
+	bool Save(const std::string& textureFile, UINT64 sourceHash, const AtlasEntry& entry);
+
+	// True if the entry of textureFile was written for sourceHash and Find accepts it, for the cooker
+	bool IsValid(const std::string& textureFile, UINT64 sourceHash);
+
+	// Name of the entry file for textureFile
+	static std::string GetEntryFileName(const std::string& textureFile);
+
+	// Forgets the entries found so far, call after the atlases were cooked again
+	void Release();
+
+	// 'DSTA'
+	static const UINT mMagic = 0x41545344;
+	// bump this whenever the layout changes
+	static const UINT mVersion = 2;
+
+private:
+	TextureAtlas();
+	~TextureAtlas();
+
+	// Reads the entry file of textureFile if the stamp of an existing source matches,
+	// sourceHash is the hash it was written for
+	bool Load(const std::string& textureFile, AtlasEntry& entry, UINT64& sourceHash);
+
+	struct CachedEntry
+	{
+		bool found;
+		AtlasEntry entry;
+	};
+
+	std::mutex mMutex;
+	std::map<std::string, CachedEntry> mEntries;
+
+	static TextureAtlas* mInstance;
+};
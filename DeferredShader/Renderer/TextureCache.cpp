@@ -0,0 +1,310 @@
+#include "TextureCache.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// 'DDS '
+	const UINT DDS_MAGIC = 0x20534444;
+	// 'DX10', the pixel format is the DXGI_FORMAT of the extended header
+	const UINT DDS_FOURCC_DX10 = 0x30315844;
+
+	const UINT DDSD_CAPS = 0x1;
+	const UINT DDSD_HEIGHT = 0x2;
+	const UINT DDSD_WIDTH = 0x4;
+	const UINT DDSD_PITCH = 0x8;
+	const UINT DDSD_PIXELFORMAT = 0x1000;
+	const UINT DDSD_MIPMAPCOUNT = 0x20000;
+	const UINT DDSD_LINEARSIZE = 0x80000;
+	const UINT DDPF_FOURCC = 0x4;
+	const UINT DDSCAPS_COMPLEX = 0x8;
+	const UINT DDSCAPS_TEXTURE = 0x1000;
+	const UINT DDSCAPS_MIPMAP = 0x400000;
+	const UINT DDS_DIMENSION_TEXTURE2D = 3;
+
+	// D3D11 limit for 2D textures
+	const UINT MaxTextureSize = 16384;
+
+	bool IsCachedFormat(DXGI_FORMAT format)
+	{
+		return format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || GetBlockBytes(format) > 0;
+	}
+
+	// Rows of a mip as stored, rows of 4x4 blocks for the BCn formats
+	UINT GetRowCount(DXGI_FORMAT format, UINT height)
+	{
+		return GetBlockBytes(format) > 0 ? std::max((height + 3) / 4, 1u) : height;
+	}
+}
+
+#pragma pack(push,1)
+struct DdsPixelFormat
+{
+	UINT size;
+	UINT flags;
+	UINT fourCC;
+	UINT rgbBitCount;
+	UINT rBitMask;
+	UINT gBitMask;
+	UINT bBitMask;
+	UINT aBitMask;
+};
+
+// DDS_HEADER of the DDS format, preceded by DDS_MAGIC in the file
+struct DdsHeader
+{
+	UINT size;
+	UINT flags;
+	UINT height;
+	UINT width;
+	UINT pitchOrLinearSize;
+	UINT depth;
+	UINT mipMapCount;
+	UINT reserved1[11];		// [0] TextureCache::mMagic, [1] version, [2] [3] source hash, [4] TextureContent,
+							// [5] [6] source size, [7] [8] source write time
+	DdsPixelFormat pixelFormat;
+	UINT caps;
+	UINT caps2;
+	UINT caps3;
+	UINT caps4;
+	UINT reserved2;
+};
+
+// DDS_HEADER_DXT10, follows DdsHeader when the fourCC is 'DX10'
+struct DdsHeaderDx10
+{
+	UINT dxgiFormat;
+	UINT resourceDimension;
+	UINT miscFlag;
+	UINT arraySize;
+	UINT miscFlags2;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(DdsHeader) == 124 && sizeof(DdsPixelFormat) == 32 && sizeof(DdsHeaderDx10) == 20, "DDS header layout");
+
+TextureCache* TextureCache::mInstance = 0;
+
+TextureCache* TextureCache::Instance()
+{
+	if (mInstance == 0)
+	{
+		mInstance = new TextureCache();
+	}
+	return mInstance;
+}
+
+TextureCache::TextureCache()
+{
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+std::string TextureCache::GetCacheFileName(const std::string& sourceFile)
+{
+	return sourceFile + ".dds";
+}
+
+bool TextureCache::GetSourceStamp(const std::string& sourceFile, SourceStamp& stamp)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(sourceFile.c_str(), GetFileExInfoStandard, &attributes) || (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		return false;
+
+	stamp.size = attributes.nFileSizeLow | ((UINT64)attributes.nFileSizeHigh << 32);
+	stamp.writeTime = attributes.ftLastWriteTime.dwLowDateTime | ((UINT64)attributes.ftLastWriteTime.dwHighDateTime << 32);
+#else
+	struct stat fileStat;
+	if (stat(sourceFile.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+		return false;
+
+	stamp.size = (UINT64)fileStat.st_size;
+	stamp.writeTime = (UINT64)fileStat.st_mtim.tv_sec * 1000000000 + (UINT64)fileStat.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+bool TextureCache::ReadHeader(const BYTE* data, size_t size, TextureContent content, UINT64& sourceHash, SourceStamp& stamp, TextureData& textureData)
+{
+	const size_t payloadOffset = sizeof(UINT) + sizeof(DdsHeader) + sizeof(DdsHeaderDx10);
+	if (size < payloadOffset)
+		return false;
+
+	UINT magic;
+	DdsHeader header;
+	DdsHeaderDx10 header10;
+	memcpy(&magic, data, sizeof(magic));
+	memcpy(&header, data + sizeof(UINT), sizeof(header));
+	memcpy(&header10, data + sizeof(UINT) + sizeof(DdsHeader), sizeof(header10));
+
+	if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || header.pixelFormat.fourCC != DDS_FOURCC_DX10 ||
+		header.reserved1[0] != mMagic || header.reserved1[1] != mVersion || header.reserved1[4] != (UINT)content)
+	{
+		return false;
+	}
+	sourceHash = header.reserved1[2] | ((UINT64)header.reserved1[3] << 32);
+	stamp.size = header.reserved1[5] | ((UINT64)header.reserved1[6] << 32);
+	stamp.writeTime = header.reserved1[7] | ((UINT64)header.reserved1[8] << 32);
+
+	DXGI_FORMAT format = (DXGI_FORMAT)header10.dxgiFormat;
+	if (header10.resourceDimension != DDS_DIMENSION_TEXTURE2D || header10.arraySize != 1 || !IsCachedFormat(format) ||
+		header.width == 0 || header.height == 0 || header.width > MaxTextureSize || header.height > MaxTextureSize ||
+		header.mipMapCount == 0 || header.mipMapCount > GetMipCount(header.width, header.height))
+	{
+		return false;
+	}
+
+	textureData.width = header.width;
+	textureData.height = header.height;
+	textureData.format = format;
+	textureData.mips.clear();
+	textureData.pixels.clear();
+	textureData.mappedOffset = payloadOffset;
+
+	size_t offset = 0;
+	for (UINT m = 0; m < header.mipMapCount; ++m)
+	{
+		TextureMip mip;
+		mip.width = std::max(header.width >> m, 1u);
+		mip.height = std::max(header.height >> m, 1u);
+		mip.rowPitch = GetRowPitch(format, mip.width);
+		mip.offset = offset;
+		textureData.mips.push_back(mip);
+		offset += (size_t)GetSurfaceBytes(format, mip.width, mip.height);
+	}
+
+	return payloadOffset + offset <= size;
+}
+
+bool TextureCache::Map(const std::string& sourceFile, TextureContent content, UINT64& sourceHash, SourceStamp& stamp, TextureData& textureData)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(GetCacheFileName(sourceFile)))
+		return false;
+
+	if (!ReadHeader(file->GetData(), file->GetSize(), content, sourceHash, stamp, textureData))
+	{
+		textureData = TextureData();
+		return false;
+	}
+
+	textureData.mappedFile = file;
+	return true;
+}
+
+bool TextureCache::Load(const std::string& sourceFile, UINT64 sourceHash, TextureContent content, TextureData& textureData)
+{
+	UINT64 cachedHash;
+	SourceStamp cachedStamp;
+	if (!Map(sourceFile, content, cachedHash, cachedStamp, textureData))
+		return false;
+
+	if (sourceHash != 0 && cachedHash != sourceHash)
+	{
+		textureData = TextureData();
+		return false;
+	}
+	return true;
+}
+
+bool TextureCache::LoadUnchanged(const std::string& sourceFile, TextureContent content, TextureData& textureData)
+{
+	SourceStamp stamp;
+	bool hasSource = GetSourceStamp(sourceFile, stamp);
+
+	UINT64 cachedHash;
+	SourceStamp cachedStamp;
+	if (!Map(sourceFile, content, cachedHash, cachedStamp, textureData))
+		return false;
+
+	if (hasSource && (cachedStamp.size != stamp.size || cachedStamp.writeTime != stamp.writeTime))
+	{
+		textureData = TextureData();
+		return false;
+	}
+	return true;
+}
+
+bool TextureCache::IsValid(const std::string& sourceFile, UINT64 sourceHash, TextureContent content)
+{
+	MappedFile file;
+	TextureData textureData;
+	UINT64 cachedHash;
+	SourceStamp cachedStamp, stamp;
+	if (!file.Open(GetCacheFileName(sourceFile)) || !ReadHeader(file.GetData(), file.GetSize(), content, cachedHash, cachedStamp, textureData) ||
+		(sourceHash != 0 && cachedHash != sourceHash))
+	{
+		return false;
+	}
+	return !GetSourceStamp(sourceFile, stamp) || (cachedStamp.size == stamp.size && cachedStamp.writeTime == stamp.writeTime);
+}
+
+bool TextureCache::Save(const std::string& sourceFile, UINT64 sourceHash, TextureContent content, const TextureData& textureData)
+{
+	const BYTE* pixels = textureData.GetPixels();
+	if (pixels == NULL || textureData.mips.empty() || !IsCachedFormat(textureData.format))
+		return false;
+
+	// a source that does not exist, like an atlas, gets a zero stamp
+	SourceStamp stamp;
+	if (!GetSourceStamp(sourceFile, stamp))
+		ZeroMemory(&stamp, sizeof(stamp));
+
+	std::string cacheFile = GetCacheFileName(sourceFile);
+	std::ofstream out(cacheFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	bool compressed = GetBlockBytes(textureData.format) > 0;
+
+	DdsHeader header;
+	ZeroMemory(&header, sizeof(header));
+	header.size = sizeof(DdsHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | (compressed ? DDSD_LINEARSIZE : DDSD_PITCH);
+	header.height = textureData.height;
+	header.width = textureData.width;
+	header.pitchOrLinearSize = compressed ? (UINT)GetSurfaceBytes(textureData.format, textureData.width, textureData.height) : GetRowPitch(textureData.format, textureData.width);
+	header.mipMapCount = (UINT)textureData.mips.size();
+	header.reserved1[0] = mMagic;
+	header.reserved1[1] = mVersion;
+	header.reserved1[2] = (UINT)sourceHash;
+	header.reserved1[3] = (UINT)(sourceHash >> 32);
+	header.reserved1[4] = (UINT)content;
+	header.reserved1[5] = (UINT)stamp.size;
+	header.reserved1[6] = (UINT)(stamp.size >> 32);
+	header.reserved1[7] = (UINT)stamp.writeTime;
+	header.reserved1[8] = (UINT)(stamp.writeTime >> 32);
+	header.pixelFormat.size = sizeof(DdsPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+	header.caps = DDSCAPS_TEXTURE | (header.mipMapCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	DdsHeaderDx10 header10;
+	ZeroMemory(&header10, sizeof(header10));
+	header10.dxgiFormat = (UINT)textureData.format;
+	header10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	header10.arraySize = 1;
+
+	out.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)&header10, sizeof(header10));
+
+	// the rows are packed, whatever pitch they have in textureData
+	for (size_t m = 0; m < textureData.mips.size(); ++m)
+	{
+		const TextureMip& mip = textureData.mips[m];
+		UINT rowBytes = GetRowPitch(textureData.format, mip.width);
+		UINT rowCount = GetRowCount(textureData.format, mip.height);
+		for (UINT r = 0; r < rowCount; ++r)
+			out.write((const char*)(pixels + mip.offset + (size_t)r * mip.rowPitch), rowBytes);
+	}
+
+	return out.good();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+#include "MipGenerator.h"
+
+// TextureCache
+// singleton class, reads and writes cooked textures: a DDS file with the DX10 header
+// next to the source image holding the whole mip chain, block compressed by the
+// AssetCooker. usage:
+// if (!TextureCache::Instance()->LoadUnchanged("..\\Assets\\cube\\default.png", TEXTURE_COLOR, textureData)) {
+//     decode the image
+// }
+// in the cooker:
+// UINT64 hash = MeshCache::Instance()->HashFile("..\\Assets\\cube\\default.png");
+// if (!TextureCache::Instance()->IsValid("..\\Assets\\cube\\default.png", hash, TEXTURE_COLOR)) {
+//     decode and compress the image, then TextureCache::Instance()->Save(...)
+// }
+// The cooker's tag, the cache version, the source hash, the source size and last write
+// time and the TextureContent are stored in the reserved words of the DDS header, so
+// other DDS tools still read the files. The runtime checks the size and write time of
+// the source and never reads it, the cooker checks the content hash. Load maps the
+// file and leaves the mips in the mapping, the upload reads them from there without a copy.
+class TextureCache
+{
+public:
+	// Size and last write time of a source file, the time in the file time units of the platform
+	struct SourceStamp
+	{
+		UINT64 size;
+		UINT64 writeTime;
+	};
+
+	static TextureCache* Instance();
+
+	// Maps the cooked texture of sourceFile. Fails if there is no cache, the cache was
+	// written by another version or for another content, or the source hash does not match.
+	// sourceHash 0 means the source is not available and any valid cache is accepted.
+	bool Load(const std::string& sourceFile, UINT64 sourceHash, TextureContent content, TextureData& textureData);
+
+	// Load for the runtime, without reading the source: the size and last write time of
+	// sourceFile have to be the ones Save stored. A missing source accepts any valid cache.
+	bool LoadUnchanged(const std::string& sourceFile, TextureContent content, TextureData& textureData);
+
+	// Load without mapping the mips, only the header is read. The stamp of an existing
+	// source has to match too, so that LoadUnchanged accepts what the cooker keeps.
+	bool IsValid(const std::string& sourceFile, UINT64 sourceHash, TextureContent content);
+
+	// Writes the mips of textureData, RGBA8 or BCn, as the cooked texture of sourceFile
+	bool Save(const std::string& sourceFile, UINT64 sourceHash, TextureContent content, const TextureData& textureData);
+
+	// Name of the cache file for sourceFile
+	static std::string GetCacheFileName(const std::string& sourceFile);
+
+	// Stamp of sourceFile, false if it is not a file
+	static bool GetSourceStamp(const std::string& sourceFile, SourceStamp& stamp);
+
+	// 'DSTC', in the first reserved word of the DDS header
+	static const UINT mMagic = 0x43545344;
+	// bump this whenever the layout or the cooked data changes
+	static const UINT mVersion = 2;
+
+private:
+	TextureCache();
+	~TextureCache();
+
+	// Checks the headers of a mapped cache file and fills everything but the mapping,
+	// sourceHash and stamp are what the file was cooked from
+	bool ReadHeader(const BYTE* data, size_t size, TextureContent content, UINT64& sourceHash, SourceStamp& stamp, TextureData& textureData);
+
+	// Maps the cache file of sourceFile and reads its headers
+	bool Map(const std::string& sourceFile, TextureContent content, UINT64& sourceHash, SourceStamp& stamp, TextureData& textureData);
+
+	static TextureCache* mInstance;
+};
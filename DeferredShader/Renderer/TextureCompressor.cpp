@@ -0,0 +1,1453 @@
+#include "TextureCompressor.h"
+#include "Parallel.h"
+
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <atomic>
+
+namespace
+{
+	// Texels of a 4x4 block or of one subset of a partitioned block, channel major so
+	// the index search loads 4 or 8 texels of a channel at once. The lanes from count
+	// to 16 repeat the first texel and are left out of the error.
+	struct alignas(32) BlockTexels
+	{
+		float c[4][16];
+		BYTE position[16];	// in the block, row major
+		UINT count;
+	};
+
+	// Colors an index can select, the error counts the channels set in the channels mask
+	struct Palette
+	{
+		float color[16][4];
+		UINT size;
+		UINT channels;
+	};
+
+	// Picks the closest palette color for every texel and returns the summed squared error.
+	// Texels and palette colors are whole numbers, so the sum is exact in any order and
+	// all versions return the same.
+	typedef float (*FindIndicesFunc)(const BlockTexels& texels, const Palette& palette, BYTE indices[16]);
+
+	const UINT Bc1Refinements = 2;
+	const UINT Bc4Refinements = 2;
+
+	// BC7 settings per TextureCompressOptions::bc7Quality
+	struct Bc7Params
+	{
+		UINT partitions;	// two subset partitions tried, best estimate first
+		UINT rotations;		// mode 5 channel rotations tried
+		UINT refinements;	// least squares refits of the endpoints
+		bool pbitSearch;	// try every p-bit combination instead of the closest ones
+	};
+
+	const Bc7Params Bc7Qualities[] =
+	{
+		{ 0, 1, 1, false },
+		{ 8, 1, 2, false },
+		{ 32, 4, 3, true },
+	};
+
+	// Layout of the BC7 modes
+	struct Bc7ModeInfo
+	{
+		UINT subsets;
+		UINT partitionBits;
+		UINT rotationBits;
+		UINT indexSelectionBits;
+		UINT colorBits;
+		UINT alphaBits;			// 0: alpha is 255
+		UINT endpointPBits;		// one p-bit per endpoint
+		UINT sharedPBits;		// one p-bit per subset
+		UINT indexBits;
+		UINT index2Bits;		// separate alpha (or color) indices of modes 4 and 5
+	};
+
+	const Bc7ModeInfo Bc7Modes[8] =
+	{
+		{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+	};
+
+	// Two subset partitions, bit t is the subset of texel t
+	const USHORT Bc7Partitions2[64] =
+	{
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+
+	// Texel of the second subset whose index drops its top bit, the first subset's is texel 0
+	const BYTE Bc7Anchors2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15,
+		15, 15, 15, 15, 15, 15, 15, 15,
+		15,  2,  8,  2,  2,  8,  8, 15,
+		 2,  8,  2,  2,  8,  8,  2,  2,
+		15, 15,  6,  8,  2,  8, 15, 15,
+		 2,  8,  2,  2,  2, 15, 15,  6,
+		 6,  2,  6,  8, 15, 15,  2,  2,
+		15, 15, 15, 15, 15,  2,  2, 15,
+	};
+
+	const BYTE Bc7Weights2[4] = { 0, 21, 43, 64 };
+	const BYTE Bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const BYTE Bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	const BYTE* GetBc7Weights(UINT indexBits)
+	{
+		return indexBits == 2 ? Bc7Weights2 : indexBits == 3 ? Bc7Weights3 : Bc7Weights4;
+	}
+
+	UINT GetBc7Subset(UINT subsets, UINT partition, UINT texel)
+	{
+		return subsets == 2 ? (Bc7Partitions2[partition] >> texel) & 1 : 0;
+	}
+
+	bool IsBc7Anchor(UINT subsets, UINT partition, UINT texel)
+	{
+		return texel == 0 || (subsets == 2 && texel == Bc7Anchors2[partition]);
+	}
+
+	// Replicates the top bits of a precision bit code into 8 bits
+	UINT Expand(UINT code, UINT precision)
+	{
+		return precision >= 8 ? code : (code << (8 - precision)) | (code >> (2 * precision - 8));
+	}
+
+	UINT Interpolate(UINT e0, UINT e1, UINT weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	// Little endian bit stream of a 128 bit BC7 block
+	struct BitWriter
+	{
+		BYTE* block;
+		UINT bit;
+
+		void Write(UINT value, UINT count)
+		{
+			for (UINT i = 0; i < count; ++i, ++bit)
+			{
+				if ((value >> i) & 1)
+					block[bit >> 3] |= (BYTE)(1 << (bit & 7));
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const BYTE* block;
+		UINT bit;
+
+		UINT Read(UINT count)
+		{
+			UINT value = 0;
+			for (UINT i = 0; i < count; ++i, ++bit)
+				value |= ((block[bit >> 3] >> (bit & 7)) & 1u) << i;
+			return value;
+		}
+	};
+
+	void AddTexel(BlockTexels& texels, const BYTE rgba[4], UINT position)
+	{
+		for (UINT c = 0; c < 4; ++c)
+			texels.c[c][texels.count] = rgba[c];
+		texels.position[texels.count] = (BYTE)position;
+		texels.count++;
+	}
+
+	void PadTexels(BlockTexels& texels)
+	{
+		for (UINT t = texels.count; t < 16; ++t)
+		{
+			for (UINT c = 0; c < 4; ++c)
+				texels.c[c][t] = texels.c[c][0];
+			texels.position[t] = texels.position[0];
+		}
+	}
+
+	UINT GetChannelList(UINT channels, UINT list[4])
+	{
+		UINT count = 0;
+		for (UINT c = 0; c < 4; ++c)
+		{
+			if (channels & (1 << c))
+				list[count++] = c;
+		}
+		return count;
+	}
+
+	float FindIndicesScalar(const BlockTexels& texels, const Palette& palette, BYTE indices[16])
+	{
+		UINT channels[4];
+		UINT channelCount = GetChannelList(palette.channels, channels);
+
+		float error = 0.0f;
+		for (UINT t = 0; t < texels.count; ++t)
+		{
+			float bestError = FLT_MAX;
+			UINT best = 0;
+			for (UINT i = 0; i < palette.size; ++i)
+			{
+				float e = 0.0f;
+				for (UINT k = 0; k < channelCount; ++k)
+				{
+					float d = texels.c[channels[k]][t] - palette.color[i][channels[k]];
+					e += d * d;
+				}
+				if (e < bestError)
+				{
+					bestError = e;
+					best = i;
+				}
+			}
+			indices[t] = (BYTE)best;
+			error += bestError;
+		}
+		return error;
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET_SSE2
+	float FindIndicesSse2(const BlockTexels& texels, const Palette& palette, BYTE indices[16])
+	{
+		UINT channels[4];
+		UINT channelCount = GetChannelList(palette.channels, channels);
+
+		const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		const __m128 count = _mm_set1_ps((float)texels.count);
+		__m128 error = _mm_setzero_ps();
+		for (UINT t = 0; t < texels.count; t += 4)
+		{
+			__m128 x[4];
+			for (UINT k = 0; k < channelCount; ++k)
+				x[k] = _mm_load_ps(&texels.c[channels[k]][t]);
+
+			__m128 bestError = _mm_set1_ps(FLT_MAX);
+			__m128 best = _mm_setzero_ps();
+			for (UINT i = 0; i < palette.size; ++i)
+			{
+				__m128 e = _mm_setzero_ps();
+				for (UINT k = 0; k < channelCount; ++k)
+				{
+					__m128 d = _mm_sub_ps(x[k], _mm_set1_ps(palette.color[i][channels[k]]));
+					e = _mm_add_ps(e, _mm_mul_ps(d, d));
+				}
+				__m128 less = _mm_cmplt_ps(e, bestError);
+				bestError = _mm_min_ps(e, bestError);
+				best = _mm_or_ps(_mm_and_ps(less, _mm_set1_ps((float)i)), _mm_andnot_ps(less, best));
+			}
+
+			alignas(16) int lanes[4];
+			_mm_store_si128((__m128i*)lanes, _mm_cvttps_epi32(best));
+			for (UINT l = 0; l < 4 && t + l < texels.count; ++l)
+				indices[t + l] = (BYTE)lanes[l];
+
+			__m128 valid = _mm_cmplt_ps(_mm_add_ps(_mm_set1_ps((float)t), laneOffsets), count);
+			error = _mm_add_ps(error, _mm_and_ps(valid, bestError));
+		}
+
+		alignas(16) float sums[4];
+		_mm_store_ps(sums, error);
+		return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	}
+
+	SIMD_TARGET_AVX2
+	float FindIndicesAvx2(const BlockTexels& texels, const Palette& palette, BYTE indices[16])
+	{
+		UINT channels[4];
+		UINT channelCount = GetChannelList(palette.channels, channels);
+
+		const __m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const __m256 count = _mm256_set1_ps((float)texels.count);
+		__m256 error = _mm256_setzero_ps();
+		for (UINT t = 0; t < texels.count; t += 8)
+		{
+			__m256 x[4];
+			for (UINT k = 0; k < channelCount; ++k)
+				x[k] = _mm256_load_ps(&texels.c[channels[k]][t]);
+
+			__m256 bestError = _mm256_set1_ps(FLT_MAX);
+			__m256 best = _mm256_setzero_ps();
+			for (UINT i = 0; i < palette.size; ++i)
+			{
+				__m256 e = _mm256_setzero_ps();
+				for (UINT k = 0; k < channelCount; ++k)
+				{
+					__m256 d = _mm256_sub_ps(x[k], _mm256_set1_ps(palette.color[i][channels[k]]));
+					e = _mm256_add_ps(e, _mm256_mul_ps(d, d));
+				}
+				__m256 less = _mm256_cmp_ps(e, bestError, _CMP_LT_OQ);
+				bestError = _mm256_min_ps(e, bestError);
+				best = _mm256_blendv_ps(best, _mm256_set1_ps((float)i), less);
+			}
+
+			alignas(32) int lanes[8];
+			_mm256_store_si256((__m256i*)lanes, _mm256_cvttps_epi32(best));
+			for (UINT l = 0; l < 8 && t + l < texels.count; ++l)
+				indices[t + l] = (BYTE)lanes[l];
+
+			__m256 valid = _mm256_cmp_ps(_mm256_add_ps(_mm256_set1_ps((float)t), laneOffsets), count, _CMP_LT_OQ);
+			error = _mm256_add_ps(error, _mm256_and_ps(valid, bestError));
+		}
+
+		alignas(32) float sums[8];
+		_mm256_store_ps(sums, error);
+		return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+	}
+#endif
+
+	FindIndicesFunc GetFindIndices(SimdLevel level)
+	{
+#ifdef SIMD_X86
+		if (level == SIMD_AVX2)
+			return FindIndicesAvx2;
+		if (level == SIMD_SSE2)
+			return FindIndicesSse2;
+#endif
+		return FindIndicesScalar;
+	}
+
+	// Eigenvector of the largest eigenvalue of a symmetric 4x4 scatter matrix by power
+	// iteration, returns the eigenvalue. The axis is zero for a zero matrix.
+	float GetPrincipalAxis(const float scatter[4][4], UINT iterations, float axis[4])
+	{
+		// start from the channel with the largest spread
+		UINT largest = 0;
+		for (UINT i = 1; i < 4; ++i)
+		{
+			if (scatter[i][i] > scatter[largest][largest])
+				largest = i;
+		}
+		for (UINT c = 0; c < 4; ++c)
+			axis[c] = scatter[largest][c];
+
+		for (UINT iteration = 0; iteration < iterations; ++iteration)
+		{
+			float v[4];
+			float largestComponent = 0.0f;
+			for (UINT i = 0; i < 4; ++i)
+			{
+				v[i] = scatter[i][0] * axis[0] + scatter[i][1] * axis[1] + scatter[i][2] * axis[2] + scatter[i][3] * axis[3];
+				largestComponent = std::max(largestComponent, fabsf(v[i]));
+			}
+			if (largestComponent <= 0.0f)
+				break;
+			for (UINT i = 0; i < 4; ++i)
+				axis[i] = v[i] / largestComponent;
+		}
+
+		float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+		if (length <= 0.0f)
+			return 0.0f;
+
+		float lambda = 0.0f;
+		for (UINT i = 0; i < 4; ++i)
+			axis[i] /= length;
+		for (UINT i = 0; i < 4; ++i)
+		{
+			for (UINT j = 0; j < 4; ++j)
+				lambda += axis[i] * scatter[i][j] * axis[j];
+		}
+		return lambda;
+	}
+
+	// Per texel sums for the scatter matrix: the channels, then the products of channels i <= j
+	const UINT MomentCount = 14;
+
+	void AddMoments(const float x[4], float moments[MomentCount])
+	{
+		UINT k = 4;
+		for (UINT i = 0; i < 4; ++i)
+		{
+			moments[i] += x[i];
+			for (UINT j = i; j < 4; ++j)
+				moments[k++] += x[i] * x[j];
+		}
+	}
+
+	// Scatter matrix about the mean of count texels from their summed moments, only the channels of the mask
+	void GetScatter(const float moments[MomentCount], UINT count, UINT channels, float mean[4], float scatter[4][4])
+	{
+		for (UINT i = 0; i < 4; ++i)
+			mean[i] = channels & (1 << i) ? moments[i] / count : 0.0f;
+
+		UINT k = 4;
+		for (UINT i = 0; i < 4; ++i)
+		{
+			for (UINT j = i; j < 4; ++j, ++k)
+			{
+				bool used = (channels & (1 << i)) && (channels & (1 << j));
+				scatter[i][j] = scatter[j][i] = used ? moments[k] - moments[i] * mean[j] : 0.0f;
+			}
+		}
+	}
+
+	// Summed squared distance of the texels of every two subset partition to the principal
+	// axes of their subsets. The moments of the texels are summed once, the subset sums of
+	// a partition only add up the texels of one subset.
+	void EstimatePartitions(const BYTE rgba[16][4], UINT channels, float estimates[64])
+	{
+		float texelMoments[16][MomentCount] = {};
+		float totalMoments[MomentCount] = {};
+		for (UINT t = 0; t < 16; ++t)
+		{
+			float x[4] = { (float)rgba[t][0], (float)rgba[t][1], (float)rgba[t][2], (float)rgba[t][3] };
+			AddMoments(x, texelMoments[t]);
+			for (UINT k = 0; k < MomentCount; ++k)
+				totalMoments[k] += texelMoments[t][k];
+		}
+
+		for (UINT p = 0; p < 64; ++p)
+		{
+			float moments[2][MomentCount] = {};
+			UINT counts[2] = { 0, 0 };
+			for (UINT t = 0; t < 16; ++t)
+			{
+				if ((Bc7Partitions2[p] >> t) & 1)
+				{
+					for (UINT k = 0; k < MomentCount; ++k)
+						moments[1][k] += texelMoments[t][k];
+					counts[1]++;
+				}
+			}
+			for (UINT k = 0; k < MomentCount; ++k)
+				moments[0][k] = totalMoments[k] - moments[1][k];
+			counts[0] = 16 - counts[1];
+
+			estimates[p] = 0.0f;
+			for (UINT s = 0; s < 2; ++s)
+			{
+				float mean[4], scatter[4][4], axis[4];
+				GetScatter(moments[s], counts[s], channels, mean, scatter);
+				float trace = scatter[0][0] + scatter[1][1] + scatter[2][2] + scatter[3][3];
+				estimates[p] += std::max(trace - GetPrincipalAxis(scatter, 4, axis), 0.0f);
+			}
+		}
+	}
+
+	// Endpoints at the extreme texels along the principal axis
+	void GetEndpointRange(const BlockTexels& texels, UINT channels, float endpoints[2][4])
+	{
+		float moments[MomentCount] = {};
+		for (UINT t = 0; t < texels.count; ++t)
+		{
+			float x[4] = { texels.c[0][t], texels.c[1][t], texels.c[2][t], texels.c[3][t] };
+			AddMoments(x, moments);
+		}
+		float mean[4], scatter[4][4], axis[4];
+		GetScatter(moments, texels.count, channels, mean, scatter);
+		GetPrincipalAxis(scatter, 8, axis);
+
+		float low = FLT_MAX, high = -FLT_MAX;
+		for (UINT t = 0; t < texels.count; ++t)
+		{
+			float projection = 0.0f;
+			for (UINT c = 0; c < 4; ++c)
+				projection += (texels.c[c][t] - mean[c]) * axis[c];
+			low = std::min(low, projection);
+			high = std::max(high, projection);
+		}
+
+		for (UINT c = 0; c < 4; ++c)
+		{
+			endpoints[0][c] = std::min(std::max(mean[c] + low * axis[c], 0.0f), 255.0f);
+			endpoints[1][c] = std::min(std::max(mean[c] + high * axis[c], 0.0f), 255.0f);
+		}
+	}
+
+	// Least squares endpoints for texels placed at weights (0 at endpoint 0, 1 at endpoint 1)
+	// between them, texels with a negative weight are left out. False if the fit is degenerate.
+	bool SolveEndpoints(const BlockTexels& texels, UINT channels, const float weights[16], float endpoints[2][4])
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float rhs0[4] = {}, rhs1[4] = {};
+		for (UINT t = 0; t < texels.count; ++t)
+		{
+			float w = weights[t];
+			if (w < 0.0f)
+				continue;
+			float u = 1.0f - w;
+			a += u * u;
+			b += u * w;
+			c += w * w;
+			for (UINT ch = 0; ch < 4; ++ch)
+			{
+				rhs0[ch] += u * texels.c[ch][t];
+				rhs1[ch] += w * texels.c[ch][t];
+			}
+		}
+
+		float determinant = a * c - b * b;
+		if (fabsf(determinant) < 1e-4f)
+			return false;
+
+		for (UINT ch = 0; ch < 4; ++ch)
+		{
+			if (channels & (1 << ch))
+			{
+				endpoints[0][ch] = std::min(std::max((c * rhs0[ch] - b * rhs1[ch]) / determinant, 0.0f), 255.0f);
+				endpoints[1][ch] = std::min(std::max((a * rhs1[ch] - b * rhs0[ch]) / determinant, 0.0f), 255.0f);
+			}
+		}
+		return true;
+	}
+
+	// BC1
+
+	UINT Pack565(const float color[4])
+	{
+		UINT r = (UINT)std::min(std::max(color[0] * 31.0f / 255.0f + 0.5f, 0.0f), 31.0f);
+		UINT g = (UINT)std::min(std::max(color[1] * 63.0f / 255.0f + 0.5f, 0.0f), 63.0f);
+		UINT b = (UINT)std::min(std::max(color[2] * 31.0f / 255.0f + 0.5f, 0.0f), 31.0f);
+		return (r << 11) | (g << 5) | b;
+	}
+
+	void Unpack565(UINT color, BYTE rgba[4])
+	{
+		rgba[0] = (BYTE)Expand(color >> 11, 5);
+		rgba[1] = (BYTE)Expand((color >> 5) & 63, 6);
+		rgba[2] = (BYTE)Expand(color & 31, 5);
+		rgba[3] = 255;
+	}
+
+	// The four colors of a BC1 color block: two blends for c0 > c1 (BC3 always), otherwise
+	// their average and transparent black
+	void GetBc1Colors(UINT c0, UINT c1, bool fourColor, BYTE colors[4][4])
+	{
+		Unpack565(c0, colors[0]);
+		Unpack565(c1, colors[1]);
+		for (UINT c = 0; c < 3; ++c)
+		{
+			UINT a = colors[0][c], b = colors[1][c];
+			colors[2][c] = (BYTE)(fourColor ? (2 * a + b + 1) / 3 : (a + b + 1) / 2);
+			colors[3][c] = (BYTE)(fourColor ? (a + 2 * b + 1) / 3 : 0);
+		}
+		colors[2][3] = 255;
+		colors[3][3] = fourColor ? 255 : 0;
+	}
+
+	void EncodeBc1Block(const BYTE rgba[16][4], BYTE* block, bool bc3, const BYTE singleColor5[256][2], const BYTE singleColor6[256][2],
+		FindIndicesFunc findIndices)
+	{
+		// BC1 makes texels with alpha below 128 transparent, index 3 of the three color mode
+		BlockTexels texels;
+		texels.count = 0;
+		for (UINT t = 0; t < 16; ++t)
+		{
+			if (bc3 || rgba[t][3] >= 128)
+				AddTexel(texels, rgba[t], t);
+		}
+		bool transparent = texels.count < 16;
+
+		UINT bestC0 = 0, bestC1 = 0;
+		bool bestFourColor = false;
+		BYTE bestIndices[16] = {};
+		float bestError = FLT_MAX;
+
+		auto tryEndpoints = [&](UINT c0, UINT c1)
+		{
+			// the endpoint order picks the mode, four colors need c0 > c1
+			if (transparent ? c0 > c1 : c0 < c1)
+				std::swap(c0, c1);
+			bool fourColor = bc3 || c0 > c1;
+
+			BYTE colors[4][4];
+			GetBc1Colors(c0, c1, fourColor, colors);
+			Palette palette;
+			for (UINT i = 0; i < 4; ++i)
+			{
+				for (UINT c = 0; c < 4; ++c)
+					palette.color[i][c] = colors[i][c];
+			}
+			palette.size = fourColor ? 4 : 3;
+			palette.channels = 0x7;
+
+			BYTE indices[16];
+			float error = findIndices(texels, palette, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestC0 = c0;
+				bestC1 = c1;
+				bestFourColor = fourColor;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		};
+
+		if (texels.count > 0)
+		{
+			PadTexels(texels);
+
+			bool singleColor = !transparent;
+			for (UINT t = 1; t < texels.count && singleColor; ++t)
+			{
+				for (UINT c = 0; c < 3; ++c)
+					singleColor = singleColor && texels.c[c][t] == texels.c[c][0];
+			}
+			if (singleColor)
+			{
+				UINT r = (UINT)texels.c[0][0], g = (UINT)texels.c[1][0], b = (UINT)texels.c[2][0];
+				tryEndpoints((singleColor5[r][0] << 11) | (singleColor6[g][0] << 5) | singleColor5[b][0],
+					(singleColor5[r][1] << 11) | (singleColor6[g][1] << 5) | singleColor5[b][1]);
+			}
+
+			float endpoints[2][4];
+			GetEndpointRange(texels, 0x7, endpoints);
+			for (UINT r = 0; ; ++r)
+			{
+				tryEndpoints(Pack565(endpoints[0]), Pack565(endpoints[1]));
+				if (r == Bc1Refinements || bestError == 0.0f)
+					break;
+
+				const float fourColorWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+				const float threeColorWeights[4] = { 0.0f, 1.0f, 0.5f, -1.0f };
+				float weights[16];
+				for (UINT t = 0; t < texels.count; ++t)
+					weights[t] = bestFourColor ? fourColorWeights[bestIndices[t]] : threeColorWeights[bestIndices[t]];
+				if (!SolveEndpoints(texels, 0x7, weights, endpoints))
+					break;
+			}
+		}
+
+		BYTE indices[16];
+		memset(indices, 3, sizeof(indices));
+		for (UINT t = 0; t < texels.count; ++t)
+			indices[texels.position[t]] = bestIndices[t];
+
+		UINT bits = 0;
+		for (UINT t = 0; t < 16; ++t)
+			bits |= (UINT)indices[t] << (2 * t);
+
+		block[0] = (BYTE)bestC0;
+		block[1] = (BYTE)(bestC0 >> 8);
+		block[2] = (BYTE)bestC1;
+		block[3] = (BYTE)(bestC1 >> 8);
+		for (UINT i = 0; i < 4; ++i)
+			block[4 + i] = (BYTE)(bits >> (8 * i));
+	}
+
+	void DecodeBc1Block(const BYTE* block, bool bc3, BYTE rgba[16][4])
+	{
+		UINT c0 = block[0] | (block[1] << 8);
+		UINT c1 = block[2] | (block[3] << 8);
+		BYTE colors[4][4];
+		GetBc1Colors(c0, c1, bc3 || c0 > c1, colors);
+
+		UINT bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((UINT)block[7] << 24);
+		for (UINT t = 0; t < 16; ++t)
+			memcpy(rgba[t], colors[(bits >> (2 * t)) & 3], 4);
+	}
+
+	// BC4
+
+	// Eight values: the endpoints and six blends for e0 > e1, otherwise the endpoints,
+	// four blends, 0 and 255
+	void GetBc4Values(UINT e0, UINT e1, BYTE values[8])
+	{
+		values[0] = (BYTE)e0;
+		values[1] = (BYTE)e1;
+		if (e0 > e1)
+		{
+			for (UINT i = 2; i < 8; ++i)
+				values[i] = (BYTE)(((8 - i) * e0 + (i - 1) * e1 + 3) / 7);
+		}
+		else
+		{
+			for (UINT i = 2; i < 6; ++i)
+				values[i] = (BYTE)(((6 - i) * e0 + (i - 1) * e1 + 2) / 5);
+			values[6] = 0;
+			values[7] = 255;
+		}
+	}
+
+	void EncodeBc4Block(const BYTE values[16], BYTE* block, FindIndicesFunc findIndices)
+	{
+		BlockTexels texels;
+		texels.count = 0;
+		UINT low = 255, high = 0;
+		for (UINT t = 0; t < 16; ++t)
+		{
+			BYTE texel[4] = { values[t], 0, 0, 0 };
+			AddTexel(texels, texel, t);
+			low = std::min(low, (UINT)values[t]);
+			high = std::max(high, (UINT)values[t]);
+		}
+
+		UINT bestE0 = high, bestE1 = low;
+		BYTE bestIndices[16] = {};
+		float bestError = low == high ? 0.0f : FLT_MAX;
+
+		auto tryEndpoints = [&](float value0, float value1, bool sixValues, BYTE indices[16]) -> float
+		{
+			UINT e0 = (UINT)std::min(std::max(value0 + 0.5f, 0.0f), 255.0f);
+			UINT e1 = (UINT)std::min(std::max(value1 + 0.5f, 0.0f), 255.0f);
+			if (sixValues ? e0 > e1 : e0 < e1)
+				std::swap(e0, e1);
+			if (!sixValues && e0 == e1)
+				e0 < 255 ? e0++ : e1--;
+
+			BYTE palette8[8];
+			GetBc4Values(e0, e1, palette8);
+			Palette palette;
+			for (UINT i = 0; i < 8; ++i)
+			{
+				palette.color[i][0] = palette8[i];
+				palette.color[i][1] = palette.color[i][2] = palette.color[i][3] = 0.0f;
+			}
+			palette.size = 8;
+			palette.channels = 0x1;
+
+			float error = findIndices(texels, palette, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestE0 = e0;
+				bestE1 = e1;
+				memcpy(bestIndices, indices, 16);
+			}
+			return error;
+		};
+
+		for (UINT mode = 0; mode < 2 && bestError > 0.0f; ++mode)
+		{
+			float endpoints[2][4] = {};
+			bool sixValues = mode == 1;
+			if (!sixValues)
+			{
+				endpoints[0][0] = (float)high;
+				endpoints[1][0] = (float)low;
+			}
+			else
+			{
+				// six values between the inner extremes and exact 0 and 255, for blocks that reach them
+				if (low > 0 && high < 255)
+					break;
+				UINT innerLow = 255, innerHigh = 0;
+				for (UINT t = 0; t < 16; ++t)
+				{
+					if (values[t] > 0 && values[t] < 255)
+					{
+						innerLow = std::min(innerLow, (UINT)values[t]);
+						innerHigh = std::max(innerHigh, (UINT)values[t]);
+					}
+				}
+				endpoints[0][0] = innerLow <= innerHigh ? (float)innerLow : 0.0f;
+				endpoints[1][0] = innerLow <= innerHigh ? (float)innerHigh : 255.0f;
+			}
+
+			for (UINT r = 0; ; ++r)
+			{
+				BYTE indices[16];
+				tryEndpoints(endpoints[0][0], endpoints[1][0], sixValues, indices);
+				if (r == Bc4Refinements)
+					break;
+
+				float weights[16];
+				for (UINT t = 0; t < 16; ++t)
+				{
+					UINT i = indices[t];
+					weights[t] = i < 2 ? (float)i : sixValues ? (i < 6 ? (i - 1) / 5.0f : -1.0f) : (i - 1) / 7.0f;
+				}
+				if (!SolveEndpoints(texels, 0x1, weights, endpoints))
+					break;
+			}
+		}
+
+		UINT64 bits = 0;
+		for (UINT t = 0; t < 16; ++t)
+			bits |= (UINT64)bestIndices[t] << (3 * t);
+
+		block[0] = (BYTE)bestE0;
+		block[1] = (BYTE)bestE1;
+		for (UINT i = 0; i < 6; ++i)
+			block[2 + i] = (BYTE)(bits >> (8 * i));
+	}
+
+	void DecodeBc4Block(const BYTE* block, BYTE values[16])
+	{
+		BYTE palette[8];
+		GetBc4Values(block[0], block[1], palette);
+
+		UINT64 bits = 0;
+		for (UINT i = 0; i < 6; ++i)
+			bits |= (UINT64)block[2 + i] << (8 * i);
+		for (UINT t = 0; t < 16; ++t)
+			values[t] = palette[(bits >> (3 * t)) & 7];
+	}
+
+	// BC7
+
+	enum PBitMode
+	{
+		PBITS_NONE,
+		PBITS_ENDPOINT,
+		PBITS_SHARED
+	};
+
+	// Quantizes value to a bits bit code plus the p-bit pbit (-1 for none), returns the code
+	// without the p-bit and the 8 bit value the decoder expands it to in decoded
+	UINT QuantizeEndpoint(float value, UINT bits, int pbit, BYTE& decoded)
+	{
+		UINT precision = bits + (pbit >= 0 ? 1 : 0);
+		int maxCode = (1 << precision) - 1;
+		int code = std::min(std::max((int)(value * (maxCode / 255.0f) + 0.5f), 0), maxCode);
+		if (pbit >= 0 && (code & 1) != pbit)
+		{
+			// the closest code that ends in the p-bit
+			int down = code - 1, up = code + 1;
+			if (down < 0)
+				code = up;
+			else if (up > maxCode)
+				code = down;
+			else
+				code = fabsf(Expand(up, precision) - value) < fabsf(Expand(down, precision) - value) ? up : down;
+		}
+		decoded = (BYTE)Expand(code, precision);
+		return pbit >= 0 ? code >> 1 : code;
+	}
+
+	// Quantizes both endpoints in the channels of the mask, the other channels decode to 255.
+	// errors receives the squared quantization error of each endpoint.
+	void QuantizeEndpoints(const float endpoints[2][4], UINT channels, UINT colorBits, UINT alphaBits, const int pbits[2],
+		BYTE codes[2][4], BYTE decoded[2][4], float errors[2])
+	{
+		for (UINT e = 0; e < 2; ++e)
+		{
+			errors[e] = 0.0f;
+			for (UINT c = 0; c < 4; ++c)
+			{
+				if (channels & (1 << c))
+				{
+					codes[e][c] = (BYTE)QuantizeEndpoint(endpoints[e][c], c < 3 ? colorBits : alphaBits, pbits[e], decoded[e][c]);
+					float d = decoded[e][c] - endpoints[e][c];
+					errors[e] += d * d;
+				}
+				else
+				{
+					codes[e][c] = 0;
+					decoded[e][c] = 255;
+				}
+			}
+		}
+	}
+
+	struct SubsetFit
+	{
+		BYTE codes[2][4];	// quantized endpoints without the p-bits
+		BYTE pbits[2];
+		BYTE indices[16];	// by texel of the subset
+		float error;
+	};
+
+	// Fits the endpoints of one subset and picks its indices
+	void FitSubset(const BlockTexels& texels, UINT channels, UINT colorBits, UINT alphaBits, PBitMode pbitMode, UINT indexBits,
+		const Bc7Params& params, FindIndicesFunc findIndices, SubsetFit& fit)
+	{
+		const BYTE* weights = GetBc7Weights(indexBits);
+		fit.error = FLT_MAX;
+
+		// decoded endpoints whose indices were searched, refits often land on them again
+		const UINT MaxTried = 16;
+		BYTE tried[MaxTried][2][4];
+		UINT triedCount = 0;
+
+		float endpoints[2][4];
+		GetEndpointRange(texels, channels, endpoints);
+		for (UINT r = 0; ; ++r)
+		{
+			// both endpoints quantized with either p-bit, the combinations pick from these
+			const int none[2] = { -1, -1 }, zeros[2] = { 0, 0 }, ones[2] = { 1, 1 };
+			BYTE codes[2][2][4], decoded[2][2][4];	// [p-bit][endpoint][channel]
+			float errors[2][2];
+			QuantizeEndpoints(endpoints, channels, colorBits, alphaBits, pbitMode == PBITS_NONE ? none : zeros, codes[0], decoded[0], errors[0]);
+			if (pbitMode != PBITS_NONE)
+				QuantizeEndpoints(endpoints, channels, colorBits, alphaBits, ones, codes[1], decoded[1], errors[1]);
+
+			UINT combinations[4][2] = { { 0, 0 } };
+			UINT combinationCount = 1;
+			if (pbitMode != PBITS_NONE && params.pbitSearch)
+			{
+				const UINT all[4][2] = { { 0, 0 }, { 1, 1 }, { 0, 1 }, { 1, 0 } };
+				memcpy(combinations, all, sizeof(all));
+				combinationCount = pbitMode == PBITS_SHARED ? 2 : 4;
+			}
+			else if (pbitMode == PBITS_SHARED)
+			{
+				combinations[0][0] = combinations[0][1] = errors[0][0] + errors[0][1] <= errors[1][0] + errors[1][1] ? 0 : 1;
+			}
+			else if (pbitMode == PBITS_ENDPOINT)
+			{
+				// the p-bits closest to the endpoints
+				combinations[0][0] = errors[0][0] <= errors[1][0] ? 0 : 1;
+				combinations[0][1] = errors[0][1] <= errors[1][1] ? 0 : 1;
+			}
+
+			bool searched = false;
+			for (UINT i = 0; i < combinationCount; ++i)
+			{
+				UINT p0 = combinations[i][0], p1 = combinations[i][1];
+				BYTE candidate[2][4];
+				memcpy(candidate[0], decoded[p0][0], 4);
+				memcpy(candidate[1], decoded[p1][1], 4);
+
+				bool known = false;
+				for (UINT k = 0; k < triedCount && !known; ++k)
+					known = memcmp(tried[k], candidate, sizeof(candidate)) == 0;
+				if (known)
+					continue;
+				if (triedCount < MaxTried)
+					memcpy(tried[triedCount++], candidate, sizeof(candidate));
+				searched = true;
+
+				Palette palette;
+				palette.size = 1 << indexBits;
+				palette.channels = channels;
+				for (UINT p = 0; p < palette.size; ++p)
+				{
+					for (UINT c = 0; c < 4; ++c)
+						palette.color[p][c] = (float)Interpolate(candidate[0][c], candidate[1][c], weights[p]);
+				}
+
+				BYTE indices[16];
+				float error = findIndices(texels, palette, indices);
+				if (error < fit.error)
+				{
+					fit.error = error;
+					memcpy(fit.codes[0], codes[p0][0], 4);
+					memcpy(fit.codes[1], codes[p1][1], 4);
+					fit.pbits[0] = (BYTE)(pbitMode != PBITS_NONE ? p0 : 0);
+					fit.pbits[1] = (BYTE)(pbitMode != PBITS_NONE ? p1 : 0);
+					memcpy(fit.indices, indices, sizeof(indices));
+				}
+			}
+
+			if (!searched || r == params.refinements || fit.error == 0.0f)
+				break;
+
+			float texelWeights[16];
+			for (UINT t = 0; t < texels.count; ++t)
+				texelWeights[t] = weights[fit.indices[t]] / 64.0f;
+			if (!SolveEndpoints(texels, channels, texelWeights, endpoints))
+				break;
+		}
+	}
+
+	// The index of the anchor texel is stored without its top bit, swaps the endpoints
+	// and mirrors the indices if it is set. The palette is symmetric, the error stays.
+	void FixAnchor(SubsetFit& fit, UINT anchor, UINT indexBits)
+	{
+		UINT maxIndex = (1 << indexBits) - 1;
+		if ((fit.indices[anchor] >> (indexBits - 1)) == 0)
+			return;
+
+		for (UINT c = 0; c < 4; ++c)
+			std::swap(fit.codes[0][c], fit.codes[1][c]);
+		std::swap(fit.pbits[0], fit.pbits[1]);
+		for (UINT t = 0; t < 16; ++t)
+			fit.indices[t] = (BYTE)(maxIndex - fit.indices[t]);
+	}
+
+	struct Bc7Block
+	{
+		UINT mode;
+		UINT partition;
+		UINT rotation;
+		BYTE codes[2][2][4];		// [subset][endpoint][channel] without the p-bits
+		BYTE pbits[2][2];
+		BYTE indices[16];			// by block position
+		BYTE alphaIndices[16];		// mode 5
+		float error;
+	};
+
+	void BuildSubsetTexels(const BYTE rgba[16][4], UINT subsets, UINT partition, UINT subset, BlockTexels& texels)
+	{
+		texels.count = 0;
+		for (UINT t = 0; t < 16; ++t)
+		{
+			if (GetBc7Subset(subsets, partition, t) == subset)
+				AddTexel(texels, rgba[t], t);
+		}
+		PadTexels(texels);
+	}
+
+	// Modes 1, 3, 6 and 7: RGB or RGBA endpoints per subset with one set of indices
+	void EncodeBc7Subsets(const BYTE rgba[16][4], UINT mode, UINT partition, const Bc7Params& params, FindIndicesFunc findIndices, Bc7Block& best)
+	{
+		const Bc7ModeInfo& info = Bc7Modes[mode];
+		UINT channels = info.alphaBits > 0 ? 0xf : 0x7;
+		PBitMode pbitMode = info.endpointPBits ? PBITS_ENDPOINT : info.sharedPBits ? PBITS_SHARED : PBITS_NONE;
+
+		Bc7Block block;
+		block.mode = mode;
+		block.partition = partition;
+		block.rotation = 0;
+		block.error = 0.0f;
+		for (UINT s = 0; s < info.subsets; ++s)
+		{
+			BlockTexels texels;
+			BuildSubsetTexels(rgba, info.subsets, partition, s, texels);
+
+			SubsetFit fit;
+			FitSubset(texels, channels, info.colorBits, info.alphaBits, pbitMode, info.indexBits, params, findIndices, fit);
+
+			UINT anchor = 0;
+			while (texels.position[anchor] != (s == 0 ? 0 : Bc7Anchors2[partition]))
+				anchor++;
+			FixAnchor(fit, anchor, info.indexBits);
+
+			memcpy(block.codes[s], fit.codes, sizeof(fit.codes));
+			block.pbits[s][0] = fit.pbits[0];
+			block.pbits[s][1] = fit.pbits[1];
+			for (UINT t = 0; t < texels.count; ++t)
+				block.indices[texels.position[t]] = fit.indices[t];
+
+			block.error += fit.error;
+			if (block.error >= best.error)
+				return;
+		}
+		best = block;
+	}
+
+	// Mode 5: RGB and alpha endpoints with their own indices, rotation swaps alpha with a color channel
+	void EncodeBc7Mode5(const BYTE rgba[16][4], UINT rotation, const Bc7Params& params, FindIndicesFunc findIndices, Bc7Block& best)
+	{
+		BlockTexels texels;
+		texels.count = 0;
+		for (UINT t = 0; t < 16; ++t)
+		{
+			BYTE texel[4] = { rgba[t][0], rgba[t][1], rgba[t][2], rgba[t][3] };
+			if (rotation > 0)
+				std::swap(texel[3], texel[rotation - 1]);
+			AddTexel(texels, texel, t);
+		}
+
+		SubsetFit color, alpha;
+		FitSubset(texels, 0x7, 7, 8, PBITS_NONE, 2, params, findIndices, color);
+		if (color.error >= best.error)
+			return;
+		FitSubset(texels, 0x8, 7, 8, PBITS_NONE, 2, params, findIndices, alpha);
+		if (color.error + alpha.error >= best.error)
+			return;
+		FixAnchor(color, 0, 2);
+		FixAnchor(alpha, 0, 2);
+
+		best.mode = 5;
+		best.partition = 0;
+		best.rotation = rotation;
+		for (UINT e = 0; e < 2; ++e)
+		{
+			for (UINT c = 0; c < 3; ++c)
+				best.codes[0][e][c] = color.codes[e][c];
+			best.codes[0][e][3] = alpha.codes[e][3];
+			best.pbits[0][e] = 0;
+		}
+		memcpy(best.indices, color.indices, 16);
+		memcpy(best.alphaIndices, alpha.indices, 16);
+		best.error = color.error + alpha.error;
+	}
+
+	void WriteBc7Block(const Bc7Block& bc7, BYTE* block)
+	{
+		const Bc7ModeInfo& info = Bc7Modes[bc7.mode];
+		memset(block, 0, 16);
+
+		BitWriter writer = { block, 0 };
+		writer.Write(1u << bc7.mode, bc7.mode + 1);
+		writer.Write(bc7.partition, info.partitionBits);
+		writer.Write(bc7.rotation, info.rotationBits);
+		writer.Write(0, info.indexSelectionBits);
+		for (UINT c = 0; c < 4; ++c)
+		{
+			UINT bits = c < 3 ? info.colorBits : info.alphaBits;
+			for (UINT s = 0; s < info.subsets; ++s)
+			{
+				writer.Write(bc7.codes[s][0][c], bits);
+				writer.Write(bc7.codes[s][1][c], bits);
+			}
+		}
+		for (UINT s = 0; s < info.subsets; ++s)
+		{
+			if (info.endpointPBits)
+			{
+				writer.Write(bc7.pbits[s][0], 1);
+				writer.Write(bc7.pbits[s][1], 1);
+			}
+			else if (info.sharedPBits)
+			{
+				writer.Write(bc7.pbits[s][0], 1);
+			}
+		}
+		for (UINT t = 0; t < 16; ++t)
+			writer.Write(bc7.indices[t], info.indexBits - (IsBc7Anchor(info.subsets, bc7.partition, t) ? 1 : 0));
+		if (info.index2Bits > 0)
+		{
+			for (UINT t = 0; t < 16; ++t)
+				writer.Write(bc7.alphaIndices[t], info.index2Bits - (t == 0 ? 1 : 0));
+		}
+	}
+
+	void EncodeBc7Block(const BYTE rgba[16][4], BYTE* block, const Bc7Params& params, FindIndicesFunc findIndices)
+	{
+		bool opaque = true;
+		for (UINT t = 0; t < 16; ++t)
+			opaque = opaque && rgba[t][3] == 255;
+
+		Bc7Block best;
+		best.error = FLT_MAX;
+		EncodeBc7Subsets(rgba, 6, 0, params, findIndices, best);
+
+		if (params.partitions > 0 && best.error > 0.0f)
+		{
+			// the two subset modes on the partitions whose subsets lie closest to a line
+			float estimates[64];
+			EstimatePartitions(rgba, opaque ? 0x7 : 0xf, estimates);
+			std::pair<float, UINT> ranking[64];
+			for (UINT p = 0; p < 64; ++p)
+				ranking[p] = std::make_pair(estimates[p], p);
+			UINT partitions = std::min(params.partitions, 64u);
+			std::partial_sort(ranking, ranking + partitions, ranking + 64);
+
+			for (UINT i = 0; i < partitions; ++i)
+			{
+				if (opaque)
+				{
+					EncodeBc7Subsets(rgba, 1, ranking[i].second, params, findIndices, best);
+					EncodeBc7Subsets(rgba, 3, ranking[i].second, params, findIndices, best);
+				}
+				else
+				{
+					EncodeBc7Subsets(rgba, 7, ranking[i].second, params, findIndices, best);
+				}
+			}
+
+			if (!opaque)
+			{
+				for (UINT rotation = 0; rotation < params.rotations; ++rotation)
+					EncodeBc7Mode5(rgba, rotation, params, findIndices, best);
+			}
+		}
+
+		WriteBc7Block(best, block);
+	}
+
+	bool DecodeBc7Block(const BYTE* block, BYTE rgba[16][4])
+	{
+		UINT mode = 0;
+		while (mode < 8 && (block[0] & (1 << mode)) == 0)
+			mode++;
+		if (mode == 8)
+		{
+			// reserved, decodes to transparent black
+			memset(rgba, 0, 64);
+			return true;
+		}
+
+		const Bc7ModeInfo& info = Bc7Modes[mode];
+		if (info.subsets > 2)
+			return false;
+
+		BitReader reader = { block, mode + 1 };
+		UINT partition = reader.Read(info.partitionBits);
+		UINT rotation = reader.Read(info.rotationBits);
+		UINT indexSelection = reader.Read(info.indexSelectionBits);
+
+		UINT codes[2][2][4] = {};
+		for (UINT c = 0; c < 4; ++c)
+		{
+			UINT bits = c < 3 ? info.colorBits : info.alphaBits;
+			for (UINT s = 0; s < info.subsets; ++s)
+			{
+				codes[s][0][c] = reader.Read(bits);
+				codes[s][1][c] = reader.Read(bits);
+			}
+		}
+
+		UINT pbits[2][2] = {};
+		for (UINT s = 0; s < info.subsets; ++s)
+		{
+			if (info.endpointPBits)
+			{
+				pbits[s][0] = reader.Read(1);
+				pbits[s][1] = reader.Read(1);
+			}
+			else if (info.sharedPBits)
+			{
+				pbits[s][0] = pbits[s][1] = reader.Read(1);
+			}
+		}
+
+		BYTE endpoints[2][2][4];
+		bool hasPBits = info.endpointPBits || info.sharedPBits;
+		for (UINT s = 0; s < info.subsets; ++s)
+		{
+			for (UINT e = 0; e < 2; ++e)
+			{
+				for (UINT c = 0; c < 4; ++c)
+				{
+					UINT bits = c < 3 ? info.colorBits : info.alphaBits;
+					if (bits == 0)
+						endpoints[s][e][c] = 255;
+					else if (hasPBits)
+						endpoints[s][e][c] = (BYTE)Expand((codes[s][e][c] << 1) | pbits[s][e], bits + 1);
+					else
+						endpoints[s][e][c] = (BYTE)Expand(codes[s][e][c], bits);
+				}
+			}
+		}
+
+		UINT indices[16], indices2[16] = {};
+		for (UINT t = 0; t < 16; ++t)
+			indices[t] = reader.Read(info.indexBits - (IsBc7Anchor(info.subsets, partition, t) ? 1 : 0));
+		if (info.index2Bits > 0)
+		{
+			for (UINT t = 0; t < 16; ++t)
+				indices2[t] = reader.Read(info.index2Bits - (t == 0 ? 1 : 0));
+		}
+
+		for (UINT t = 0; t < 16; ++t)
+		{
+			const BYTE (*e)[4] = endpoints[GetBc7Subset(info.subsets, partition, t)];
+			UINT colorWeight = GetBc7Weights(info.indexBits)[indices[t]];
+			UINT alphaWeight = colorWeight;
+			if (info.index2Bits > 0)
+			{
+				UINT weight2 = GetBc7Weights(info.index2Bits)[indices2[t]];
+				if (indexSelection)
+					colorWeight = weight2;
+				else
+					alphaWeight = weight2;
+			}
+
+			for (UINT c = 0; c < 3; ++c)
+				rgba[t][c] = (BYTE)Interpolate(e[0][c], e[1][c], colorWeight);
+			rgba[t][3] = (BYTE)Interpolate(e[0][3], e[1][3], alphaWeight);
+			if (rotation > 0)
+				std::swap(rgba[t][3], rgba[t][rotation - 1]);
+		}
+		return true;
+	}
+
+	// The 4x4 block at block coordinates x, y of an RGBA8 mip, texels past the edges repeat the last row and column
+	void GetBlock(const TextureData& texture, const TextureMip& mip, UINT x, UINT y, BYTE rgba[16][4])
+	{
+		for (UINT t = 0; t < 16; ++t)
+		{
+			UINT texelX = std::min(x * 4 + (t & 3), mip.width - 1);
+			UINT texelY = std::min(y * 4 + (t >> 2), mip.height - 1);
+			memcpy(rgba[t], texture.GetPixels() + mip.offset + (size_t)texelY * mip.rowPitch + texelX * 4, 4);
+		}
+	}
+
+	// Mips of compressed with the layout of format, rows receives the mip and block row of every row of blocks
+	void AllocateMips(const TextureData& source, DXGI_FORMAT format, TextureData& texture, std::vector<std::pair<UINT, UINT> >& rows)
+	{
+		texture.width = source.width;
+		texture.height = source.height;
+		texture.format = format;
+		texture.mips.resize(source.mips.size());
+
+		size_t offset = 0;
+		for (size_t m = 0; m < source.mips.size(); ++m)
+		{
+			TextureMip& mip = texture.mips[m];
+			mip.width = source.mips[m].width;
+			mip.height = source.mips[m].height;
+			mip.rowPitch = GetRowPitch(format, mip.width);
+			mip.offset = offset;
+			offset += (size_t)GetSurfaceBytes(format, mip.width, mip.height);
+
+			for (UINT y = 0; y < std::max((mip.height + 3) / 4, 1u); ++y)
+				rows.push_back(std::make_pair((UINT)m, y));
+		}
+		texture.pixels.assign(offset, 0);
+	}
+}
+
+TextureCompressor* TextureCompressor::mInstance = NULL;
+
+TextureCompressor* TextureCompressor::Instance()
+{
+	if (!mInstance)
+		mInstance = new TextureCompressor;
+	return mInstance;
+}
+
+TextureCompressor::TextureCompressor()
+{
+	mMaxSimdLevel = GetCpuSimdLevel();
+	mSimdLevel = mMaxSimdLevel;
+
+	BuildSingleColorTables();
+}
+
+TextureCompressor::~TextureCompressor()
+{
+}
+
+void TextureCompressor::BuildSingleColorTables()
+{
+	for (UINT bits = 5; bits <= 6; ++bits)
+	{
+		BYTE (*table)[2] = bits == 5 ? mSingleColor5 : mSingleColor6;
+		UINT codes = 1 << bits;
+		for (UINT value = 0; value < 256; ++value)
+		{
+			int bestError = INT_MAX;
+			for (UINT a = 0; a < codes; ++a)
+			{
+				for (UINT b = 0; b < codes; ++b)
+				{
+					int blend = (int)(2 * Expand(a, bits) + Expand(b, bits) + 1) / 3;
+					int error = abs(blend - (int)value);
+					if (error < bestError)
+					{
+						bestError = error;
+						table[value][0] = (BYTE)a;
+						table[value][1] = (BYTE)b;
+					}
+				}
+			}
+		}
+	}
+}
+
+bool TextureCompressor::Compress(const TextureData& source, DXGI_FORMAT format, TextureData& compressed, const TextureCompressOptions& options)
+{
+	UINT blockBytes = GetBlockBytes(format);
+	if (blockBytes == 0 || source.mips.empty() || source.GetPixels() == NULL ||
+		(source.format != DXGI_FORMAT_R8G8B8A8_UNORM && source.format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB))
+		return false;
+
+	std::vector<std::pair<UINT, UINT> > rows;
+	AllocateMips(source, format, compressed, rows);
+
+	const Bc7Params& bc7Params = Bc7Qualities[std::min(options.bc7Quality, (UINT)ARRAYSIZE(Bc7Qualities) - 1)];
+	FindIndicesFunc findIndices = GetFindIndices(mSimdLevel);
+
+	ParallelFor(rows.size(), [&](size_t i)
+	{
+		const TextureMip& sourceMip = source.mips[rows[i].first];
+		const TextureMip& mip = compressed.mips[rows[i].first];
+		UINT y = rows[i].second;
+		BYTE* block = &compressed.pixels[mip.offset + (size_t)y * mip.rowPitch];
+		for (UINT x = 0; x < mip.rowPitch / blockBytes; ++x, block += blockBytes)
+		{
+			BYTE rgba[16][4];
+			GetBlock(source, sourceMip, x, y, rgba);
+
+			BYTE channel[16];
+			switch (format)
+			{
+			case DXGI_FORMAT_BC1_UNORM:
+			case DXGI_FORMAT_BC1_UNORM_SRGB:
+				EncodeBc1Block(rgba, block, false, mSingleColor5, mSingleColor6, findIndices);
+				break;
+			case DXGI_FORMAT_BC3_UNORM:
+			case DXGI_FORMAT_BC3_UNORM_SRGB:
+				for (UINT t = 0; t < 16; ++t)
+					channel[t] = rgba[t][3];
+				EncodeBc4Block(channel, block, findIndices);
+				EncodeBc1Block(rgba, block + 8, true, mSingleColor5, mSingleColor6, findIndices);
+				break;
+			case DXGI_FORMAT_BC4_UNORM:
+			case DXGI_FORMAT_BC5_UNORM:
+				for (UINT c = 0; c < (format == DXGI_FORMAT_BC5_UNORM ? 2u : 1u); ++c)
+				{
+					for (UINT t = 0; t < 16; ++t)
+						channel[t] = rgba[t][c];
+					EncodeBc4Block(channel, block + 8 * c, findIndices);
+				}
+				break;
+			default:
+				EncodeBc7Block(rgba, block, bc7Params, findIndices);
+				break;
+			}
+		}
+	});
+
+	return true;
+}
+
+bool TextureCompressor::Decompress(const TextureData& compressed, TextureData& decompressed)
+{
+	DXGI_FORMAT format = compressed.format;
+	UINT blockBytes = GetBlockBytes(format);
+	if (blockBytes == 0 || compressed.mips.empty() || compressed.GetPixels() == NULL)
+		return false;
+
+	bool srgb = format == DXGI_FORMAT_BC1_UNORM_SRGB || format == DXGI_FORMAT_BC3_UNORM_SRGB || format == DXGI_FORMAT_BC7_UNORM_SRGB;
+	std::vector<std::pair<UINT, UINT> > rows;
+	AllocateMips(compressed, srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, decompressed, rows);
+
+	std::atomic<bool> decoded(true);
+	ParallelFor(rows.size(), [&](size_t i)
+	{
+		const TextureMip& sourceMip = compressed.mips[rows[i].first];
+		const TextureMip& mip = decompressed.mips[rows[i].first];
+		UINT y = rows[i].second;
+		const BYTE* block = compressed.GetPixels() + sourceMip.offset + (size_t)y * sourceMip.rowPitch;
+		for (UINT x = 0; x < sourceMip.rowPitch / blockBytes; ++x, block += blockBytes)
+		{
+			BYTE rgba[16][4];
+			BYTE channel[16];
+			switch (format)
+			{
+			case DXGI_FORMAT_BC1_UNORM:
+			case DXGI_FORMAT_BC1_UNORM_SRGB:
+				DecodeBc1Block(block, false, rgba);
+				break;
+			case DXGI_FORMAT_BC3_UNORM:
+			case DXGI_FORMAT_BC3_UNORM_SRGB:
+				DecodeBc1Block(block + 8, true, rgba);
+				DecodeBc4Block(block, channel);
+				for (UINT t = 0; t < 16; ++t)
+					rgba[t][3] = channel[t];
+				break;
+			case DXGI_FORMAT_BC4_UNORM:
+			case DXGI_FORMAT_BC5_UNORM:
+				memset(rgba, 0, sizeof(rgba));
+				for (UINT c = 0; c < (format == DXGI_FORMAT_BC5_UNORM ? 2u : 1u); ++c)
+				{
+					DecodeBc4Block(block + 8 * c, channel);
+					for (UINT t = 0; t < 16; ++t)
+						rgba[t][c] = channel[t];
+				}
+				for (UINT t = 0; t < 16; ++t)
+					rgba[t][3] = 255;
+				break;
+			default:
+				if (!DecodeBc7Block(block, rgba))
+				{
+					memset(rgba, 0, sizeof(rgba));
+					decoded = false;
+				}
+				break;
+			}
+
+			for (UINT t = 0; t < 16; ++t)
+			{
+				UINT texelX = x * 4 + (t & 3), texelY = y * 4 + (t >> 2);
+				if (texelX < mip.width && texelY < mip.height)
+					memcpy(&decompressed.pixels[mip.offset + (size_t)texelY * mip.rowPitch + texelX * 4], rgba[t], 4);
+			}
+		}
+	});
+
+	return decoded;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+#include "Simd.h"
+
+struct TextureCompressOptions
+{
+	TextureCompressOptions() : bc7Quality(1) {}
+
+	// 0: mode 6 only. 1: also the two subset modes on the 8 partitions that fit best,
+	// and mode 5 for blocks with alpha. 2: 32 partitions, all mode 5 rotations, p-bit search.
+	UINT bc7Quality;
+};
+
+// TextureCompressor
+// singleton class, CPU block compression of RGBA8 textures for the texture cooking path
+// usage:
+// TextureCompressor::Instance()->Compress(rgbaTexture, DXGI_FORMAT_BC7_UNORM, compressedTexture)
+// TextureCompressor::Instance()->Decompress(compressedTexture, rgbaTexture)
+//
+// Formats: BC1 (RGB, texels with alpha below 128 become transparent), BC3 (RGBA),
+// BC4 (red, masks), BC5 (red and green, normal maps) and BC7 (RGBA). The endpoints
+// start from the principal axis of the block colors and are refined by least
+// squares fits of the indices. BC7 tries modes 6, 1, 3, 5 and 7; the three subset
+// modes 0 and 2 are never written.
+// Every mip is compressed, rows of blocks are spread over all hardware threads.
+// The index search, where most of the time goes, runs 4 (SSE2) or 8 (AVX2) texels
+// per instruction; every SIMD level writes the same blocks. Thread safe.
+class TextureCompressor
+{
+public:
+	static TextureCompressor* Instance();
+
+	// Compresses every mip of an RGBA8 source to format, a BCn format (UNORM or SRGB).
+	// Returns false for other formats and sources.
+	bool Compress(const TextureData& source, DXGI_FORMAT format, TextureData& compressed,
+		const TextureCompressOptions& options = TextureCompressOptions());
+
+	// Decodes a texture written by Compress to RGBA8 with the same mips. BC4 decodes
+	// to (r, 0, 0, 255) and BC5 to (r, g, 0, 255) like the GPU. Returns false for other
+	// formats and for BC7 blocks in the three subset modes.
+	bool Decompress(const TextureData& compressed, TextureData& decompressed);
+
+	// The best instruction set the CPU supports is used, it can be lowered to compare
+	SimdLevel GetMaxSimdLevel() const { return mMaxSimdLevel; }
+	SimdLevel GetSimdLevel() const { return mSimdLevel; }
+	void SetSimdLevel(SimdLevel level) { mSimdLevel = std::min(level, mMaxSimdLevel); }
+
+private:
+	TextureCompressor();
+	~TextureCompressor();
+
+	// BC1 endpoints of the single color blocks: for every 8 bit value the 5 and 6 bit
+	// endpoint pairs whose 2:1 blend comes closest to it
+	void BuildSingleColorTables();
+
+	SimdLevel mMaxSimdLevel;
+	SimdLevel mSimdLevel;
+
+	BYTE mSingleColor5[256][2];
+	BYTE mSingleColor6[256][2];
+
+	static TextureCompressor* mInstance;
+};
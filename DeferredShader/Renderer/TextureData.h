@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Util.h"
+#include "MappedFile.h"
+
+#include <memory>
+
+// One level of the mip chain, a range of TextureData::pixels
+struct TextureMip
+{
+	UINT width;
+	UINT height;
+	UINT rowPitch;		// bytes per row of pixels, of 4x4 blocks for the BCn formats
+	size_t offset;		// of the first row in TextureData::GetPixels()
+};
+
+// CPU side copy of a texture, filled by TextureLoader and uploaded by TextureManager
+struct TextureData
+{
+	TextureData() : width(0), height(0), format(DXGI_FORMAT_UNKNOWN), mappedOffset(0) {}
+
+	UINT width;
+	UINT height;
+	DXGI_FORMAT format;
+
+	// mips[0] is the full image, every level halves the size down to 1x1
+	std::vector<TextureMip> mips;
+
+	// rows of every mip from the top, finest mip first
+	std::vector<BYTE> pixels;
+
+	// Cooked textures leave pixels empty, their mips are read from the mapped file
+	// starting at mappedOffset. The mapping lives as long as any copy of the TextureData.
+	std::shared_ptr<MappedFile> mappedFile;
+	size_t mappedOffset;
+
+	// The mips, from the mapped file or from pixels. NULL if there are none.
+	const BYTE* GetPixels() const
+	{
+		if (mappedFile)
+			return mappedFile->GetData() + mappedOffset;
+		return pixels.empty() ? NULL : &pixels[0];
+	}
+};
+
+// Bytes of one 4x4 block of the BCn formats, 0 for the other formats
+inline UINT GetBlockBytes(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+		return 8;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// Bytes per row of a surface of format, a row of 4x4 blocks for the BCn formats.
+// The other formats are RGBA8, the only uncompressed format TextureLoader produces.
+inline UINT GetRowPitch(DXGI_FORMAT format, UINT width)
+{
+	UINT blockBytes = GetBlockBytes(format);
+	return blockBytes > 0 ? std::max((width + 3) / 4, 1u) * blockBytes : width * 4;
+}
+
+// Bytes of a width x height surface of format
+inline UINT64 GetSurfaceBytes(DXGI_FORMAT format, UINT width, UINT height)
+{
+	UINT rows = GetBlockBytes(format) > 0 ? std::max((height + 3) / 4, 1u) : height;
+	return (UINT64)GetRowPitch(format, width) * rows;
+}
+
+// Number of levels in the full mip chain of a width x height texture
+inline UINT GetMipCount(UINT width, UINT height)
+{
+	UINT mipCount = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+		mipCount++;
+	}
+	return mipCount;
+}
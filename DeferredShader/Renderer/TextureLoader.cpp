@@ -0,0 +1,94 @@
+#include "TextureLoader.h"
+#include "TextureCache.h"
+
+#include <wincodec.h>
+#include <iostream>
+
+namespace
+{
+	// D3D11 limit for 2D textures
+	const UINT MaxTextureSize = 16384;
+}
+
+TextureLoader* TextureLoader::mInstance = NULL;
+
+TextureLoader* TextureLoader::Instance()
+{
+	if (!mInstance)
+		mInstance = new TextureLoader;
+	return mInstance;
+}
+
+TextureLoader::TextureLoader() : mFactory(NULL)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	SAFE_RELEASE(mFactory);
+}
+
+IWICImagingFactory* TextureLoader::GetFactory()
+{
+	std::call_once(mFactoryCreated, [this]()
+	{
+		HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, __uuidof(IWICImagingFactory), (LPVOID*)&mFactory);
+		if (FAILED(hr))
+		{
+			mFactory = NULL;
+			DebugLog("TextureLoader: creating the WIC factory failed (0x%08x)\n", (unsigned int)hr);
+		}
+	});
+	return mFactory;
+}
+
+bool TextureLoader::LoadToTexture(const std::string& fileName, TextureData& textureData, const MipOptions& mipOptions)
+{
+	// the AssetCooker's texture is mapped as it is, without decoding or filtering mips. It is
+	// checked against the size and write time of the source, the source is not read.
+	if (TextureCache::Instance()->LoadUnchanged(fileName, mipOptions.content, textureData))
+		return true;
+
+	IWICImagingFactory* factory = GetFactory();
+	if (!factory)
+		return false;
+
+	std::wstring wstrFileName = std::wstring(fileName.begin(), fileName.end());
+
+	IWICBitmapDecoder* decoder = NULL;
+	IWICBitmapFrameDecode* frame = NULL;
+	IWICFormatConverter* converter = NULL;
+
+	bool loaded = false;
+	UINT width = 0, height = 0;
+	if (SUCCEEDED(factory->CreateDecoderFromFilename(wstrFileName.c_str(), NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder)) &&
+		SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+		SUCCEEDED(frame->GetSize(&width, &height)) &&
+		width > 0 && height > 0 && width <= MaxTextureSize && height <= MaxTextureSize &&
+		SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+		SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom)))
+	{
+		TextureMip mip = { width, height, width * 4, 0 };
+		textureData.width = width;
+		textureData.height = height;
+		textureData.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureData.mips.assign(1, mip);
+		textureData.pixels.resize((size_t)mip.rowPitch * height);
+
+		loaded = SUCCEEDED(converter->CopyPixels(NULL, mip.rowPitch, (UINT)textureData.pixels.size(), &textureData.pixels[0]));
+	}
+
+	SAFE_RELEASE(converter);
+	SAFE_RELEASE(frame);
+	SAFE_RELEASE(decoder);
+
+	if (!loaded)
+	{
+		textureData = TextureData();
+		std::cerr << "TextureLoader: can not load " << fileName << std::endl;
+		return false;
+	}
+
+	MipGenerator::Instance()->Generate(textureData, mipOptions);
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+#include "MipGenerator.h"
+
+#include <mutex>
+
+struct IWICImagingFactory;
+
+// TextureLoader
+// singleton class, decodes image files through WIC (png, jpg, bmp, tiff, gif) into RGBA8 TextureData
+// with a mip chain filtered by MipGenerator. A cooked texture of the file in the TextureCache
+// is used instead when its source hash matches.
+// usage:
+// TextureLoader::Instance()->LoadToTexture("..\\Assets\\cube\\default.png", textureData)
+//
+// Only decodes, no device is involved, so any thread can call it. The COM library
+// must be initialized on the calling thread (CoInitializeEx), TextureManager's
+// decode workers do that.
+class TextureLoader
+{
+public:
+	static TextureLoader* Instance();
+
+	// Maps the cooked texture of fileName, or decodes the first frame of fileName to
+	// DXGI_FORMAT_R8G8B8A8_UNORM with all mips filtered as mipOptions says.
+	// Returns false if it can not be read.
+	bool LoadToTexture(const std::string& fileName, TextureData& textureData, const MipOptions& mipOptions = MipOptions());
+
+private:
+	TextureLoader();
+	~TextureLoader();
+
+	// The WIC factory is free threaded, it is created once by the first decode
+	IWICImagingFactory* GetFactory();
+
+	IWICImagingFactory* mFactory;
+	std::once_flag mFactoryCreated;
+
+	static TextureLoader* mInstance;
+};
@@ -1,6 +1,11 @@
 #include "TextureManager.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "MeshCache.h"
+#include "Parallel.h"
 
-#include "../DirectXTex/WICTextureLoader/WICTextureLoader.h"
+#include <chrono>
+#include <cmath>
 
 TextureManager *TextureManager::mInstance = 0;
 
@@ -13,62 +18,486 @@ TextureManager* TextureManager::Instance()
 	return mInstance;
 }
 
-TextureManager::TextureManager() : md3dDevice(0)
+namespace
 {
+	// mips up to this size stay resident whatever the budget
+	const UINT MipTailSize = 64;
+}
+
+TextureManager::TextureManager() : md3dDevice(0), mFallbackSRV(0), mQuit(false), mMipFilter(MIP_FILTER_KAISER), mBudget(256 * 1024 * 1024), mResidentBytes(0), mFrame(1), mLoading(false)
+{
+	ZeroMemory(&mStats, sizeof(mStats));
+	mFilenames.assign(1, std::string());	// handle 0 is InvalidTextureHandle
+	mContents.assign(1, TEXTURE_COLOR);
 }
 
 TextureManager::~TextureManager()
 {
-	for (auto it = mTextureSRVs.begin(); it != mTextureSRVs.end(); ++it)
+	Release();
+}
+
+void TextureManager::Init(ID3D11Device* device, UINT threadCount)
+{
+	Release();
+
+	md3dDevice = device;
+
+	// white, so diffuse color times texture shows the material color until the texture is in
+	TextureData fallback;
+	TextureMip fallbackMip = { 1, 1, 4, 0 };
+	fallback.width = 1;
+	fallback.height = 1;
+	fallback.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	fallback.mips.assign(1, fallbackMip);
+	fallback.pixels.assign(4, 0xff);
+	mFallbackSRV = CreateShaderResourceView(fallback, 0, NULL);
+
+	if (threadCount == 0)
+		threadCount = std::max(GetWorkerThreadCount(), 2u) - 1;
+
+	// created here before the workers race to do it
+	TextureLoader::Instance();
+	TextureCache::Instance();
+	MeshCache::Instance();
+	MipGenerator::Instance();
+
+	mQuit = false;
+	for (UINT i = 0; i < threadCount; ++i)
+		mThreads.push_back(std::thread(&TextureManager::WorkerThread, this));
+}
+
+TextureHandle TextureManager::RequestTexture(const std::string& filename, TextureContent content)
+{
+	if (filename.empty())
+		return InvalidTextureHandle;
+
+	TextureHandle handle;
 	{
-		ReleaseCOM(it->second);
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mHandles.find(filename);
+		if (it != mHandles.end())
+			return it->second;
+		if (mQuit)
+			return InvalidTextureHandle;
+
+		handle = (TextureHandle)mFilenames.size();
+		mHandles[filename] = handle;
+		mFilenames.push_back(filename);
+		mContents.push_back(content);
+
+		QueueDecode(handle);
+		mStats.requested++;
 	}
+	mRequestReady.notify_one();
 
-	mTextureSRVs.clear();
+	return handle;
 }
 
-void TextureManager::Init(ID3D11Device* device)
+void TextureManager::QueueDecode(TextureHandle handle)
 {
-	md3dDevice = device;
+	if (mInFlight.find(handle) != mInFlight.end())
+		return;
+
+	Request request;
+	request.filename = mFilenames[handle];
+	request.mipOptions.filter = mMipFilter;
+	request.mipOptions.content = mContents[handle];
+	mInFlight[handle] = request.promise.get_future().share();
+	mRequests.push_back(std::move(request));
 }
 
-ID3D11ShaderResourceView* TextureManager::CreateTexture(std::string filename)
+TextureHandle TextureManager::GetHandle(const std::string& filename)
 {
-	if (md3dDevice)
-	{
-		ID3D11ShaderResourceView* srv = 0;
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mHandles.find(filename);
+	return it != mHandles.end() ? it->second : InvalidTextureHandle;
+}
 
-		if (mTextureSRVs.find(filename) != mTextureSRVs.end())
+void TextureManager::WorkerThread()
+{
+	// WIC is COM, every thread decoding through it joins the multithreaded apartment
+	HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		Request request;
 		{
-			srv = mTextureSRVs[filename];
+			std::unique_lock<std::mutex> lock(mMutex);
+			mRequestReady.wait(lock, [this]() { return mQuit || !mRequests.empty(); });
+			if (mQuit)
+				break;
+
+			request = std::move(mRequests.front());
+			mRequests.pop_front();
 		}
-		else
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::shared_ptr<TextureData> textureData = std::make_shared<TextureData>();
+		if (!TextureLoader::Instance()->LoadToTexture(request.filename, *textureData, request.mipOptions))
+			textureData.reset();
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 		{
-			ID3D11Resource* texture = 0;
-			std::wstring wstrFilename = std::wstring(filename.begin(), filename.end());
-			DirectX::CreateWICTextureFromFile(md3dDevice, wstrFilename.c_str(), &texture, &srv);
-			
-			mTextureSRVs[filename] = srv;
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStats.decodeMilliseconds += milliseconds;
 		}
 
-		return srv;
+		request.promise.set_value(textureData);
 	}
+
+	if (SUCCEEDED(hr))
+		CoUninitialize();
 }
 
-ID3D11ShaderResourceView* TextureManager::GetTexture(std::string filename)
+ID3D11ShaderResourceView* TextureManager::CreateShaderResourceView(const TextureData& textureData, UINT firstMip, ID3D11Texture2D** texture)
 {
-	return mTextureSRVs[filename];
+	const BYTE* pixels = textureData.GetPixels();
+	if (!md3dDevice || pixels == NULL || firstMip >= textureData.mips.size())
+		return NULL;
+
+	const TextureMip& top = textureData.mips[firstMip];
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = top.width;
+	desc.Height = top.height;
+	desc.MipLevels = (UINT)textureData.mips.size() - firstMip;
+	desc.ArraySize = 1;
+	desc.Format = textureData.format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(desc.MipLevels);
+	for (UINT m = 0; m < desc.MipLevels; ++m)
+	{
+		const TextureMip& mip = textureData.mips[firstMip + m];
+		initData[m].pSysMem = pixels + mip.offset;
+		initData[m].SysMemPitch = mip.rowPitch;
+		initData[m].SysMemSlicePitch = 0;
+	}
+
+	ID3D11Texture2D* texture2D = NULL;
+	if (FAILED(md3dDevice->CreateTexture2D(&desc, &initData[0], &texture2D)))
+		return NULL;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	ZeroMemory(&srvDesc, sizeof(srvDesc));
+	srvDesc.Format = textureData.format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = desc.MipLevels;
+
+	ID3D11ShaderResourceView* srv = NULL;
+	md3dDevice->CreateShaderResourceView(texture2D, &srvDesc, &srv);
+
+	// the view holds a reference to the texture, the caller keeps one only when it copies from it later
+	if (texture != NULL && srv != NULL)
+		*texture = texture2D;
+	else
+		ReleaseCOM(texture2D);
+
+	return srv;
 }
 
-void TextureManager::Release()
+bool TextureManager::Demote(ID3D11DeviceContext* context, Texture& texture, UINT firstMip)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	texture.texture->GetDesc(&desc);
+	desc.Width = std::max(texture.width >> firstMip, 1u);
+	desc.Height = std::max(texture.height >> firstMip, 1u);
+	desc.MipLevels = texture.mipCount - firstMip;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+
+	// the lower mips are on the GPU already, copy them over instead of decoding the file again
+	ID3D11Texture2D* demoted = NULL;
+	if (FAILED(md3dDevice->CreateTexture2D(&desc, NULL, &demoted)))
+		return false;
+	for (UINT m = 0; m < desc.MipLevels; ++m)
+		context->CopySubresourceRegion(demoted, m, 0, 0, 0, texture.texture, m + firstMip - texture.residentMip, NULL);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	ZeroMemory(&srvDesc, sizeof(srvDesc));
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = desc.MipLevels;
+
+	ID3D11ShaderResourceView* srv = NULL;
+	if (FAILED(md3dDevice->CreateShaderResourceView(demoted, &srvDesc, &srv)))
+	{
+		ReleaseCOM(demoted);
+		return false;
+	}
+
+	ReleaseCOM(texture.srv);
+	ReleaseCOM(texture.texture);
+	texture.srv = srv;
+	texture.texture = demoted;
+
+	UINT64 residentBytes = GetResidentBytes(texture, firstMip);
+	mResidentBytes = mResidentBytes - texture.residentBytes + residentBytes;
+	texture.residentBytes = residentBytes;
+	texture.residentMip = firstMip;
+	return true;
+}
+
+UINT64 TextureManager::GetResidentBytes(const Texture& texture, UINT firstMip)
+{
+	UINT64 bytes = 0;
+	for (UINT m = firstMip; m < texture.mipCount; ++m)
+		bytes += GetSurfaceBytes(texture.format, std::max(texture.width >> m, 1u), std::max(texture.height >> m, 1u));
+	return bytes;
+}
+
+void TextureManager::Update(bool wait)
+{
+	do
+	{
+		// Take the decoded textures, handles requested since the last call are added to the table
+		std::vector<std::pair<TextureHandle, TextureFuture> > ready;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTextures.resize(mFilenames.size(), Texture());
+			for (auto it = mInFlight.begin(); it != mInFlight.end(); ++it)
+			{
+				if (wait || it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+					ready.push_back(*it);
+			}
+		}
+
+		UINT created = 0, failed = 0, streamIns = 0;
+		double lastLatency = 0.0, maxLatency = 0.0, totalLatency = 0.0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < ready.size(); ++i)
+		{
+			Texture& texture = mTextures[ready[i].first];
+			std::shared_ptr<TextureData> textureData = ready[i].second.get();
+
+			if (texture.srv == NULL)
+			{
+				// First load, at full size while the budget has room, else only the mip tail
+				// until a draw needs more
+				if (textureData)
+				{
+					texture.width = textureData->width;
+					texture.height = textureData->height;
+					texture.format = textureData->format;
+					texture.mipCount = (UINT)textureData->mips.size();
+					texture.tailMip = 0;
+					while (texture.tailMip + 1 < texture.mipCount && std::max(texture.width >> texture.tailMip, texture.height >> texture.tailMip) > MipTailSize)
+						texture.tailMip++;
+
+					// the top mip of a block compressed texture must be a whole number of blocks,
+					// the texture is never recreated from a mip below the last such one
+					if (GetBlockBytes(texture.format) > 0)
+					{
+						UINT lastBlockMip = 0;
+						while (lastBlockMip < texture.tailMip &&
+							std::max(texture.width >> (lastBlockMip + 1), 1u) % 4 == 0 && std::max(texture.height >> (lastBlockMip + 1), 1u) % 4 == 0)
+						{
+							lastBlockMip++;
+						}
+						texture.tailMip = std::min(texture.tailMip, lastBlockMip);
+					}
+
+					UINT firstMip = 0;
+					if (mBudget > 0 && mResidentBytes + GetResidentBytes(texture, 0) > mBudget)
+						firstMip = texture.tailMip;
+
+					texture.srv = CreateShaderResourceView(*textureData, firstMip, &texture.texture);
+					texture.residentMip = firstMip;
+					texture.neededMip = firstMip;
+				}
+
+				if (texture.srv != NULL)
+				{
+					texture.residentBytes = GetResidentBytes(texture, texture.residentMip);
+					mResidentBytes += texture.residentBytes;
+					created++;
+				}
+				else
+				{
+					texture.failed = true;
+					failed++;
+				}
+			}
+			else if (textureData)
+			{
+				// Stream in, a failed decode keeps what is resident
+				UINT firstMip = std::min(texture.neededMip, texture.residentMip);
+				ID3D11Texture2D* texture2D = NULL;
+				ID3D11ShaderResourceView* srv = firstMip < texture.residentMip ? CreateShaderResourceView(*textureData, firstMip, &texture2D) : NULL;
+				if (srv != NULL)
+				{
+					ReleaseCOM(texture.srv);
+					ReleaseCOM(texture.texture);
+					texture.srv = srv;
+					texture.texture = texture2D;
+					texture.residentMip = firstMip;
+
+					UINT64 residentBytes = GetResidentBytes(texture, firstMip);
+					mResidentBytes = mResidentBytes - texture.residentBytes + residentBytes;
+					texture.residentBytes = residentBytes;
+
+					lastLatency = std::chrono::duration<double>(Clock::now() - texture.streamInStart).count();
+					maxLatency = std::max(maxLatency, lastLatency);
+					totalLatency += lastLatency;
+					streamIns++;
+				}
+			}
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (size_t i = 0; i < ready.size(); ++i)
+			mInFlight.erase(ready[i].first);
+
+		mStats.created += created;
+		mStats.failed += failed;
+		mStats.createMilliseconds += milliseconds;
+		mStats.pending = (UINT)mInFlight.size();
+		mStats.streamIns += streamIns;
+		if (streamIns > 0)
+			mStats.lastStreamInLatency = lastLatency;
+		mStats.maxStreamInLatency = std::max(mStats.maxStreamInLatency, maxLatency);
+		mStats.totalStreamInLatency += totalLatency;
+
+		if (mLoading && mStats.pending == 0)
+		{
+			DebugLog("TextureManager: %u textures created, %u failed, decoding %.1f ms on %u threads, creating %.1f ms, %.1f MB resident\n",
+				mStats.created, mStats.failed, mStats.decodeMilliseconds, (UINT)mThreads.size(), mStats.createMilliseconds, mResidentBytes / (1024.0 * 1024.0));
+		}
+		mLoading = mStats.pending > 0;
+	} while (wait && mLoading);
+
+	UpdateResidency();
+}
+
+void TextureManager::UpdateResidency()
 {
-	for (auto& kv : mTextureSRVs)
+	// The needed mips of the textures the last frame sampled
+	UINT64 requestedBytes = 0;
+	std::vector<TextureHandle> resident;
+	std::vector<TextureHandle> used;
+	for (TextureHandle handle = 1; handle < (TextureHandle)mTextures.size(); ++handle)
+	{
+		Texture& texture = mTextures[handle];
+		if (texture.srv == NULL)
+			continue;
+
+		if (texture.usedFrame == mFrame)
+		{
+			// texels per pixel at mip 0, every mip halves it
+			float texelsPerPixel = std::max(texture.width, texture.height) * texture.uvPerPixel;
+			texture.neededMip = texelsPerPixel > 1.0f ? std::min((UINT)log2f(texelsPerPixel), texture.tailMip) : 0;
+			requestedBytes += GetResidentBytes(texture, texture.neededMip);
+			used.push_back(handle);
+		}
+		resident.push_back(handle);
+	}
+
+	// When the needed mips alone exceed the budget every used texture drops the same
+	// number of top mips, each one saves about three quarters of the bytes
+	UINT mipBias = 0;
+	for (UINT64 biasedBytes = requestedBytes; mBudget > 0 && biasedBytes > mBudget && biasedBytes > 0; )
 	{
-		if (kv.second != NULL)
+		mipBias++;
+		UINT64 bytes = 0;
+		for (size_t i = 0; i < used.size(); ++i)
 		{
-			ReleaseCOM(kv.second);
-			kv.second = NULL;
+			const Texture& texture = mTextures[used[i]];
+			bytes += GetResidentBytes(texture, std::min(texture.neededMip + mipBias, texture.tailMip));
 		}
+		if (bytes == biasedBytes)
+			break;	// everything is down to the mip tail
+		biasedBytes = bytes;
+	}
+
+	std::vector<TextureHandle> streamIns;
+	for (size_t i = 0; i < used.size(); ++i)
+	{
+		Texture& texture = mTextures[used[i]];
+		texture.neededMip = std::min(texture.neededMip + mipBias, texture.tailMip);
+		if (texture.neededMip < texture.residentMip)
+			streamIns.push_back(used[i]);
 	}
-	
-}
\ No newline at end of file
+
+	if (!streamIns.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (size_t i = 0; i < streamIns.size(); ++i)
+			{
+				if (mInFlight.find(streamIns[i]) == mInFlight.end())
+					mTextures[streamIns[i]].streamInStart = Clock::now();
+				QueueDecode(streamIns[i]);
+			}
+		}
+		mRequestReady.notify_all();
+	}
+
+	// Over budget, drop top mips starting with the least recently used textures
+	UINT demotions = 0;
+	if (mBudget > 0 && mResidentBytes > mBudget)
+	{
+		std::stable_sort(resident.begin(), resident.end(), [this](TextureHandle a, TextureHandle b) { return mTextures[a].usedFrame < mTextures[b].usedFrame; });
+
+		ID3D11DeviceContext* context = NULL;
+		md3dDevice->GetImmediateContext(&context);
+		for (size_t i = 0; i < resident.size() && mResidentBytes > mBudget; ++i)
+		{
+			Texture& texture = mTextures[resident[i]];
+			UINT firstMip = texture.usedFrame == mFrame ? texture.neededMip : texture.tailMip;
+			if (texture.residentMip < firstMip && Demote(context, texture, firstMip))
+				demotions++;
+		}
+		ReleaseCOM(context);
+	}
+
+	// the marks of the next frame
+	mFrame++;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats.budgetBytes = mBudget;
+	mStats.residentBytes = mResidentBytes;
+	mStats.requestedBytes = requestedBytes;
+	mStats.mipBias = mipBias;
+	mStats.demotions += demotions;
+}
+
+TextureStats TextureManager::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void TextureManager::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+		mRequests.clear();
+	}
+	mRequestReady.notify_all();
+
+	// a worker finishes the texture it is decoding first
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		mThreads[i].join();
+	mThreads.clear();
+
+	mInFlight.clear();
+	for (size_t i = 0; i < mTextures.size(); ++i)
+	{
+		ReleaseCOM(mTextures[i].srv);
+		ReleaseCOM(mTextures[i].texture);
+	}
+	mTextures.clear();
+	mHandles.clear();
+	mFilenames.assign(1, std::string());	// handle 0 is InvalidTextureHandle
+	mContents.assign(1, TEXTURE_COLOR);
+	ReleaseCOM(mFallbackSRV);
+
+	mResidentBytes = 0;
+	mLoading = false;
+}
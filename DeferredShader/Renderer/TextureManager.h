@@ -1,24 +1,136 @@
 #pragma once
 
 #include "Util.h"
+#include "TextureData.h"
+#include "MipGenerator.h"
 #include <map>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+
+// Interned texture id, index into the TextureManager table. 0 is no texture.
+typedef UINT TextureHandle;
+const TextureHandle InvalidTextureHandle = 0;
+
+// Texture loading and residency counters, times summed over all textures in milliseconds
+struct TextureStats
+{
+	UINT requested;		// distinct filenames requested
+	UINT created;		// textures created on the device
+	UINT failed;		// files that could not be decoded
+	UINT pending;		// queued or decoding, stream ins included
+	double decodeMilliseconds;	// file IO and decoding on the workers
+	double createMilliseconds;	// texture and SRV creation on the render thread
+
+	UINT64 budgetBytes;		// 0 is unlimited
+	UINT64 residentBytes;	// GPU memory of the resident mips of all textures
+	UINT64 requestedBytes;	// GPU memory the textures of the last frame need at their needed mip
+	UINT mipBias;			// mips dropped from every used texture because requestedBytes exceeds the budget
+	UINT streamIns;			// textures streamed back in at a finer mip
+	UINT demotions;			// textures whose top mips were dropped for the budget
+
+	// stream in request to upload latency, in seconds
+	double lastStreamInLatency;
+	double maxStreamInLatency;
+	double totalStreamInLatency;
+};
 
 // TextureManager
-// Loads texture from file using WICTextureLoader and saves
-// textures as ID3D11ShaderResourceView to textures std::map object
-// so that for each filename there is only one texture and it is not loaded multiple times
-// new texture is created only if map does not hold texture with filename if there is value in map
-// the createTexture method returns it without loading new one from disk.
+// Loads texture from file using TextureLoader and saves
+// textures as ID3D11ShaderResourceView to a table indexed by TextureHandle
+// so that for each filename there is only one texture and it is not loaded multiple times.
+// Files are decoded on worker threads, requests for a filename that is already
+// loaded or in flight share its future instead of decoding it again. Only the
+// texture and SRV creation is serialized, Update does it on the render thread.
+// Until a texture is created GetTexture returns a white 1x1 fallback texture.
+// The decoded mips are filtered by MipGenerator in linear space, normal maps as
+// vectors, the textures are created immutable from the decoded chain.
+// Every filename is interned to a TextureHandle when it is first requested,
+// the render path looks the textures up by handle in a flat table.
+//
+// Residency: the draws report the textures they sample with MarkUsed, with
+// the texture coordinate change per screen pixel that gives the finest mip the
+// frame needs. Update streams textures needing a finer mip back in (the file is
+// decoded again) and, while the resident mips exceed the memory budget, drops
+// the top mips of the least recently used textures: down to the mip tail
+// (64x64 and below) for textures the last frame did not use, down to the needed
+// mip for the others. If the needed mips alone exceed the budget, a mip bias
+// drops the same number of top mips from all of them. The mip tail always stays resident.
+// usage:
+// TextureManager::Instance()->Init(device)
+// TextureHandle handle = TextureManager::Instance()->RequestTexture(filename) from any thread
+// every frame on the render thread:
+// TextureManager::Instance()->Update()
+// ID3D11ShaderResourceView* srv = TextureManager::Instance()->GetTexture(handle)
+// TextureManager::Instance()->MarkUsed(handle, uvPerPixel)
 class TextureManager
 {
 public:
 	static TextureManager* Instance();
 
-	void Init(ID3D11Device* device);
+	// Starts the decode workers, 0 uses every hardware thread but the render thread
+	void Init(ID3D11Device* device, UINT threadCount = 0);
+
+	// Returns the handle of filename and queues it for decoding on its first request,
+	// InvalidTextureHandle for an empty filename. content picks how the mips are filtered,
+	// the first request of a filename decides. Thread safe.
+	TextureHandle RequestTexture(const std::string& filename, TextureContent content = TEXTURE_COLOR);
+
+	// Handle of a requested filename without requesting it, InvalidTextureHandle if it never was. Thread safe.
+	TextureHandle GetHandle(const std::string& filename);
 
-	ID3D11ShaderResourceView* CreateTexture(std::string filename);
+	// The texture of handle, the fallback texture (or NULL without fallback) while it is decoded,
+	// NULL for InvalidTextureHandle and files that could not be loaded.
+	// Render thread only, a flat table lookup.
+	ID3D11ShaderResourceView* GetTexture(TextureHandle handle, bool fallback = true) const
+	{
+		if (handle == InvalidTextureHandle)
+			return NULL;
+		if (handle >= mTextures.size())
+			return fallback ? mFallbackSRV : NULL;
+		const Texture& texture = mTextures[handle];
+		return texture.srv != NULL || texture.failed || !fallback ? texture.srv : mFallbackSRV;
+	}
 
-	ID3D11ShaderResourceView* GetTexture(std::string filename);
+	// Records that the current frame samples handle, uvPerPixel is the texture coordinate
+	// change per screen pixel of the draw. Render thread only.
+	void MarkUsed(TextureHandle handle, float uvPerPixel)
+	{
+		if (handle == InvalidTextureHandle || handle >= mTextures.size())
+			return;
+		Texture& texture = mTextures[handle];
+		if (texture.usedFrame != mFrame)
+		{
+			texture.usedFrame = mFrame;
+			texture.uvPerPixel = uvPerPixel;
+		}
+		else
+		{
+			texture.uvPerPixel = std::min(texture.uvPerPixel, uvPerPixel);
+		}
+	}
+
+	// Creates the textures decoded since the last call and updates the residency from the
+	// textures marked used since then, wait blocks until every request is done.
+	// Call on the render thread once per frame.
+	void Update(bool wait = false);
+
+	// Mip filter of the textures decoded from now on, stream ins included. Thread safe.
+	void SetMipFilter(MipFilter filter)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMipFilter = filter;
+	}
+
+	// GPU memory for the texture mips in bytes, 0 is unlimited
+	void SetBudget(UINT64 budgetBytes) { mBudget = budgetBytes; }
+	UINT64 GetBudget() const { return mBudget; }
+
+	TextureStats GetStats();
 
 	void Release();
 
@@ -31,6 +143,82 @@ private:
 
 	TextureManager(const TextureManager& rhs);
 
+	typedef std::chrono::steady_clock Clock;
+	typedef std::shared_future<std::shared_ptr<TextureData> > TextureFuture;
+
+	struct Request
+	{
+		std::string filename;
+		MipOptions mipOptions;
+		std::promise<std::shared_ptr<TextureData> > promise;
+	};
+
+	// Entry of the render thread texture table, srv is NULL until created
+	struct Texture
+	{
+		ID3D11ShaderResourceView* srv;
+		ID3D11Texture2D* texture;
+		bool failed;
+
+		// full chain, the GPU holds mips residentMip to mipCount - 1
+		UINT width;
+		UINT height;
+		DXGI_FORMAT format;
+		UINT mipCount;
+		UINT residentMip;
+		UINT tailMip;		// first mip of the always resident tail
+		UINT64 residentBytes;
+
+		// usage of the last frame that sampled it
+		UINT usedFrame;
+		float uvPerPixel;
+		UINT neededMip;
+
+		Clock::time_point streamInStart;	// of the stream in in flight
+	};
+
+	void WorkerThread();
+
+	// Queues handle for decoding unless it is in flight, call with mMutex locked
+	void QueueDecode(TextureHandle handle);
+
+	// Creates a texture of the mips from firstMip down, NULL if it fails
+	ID3D11ShaderResourceView* CreateShaderResourceView(const TextureData& textureData, UINT firstMip, ID3D11Texture2D** texture);
+
+	// Copies the mips from firstMip down into a smaller texture and releases the old one
+	bool Demote(ID3D11DeviceContext* context, Texture& texture, UINT firstMip);
+
+	// Picks the needed mips from the last frame's marks, queues stream ins and demotes for the budget
+	void UpdateResidency();
+
+	// GPU memory of the mips from firstMip down
+	static UINT64 GetResidentBytes(const Texture& texture, UINT firstMip);
+
 	ID3D11Device* md3dDevice;
-	std::map<std::string, ID3D11ShaderResourceView*> mTextureSRVs;
-};
\ No newline at end of file
+	ID3D11ShaderResourceView* mFallbackSRV;
+
+	std::vector<std::thread> mThreads;
+	bool mQuit;
+
+	// mHandles, mFilenames, mContents, mMipFilter, mInFlight, mRequests, mQuit and mStats are guarded by mMutex
+	std::mutex mMutex;
+	std::condition_variable mRequestReady;
+	std::map<std::string, TextureHandle> mHandles;
+	std::vector<std::string> mFilenames;	// by handle
+	std::vector<TextureContent> mContents;	// by handle
+	MipFilter mMipFilter;
+	std::map<TextureHandle, TextureFuture> mInFlight;
+	std::deque<Request> mRequests;
+
+	// By handle, only the render thread touches it. Handles requested since the
+	// last Update are past its end and count as in flight.
+	std::vector<Texture> mTextures;
+
+	// Residency state, render thread only
+	UINT64 mBudget;
+	UINT64 mResidentBytes;
+	UINT mFrame;	// MarkUsed stamps the textures with it, Update advances it
+
+	TextureStats mStats;
+	bool mLoading;	// textures were pending during the last Update
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 #if defined(DEBUG) || defined(_DEBUG)
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
@@ -10,7 +12,45 @@
 #include <directxmath.h>
 #include <wchar.h>
 #include <winerror.h>
+
+#else
+
+// Tools built without the Windows SDK (AssetCooker on Linux) only compile the
+// CPU side of the renderer: mesh loaders, mesh processing and the mesh cache.
+// DirectXMath is the portable github release there.
+#include <DirectXMath.h>
+#include <cstdint>
+#include <cstring>
+
+typedef uint8_t BYTE;
+typedef int16_t SHORT;
+typedef uint16_t USHORT;
+typedef uint32_t UINT;
+typedef uint64_t UINT64;
+
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// The texture formats the cooker reads and writes, values as in dxgiformat.h
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC7_UNORM = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB = 99
+};
+
+#endif
+
 #include <stdarg.h>
+#include <cstdio>
 #include <cassert>
 #include <ctime>
 #include <algorithm>
@@ -20,15 +60,22 @@
 #include <vector>
 #include <map>
 
+#ifdef _WIN32
 #include "DemoTimer.h"
 
 
 // gui includes
 #include "imgui.h"
 #include "imgui_impl_dx11.h"
+#endif
 
 using namespace DirectX;
 
+#ifndef _WIN32
+// math.h defines M_PI as a macro outside of Windows
+#undef M_PI
+#endif
+
 const float M_PI = 3.1415926535f;
 const float M_PI2 = 2 * M_PI;
 
@@ -67,6 +114,7 @@ const float M_PI2 = 2 * M_PI;
 #define V(x)           { hr = (x); }
 #endif
 
+#ifdef _WIN32
 static bool CompileShader(PWCHAR strPath, D3D10_SHADER_MACRO* pMacros, const char * strEntryPoint, const char * strProfile, DWORD dwShaderFlags, ID3DBlob ** blob)
 {
 	if (!strPath || !strEntryPoint || !strProfile || !blob)
@@ -126,8 +174,24 @@ inline void DX_SetDebugName(_In_ ID3D11DeviceChild* pObj, _In_z_ const CHAR* pst
 #else
 #define DX_SetDebugName( pObj, pstrName )
 #endif
+#endif // _WIN32
+
+// Formats a message printf style and writes it to the debugger output window
+inline void DebugLog(const char* format, ...)
+{
+	char buffer[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+#ifdef _WIN32
+	OutputDebugStringA(buffer);
+#else
+	fputs(buffer, stderr);
+#endif
+}
 
-static float rad2deg(float rad)
+inline float rad2deg(float rad)
 {
 	return rad * (180 / M_PI);
 }
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "VertexQuantizer.h"
+
+#include <cmath>
+
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	inline float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline SHORT FloatToSnorm16(float v)
+	{
+		v = std::max(-1.0f, std::min(1.0f, v));
+		return (SHORT)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+	}
+
+	inline float Snorm16ToFloat(SHORT v)
+	{
+		return std::max(-1.0f, v / 32767.0f);
+	}
+
+	inline USHORT FloatToUnorm16(float v)
+	{
+		v = std::max(0.0f, std::min(1.0f, v));
+		return (USHORT)(v * 65535.0f + 0.5f);
+	}
+
+	const float TWO_PI = 6.28318530718f;
+	const USHORT TANGENT_ANGLE_MAX = 32767;
+	const USHORT TANGENT_SIGN_BIT = 0x8000;
+
+	// Orthonormal basis around a unit normal without branches on the axes
+	// (Duff et al. 2017), same as TangentBasis in DeferredShading.hlsl
+	void TangentBasis(const XMFLOAT3& n, XMFLOAT3& b1, XMFLOAT3& b2)
+	{
+		float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + n.z);
+		float b = n.x * n.y * a;
+		b1 = XMFLOAT3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+		b2 = XMFLOAT3(b, sign + n.y * n.y * a, -n.y);
+	}
+}
+
+VertexQuantizer* VertexQuantizer::mInstance = NULL;
+
+VertexQuantizer* VertexQuantizer::Instance()
+{
+	if (!mInstance)
+		mInstance = new VertexQuantizer;
+	return mInstance;
+}
+
+VertexQuantizer::VertexQuantizer()
+{
+}
+
+VertexQuantizer::~VertexQuantizer()
+{
+}
+
+void VertexQuantizer::EncodeOctahedral(const XMFLOAT3& normal, SHORT encoded[2])
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (length <= 0.0f)
+	{
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	// project onto the octahedron, fold the lower hemisphere over the diagonals
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if (normal.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+		float foldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = FloatToSnorm16(x);
+	encoded[1] = FloatToSnorm16(y);
+}
+
+XMFLOAT3 VertexQuantizer::DecodeOctahedral(const SHORT encoded[2])
+{
+	// same math as DecodeOctahedralNormal in DeferredShading.hlsl
+	float x = Snorm16ToFloat(encoded[0]);
+	float y = Snorm16ToFloat(encoded[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = std::max(0.0f, -z);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+
+	float length = sqrtf(x * x + y * y + z * z);
+	if (length <= 0.0f)
+		return XMFLOAT3(0.0f, 0.0f, 0.0f);
+	return XMFLOAT3(x / length, y / length, z / length);
+}
+
+USHORT VertexQuantizer::EncodeTangent(const XMFLOAT3& normal, const XMFLOAT4& tangent)
+{
+	// the angle is measured in the basis of the normal the shader decodes
+	SHORT encoded[2];
+	EncodeOctahedral(normal, encoded);
+	XMFLOAT3 n = DecodeOctahedral(encoded);
+
+	XMFLOAT3 b1, b2;
+	TangentBasis(n, b1, b2);
+	float x = tangent.x * b1.x + tangent.y * b1.y + tangent.z * b1.z;
+	float y = tangent.x * b2.x + tangent.y * b2.y + tangent.z * b2.z;
+	float angle = (x != 0.0f || y != 0.0f) ? atan2f(y, x) : 0.0f;
+
+	USHORT encodedAngle = (USHORT)(std::max(0.0f, std::min(1.0f, angle / TWO_PI + 0.5f)) * TANGENT_ANGLE_MAX + 0.5f);
+	return encodedAngle | (tangent.w < 0.0f ? TANGENT_SIGN_BIT : 0);
+}
+
+XMFLOAT4 VertexQuantizer::DecodeTangent(const SHORT encodedNormal[2], USHORT encoded)
+{
+	// same math as DecodeTangent in DeferredShading.hlsl
+	XMFLOAT3 n = DecodeOctahedral(encodedNormal);
+	XMFLOAT3 b1, b2;
+	TangentBasis(n, b1, b2);
+
+	float angle = ((encoded & TANGENT_ANGLE_MAX) / (float)TANGENT_ANGLE_MAX - 0.5f) * TWO_PI;
+	float c = cosf(angle);
+	float s = sinf(angle);
+	return XMFLOAT4(b1.x * c + b2.x * s, b1.y * c + b2.y * s, b1.z * c + b2.z * s, (encoded & TANGENT_SIGN_BIT) ? -1.0f : 1.0f);
+}
+
+Vertex VertexQuantizer::DecodeVertex(const PackedVertex& packed, const XMFLOAT3& positionScale, const XMFLOAT3& positionOffset)
+{
+	Vertex vertex;
+	vertex.Position = XMFLOAT3(packed.Position[0] / 65535.0f * positionScale.x + positionOffset.x,
+		packed.Position[1] / 65535.0f * positionScale.y + positionOffset.y,
+		packed.Position[2] / 65535.0f * positionScale.z + positionOffset.z);
+	vertex.Normal = DecodeOctahedral(packed.Normal);
+	vertex.Tex = XMFLOAT2(XMConvertHalfToFloat(packed.Tex[0]), XMConvertHalfToFloat(packed.Tex[1]));
+	vertex.Tangent = DecodeTangent(packed.Normal, packed.Position[3]);
+	return vertex;
+}
+
+QuantizationError VertexQuantizer::Quantize(MeshData& meshData)
+{
+	QuantizationError error;
+	error.maxPositionError = 0.0f;
+	error.maxNormalError = 0.0f;
+	error.maxTexError = 0.0f;
+	error.maxTangentError = 0.0f;
+
+	meshData.PackedVertices.clear();
+	if (meshData.Vertices.empty())
+		return error;
+
+	// UNORM 0..1 spans the bounding box
+	XMFLOAT3 boundsMin(meshData.bounds.Center.x - meshData.bounds.Extents.x,
+		meshData.bounds.Center.y - meshData.bounds.Extents.y,
+		meshData.bounds.Center.z - meshData.bounds.Extents.z);
+	XMFLOAT3 boundsSize(meshData.bounds.Extents.x * 2.0f, meshData.bounds.Extents.y * 2.0f, meshData.bounds.Extents.z * 2.0f);
+	meshData.positionOffset = boundsMin;
+	meshData.positionScale = boundsSize;
+
+	float invSize[3] = {
+		boundsSize.x > 0.0f ? 1.0f / boundsSize.x : 0.0f,
+		boundsSize.y > 0.0f ? 1.0f / boundsSize.y : 0.0f,
+		boundsSize.z > 0.0f ? 1.0f / boundsSize.z : 0.0f };
+
+	meshData.PackedVertices.resize(meshData.Vertices.size());
+	for (size_t i = 0; i < meshData.Vertices.size(); ++i)
+	{
+		const Vertex& v = meshData.Vertices[i];
+		PackedVertex& packed = meshData.PackedVertices[i];
+
+		packed.Position[0] = FloatToUnorm16((v.Position.x - boundsMin.x) * invSize[0]);
+		packed.Position[1] = FloatToUnorm16((v.Position.y - boundsMin.y) * invSize[1]);
+		packed.Position[2] = FloatToUnorm16((v.Position.z - boundsMin.z) * invSize[2]);
+
+		EncodeOctahedral(v.Normal, packed.Normal);
+		packed.Position[3] = EncodeTangent(v.Normal, v.Tangent);
+
+		packed.Tex[0] = XMConvertFloatToHalf(v.Tex.x);
+		packed.Tex[1] = XMConvertFloatToHalf(v.Tex.y);
+
+		// measure what the vertex shader will get back
+		float px = packed.Position[0] / 65535.0f * boundsSize.x + boundsMin.x;
+		float py = packed.Position[1] / 65535.0f * boundsSize.y + boundsMin.y;
+		float pz = packed.Position[2] / 65535.0f * boundsSize.z + boundsMin.z;
+		float dx = px - v.Position.x;
+		float dy = py - v.Position.y;
+		float dz = pz - v.Position.z;
+		error.maxPositionError = std::max(error.maxPositionError, sqrtf(dx * dx + dy * dy + dz * dz));
+
+		float normalLength = sqrtf(v.Normal.x * v.Normal.x + v.Normal.y * v.Normal.y + v.Normal.z * v.Normal.z);
+		if (normalLength > 0.0f)
+		{
+			XMFLOAT3 n = DecodeOctahedral(packed.Normal);
+			float cosAngle = (n.x * v.Normal.x + n.y * v.Normal.y + n.z * v.Normal.z) / normalLength;
+			float angle = rad2deg(acosf(std::max(-1.0f, std::min(1.0f, cosAngle))));
+			error.maxNormalError = std::max(error.maxNormalError, angle);
+
+			// against the tangent projected into the decoded normal plane, the shader gets no more
+			XMFLOAT4 t = DecodeTangent(packed.Normal, packed.Position[3]);
+			float tn = v.Tangent.x * n.x + v.Tangent.y * n.y + v.Tangent.z * n.z;
+			XMFLOAT3 projected(v.Tangent.x - tn * n.x, v.Tangent.y - tn * n.y, v.Tangent.z - tn * n.z);
+			float projectedLength = sqrtf(projected.x * projected.x + projected.y * projected.y + projected.z * projected.z);
+			if (projectedLength > 0.0f)
+			{
+				float cosTangent = (t.x * projected.x + t.y * projected.y + t.z * projected.z) / projectedLength;
+				float tangentAngle = rad2deg(acosf(std::max(-1.0f, std::min(1.0f, cosTangent))));
+				error.maxTangentError = std::max(error.maxTangentError, tangentAngle);
+			}
+		}
+
+		error.maxTexError = std::max(error.maxTexError, fabsf(XMConvertHalfToFloat(packed.Tex[0]) - v.Tex.x));
+		error.maxTexError = std::max(error.maxTexError, fabsf(XMConvertHalfToFloat(packed.Tex[1]) - v.Tex.y));
+	}
+
+	return error;
+}
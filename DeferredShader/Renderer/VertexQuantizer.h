@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Util.h"
+#include "MeshData.h"
+
+// Largest error introduced by quantizing a mesh
+struct QuantizationError
+{
+	float maxPositionError;		// object space distance
+	float maxNormalError;		// degrees
+	float maxTexError;			// texcoord units
+	float maxTangentError;		// degrees
+};
+
+// VertexQuantizer
+// singleton class, packs MeshData::Vertices into the 16 byte PackedVertex format
+// usage:
+// VertexQuantizer::Instance()->Quantize(meshData)
+class VertexQuantizer
+{
+public:
+	static VertexQuantizer* Instance();
+
+	// Fills meshData.PackedVertices and the position dequantization constants
+	// from meshData.Vertices and meshData.bounds, returns the quantization error.
+	QuantizationError Quantize(MeshData& meshData);
+
+	// Octahedral normal encoding into two SNORM16 values and back
+	static void EncodeOctahedral(const XMFLOAT3& normal, SHORT encoded[2]);
+	static XMFLOAT3 DecodeOctahedral(const SHORT encoded[2]);
+
+	// Tangent as a 15 bit angle in the plane of the octahedral encoded normal,
+	// the top bit is set for a negative bitangent sign
+	static USHORT EncodeTangent(const XMFLOAT3& normal, const XMFLOAT4& tangent);
+	static XMFLOAT4 DecodeTangent(const SHORT encodedNormal[2], USHORT encoded);
+
+	// Unpacks a vertex written by Quantize, positionScale / positionOffset are the MeshData constants
+	static Vertex DecodeVertex(const PackedVertex& packed, const XMFLOAT3& positionScale, const XMFLOAT3& positionOffset);
+
+private:
+	VertexQuantizer();
+	~VertexQuantizer();
+
+	static VertexQuantizer* mInstance;
+};
@@ -0,0 +1,418 @@
+#include "VirtualTexture.h"
+
+#include <chrono>
+
+namespace
+{
+	// Pages as the feedback writes them, without the virtual texture index
+	const UINT PAGE_INDEX_BITS = 0x70000000;
+
+	bool IsPowerOfTwo(UINT value)
+	{
+		return value != 0 && (value & (value - 1)) == 0;
+	}
+
+	UINT Log2(UINT value)
+	{
+		UINT log = 0;
+		while (value > 1)
+		{
+			value >>= 1;
+			log++;
+		}
+		return log;
+	}
+
+	UINT HashPage(VirtualPageId page)
+	{
+		UINT hash = page * 0x9e3779b1u;
+		return hash ^ (hash >> 15);
+	}
+}
+
+PageCounter::PageCounter() : mGeneration(1), mMask(0)
+{
+}
+
+void PageCounter::Clear()
+{
+	mPages.clear();
+	mCounts.clear();
+
+	// the table is only cleared when the generation wraps
+	if (++mGeneration == 0)
+	{
+		std::fill(mGenerations.begin(), mGenerations.end(), 0u);
+		mGeneration = 1;
+	}
+}
+
+void PageCounter::Grow()
+{
+	size_t size = std::max<size_t>(mKeys.size() * 2, 256);
+	mKeys.assign(size, InvalidPageId);
+	mIndices.assign(size, 0);
+	mGenerations.assign(size, 0);
+	mGeneration = 1;
+	mMask = (UINT)size - 1;
+
+	for (UINT p = 0; p < (UINT)mPages.size(); ++p)
+	{
+		UINT i = HashPage(mPages[p]) & mMask;
+		while (mGenerations[i] == mGeneration)
+			i = (i + 1) & mMask;
+		mKeys[i] = mPages[p];
+		mIndices[i] = p;
+		mGenerations[i] = mGeneration;
+	}
+}
+
+UINT PageCounter::Add(VirtualPageId page, UINT count)
+{
+	// at most half full, the probe sequences stay short
+	if (mPages.size() * 2 >= mKeys.size())
+		Grow();
+
+	UINT i = HashPage(page) & mMask;
+	for (;;)
+	{
+		if (mGenerations[i] != mGeneration)
+		{
+			mKeys[i] = page;
+			mIndices[i] = (UINT)mPages.size();
+			mGenerations[i] = mGeneration;
+			mPages.push_back(page);
+			mCounts.push_back(count);
+			return mIndices[i];
+		}
+		if (mKeys[i] == page)
+		{
+			mCounts[mIndices[i]] += count;
+			return mIndices[i];
+		}
+		i = (i + 1) & mMask;
+	}
+}
+
+size_t PageCounter::Add(const VirtualPageId* pages, size_t count)
+{
+	size_t added = 0;
+	VirtualPageId lastPage = InvalidPageId;
+	UINT lastIndex = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		VirtualPageId page = pages[i];
+		if (page == InvalidPageId)
+			continue;
+
+		if (page == lastPage)
+		{
+			mCounts[lastIndex]++;
+		}
+		else
+		{
+			lastIndex = Add(page);
+			lastPage = page;
+		}
+		added++;
+	}
+	return added;
+}
+
+VirtualTexture::VirtualTexture() : mWidth(0), mHeight(0), mPageSize(0), mCachePagesX(0), mCachePagesY(0), mFrame(0), mFeedbackSamples(0), mFeedbackMilliseconds(0.0)
+{
+	ZeroMemory(&mStats, sizeof(mStats));
+}
+
+bool VirtualTexture::Init(UINT width, UINT height, UINT pageSize, UINT cachePagesX, UINT cachePagesY)
+{
+	if (!IsPowerOfTwo(width) || !IsPowerOfTwo(height) || !IsPowerOfTwo(pageSize) || width < pageSize || height < pageSize ||
+		width / pageSize > 4096 || height / pageSize > 4096 || cachePagesX == 0 || cachePagesY == 0 ||
+		cachePagesX > 256 || cachePagesY > 256 || cachePagesX * cachePagesY < 2)
+	{
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mPageSize = pageSize;
+	mCachePagesX = cachePagesX;
+	mCachePagesY = cachePagesY;
+
+	// down to the mip that fits into one page
+	UINT pagesX = width / pageSize;
+	UINT pagesY = height / pageSize;
+	UINT mipCount = Log2(std::max(pagesX, pagesY)) + 1;
+	if (mipCount > 16)
+		return false;
+
+	mMips.resize(mipCount);
+	for (UINT m = 0; m < mipCount; ++m)
+	{
+		Mip& mip = mMips[m];
+		mip.pagesX = std::max(pagesX >> m, 1u);
+		mip.pagesY = std::max(pagesY >> m, 1u);
+		PageTableEntry empty = { 0, 0, 0, 0 };
+		mip.table.assign((size_t)mip.pagesX * mip.pagesY, empty);
+		mip.slots.assign((size_t)mip.pagesX * mip.pagesY, 0);
+		mip.dirty = true;
+	}
+
+	UINT slotCount = cachePagesX * cachePagesY;
+	Slot freeSlot = { InvalidPageId, 0 };
+	mSlots.assign(slotCount, freeSlot);
+	mFreeSlots.resize(slotCount);
+	for (UINT s = 0; s < slotCount; ++s)
+		mFreeSlots[s] = slotCount - 1 - s;
+
+	mFrame = 0;
+	mFeedback.Clear();
+	mQueue.Clear();
+	mFeedbackSamples = 0;
+	mFeedbackMilliseconds = 0.0;
+	ZeroMemory(&mStats, sizeof(mStats));
+	return true;
+}
+
+bool VirtualTexture::IsValidPage(VirtualPageId page) const
+{
+	UINT mip = GetPageMip(page);
+	return (page & 0x80000000u) != 0 && mip < mMips.size() && GetPageX(page) < mMips[mip].pagesX && GetPageY(page) < mMips[mip].pagesY;
+}
+
+bool VirtualTexture::IsResident(VirtualPageId page) const
+{
+	return IsValidPage(page) && mMips[GetPageMip(page)].slots[GetPageIndex(page)] != 0;
+}
+
+VirtualPageId VirtualTexture::GetAncestor(VirtualPageId page, UINT mip) const
+{
+	UINT shift = mip - GetPageMip(page);
+	return MakePageId(GetPageX(page) >> shift, GetPageY(page) >> shift, mip);
+}
+
+void VirtualTexture::AddFeedback(const VirtualPageId* pages, size_t count)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	mFeedbackSamples += mFeedback.Add(pages, count);
+	mFeedbackMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VirtualTexture::SetEntries(VirtualPageId page, const PageTableEntry& entry, bool onlyMip)
+{
+	UINT pageMip = GetPageMip(page);
+	for (int k = (int)pageMip; k >= 0; --k)
+	{
+		Mip& mip = mMips[k];
+		UINT shift = pageMip - k;
+		UINT x0 = GetPageX(page) << shift, x1 = std::min((GetPageX(page) + 1) << shift, mip.pagesX);
+		UINT y0 = GetPageY(page) << shift, y1 = std::min((GetPageY(page) + 1) << shift, mip.pagesY);
+		for (UINT y = y0; y < y1; ++y)
+		{
+			PageTableEntry* row = &mip.table[(size_t)y * mip.pagesX];
+			for (UINT x = x0; x < x1; ++x)
+			{
+				PageTableEntry& current = row[x];
+				bool replace = onlyMip ? current.resident && current.mip == pageMip : !current.resident || current.mip > pageMip;
+				if (replace)
+					current = entry;
+			}
+		}
+		mip.dirty = true;
+	}
+}
+
+void VirtualTexture::Map(VirtualPageId page, UINT slot)
+{
+	mSlots[slot].page = page;
+	mSlots[slot].usedFrame = mFrame;
+	mMips[GetPageMip(page)].slots[GetPageIndex(page)] = slot + 1;
+
+	PageTableEntry entry = { (BYTE)(slot % mCachePagesX), (BYTE)(slot / mCachePagesX), (BYTE)GetPageMip(page), 1 };
+	SetEntries(page, entry, false);
+}
+
+void VirtualTexture::Unmap(UINT slot)
+{
+	VirtualPageId page = mSlots[slot].page;
+	UINT mip = GetPageMip(page);
+
+	// the pages drawn with this one fall back to what its parent is drawn with
+	PageTableEntry parent = { 0, 0, 0, 0 };
+	if (mip + 1 < mMips.size())
+	{
+		VirtualPageId parentPage = GetAncestor(page, mip + 1);
+		parent = mMips[mip + 1].table[GetPageIndex(parentPage)];
+	}
+	SetEntries(page, parent, true);
+
+	mMips[mip].slots[GetPageIndex(page)] = 0;
+	mSlots[slot].page = InvalidPageId;
+}
+
+void VirtualTexture::Touch(VirtualPageId page)
+{
+	for (UINT m = GetPageMip(page); m < mMips.size(); ++m)
+	{
+		UINT slot = mMips[m].slots[GetPageIndex(GetAncestor(page, m))];
+		if (slot == 0)
+			continue;
+
+		// the coarser pages were marked with it
+		if (mSlots[slot - 1].usedFrame == mFrame)
+			break;
+		mSlots[slot - 1].usedFrame = mFrame;
+	}
+}
+
+void VirtualTexture::Update(UINT maxLoads, std::vector<PageLoad>& loads)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	double feedbackMilliseconds = mFeedbackMilliseconds;
+	mFeedbackMilliseconds = 0.0;
+	ZeroMemory(&mStats, sizeof(mStats));
+	if (mMips.empty())
+		return;
+
+	mFrame++;
+	mStats.feedbackSamples = (UINT)mFeedbackSamples;
+
+	UINT lastMip = GetMipCount() - 1;
+	mQueue.Clear();
+
+	// The coarsest mip is drawn in place of everything else, it comes first
+	for (UINT y = 0; y < mMips[lastMip].pagesY; ++y)
+	{
+		for (UINT x = 0; x < mMips[lastMip].pagesX; ++x)
+		{
+			if (!IsResident(MakePageId(x, y, lastMip)))
+				mQueue.Add(MakePageId(x, y, lastMip), 0);
+		}
+	}
+
+	// The page drawn for every requested page stays, a missing page queues the page
+	// one mip finer than the one drawn in its place
+	for (UINT i = 0; i < mFeedback.GetPageCount(); ++i)
+	{
+		VirtualPageId page = mFeedback.GetPage(i) & ~PAGE_INDEX_BITS;
+		if (!IsValidPage(page))
+			continue;
+		mStats.requestedPages++;
+
+		UINT mip = GetPageMip(page);
+		const PageTableEntry& entry = mMips[mip].table[GetPageIndex(page)];
+		if (entry.resident)
+			Touch(GetAncestor(page, entry.mip));
+		if (entry.resident && entry.mip == mip)
+			continue;
+
+		mStats.missingPages++;
+		mQueue.Add(GetAncestor(page, entry.resident ? entry.mip - 1 : lastMip), mFeedback.GetCount(i));
+	}
+	mFeedback.Clear();
+	mFeedbackSamples = 0;
+
+	// Coarse mips first, then the pages covering the most pixels
+	std::vector<UINT> order(mQueue.GetPageCount());
+	for (UINT i = 0; i < (UINT)order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](UINT a, UINT b)
+	{
+		UINT mipA = GetPageMip(mQueue.GetPage(a)), mipB = GetPageMip(mQueue.GetPage(b));
+		if (mipA != mipB)
+			return mipA > mipB;
+		if (mQueue.GetCount(a) != mQueue.GetCount(b))
+			return mQueue.GetCount(a) > mQueue.GetCount(b);
+		return mQueue.GetPage(a) < mQueue.GetPage(b);
+	});
+	mStats.queuedLoads = (UINT)order.size();
+
+	// The least recently used pages the frame did not draw, the coarsest mip stays
+	std::vector<UINT> evictable;
+	bool evictableSorted = false;
+	size_t nextEvictable = 0;
+
+	for (size_t q = 0; q < order.size() && mStats.loads < maxLoads; ++q)
+	{
+		VirtualPageId page = mQueue.GetPage(order[q]);
+
+		UINT slot;
+		if (!mFreeSlots.empty())
+		{
+			slot = mFreeSlots.back();
+			mFreeSlots.pop_back();
+		}
+		else
+		{
+			if (!evictableSorted)
+			{
+				for (UINT s = 0; s < (UINT)mSlots.size(); ++s)
+				{
+					if (mSlots[s].page != InvalidPageId && mSlots[s].usedFrame != mFrame && GetPageMip(mSlots[s].page) != lastMip)
+						evictable.push_back(s);
+				}
+				std::stable_sort(evictable.begin(), evictable.end(), [&](UINT a, UINT b) { return mSlots[a].usedFrame < mSlots[b].usedFrame; });
+				evictableSorted = true;
+			}
+
+			// every page in the cache is drawn, the rest waits for the next frames
+			if (nextEvictable == evictable.size())
+				break;
+			slot = evictable[nextEvictable++];
+			Unmap(slot);
+			mStats.evictions++;
+		}
+
+		Map(page, slot);
+		PageLoad load = { page, slot % mCachePagesX, slot / mCachePagesX };
+		loads.push_back(load);
+		mStats.loads++;
+	}
+
+	mStats.residentPages = (UINT)(mSlots.size() - mFreeSlots.size());
+	mStats.milliseconds = feedbackMilliseconds + std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VirtualTexture::ClearDirty()
+{
+	for (size_t m = 0; m < mMips.size(); ++m)
+		mMips[m].dirty = false;
+}
+
+bool VirtualTexture::Validate() const
+{
+	for (UINT s = 0; s < (UINT)mSlots.size(); ++s)
+	{
+		VirtualPageId page = mSlots[s].page;
+		if (page != InvalidPageId && (!IsValidPage(page) || mMips[GetPageMip(page)].slots[GetPageIndex(page)] != s + 1))
+			return false;
+	}
+
+	for (UINT k = 0; k < GetMipCount(); ++k)
+	{
+		for (UINT y = 0; y < mMips[k].pagesY; ++y)
+		{
+			for (UINT x = 0; x < mMips[k].pagesX; ++x)
+			{
+				VirtualPageId page = MakePageId(x, y, k);
+				const PageTableEntry& entry = mMips[k].table[GetPageIndex(page)];
+
+				// the nearest resident page at this mip or coarser
+				UINT slot = 0, m = k;
+				for (; m < GetMipCount() && slot == 0; ++m)
+					slot = mMips[m].slots[GetPageIndex(GetAncestor(page, m))];
+
+				if (slot == 0)
+				{
+					if (entry.resident)
+						return false;
+				}
+				else if (!entry.resident || entry.mip != m - 1 || entry.x != (slot - 1) % mCachePagesX || entry.y != (slot - 1) / mCachePagesX)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Util.h"
+
+// Page of a virtual texture as the feedback pass writes it: x in bits 0-11, y in bits
+// 12-23, mip in bits 24-27, bits 28-30 are free for a virtual texture index and bit 31
+// is set on every page, so a cleared feedback buffer reads InvalidPageId.
+typedef UINT VirtualPageId;
+const VirtualPageId InvalidPageId = 0;
+
+inline VirtualPageId MakePageId(UINT x, UINT y, UINT mip) { return 0x80000000u | x | (y << 12) | (mip << 24); }
+inline UINT GetPageX(VirtualPageId page) { return page & 0xfff; }
+inline UINT GetPageY(VirtualPageId page) { return (page >> 12) & 0xfff; }
+inline UINT GetPageMip(VirtualPageId page) { return (page >> 24) & 0xf; }
+
+// Indirection entry of a page, the texel of the page table texture (R8G8B8A8_UINT):
+// the cache slot and the mip of the page drawn in its place, itself or the nearest
+// resident coarser page. resident is 0 while none is.
+struct PageTableEntry
+{
+	BYTE x;
+	BYTE y;
+	BYTE mip;
+	BYTE resident;
+};
+
+// A page Update picked, the caller copies its data into the cache slot
+struct PageLoad
+{
+	VirtualPageId page;
+	UINT slotX;
+	UINT slotY;
+};
+
+// Counters of the last VirtualTexture::Update
+struct VirtualTextureStats
+{
+	UINT feedbackSamples;	// page ids added since the Update before, without InvalidPageId
+	UINT requestedPages;	// distinct pages among them
+	UINT missingPages;		// requested pages drawn with a coarser page
+	UINT queuedLoads;		// distinct pages that would bring a missing page closer
+	UINT loads;				// pages picked this Update
+	UINT evictions;			// resident pages dropped for them
+	UINT residentPages;
+	double milliseconds;	// CPU time of the feedback processing and Update
+};
+
+// PageCounter
+// Open addressing hash map from page id to a count, linear probing in a power of two
+// table. Clear is O(1), a generation number marks the table slots of the current
+// contents. Feedback has long runs of one id, consecutive equal ids cost one lookup.
+// usage:
+// counter.Clear(); counter.Add(pages, count);
+// for (UINT i = 0; i < counter.GetPageCount(); ++i) counter.GetPage(i), counter.GetCount(i)
+class PageCounter
+{
+public:
+	PageCounter();
+
+	void Clear();
+
+	// Counts page count times, returns the index of the page in GetPage / GetCount
+	UINT Add(VirtualPageId page, UINT count = 1);
+
+	// Counts every page but InvalidPageId, returns the number counted
+	size_t Add(const VirtualPageId* pages, size_t count);
+
+	// Distinct pages in the order they were first added
+	UINT GetPageCount() const { return (UINT)mPages.size(); }
+	VirtualPageId GetPage(UINT index) const { return mPages[index]; }
+	UINT GetCount(UINT index) const { return mCounts[index]; }
+
+private:
+	void Grow();
+
+	std::vector<VirtualPageId> mKeys;
+	std::vector<UINT> mIndices;		// into mPages
+	std::vector<UINT> mGenerations;	// mKeys[i] is valid if mGenerations[i] == mGeneration
+	UINT mGeneration;
+	UINT mMask;
+
+	std::vector<VirtualPageId> mPages;
+	std::vector<UINT> mCounts;
+};
+
+// VirtualTexture
+// Page table and page cache of a sparse virtual texture, the CPU side without any
+// GPU or file access, so it can be driven by synthetic feedback.
+// usage:
+// virtualTexture.Init(65536, 65536, 128, 32, 32)
+// every frame:
+// virtualTexture.AddFeedback(pageIds, count) with the feedback buffer of a past frame
+// virtualTexture.Update(maxLoads, loads)
+// copy the page of every load into its cache slot, upload the dirty page table mips
+//
+// The virtual texture is cut into pages of pageSize texels on every mip down to the
+// mip that is a single page, the cache holds cachePagesX x cachePagesY of them. The
+// page table has an entry per page and mip mapping it to its cache slot, or to the
+// nearest resident coarser page while it is not loaded, so the shader always finds
+// something to draw. The coarsest mip is loaded first and never evicted.
+//
+// Update deduplicates the feedback, marks the pages drawn for it and their coarser
+// pages as used, and queues for every missing page the page one mip finer than the
+// one drawn in its place, so a page only loads after its coarser pages did. The queue
+// is sorted coarse mips first, then by the number of feedback samples, and up to
+// maxLoads pages get a free slot or the slot of the least recently used page that the
+// frame did not use. Pages are loaded one mip step per Update at most, a finer page
+// needs feedback again after its parent arrived.
+class VirtualTexture
+{
+public:
+	VirtualTexture();
+
+	// Sizes are powers of two, width and height at least pageSize. At most 4096 pages
+	// a side on mip 0, 16 mips and 256 cache pages a side. Returns false otherwise.
+	bool Init(UINT width, UINT height, UINT pageSize, UINT cachePagesX, UINT cachePagesY);
+
+	// Page ids of a frame's feedback, InvalidPageId and pages outside the texture are skipped
+	void AddFeedback(const VirtualPageId* pages, size_t count);
+
+	// Processes the feedback added since the last Update and appends the pages to load
+	// to loads. Their page table entries point at their slots already, copy the pages
+	// before the page table is drawn with.
+	void Update(UINT maxLoads, std::vector<PageLoad>& loads);
+
+	UINT GetWidth() const { return mWidth; }
+	UINT GetHeight() const { return mHeight; }
+	UINT GetPageSize() const { return mPageSize; }
+	UINT GetMipCount() const { return (UINT)mMips.size(); }
+	UINT GetPagesX(UINT mip) const { return mMips[mip].pagesX; }
+	UINT GetPagesY(UINT mip) const { return mMips[mip].pagesY; }
+	UINT GetCachePagesX() const { return mCachePagesX; }
+	UINT GetCachePagesY() const { return mCachePagesY; }
+
+	// pagesX x pagesY entries of mip, rows from the top
+	const PageTableEntry* GetPageTable(UINT mip) const { return &mMips[mip].table[0]; }
+
+	// Page table mips changed since the last ClearDirty
+	bool IsPageTableDirty(UINT mip) const { return mMips[mip].dirty; }
+	void ClearDirty();
+
+	bool IsResident(VirtualPageId page) const;
+
+	const VirtualTextureStats& GetStats() const { return mStats; }
+
+	// Checks every page table entry against the resident pages, for tests
+	bool Validate() const;
+
+private:
+	struct Mip
+	{
+		UINT pagesX;
+		UINT pagesY;
+		std::vector<PageTableEntry> table;
+		std::vector<UINT> slots;	// cache slot + 1 of every resident page, 0 if not resident
+		bool dirty;
+	};
+
+	struct Slot
+	{
+		VirtualPageId page;		// InvalidPageId if free
+		UINT usedFrame;
+	};
+
+	bool IsValidPage(VirtualPageId page) const;
+	UINT GetPageIndex(VirtualPageId page) const { return GetPageY(page) * mMips[GetPageMip(page)].pagesX + GetPageX(page); }
+
+	// The page at mip covering page
+	VirtualPageId GetAncestor(VirtualPageId page, UINT mip) const;
+
+	// Sets the entries of page and the finer pages below it mapped to a coarser page than
+	// mip, or mapped to mip if onlyMip, to entry
+	void SetEntries(VirtualPageId page, const PageTableEntry& entry, bool onlyMip);
+
+	void Map(VirtualPageId page, UINT slot);
+	void Unmap(UINT slot);
+
+	// Marks page and its coarser pages used by this frame
+	void Touch(VirtualPageId page);
+
+	UINT mWidth;
+	UINT mHeight;
+	UINT mPageSize;
+	UINT mCachePagesX;
+	UINT mCachePagesY;
+	std::vector<Mip> mMips;
+
+	std::vector<Slot> mSlots;
+	std::vector<UINT> mFreeSlots;
+	UINT mFrame;
+
+	PageCounter mFeedback;
+	PageCounter mQueue;
+	size_t mFeedbackSamples;
+	double mFeedbackMilliseconds;
+
+	VirtualTextureStats mStats;
+};
@@ -0,0 +1,177 @@
+#include "VirtualTextureFile.h"
+#include "TextureCompressor.h"
+
+namespace
+{
+	bool IsPowerOfTwo(UINT value)
+	{
+		return value != 0 && (value & (value - 1)) == 0;
+	}
+
+	// Mips of a width x height virtual texture, down to the one that fits into a page,
+	// VirtualTexture::Init counts them the same way
+	UINT GetPageMipCount(UINT width, UINT height, UINT pageSize)
+	{
+		UINT pages = std::max(width / pageSize, height / pageSize);
+		UINT mipCount = 1;
+		while (pages > 1)
+		{
+			pages >>= 1;
+			mipCount++;
+		}
+		return mipCount;
+	}
+}
+
+VirtualTextureFile::VirtualTextureFile()
+{
+	ZeroMemory(&mHeader, sizeof(mHeader));
+}
+
+bool VirtualTextureFile::Write(const std::string& fileName, const TextureData& texture, UINT pageSize, UINT border, DXGI_FORMAT format)
+{
+	const BYTE* pixels = texture.GetPixels();
+	UINT tileSize = pageSize + 2 * border;
+	bool compressed = GetBlockBytes(format) > 0;
+	if (pixels == NULL || texture.format != DXGI_FORMAT_R8G8B8A8_UNORM || !IsPowerOfTwo(texture.width) || !IsPowerOfTwo(texture.height) ||
+		!IsPowerOfTwo(pageSize) || texture.width < pageSize || texture.height < pageSize || (compressed && tileSize % 4 != 0) ||
+		(!compressed && format != DXGI_FORMAT_R8G8B8A8_UNORM))
+	{
+		return false;
+	}
+
+	UINT mipCount = GetPageMipCount(texture.width, texture.height, pageSize);
+	if (texture.mips.size() < mipCount)
+		return false;
+
+	std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	Header header;
+	header.magic = mMagic;
+	header.version = mVersion;
+	header.width = texture.width;
+	header.height = texture.height;
+	header.pageSize = pageSize;
+	header.border = border;
+	header.mipCount = mipCount;
+	header.format = (UINT)format;
+	header.pageBytes = (UINT)GetSurfaceBytes(format, tileSize, tileSize);
+	out.write((const char*)&header, sizeof(header));
+
+	UINT tileRowBytes = GetRowPitch(format, tileSize);
+	UINT tileRows = compressed ? tileSize / 4 : tileSize;
+	for (UINT m = 0; m < mipCount; ++m)
+	{
+		const TextureMip& mip = texture.mips[m];
+		UINT pagesX = std::max((texture.width / pageSize) >> m, 1u);
+		UINT pagesY = std::max((texture.height / pageSize) >> m, 1u);
+
+		// A row of pages is cut into a strip of tiles side by side and compressed at once,
+		// the tiles are whole blocks so every one comes out as it would on its own
+		TextureData strip;
+		strip.width = pagesX * tileSize;
+		strip.height = tileSize;
+		strip.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		TextureMip stripMip = { strip.width, strip.height, strip.width * 4, 0 };
+		strip.mips.push_back(stripMip);
+		strip.pixels.resize((size_t)stripMip.rowPitch * strip.height);
+
+		for (UINT py = 0; py < pagesY; ++py)
+		{
+			for (UINT row = 0; row < tileSize; ++row)
+			{
+				int sourceRow = std::min(std::max((int)(py * pageSize + row) - (int)border, 0), (int)mip.height - 1);
+				const UINT* sourceTexels = (const UINT*)(pixels + mip.offset + (size_t)sourceRow * mip.rowPitch);
+				UINT* destTexels = (UINT*)&strip.pixels[(size_t)row * stripMip.rowPitch];
+				for (UINT column = 0; column < strip.width; ++column)
+				{
+					UINT px = column / tileSize;
+					int sourceColumn = std::min(std::max((int)(px * pageSize + column % tileSize) - (int)border, 0), (int)mip.width - 1);
+					destTexels[column] = sourceTexels[sourceColumn];
+				}
+			}
+
+			TextureData encoded;
+			if (compressed)
+			{
+				if (!TextureCompressor::Instance()->Compress(strip, format, encoded))
+					return false;
+			}
+			const TextureData& tiles = compressed ? encoded : strip;
+			const BYTE* tilePixels = tiles.GetPixels();
+
+			for (UINT px = 0; px < pagesX; ++px)
+			{
+				for (UINT r = 0; r < tileRows; ++r)
+					out.write((const char*)(tilePixels + tiles.mips[0].offset + (size_t)r * tiles.mips[0].rowPitch + (size_t)px * tileRowBytes), tileRowBytes);
+			}
+		}
+	}
+
+	return out.good();
+}
+
+bool VirtualTextureFile::Open(const std::string& fileName)
+{
+	Close();
+	if (!mFile.Open(fileName) || mFile.GetSize() < sizeof(Header))
+	{
+		Close();
+		return false;
+	}
+
+	Header header;
+	memcpy(&header, mFile.GetData(), sizeof(header));
+	UINT tileSize = header.pageSize + 2 * header.border;
+	if (header.magic != mMagic || header.version != mVersion || !IsPowerOfTwo(header.pageSize) ||
+		header.width < header.pageSize || header.height < header.pageSize ||
+		header.mipCount != GetPageMipCount(header.width, header.height, header.pageSize) ||
+		header.pageBytes != GetSurfaceBytes((DXGI_FORMAT)header.format, tileSize, tileSize))
+	{
+		Close();
+		return false;
+	}
+
+	std::vector<UINT> firstPages(header.mipCount + 1, 0);
+	for (UINT m = 0; m < header.mipCount; ++m)
+	{
+		UINT pagesX = std::max((header.width / header.pageSize) >> m, 1u);
+		UINT pagesY = std::max((header.height / header.pageSize) >> m, 1u);
+		firstPages[m + 1] = firstPages[m] + pagesX * pagesY;
+	}
+
+	// a truncated file is not read past its end
+	if (mFile.GetSize() < sizeof(Header) + (UINT64)firstPages[header.mipCount] * header.pageBytes)
+	{
+		Close();
+		return false;
+	}
+
+	mHeader = header;
+	mFirstPages.swap(firstPages);
+	return true;
+}
+
+void VirtualTextureFile::Close()
+{
+	mFile.Close();
+	ZeroMemory(&mHeader, sizeof(mHeader));
+	mFirstPages.clear();
+}
+
+const BYTE* VirtualTextureFile::GetPage(VirtualPageId page) const
+{
+	UINT mip = GetPageMip(page);
+	if (!mFile.IsOpen() || page == InvalidPageId || mip >= mHeader.mipCount)
+		return NULL;
+
+	UINT pagesX = std::max((mHeader.width / mHeader.pageSize) >> mip, 1u);
+	UINT pagesY = std::max((mHeader.height / mHeader.pageSize) >> mip, 1u);
+	if (GetPageX(page) >= pagesX || GetPageY(page) >= pagesY)
+		return NULL;
+
+	UINT index = mFirstPages[mip] + GetPageY(page) * pagesX + GetPageX(page);
+	return mFile.GetData() + sizeof(Header) + (size_t)index * mHeader.pageBytes;
+}
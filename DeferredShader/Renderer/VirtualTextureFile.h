@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Util.h"
+#include "TextureData.h"
+#include "VirtualTexture.h"
+
+// VirtualTextureFile
+// Tiled page file of a virtual texture, written by the cooker and mapped at runtime.
+// usage:
+// VirtualTextureFile::Write("terrain.vt", rgbaTextureWithMips, 128, 4, DXGI_FORMAT_BC7_UNORM)
+// file.Open("terrain.vt"); virtualTexture.Init(file.GetWidth(), file.GetHeight(), file.GetPageSize(), ...)
+// for every PageLoad: copy file.GetPage(load.page) into the cache slot
+//
+// Every page is a tile of (pageSize + 2 * border)^2 texels: the page and a border of
+// the texels around it, clamped at the texture edges, so the cache can be sampled
+// bilinear and anisotropic without reading the neighbouring slot. The tiles of all
+// mips VirtualTexture pages, finest first and rows from the top, follow the header
+// at a fixed size each, a page is found by its index without a table.
+class VirtualTextureFile
+{
+public:
+	VirtualTextureFile();
+
+	// Cuts the mips of an RGBA8 texture into tiles and writes them as RGBA8 or compressed
+	// to a BCn format. The texture needs the mips down to the one that fits into a page,
+	// the tile side must be a multiple of 4 for BCn.
+	static bool Write(const std::string& fileName, const TextureData& texture, UINT pageSize, UINT border, DXGI_FORMAT format);
+
+	// Maps the file, returns false if it is not a page file of this version
+	bool Open(const std::string& fileName);
+	void Close();
+
+	UINT GetWidth() const { return mHeader.width; }
+	UINT GetHeight() const { return mHeader.height; }
+	UINT GetPageSize() const { return mHeader.pageSize; }
+	UINT GetBorder() const { return mHeader.border; }
+	UINT GetTileSize() const { return mHeader.pageSize + 2 * mHeader.border; }
+	UINT GetMipCount() const { return mHeader.mipCount; }
+	DXGI_FORMAT GetFormat() const { return (DXGI_FORMAT)mHeader.format; }
+
+	// Bytes of a tile and of a row of its texels, a row of 4x4 blocks for BCn
+	UINT GetPageBytes() const { return mHeader.pageBytes; }
+	UINT GetPageRowPitch() const { return GetRowPitch(GetFormat(), GetTileSize()); }
+
+	// The tile of page in the mapping, NULL if the file has no such page
+	const BYTE* GetPage(VirtualPageId page) const;
+
+	// 'DSVT'
+	static const UINT mMagic = 0x54565344;
+	// bump this whenever the layout changes
+	static const UINT mVersion = 1;
+
+private:
+	VirtualTextureFile(const VirtualTextureFile& rhs);
+	VirtualTextureFile& operator=(const VirtualTextureFile& rhs);
+
+	struct Header
+	{
+		UINT magic;
+		UINT version;
+		UINT width;
+		UINT height;
+		UINT pageSize;
+		UINT border;
+		UINT mipCount;
+		UINT format;
+		UINT pageBytes;
+	};
+
+	MappedFile mFile;
+	Header mHeader;
+	std::vector<UINT> mFirstPages;	// index of the first tile of every mip, then the tile count
+};
@@ -0,0 +1,162 @@
+#include "VirtualTextureResources.h"
+
+VirtualTextureResources::VirtualTextureResources() : mCache(NULL), mCacheSRV(NULL), mPageTable(NULL), mPageTableSRV(NULL),
+mFeedback(NULL), mFeedbackRTV(NULL), mFeedbackWrite(0), mFeedbackPending(0), mTileSize(0),
+mTextureConstants(0.0f, 0.0f, 0.0f, 0.0f), mCacheConstants(0.0f, 0.0f, 0.0f, 0.0f)
+{
+	for (UINT i = 0; i < ARRAYSIZE(mFeedbackStaging); ++i)
+		mFeedbackStaging[i] = NULL;
+}
+
+VirtualTextureResources::~VirtualTextureResources()
+{
+	Release();
+}
+
+bool VirtualTextureResources::Init(ID3D11Device* device, const VirtualTexture& virtualTexture, const VirtualTextureFile& file, UINT feedbackWidth, UINT feedbackHeight)
+{
+	HRESULT hr;
+
+	Release();
+
+	if (virtualTexture.GetWidth() != file.GetWidth() || virtualTexture.GetHeight() != file.GetHeight() ||
+		virtualTexture.GetPageSize() != file.GetPageSize() || virtualTexture.GetMipCount() != file.GetMipCount())
+	{
+		DebugLog("VirtualTextureResources: the page file does not match the virtual texture\n");
+		return false;
+	}
+
+	mTileSize = file.GetTileSize();
+	UINT cacheWidth = virtualTexture.GetCachePagesX() * mTileSize;
+	UINT cacheHeight = virtualTexture.GetCachePagesY() * mTileSize;
+	if (cacheWidth > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION || cacheHeight > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+	{
+		DebugLog("VirtualTextureResources: a %u x %u page cache is too large\n", cacheWidth, cacheHeight);
+		return false;
+	}
+
+	// The page cache, written a tile at a time
+	D3D11_TEXTURE2D_DESC dtd = {
+		cacheWidth, //UINT Width;
+		cacheHeight, //UINT Height;
+		1, //UINT MipLevels;
+		1, //UINT ArraySize;
+		file.GetFormat(), //DXGI_FORMAT Format;
+		1, //DXGI_SAMPLE_DESC SampleDesc;
+		0,
+		D3D11_USAGE_DEFAULT,//D3D11_USAGE Usage;
+		D3D11_BIND_SHADER_RESOURCE,//UINT BindFlags;
+		0,//UINT CPUAccessFlags;
+		0//UINT MiscFlags;
+	};
+	V_RETURN(device->CreateTexture2D(&dtd, NULL, &mCache));
+	V_RETURN(device->CreateShaderResourceView(mCache, NULL, &mCacheSRV));
+
+	// The page table, a texel per page on every mip
+	dtd.Width = virtualTexture.GetPagesX(0);
+	dtd.Height = virtualTexture.GetPagesY(0);
+	dtd.MipLevels = virtualTexture.GetMipCount();
+	dtd.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	V_RETURN(device->CreateTexture2D(&dtd, NULL, &mPageTable));
+	V_RETURN(device->CreateShaderResourceView(mPageTable, NULL, &mPageTableSRV));
+
+	// The feedback target and the staging textures it is read back through
+	dtd.Width = feedbackWidth;
+	dtd.Height = feedbackHeight;
+	dtd.MipLevels = 1;
+	dtd.Format = DXGI_FORMAT_R32_UINT;
+	dtd.BindFlags = D3D11_BIND_RENDER_TARGET;
+	V_RETURN(device->CreateTexture2D(&dtd, NULL, &mFeedback));
+	V_RETURN(device->CreateRenderTargetView(mFeedback, NULL, &mFeedbackRTV));
+
+	dtd.Usage = D3D11_USAGE_STAGING;
+	dtd.BindFlags = 0;
+	dtd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (UINT i = 0; i < ARRAYSIZE(mFeedbackStaging); ++i)
+		V_RETURN(device->CreateTexture2D(&dtd, NULL, &mFeedbackStaging[i]));
+
+	mTextureConstants = XMFLOAT4((float)file.GetWidth(), (float)file.GetHeight(), (float)file.GetPageSize(), (float)file.GetMipCount());
+	mCacheConstants = XMFLOAT4((float)cacheWidth, (float)cacheHeight, (float)mTileSize, (float)file.GetBorder());
+	return true;
+}
+
+void VirtualTextureResources::Release()
+{
+	SAFE_RELEASE(mCache);
+	SAFE_RELEASE(mCacheSRV);
+	SAFE_RELEASE(mPageTable);
+	SAFE_RELEASE(mPageTableSRV);
+	SAFE_RELEASE(mFeedback);
+	SAFE_RELEASE(mFeedbackRTV);
+	for (UINT i = 0; i < ARRAYSIZE(mFeedbackStaging); ++i)
+		SAFE_RELEASE(mFeedbackStaging[i]);
+
+	mFeedbackWrite = 0;
+	mFeedbackPending = 0;
+}
+
+void VirtualTextureResources::Upload(ID3D11DeviceContext* pd3dImmediateContext, VirtualTexture& virtualTexture, const VirtualTextureFile& file, const std::vector<PageLoad>& loads)
+{
+	if (mCache == NULL)
+		return;
+
+	for (size_t i = 0; i < loads.size(); ++i)
+	{
+		const BYTE* tile = file.GetPage(loads[i].page);
+		if (tile == NULL)
+			continue;
+
+		D3D11_BOX box = { loads[i].slotX * mTileSize, loads[i].slotY * mTileSize, 0, (loads[i].slotX + 1) * mTileSize, (loads[i].slotY + 1) * mTileSize, 1 };
+		pd3dImmediateContext->UpdateSubresource(mCache, 0, &box, tile, file.GetPageRowPitch(), file.GetPageBytes());
+	}
+
+	// the page table entries are the texels, the mips are written whole
+	for (UINT m = 0; m < virtualTexture.GetMipCount(); ++m)
+	{
+		if (virtualTexture.IsPageTableDirty(m))
+			pd3dImmediateContext->UpdateSubresource(mPageTable, m, NULL, virtualTexture.GetPageTable(m), virtualTexture.GetPagesX(m) * sizeof(PageTableEntry), 0);
+	}
+	virtualTexture.ClearDirty();
+}
+
+void VirtualTextureResources::ClearFeedback(ID3D11DeviceContext* pd3dImmediateContext)
+{
+	if (mFeedbackRTV == NULL)
+		return;
+
+	// the float clear color converts to the UINT InvalidPageId
+	const float invalidPage[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	pd3dImmediateContext->ClearRenderTargetView(mFeedbackRTV, invalidPage);
+}
+
+void VirtualTextureResources::ReadFeedback(ID3D11DeviceContext* pd3dImmediateContext, VirtualTexture& virtualTexture)
+{
+	if (mFeedback == NULL)
+		return;
+
+	const UINT stagingCount = ARRAYSIZE(mFeedbackStaging);
+
+	// a full ring drops this frame's feedback, the next frames request the same pages
+	if (mFeedbackPending < stagingCount)
+	{
+		pd3dImmediateContext->CopyResource(mFeedbackStaging[mFeedbackWrite], mFeedback);
+		mFeedbackWrite = (mFeedbackWrite + 1) % stagingCount;
+		mFeedbackPending++;
+	}
+
+	if (mFeedbackPending <= FeedbackLatency)
+		return;
+
+	UINT oldest = (mFeedbackWrite + stagingCount - mFeedbackPending) % stagingCount;
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(pd3dImmediateContext->Map(mFeedbackStaging[oldest], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+		return;
+
+	D3D11_TEXTURE2D_DESC desc;
+	mFeedbackStaging[oldest]->GetDesc(&desc);
+	for (UINT y = 0; y < desc.Height; ++y)
+		virtualTexture.AddFeedback((const VirtualPageId*)((const BYTE*)mapped.pData + (size_t)y * mapped.RowPitch), desc.Width);
+
+	pd3dImmediateContext->Unmap(mFeedbackStaging[oldest], 0);
+	mFeedbackPending--;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Util.h"
+#include "VirtualTexture.h"
+#include "VirtualTextureFile.h"
+
+// VirtualTextureResources
+// GPU side of a VirtualTexture: the page cache texture, the page table texture and the
+// feedback target the geometry pass writes page ids into (Shaders\VirtualTexture.hlsl).
+// usage:
+// resources.Init(device, virtualTexture, file, width / 8, height / 8)
+// every frame:
+// resources.ClearFeedback(context), draw with GetFeedbackRTV() bound next to the GBuffer
+// resources.ReadFeedback(context, virtualTexture)
+// virtualTexture.Update(maxLoads, loads); resources.Upload(context, virtualTexture, file, loads)
+// bind GetPageTableView() and GetCacheView() for VirtualTextureSample
+//
+// The feedback is copied into a ring of staging textures and read FeedbackLatency
+// frames later without waiting for the GPU, a copy that is not ready yet is read the
+// next frame.
+class VirtualTextureResources
+{
+public:
+	// Frames between the copy of the feedback and its read back
+	static const UINT FeedbackLatency = 2;
+
+	VirtualTextureResources();
+	~VirtualTextureResources();
+
+	// The cache holds the tiles of the file in its format, the page table has a texel per
+	// page and a mip per VirtualTexture mip. The feedback target is feedbackWidth x feedbackHeight.
+	bool Init(ID3D11Device* device, const VirtualTexture& virtualTexture, const VirtualTextureFile& file, UINT feedbackWidth, UINT feedbackHeight);
+	void Release();
+
+	// Copies the tiles of loads into their cache slots and the dirty page table mips
+	void Upload(ID3D11DeviceContext* pd3dImmediateContext, VirtualTexture& virtualTexture, const VirtualTextureFile& file, const std::vector<PageLoad>& loads);
+
+	// Clears the feedback target to InvalidPageId
+	void ClearFeedback(ID3D11DeviceContext* pd3dImmediateContext);
+
+	// Queues the copy of this frame's feedback and hands the oldest finished copy to virtualTexture
+	void ReadFeedback(ID3D11DeviceContext* pd3dImmediateContext, VirtualTexture& virtualTexture);
+
+	ID3D11RenderTargetView* GetFeedbackRTV() { return mFeedbackRTV; }
+	ID3D11ShaderResourceView* GetPageTableView() { return mPageTableSRV; }
+	ID3D11ShaderResourceView* GetCacheView() { return mCacheSRV; }
+
+	// The VirtualTextureSample constants: (width, height, pageSize, mipCount) and
+	// (cache width, cache height, tile size, border)
+	XMFLOAT4 GetTextureConstants() const { return mTextureConstants; }
+	XMFLOAT4 GetCacheConstants() const { return mCacheConstants; }
+
+private:
+	ID3D11Texture2D* mCache;
+	ID3D11ShaderResourceView* mCacheSRV;
+	ID3D11Texture2D* mPageTable;
+	ID3D11ShaderResourceView* mPageTableSRV;
+
+	ID3D11Texture2D* mFeedback;
+	ID3D11RenderTargetView* mFeedbackRTV;
+	ID3D11Texture2D* mFeedbackStaging[FeedbackLatency + 1];
+	UINT mFeedbackWrite;	// staging texture of the next copy
+	UINT mFeedbackPending;	// copies not read back yet
+
+	UINT mTileSize;
+	XMFLOAT4 mTextureConstants;
+	XMFLOAT4 mCacheConstants;
+};
@@ -7,6 +7,8 @@ cbuffer cbPerObjectVS : register(b0)
 {
     float4x4 WorldViewProjection    : packoffset(c0);
     float4x4 World                  : packoffset(c4);
+    float4 PositionScale            : packoffset(c8);	// dequantization of packed positions,
+    float4 PositionOffset           : packoffset(c9);	// scale 1 and offset 0 for float vertices
 }
 
 // Model pixel shader constants
@@ -19,20 +21,32 @@ cbuffer cbPerObjectPS : register(b0)
 	bool useSpecularTexture		: packoffset(c1.w);
 	bool useNormalMapTexture	: packoffset(c2.x);
 	bool useAlphaTexture		: packoffset(c2.y);
-	float pad					: packoffset(c2.z);
+	float2 pad					: packoffset(c2.z);
+	float4 diffuseTransform		: packoffset(c3);	// UV scale in xy and bias in zw into the diffuse texture's atlas
 }
 
-// Diffuse texture and linear sampler
+// Diffuse texture, tangent space normal map and linear sampler
 Texture2D DiffuseTexture    : register(t0);
+Texture2D NormalMapTexture  : register(t1);
 SamplerState LinearSampler  : register(s0);
 
 
 // shader input/output structure
+// PACKED_VERTEX selects the 16 byte PackedVertex layout from Mesh.h,
+// positions are UNORM16 in the mesh bounds, normals octahedral SNORM16
+// and Position.w the tangent angle and bitangent sign
 struct VS_INPUT
 {
     float4 Position : POSITION;
+#ifdef PACKED_VERTEX
+    float2 Normal   : NORMAL;
+#else
     float3 Normal   : NORMAL;
+#endif
     float2 UV       : TEXCOORD0;
+#ifndef PACKED_VERTEX
+    float4 Tangent  : TANGENT;
+#endif
 };
 
 struct VS_OUTPUT
@@ -40,21 +54,57 @@ struct VS_OUTPUT
     float4 Position : SV_POSITION;
     float2 UV       : TEXCOORD0;
     float3 Normal   : TEXCOORD1;
+    float4 Tangent  : TEXCOORD2;	// w is the bitangent sign
 };
 
+// Octahedral normal decode, same as VertexQuantizer::DecodeOctahedral
+float3 DecodeOctahedralNormal(float2 e)
+{
+    float3 n = float3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Tangent decode, same as VertexQuantizer::DecodeTangent: a 15 bit angle in the
+// basis of TangentBasis around the normal, the top bit is the bitangent sign
+float4 DecodeTangent(float3 n, float encoded)
+{
+    float sign = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (sign + n.z);
+    float b = n.x * n.y * a;
+    float3 b1 = float3(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    float3 b2 = float3(b, sign + n.y * n.y * a, -n.y);
+
+    float bits = round(encoded * 65535.0);
+    float bitangentSign = bits >= 32768.0 ? -1.0 : 1.0;
+    float angle = ((bits - (bits >= 32768.0 ? 32768.0 : 0.0)) / 32767.0 - 0.5) * 6.28318530718;
+    return float4(b1 * cos(angle) + b2 * sin(angle), bitangentSign);
+}
+
 // Vertex shader
 VS_OUTPUT RenderSceneVS(VS_INPUT input)
 {
     VS_OUTPUT Output;
     float3 vNormalWorldSpace;
+
+    float4 position = float4(input.Position.xyz * PositionScale.xyz + PositionOffset.xyz, 1.0);
+#ifdef PACKED_VERTEX
+    float3 normal = DecodeOctahedralNormal(input.Normal);
+    float4 tangent = DecodeTangent(normal, input.Position.w);
+#else
+    float3 normal = input.Normal;
+    float4 tangent = input.Tangent;
+#endif
     
 	// Transform position from object space to homogeneous projection space
-    Output.Position = mul(input.Position, WorldViewProjection);
+    Output.Position = mul(position, WorldViewProjection);
 
     Output.UV = input.UV;
 
 	// Transform the normal to world space
-	Output.Normal = mul(input.Normal, (float3x3) World);
+	Output.Normal = mul(normal, (float3x3) World);
+	Output.Tangent = float4(mul(tangent.xyz, (float3x3) World), tangent.w);
     
     return Output;
 }
@@ -90,10 +140,26 @@ PS_GBUFFER_OUT RenderScenePS(VS_OUTPUT In)
 	float3 DiffuseColor = diffuseColor.xyz;
 	if (useDiffuseTexture)
 	{
-		DiffuseColor = DiffuseTexture.Sample(LinearSampler, In.UV);
+		// Atlased textures wrap inside their rectangle, the gutter around it holds the
+		// wrapped texels. The gradients of the unwrapped UVs keep the mip across the seam.
+		// Textures of their own have scale 1 and bias 0, the same as wrap addressing.
+		float2 AtlasUV = frac(In.UV) * diffuseTransform.xy + diffuseTransform.zw;
+		DiffuseColor = DiffuseTexture.SampleGrad(LinearSampler, AtlasUV, ddx(In.UV) * diffuseTransform.xy, ddy(In.UV) * diffuseTransform.xy);
 	}
     
 	DiffuseColor *= DiffuseColor;
 
-    return PackGBuffer(DiffuseColor, normalize(In.Normal), specIntensity, specExp);
+	float3 Normal = normalize(In.Normal);
+	if (useNormalMapTexture)
+	{
+		// MikkTSpace: unnormalized interpolated tangent, bitangent from the sign
+		float3 Tangent = In.Tangent.xyz - dot(In.Tangent.xyz, Normal) * Normal;
+		float3 Bitangent = In.Tangent.w * cross(Normal, Tangent);
+		// z is rebuilt from xy, cooked normal maps are BC5 and have no blue channel
+		float2 TangentXY = NormalMapTexture.Sample(LinearSampler, In.UV).xy * 2.0 - 1.0;
+		float3 TangentNormal = float3(TangentXY, sqrt(saturate(1.0 - dot(TangentXY, TangentXY))));
+		Normal = normalize(TangentNormal.x * Tangent + TangentNormal.y * Bitangent + TangentNormal.z * Normal);
+	}
+
+    return PackGBuffer(DiffuseColor, Normal, specIntensity, specExp);
 }
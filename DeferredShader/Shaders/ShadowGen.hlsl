@@ -1,25 +1,29 @@
-//////////// Spot Shadow map generation
-
+// Per object constants of every shadow pass, SceneManager::RenderSceneNoShaders fills them per mesh
 cbuffer cbSpotShadowGenVS : register(b0)
 {
-	float4x4 ShadowMat : packoffset(c0);
+	float4x4 ShadowMat              : packoffset(c0);	// object to spot shadow clip space
+	float4x4 World                  : packoffset(c4);
+	float4 PositionScale            : packoffset(c8);
+	float4 PositionOffset           : packoffset(c9);
 }
 
-float4 SpotShadowGenVS(float4 Pos : POSITION) : SV_Position
+// dequantize packed positions, identity for float vertices
+float4 DequantizePosition(float4 Pos)
 {
-	return mul(Pos, ShadowMat);
+	return float4(Pos.xyz * PositionScale.xyz + PositionOffset.xyz, 1.0);
 }
 
-cbuffer cbPerObjectVS : register(b0)
+//////////// Spot Shadow map generation
+
+float4 SpotShadowGenVS(float4 Pos : POSITION) : SV_Position
 {
-	float4x4 WorldViewProjection    : packoffset(c0);
-	float4x4 World                  : packoffset(c4);
+	return mul(DequantizePosition(Pos), ShadowMat);
 }
 
 //////////// Point and Cascaded Shadowmap Generation
 float4 ShadowMapGenVS(float4 Pos : POSITION) : SV_Position
 {
-	return mul(Pos, World);
+	return mul(DequantizePosition(Pos), World);
 }
 
 cbuffer cbuffercbShadowMapCubeGS : register(b0)
@@ -0,0 +1,46 @@
+// VirtualTexture.hlsl
+
+// Page table and page cache of a virtual texture, see VirtualTextureResources
+//   vtTexture: width, height, page size, mip count
+//   vtCache:   cache width, cache height, tile size, border
+
+// Mip of the virtual texture the pixel reads, from the uv derivatives
+float VirtualTextureMip(float2 uv, float4 vtTexture)
+{
+	float2 dx = ddx(uv * vtTexture.xy);
+	float2 dy = ddy(uv * vtTexture.xy);
+	float lengthSq = max(dot(dx, dx), dot(dy, dy));
+	return clamp(floor(0.5 * log2(lengthSq)), 0.0, vtTexture.w - 1.0);
+}
+
+// Page the pixel reads, for the R32_UINT feedback target: x in bits 0-11, y in 12-23,
+// mip in 24-27 and bit 31 set, the layout of VirtualPageId. A positive mipBias requests
+// coarser pages and keeps the cache smaller.
+uint VirtualTextureFeedback(float2 uv, float4 vtTexture, float mipBias)
+{
+	float mip = clamp(VirtualTextureMip(uv, vtTexture) + mipBias, 0.0, vtTexture.w - 1.0);
+	uint2 page = (uint2)(frac(uv) * vtTexture.xy / vtTexture.z) >> (uint)mip;
+	return 0x80000000 | page.x | (page.y << 12) | ((uint)mip << 24);
+}
+
+// Samples the virtual texture bilinear from the page drawn for uv: the page itself or
+// the nearest resident coarser page the page table points at. Black while nothing is resident.
+float4 VirtualTextureSample(Texture2D<uint4> pageTable, Texture2D<float4> cache, SamplerState linearSampler,
+	float2 uv, float4 vtTexture, float4 vtCache)
+{
+	// the derivatives before the wrap, frac jumps at the texture edges
+	float mip = VirtualTextureMip(uv, vtTexture);
+	uv = frac(uv);
+	uint2 page = (uint2)(uv * vtTexture.xy / vtTexture.z) >> (uint)mip;
+	uint4 entry = pageTable.Load(int3(page, mip));
+	if (entry.w == 0)
+		return float4(0.0, 0.0, 0.0, 1.0);
+
+	// texel of the drawn page's mip, relative to the page
+	float2 mipSize = max(vtTexture.xy / exp2(entry.z), 1.0);
+	uint2 drawnPage = page >> (entry.z - (uint)mip);
+	float2 texel = uv * mipSize - drawnPage * vtTexture.z;
+
+	float2 cacheUV = (entry.xy * vtCache.z + vtCache.w + texel) / vtCache.xy;
+	return cache.SampleLevel(linearSampler, cacheUV, 0);
+}